@@ -191,6 +191,12 @@ struct atransport
     usb_handle *usb;
     int sfd;
 
+        /* receive buffer for socket transports, so that many packets
+        ** can be parsed out of a single read */
+    unsigned char *rbuf;
+    unsigned rbuf_start;
+    unsigned rbuf_end;
+
         /* used to identify transports for clients */
     char *serial;
     char *product;
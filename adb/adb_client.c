@@ -18,6 +18,12 @@ static const char* __adb_serial = NULL;
 
 static int __adb_server_port = DEFAULT_ADB_PORT;
 
+/* Port of the server whose version this process has already checked, so
+** clients that connect many times (adb batch, install, sync) only pay for
+** the host:version handshake once.
+*/
+static int __adb_server_checked = -1;
+
 void adb_set_transport(transport_type type, const char* serial)
 {
     __adb_transport = type;
@@ -208,8 +214,21 @@ int _adb_connect(const char *service)
 
 int adb_connect(const char *service)
 {
+    int fd;
+
+    if (__adb_server_checked == __adb_server_port &&
+            strcmp(service, "host:start-server")) {
+        fd = _adb_connect(service);
+        if (fd != -2) {
+            D("adb_connect: return fd %d\n", fd);
+            return fd;
+        }
+        // the server went away since we checked it, start over
+        __adb_server_checked = -1;
+    }
+
     // first query the adb server's version
-    int fd = _adb_connect("host:version");
+    fd = _adb_connect("host:version");
 
     D("adb_connect: service %s\n", service);
     if(fd == -2) {
@@ -260,6 +279,8 @@ int adb_connect(const char *service)
         }
     }
 
+    __adb_server_checked = __adb_server_port;
+
     // if the command is start-server, we are done.
     if (!strcmp(service, "host:start-server"))
         return 0;
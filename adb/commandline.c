@@ -158,6 +158,10 @@ void help()
         "  adb wait-for-device          - block until device is online\n"
         "  adb start-server             - ensure that there is a server running\n"
         "  adb kill-server              - kill the server if it is running\n"
+        "  adb batch                    - run the adb commands read from stdin, one per line,\n"
+        "                                 without restarting the client for each one;\n"
+        "                                 interactive shells are not allowed, and a\n"
+        "                                 command that exits adb ends the batch\n"
         "  adb get-state                - prints: offline | bootloader | device\n"
         "  adb get-serialno             - prints: <serial-number>\n"
         "  adb get-devpath              - prints: <device-path>\n"
@@ -906,6 +910,129 @@ static const char *find_product_out_path(const char *hint)
     return path_buf;
 }
 
+#define BATCH_MAX_ARGS 64
+
+/* Splits a batch line into words, in place.  Words are separated by
+** blanks and may be quoted with '...' or "..." to include blanks.
+*/
+static int split_batch_line(char *line, char **args, int max_args)
+{
+    int nargs = 0;
+    char *in = line;
+
+    for (;;) {
+        char *out;
+        char quote = 0;
+
+        while (*in == ' ' || *in == '\t' || *in == '\r' || *in == '\n')
+            in++;
+        if (*in == '\0' || *in == '#')
+            break;
+        if (nargs == max_args)
+            return -1;
+
+        args[nargs++] = out = in;
+        for (; *in; in++) {
+            if (quote) {
+                if (*in == quote) {
+                    quote = 0;
+                    continue;
+                }
+            } else if (*in == '\'' || *in == '"') {
+                quote = *in;
+                continue;
+            } else if (*in == ' ' || *in == '\t' || *in == '\r' || *in == '\n') {
+                break;
+            }
+            *out++ = *in;
+        }
+        if (*in)
+            in++;
+        *out = '\0';
+    }
+    return nargs;
+}
+
+/* Returns the index of the command in a batch line, past the modifiers
+** and flags that adb_commandline() takes before it, or nargs if none.
+*/
+static int batch_command(char **args, int nargs)
+{
+    int i;
+
+    for (i = 0; i < nargs; i++) {
+        if (!strcmp(args[i], "-s") || !strcmp(args[i], "-p"))
+            i++;
+        else if (args[i][0] != '-' && strcmp(args[i], "persist") &&
+                 strcmp(args[i], "nodaemon"))
+            break;
+    }
+    return i < nargs ? i : nargs;
+}
+
+/* Runs one adb command per line of stdin in this process, so that
+** harnesses issuing many commands only pay for starting the client and
+** checking the server version once.  The server protocol carries one
+** service per connection, so each command still opens its own (cheap,
+** loopback) connection to the server.
+**
+** stdin holds the batch, so commands that would read it, a nested batch
+** or a shell without a command, are rejected.  A command that exits the
+** client, such as sync without a product directory, ends the batch with
+** its own exit status.
+*/
+static int batch(transport_type ttype, char* serial)
+{
+    char line[4096];
+    char *args[BATCH_MAX_ARGS + 3];
+    int nargs, first, cmd, failures = 0;
+
+    while (fgets(line, sizeof(line), stdin)) {
+        /* commands inherit the -s/-d/-e given to "adb batch" */
+        first = 0;
+        if (serial) {
+            args[first++] = "-s";
+            args[first++] = serial;
+        } else if (ttype == kTransportUsb) {
+            args[first++] = "-d";
+        } else if (ttype == kTransportLocal) {
+            args[first++] = "-e";
+        }
+
+        nargs = split_batch_line(line, args + first, BATCH_MAX_ARGS);
+        if (nargs < 0) {
+            fprintf(stderr, "adb batch: too many arguments\n");
+            failures++;
+            continue;
+        }
+        if (nargs == 0)
+            continue;
+        cmd = batch_command(args, first + nargs);
+        if (cmd == first + nargs) {
+            fprintf(stderr, "adb batch: no command\n");
+            failures++;
+            continue;
+        }
+        if (!strcmp(args[cmd], "batch")) {
+            fprintf(stderr, "adb batch: cannot nest batch\n");
+            failures++;
+            continue;
+        }
+        if ((!strcmp(args[cmd], "shell") || !strcmp(args[cmd], "hell")) &&
+                cmd + 1 == first + nargs) {
+            fprintf(stderr, "adb batch: shell needs a command\n");
+            failures++;
+            continue;
+        }
+
+        if (adb_commandline(first + nargs, args))
+            failures++;
+        fflush(stdout);
+    }
+
+    return failures ? 1 : 0;
+}
+
 int adb_commandline(int argc, char **argv)
 {
     char buf[4096];
@@ -1343,6 +1470,11 @@ top:
         return adb_connect("host:start-server");
     }
 
+    if (!strcmp(argv[0], "batch")) {
+        if (argc != 1) return usage();
+        return batch(ttype, serial);
+    }
+
     if (!strcmp(argv[0], "backup")) {
         return backup(argc, argv);
     }
@@ -222,6 +222,12 @@ static __inline__  int  adb_socket_setbufsize( int   fd, int  bufsize )
     return setsockopt(fd, SOL_SOCKET, SO_RCVBUF, (const char*)&opt, sizeof(opt));
 }
 
+static __inline__  int  adb_socket_setsndbufsize( int   fd, int  bufsize )
+{
+    int opt = bufsize;
+    return setsockopt(fd, SOL_SOCKET, SO_SNDBUF, (const char*)&opt, sizeof(opt));
+}
+
 extern int  adb_socketpair( int  sv[2] );
 
 static __inline__  char*  adb_dirstart( const char*  path )
@@ -435,6 +441,12 @@ static __inline__  int  adb_socket_setbufsize( int   fd, int  bufsize )
     return setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &opt, sizeof(opt));
 }
 
+static __inline__  int  adb_socket_setsndbufsize( int   fd, int  bufsize )
+{
+    int opt = bufsize;
+    return setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &opt, sizeof(opt));
+}
+
 static __inline__ void  disable_tcp_nagle(int fd)
 {
     int  on = 1;
@@ -0,0 +1,325 @@
+/* a simple test program, pretends to be a device on a TCP port so that the
+ * receive path of the ADB server's local transport can be timed:
+ *
+ *   test_local_transport [-w window] [-m megabytes] [port]
+ *   adb connect 127.0.0.1:<port>
+ *   time adb -s 127.0.0.1:<port> pull /any/name /tmp/out
+ *
+ * every pull returns a file of the given size (64 MB by default), made of
+ * 64K sync DATA chunks cut into MAX_PAYLOAD sized WRTE packets like adbd
+ * does.  adbd sends one WRTE and waits for the OKAY before the next;
+ * -w lets several be in flight, as with several streams at once.
+ * pushes are accepted and thrown away.
+ */
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+
+#define MAX_PAYLOAD 4096
+#define A_VERSION 0x01000000
+
+#define A_CNXN 0x4e584e43
+#define A_OPEN 0x4e45504f
+#define A_OKAY 0x59414b4f
+#define A_CLSE 0x45534c43
+#define A_WRTE 0x45545257
+
+#define MKID(a,b,c,d) ((a) | ((b) << 8) | ((c) << 16) | ((d) << 24))
+#define ID_STAT MKID('S','T','A','T')
+#define ID_SEND MKID('S','E','N','D')
+#define ID_RECV MKID('R','E','C','V')
+#define ID_DONE MKID('D','O','N','E')
+#define ID_DATA MKID('D','A','T','A')
+#define ID_OKAY MKID('O','K','A','Y')
+#define ID_QUIT MKID('Q','U','I','T')
+#define SYNC_DATA_MAX (64*1024)
+
+struct amessage {
+    unsigned command;
+    unsigned arg0;
+    unsigned arg1;
+    unsigned data_length;
+    unsigned data_check;
+    unsigned magic;
+};
+
+struct packet {
+    struct amessage msg;
+    unsigned char data[MAX_PAYLOAD];
+};
+
+static int  fd;
+static int  window = 1;
+static int  in_flight;
+static unsigned  local_id = 1, remote_id;
+
+/* sync requests from the host, which may span WRTE packets */
+static unsigned char  req[MAX_PAYLOAD * 2];
+static int  req_len;
+/* bytes of a pushed DATA chunk still to skip */
+static unsigned  skip;
+static int  pushing;
+
+static void
+panic( const char*  msg )
+{
+    fprintf(stderr, "PANIC: %s: %s\n", msg, strerror(errno));
+    exit(1);
+}
+
+static void
+readx( void*  buf, int  len )
+{
+    char*  p = buf;
+    while (len > 0) {
+        int  len2 = read(fd, p, len);
+        if (len2 <= 0) {
+            if (len2 < 0 && errno == EINTR)
+                continue;
+            if (len2 == 0)
+                exit(0);
+            panic("read");
+        }
+        len -= len2;
+        p += len2;
+    }
+}
+
+static void
+writex( const void*  buf, int  len )
+{
+    const char*  p = buf;
+    while (len > 0) {
+        int  len2 = write(fd, p, len);
+        if (len2 < 0) {
+            if (errno == EINTR)
+                continue;
+            panic("write");
+        }
+        len -= len2;
+        p += len2;
+    }
+}
+
+static void
+send_packet( unsigned  command, unsigned  arg0, unsigned  arg1,
+             const void*  data, unsigned  len )
+{
+    struct packet  p;
+    unsigned  sum = 0, n;
+
+    memcpy(p.data, data, len);
+    for (n = 0; n < len; n++)
+        sum += p.data[n];
+    p.msg.command = command;
+    p.msg.arg0 = arg0;
+    p.msg.arg1 = arg1;
+    p.msg.data_length = len;
+    p.msg.data_check = sum;
+    p.msg.magic = command ^ 0xffffffff;
+    /* header and payload in one write, as remote_write() does */
+    writex(&p, sizeof(p.msg) + len);
+}
+
+static void  handle_packet( struct packet*  p );
+
+static void
+read_packet( void )
+{
+    struct packet  p;
+
+    readx(&p.msg, sizeof(p.msg));
+    if (p.msg.data_length > MAX_PAYLOAD) {
+        fprintf(stderr, "PANIC: packet of %u bytes\n", p.msg.data_length);
+        exit(1);
+    }
+    readx(p.data, p.msg.data_length);
+    handle_packet(&p);
+}
+
+/* sends data to the host on the open stream, waiting for OKAYs to keep
+ * at most 'window' WRTE packets unanswered */
+static void
+stream_write( const void*  data, unsigned  len )
+{
+    const unsigned char*  p = data;
+
+    while (len > 0) {
+        unsigned  n = len < MAX_PAYLOAD ? len : MAX_PAYLOAD;
+        while (in_flight >= window)
+            read_packet();
+        send_packet(A_WRTE, local_id, remote_id, p, n);
+        in_flight++;
+        p += n;
+        len -= n;
+    }
+}
+
+static unsigned  file_size = 64 * 1024 * 1024;
+
+static void
+send_file( void )
+{
+    static unsigned char  chunk[8 + SYNC_DATA_MAX];
+    unsigned  left = file_size;
+    unsigned  n;
+
+    memset(chunk + 8, 'x', SYNC_DATA_MAX);
+    while (left > 0) {
+        n = left < SYNC_DATA_MAX ? left : SYNC_DATA_MAX;
+        ((unsigned*)chunk)[0] = ID_DATA;
+        ((unsigned*)chunk)[1] = n;
+        stream_write(chunk, 8 + n);
+        left -= n;
+    }
+    ((unsigned*)chunk)[0] = ID_DONE;
+    ((unsigned*)chunk)[1] = 0;
+    stream_write(chunk, 8);
+}
+
+/* answers the sync requests buffered in req[] */
+static void
+handle_sync( void )
+{
+    for (;;) {
+        unsigned  id, len, reply[4];
+        int  used;
+
+        if (skip > 0) {
+            unsigned  n = skip < (unsigned)req_len ? skip : (unsigned)req_len;
+            skip -= n;
+            memmove(req, req + n, req_len - n);
+            req_len -= n;
+            if (skip > 0)
+                return;
+        }
+        if (req_len < 8)
+            return;
+        id = ((unsigned*)req)[0];
+        len = ((unsigned*)req)[1];
+
+        if (pushing) {
+            used = 8;
+            if (id == ID_DATA) {
+                skip = len;
+            } else if (id == ID_DONE) {
+                pushing = 0;
+                reply[0] = ID_OKAY;
+                reply[1] = 0;
+                stream_write(reply, 8);
+            }
+        } else {
+            if (id == ID_QUIT) {
+                send_packet(A_CLSE, local_id, remote_id, NULL, 0);
+                req_len = 0;
+                return;
+            }
+            if (req_len < 8 + (int)len)
+                return;
+            used = 8 + len;
+            if (id == ID_STAT) {
+                reply[0] = ID_STAT;
+                reply[1] = 0100644;
+                reply[2] = file_size;
+                reply[3] = 0;
+                stream_write(reply, 16);
+            } else if (id == ID_RECV) {
+                send_file();
+            } else if (id == ID_SEND) {
+                pushing = 1;
+            }
+        }
+        memmove(req, req + used, req_len - used);
+        req_len -= used;
+    }
+}
+
+static void
+handle_packet( struct packet*  p )
+{
+    switch (p->msg.command) {
+    case A_CNXN:
+        send_packet(A_CNXN, A_VERSION, MAX_PAYLOAD, "device::", 9);
+        break;
+    case A_OPEN:
+        /* every service is treated as sync: */
+        remote_id = p->msg.arg0;
+        local_id++;
+        in_flight = 0;
+        req_len = 0;
+        skip = 0;
+        pushing = 0;
+        send_packet(A_OKAY, local_id, remote_id, NULL, 0);
+        break;
+    case A_OKAY:
+        if (in_flight > 0)
+            in_flight--;
+        break;
+    case A_WRTE:
+        send_packet(A_OKAY, local_id, remote_id, NULL, 0);
+        memcpy(req + req_len, p->data, p->msg.data_length);
+        req_len += p->msg.data_length;
+        handle_sync();
+        break;
+    case A_CLSE:
+        break;
+    }
+}
+
+int  main( int  argc, char**  argv )
+{
+    struct sockaddr_in   addr;
+    int                  s, c, on = 1;
+    int                  port = 5590;
+
+    while ((c = getopt(argc, argv, "w:m:")) != -1) {
+        switch (c) {
+        case 'w':
+            window = atoi(optarg);
+            break;
+        case 'm':
+            file_size = atoi(optarg) * 1024 * 1024;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-w window] [-m megabytes] [port]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (optind < argc)
+        port = atoi(argv[optind]);
+    if (window < 1)
+        window = 1;
+    signal(SIGCHLD, SIG_IGN);
+
+    s = socket(AF_INET, SOCK_STREAM, 0);
+    if (s < 0)
+        panic("socket");
+    setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(s, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+        panic("bind");
+    if (listen(s, 1) < 0)
+        panic("listen");
+
+    /* one host at a time; a new "adb connect" gets a fresh session */
+    for (;;) {
+        fd = accept(s, NULL, NULL);
+        if (fd < 0)
+            panic("accept");
+        if (fork() == 0) {
+            close(s);
+            for (;;)
+                read_packet();
+        }
+        close(fd);
+    }
+    return 0;
+}
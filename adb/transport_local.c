@@ -52,12 +52,55 @@ ADB_MUTEX_DEFINE( local_transports_lock );
 static atransport*  local_transports[ ADB_LOCAL_TRANSPORT_MAX ];
 #endif /* ADB_HOST */
 
+/* The receive buffer must hold at least one maximum sized packet. */
+#define  LOCAL_RBUF_SIZE  (64*1024)
+#define  LOCAL_SOCKET_BUFSIZE  (256*1024)
+
+/* Make sure at least 'len' bytes are buffered in t->rbuf, reading as much
+ * as the socket has available in one go so that subsequent packets can be
+ * parsed without going back to the kernel.
+ */
+static int remote_fill(atransport *t, unsigned len)
+{
+    int r;
+
+    if (t->rbuf_end - t->rbuf_start >= len) {
+        return 0;
+    }
+
+    if (t->rbuf_start + len > LOCAL_RBUF_SIZE) {
+        memmove(t->rbuf, t->rbuf + t->rbuf_start, t->rbuf_end - t->rbuf_start);
+        t->rbuf_end -= t->rbuf_start;
+        t->rbuf_start = 0;
+    }
+
+    while (t->rbuf_end - t->rbuf_start < len) {
+        r = adb_read(t->sfd, t->rbuf + t->rbuf_end, LOCAL_RBUF_SIZE - t->rbuf_end);
+        if (r > 0) {
+            t->rbuf_end += r;
+        } else {
+            if (r < 0) {
+                D("remote_fill: fd=%d error %d: %s\n", t->sfd, errno, strerror(errno));
+                if (errno == EINTR)
+                    continue;
+            } else {
+                D("remote_fill: fd=%d disconnected\n", t->sfd);
+            }
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
 static int remote_read(apacket *p, atransport *t)
 {
-    if(readx(t->sfd, &p->msg, sizeof(amessage))){
+    if(remote_fill(t, sizeof(amessage))){
         D("remote local: read terminated (message)\n");
         return -1;
     }
+    memcpy(&p->msg, t->rbuf + t->rbuf_start, sizeof(amessage));
+    t->rbuf_start += sizeof(amessage);
 
     fix_endians(p);
 
@@ -70,10 +113,12 @@ static int remote_read(apacket *p, atransport *t)
         return -1;
     }
 
-    if(readx(t->sfd, p->data, p->msg.data_length)){
+    if(remote_fill(t, p->msg.data_length)){
         D("remote local: terminated (data)\n");
         return -1;
     }
+    memcpy(p->data, t->rbuf + t->rbuf_start, p->msg.data_length);
+    t->rbuf_start += p->msg.data_length;
 
     if(check_data(p)) {
         D("bad data: terminated (data)\n");
@@ -354,6 +399,8 @@ static void remote_kick(atransport *t)
 static void remote_close(atransport *t)
 {
     adb_close(t->fd);
+    free(t->rbuf);
+    t->rbuf = NULL;
 }
 
 
@@ -413,6 +460,16 @@ int init_socket_transport(atransport *t, int s, int adb_port, int local)
     t->type = kTransportLocal;
     t->adb_port = 0;
 
+    /* Allocate before registering below, so a failure never leaves a
+     * pointer to a transport the caller is about to free in
+     * local_transports[]. */
+    t->rbuf = malloc(LOCAL_RBUF_SIZE);
+    if (t->rbuf == NULL) {
+        D("cannot allocate receive buffer for fd %d\n", s);
+        return -1;
+    }
+    t->rbuf_start = t->rbuf_end = 0;
+
 #if ADB_HOST
     if (HOST && local) {
         adb_mutex_lock( &local_transports_lock );
@@ -437,5 +494,14 @@ int init_socket_transport(atransport *t, int s, int adb_port, int local)
        adb_mutex_unlock( &local_transports_lock );
     }
 #endif
+    if (fail) {
+        free(t->rbuf);
+        t->rbuf = NULL;
+    } else {
+        /* Large socket buffers keep a fast link busy while either end is
+         * momentarily away processing packets. */
+        adb_socket_setbufsize(s, LOCAL_SOCKET_BUFSIZE);
+        adb_socket_setsndbufsize(s, LOCAL_SOCKET_BUFSIZE);
+    }
     return fail;
 }
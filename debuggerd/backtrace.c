@@ -62,54 +62,80 @@ static void dump_process_footer(log_t* log, pid_t pid) {
     _LOG(log, false, "\n----- end %d -----\n", pid);
 }
 
-static void dump_thread(log_t* log, pid_t tid, ptrace_context_t* context, bool attached,
-        bool* detach_failed, int* total_sleep_time_usec) {
+/* What is captured for each thread while the process is stopped. Symbolizing
+ * and writing the output only need the ptrace context, so they are done
+ * after the threads have been let go again. */
+typedef struct {
+    pid_t tid;
+    bool attached;
+    int attach_errno;
+    ssize_t frames;
+    char name[1024];
+    backtrace_frame_t backtrace[STACK_DEPTH];
+} thread_capture_t;
+
+static void read_thread_name(thread_capture_t* thread) {
     char path[PATH_MAX];
-    char threadnamebuf[1024];
-    char* threadname = NULL;
     FILE* fp;
 
-    snprintf(path, sizeof(path), "/proc/%d/comm", tid);
+    thread->name[0] = '\0';
+    snprintf(path, sizeof(path), "/proc/%d/comm", thread->tid);
     if ((fp = fopen(path, "r"))) {
-        threadname = fgets(threadnamebuf, sizeof(threadnamebuf), fp);
-        fclose(fp);
-        if (threadname) {
-            size_t len = strlen(threadname);
-            if (len && threadname[len - 1] == '\n') {
-                threadname[len - 1] = '\0';
+        if (fgets(thread->name, sizeof(thread->name), fp)) {
+            size_t len = strlen(thread->name);
+            if (len && thread->name[len - 1] == '\n') {
+                thread->name[len - 1] = '\0';
             }
         }
+        fclose(fp);
     }
+}
 
-    _LOG(log, false, "\n\"%s\" sysTid=%d\n", threadname ? threadname : "<unknown>", tid);
+static void dump_thread(log_t* log, const thread_capture_t* thread,
+        const ptrace_context_t* context) {
+    _LOG(log, false, "\n\"%s\" sysTid=%d\n",
+            thread->name[0] ? thread->name : "<unknown>", thread->tid);
 
-    if (!attached && ptrace(PTRACE_ATTACH, tid, 0, 0) < 0) {
-        _LOG(log, false, "Could not attach to thread: %s\n", strerror(errno));
+    if (thread->attach_errno) {
+        _LOG(log, false, "Could not attach to thread: %s\n", strerror(thread->attach_errno));
         return;
     }
 
-    wait_for_stop(tid, total_sleep_time_usec);
-
-    backtrace_frame_t backtrace[STACK_DEPTH];
-    ssize_t frames = unwind_backtrace_ptrace(tid, context, backtrace, 0, STACK_DEPTH);
-    if (frames <= 0) {
+    if (thread->frames <= 0) {
         _LOG(log, false, "Could not obtain stack trace for thread.\n");
     } else {
         backtrace_symbol_t backtrace_symbols[STACK_DEPTH];
-        get_backtrace_symbols_ptrace(context, backtrace, frames, backtrace_symbols);
-        for (size_t i = 0; i < (size_t)frames; i++) {
+        get_backtrace_symbols_ptrace(context, thread->backtrace, thread->frames,
+                backtrace_symbols);
+        for (size_t i = 0; i < (size_t)thread->frames; i++) {
             char line[MAX_BACKTRACE_LINE_LENGTH];
-            format_backtrace_line(i, &backtrace[i], &backtrace_symbols[i],
+            format_backtrace_line(i, &thread->backtrace[i], &backtrace_symbols[i],
                     line, MAX_BACKTRACE_LINE_LENGTH);
             _LOG(log, false, "  %s\n", line);
         }
-        free_backtrace_symbols(backtrace_symbols, frames);
+        free_backtrace_symbols(backtrace_symbols, thread->frames);
     }
+}
 
-    if (!attached && ptrace(PTRACE_DETACH, tid, 0, 0) != 0) {
-        LOG("ptrace detach from %d failed: %s\n", tid, strerror(errno));
-        *detach_failed = true;
+static thread_capture_t* add_thread(thread_capture_t** threads, size_t* count,
+        size_t* capacity, pid_t tid) {
+    if (*count == *capacity) {
+        size_t new_capacity = *capacity ? *capacity * 2 : 16;
+        thread_capture_t* new_threads = realloc(*threads,
+                new_capacity * sizeof(thread_capture_t));
+        if (!new_threads) {
+            return NULL;
+        }
+        *threads = new_threads;
+        *capacity = new_capacity;
     }
+    thread_capture_t* thread = &(*threads)[(*count)++];
+    thread->tid = tid;
+    thread->attached = false;
+    thread->attach_errno = 0;
+    thread->frames = 0;
+    read_thread_name(thread);
+    return thread;
 }
 
 void dump_backtrace(int fd, pid_t pid, pid_t tid, bool* detach_failed,
@@ -118,9 +144,15 @@ void dump_backtrace(int fd, pid_t pid, pid_t tid, bool* detach_failed,
     log.tfd = fd;
     log.quiet = true;
 
+    thread_capture_t* threads = NULL;
+    size_t count = 0;
+    size_t capacity = 0;
+
     ptrace_context_t* context = load_ptrace_context(tid);
     dump_process_header(&log, pid);
-    dump_thread(&log, tid, context, true, detach_failed, total_sleep_time_usec);
+
+    /* The requesting thread is already attached by the caller. */
+    add_thread(&threads, &count, &capacity, tid);
 
     char task_path[64];
     snprintf(task_path, sizeof(task_path), "/proc/%d/task", pid);
@@ -139,11 +171,43 @@ void dump_backtrace(int fd, pid_t pid, pid_t tid, bool* detach_failed,
                 continue;
             }
 
-            dump_thread(&log, new_tid, context, false, detach_failed, total_sleep_time_usec);
+            if (!add_thread(&threads, &count, &capacity, new_tid)) {
+                LOG("out of memory listing threads of %d\n", pid);
+                break;
+            }
         }
         closedir(d);
     }
 
+    /* Stop every thread up front, so that the stacks are captured at about
+     * the same moment and a single wait covers all of the stops. Each thread
+     * is let go as soon as its raw frames are captured, so it stays stopped
+     * only until its own turn; symbolizing and output come afterwards. */
+    for (size_t i = 1; i < count; i++) {
+        if (ptrace(PTRACE_ATTACH, threads[i].tid, 0, 0) < 0) {
+            threads[i].attach_errno = errno;
+        } else {
+            threads[i].attached = true;
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (i == 0 || threads[i].attached) {
+            wait_for_stop(threads[i].tid, total_sleep_time_usec);
+            threads[i].frames = unwind_backtrace_ptrace(threads[i].tid, context,
+                    threads[i].backtrace, 0, STACK_DEPTH);
+        }
+        if (i > 0 && threads[i].attached && ptrace(PTRACE_DETACH, threads[i].tid, 0, 0) != 0) {
+            LOG("ptrace detach from %d failed: %s\n", threads[i].tid, strerror(errno));
+            *detach_failed = true;
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        dump_thread(&log, &threads[i], context);
+    }
+
     dump_process_footer(&log, pid);
+    free(threads);
     free_ptrace_context(context);
 }
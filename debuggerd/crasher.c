@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <sched.h>
 #include <errno.h>
 
@@ -74,6 +75,73 @@ int ctest()
     return 0;
 }
 
+#define STALL_TICK_MS   5
+#define STALL_MS        20
+
+struct stall_slot {
+    volatile unsigned last;
+    volatile unsigned longest;
+};
+
+static long long now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+/* Notes the time every STALL_TICK_MS. The longest gap between two notes is
+ * about how long this thread was kept stopped. */
+void *stall_thread(void *x)
+{
+    struct stall_slot *slot = x;
+
+    for(;;) {
+        unsigned now = (unsigned) now_ms();
+        unsigned gap = now - slot->last;
+        slot->last = now;
+        if(gap > slot->longest) slot->longest = gap;
+        usleep(STALL_TICK_MS*1000);
+    }
+    return 0;
+}
+
+/* Spawns many threads and reports how long each was stopped, so the freeze
+ * caused by "debuggerd -b <pid>" can be seen thread by thread. */
+int stalltest(int count)
+{
+    struct stall_slot *slots = calloc(count, sizeof(struct stall_slot));
+    pthread_t thr;
+    pthread_attr_t attr;
+    int i;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    for(i = 0; i < count; i++) {
+        slots[i].last = (unsigned) now_ms();
+        pthread_create(&thr, &attr, stall_thread, &slots[i]);
+    }
+    fprintf(stderr, "crasher: %d threads, pid=%d\n", count, getpid());
+
+    for(;;) {
+        unsigned stalled = 0, total = 0, longest = 0;
+        sleep(2);
+        for(i = 0; i < count; i++) {
+            unsigned gap = slots[i].longest;
+            slots[i].longest = 0;
+            if(gap < STALL_MS) continue;
+            stalled++;
+            total += gap;
+            if(gap > longest) longest = gap;
+        }
+        if(stalled) {
+            fprintf(stderr, "crasher: %u threads stopped, for %u ms on average, "
+                    "%u ms at most\n", stalled, total / stalled, longest);
+        }
+    }
+    return 0;
+}
+
 int main(int argc, char **argv)
 {
     pthread_t thr;
@@ -85,6 +153,7 @@ int main(int argc, char **argv)
     if(argc > 1) {
         if(!strcmp(argv[1],"nostack")) crashnostack();
         if(!strcmp(argv[1],"ctest")) return ctest();
+        if(!strcmp(argv[1],"threads")) return stalltest(argc > 2 ? atoi(argv[2]) : 128);
         if(!strcmp(argv[1],"exit")) exit(1);
         if(!strcmp(argv[1],"abort")) maybeabort();
         
@@ -18,7 +18,7 @@ include $(CLEAR_VARS)
 
 LOCAL_C_INCLUDES := $(LOCAL_PATH)/../mkbootimg \
   $(LOCAL_PATH)/../../extras/ext4_utils
-LOCAL_SRC_FILES := protocol.c engine.c bootimg.c fastboot.c
+LOCAL_SRC_FILES := protocol.c engine.c bootimg.c fastboot.c usb_transport.c tcp.c
 LOCAL_MODULE := fastboot
 
 ifeq ($(HOST_OS),linux)
@@ -75,6 +75,13 @@ LOCAL_MODULE := usbtest
 include $(BUILD_HOST_EXECUTABLE)
 endif
 
+ifneq ($(HOST_OS),windows)
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := fbserver.c
+LOCAL_MODULE := fbserver
+include $(BUILD_HOST_EXECUTABLE)
+endif
+
 ifeq ($(HOST_OS),windows)
 $(LOCAL_INSTALLED_MODULE): $(HOST_OUT_EXECUTABLES)/AdbWinApi.dll
 endif
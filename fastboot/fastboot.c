@@ -64,7 +64,7 @@ boot_img_hdr *mkbootimg(void *kernel, unsigned kernel_size,
                         unsigned page_size, unsigned base,
                         unsigned *bootimg_size);
 
-static usb_handle *usb = 0;
+static Transport *transport = 0;
 static const char *serial = 0;
 static const char *product = 0;
 static const char *cmdline = 0;
@@ -240,16 +240,63 @@ int list_devices_callback(usb_ifc_info *info)
     return -1;
 }
 
-usb_handle *open_device(void)
+/* Splits the <host>[:<port>] of a "tcp:" serial number.  The host is in
+ * brackets if it is an IPv6 address. */
+static int parse_tcp_serial(const char *spec, char *host, size_t host_size,
+                            int *port)
 {
-    static usb_handle *usb = 0;
+    const char *end;
+    const char *colon;
+    char *endptr;
+    size_t len;
+    long val;
+
+    if (*spec == '[') {
+        end = strchr(++spec, ']');
+        if (!end || (end[1] && end[1] != ':')) return -1;
+        colon = end[1] ? end + 1 : NULL;
+    } else {
+        colon = strchr(spec, ':');
+        end = colon ? colon : spec + strlen(spec);
+    }
+
+    len = end - spec;
+    if (len == 0 || len >= host_size) return -1;
+    memcpy(host, spec, len);
+    host[len] = '\0';
+
+    *port = TCP_DEFAULT_PORT;
+    if (colon) {
+        val = strtol(colon + 1, &endptr, 10);
+        if (!colon[1] || *endptr || val <= 0 || val > 65535) return -1;
+        *port = val;
+    }
+    return 0;
+}
+
+Transport *open_device(void)
+{
+    static Transport *transport = 0;
+    char host[256];
+    int port = 0;
     int announce = 1;
 
-    if(usb) return usb;
+    if(transport) return transport;
+
+    if (serial && !strncmp(serial, TCP_SERIAL_PREFIX, strlen(TCP_SERIAL_PREFIX))) {
+        if (parse_tcp_serial(serial + strlen(TCP_SERIAL_PREFIX),
+                             host, sizeof(host), &port)) {
+            die("invalid network device '%s'", serial);
+        }
+    }
 
     for(;;) {
-        usb = usb_open(match_fastboot);
-        if(usb) return usb;
+        if (port) {
+            transport = tcp_transport_open(host, port);
+        } else {
+            transport = usb_transport_open(match_fastboot);
+        }
+        if(transport) return transport;
         if(announce) {
             announce = 0;
             fprintf(stderr,"< waiting for device >\n");
@@ -292,7 +339,9 @@ void usage(void)
             "  -u                                       do not first erase partition before\n"
             "                                           formatting\n"
             "  -s <specific device>                     specify device serial number\n"
-            "                                           or path to device port\n"
+            "                                           or path to device port,\n"
+            "                                           or tcp:<host>[:<port>] to\n"
+            "                                           connect over the network\n"
             "  -l                                       with \"devices\", lists device paths\n"
             "  -p <product>                             specify product name\n"
             "  -c <cmdline>                             override kernel commandline\n"
@@ -522,11 +571,11 @@ struct sparse_file **load_sparse_files(const char *fname, int max_size)
     return out_s;
 }
 
-static int64_t get_target_sparse_limit(struct usb_handle *usb)
+static int64_t get_target_sparse_limit(Transport *transport)
 {
     int64_t limit = 0;
     char response[FB_RESPONSE_SZ + 1];
-    int status = fb_getvar(usb, response, "max-download-size");
+    int status = fb_getvar(transport, response, "max-download-size");
 
     if (!status) {
         limit = strtoul(response, NULL, 0);
@@ -539,7 +588,7 @@ static int64_t get_target_sparse_limit(struct usb_handle *usb)
     return limit;
 }
 
-static int64_t get_sparse_limit(struct usb_handle *usb, int64_t size)
+static int64_t get_sparse_limit(Transport *transport, int64_t size)
 {
     int64_t limit;
 
@@ -549,7 +598,7 @@ static int64_t get_sparse_limit(struct usb_handle *usb, int64_t size)
         limit = sparse_limit;
     } else {
         if (target_sparse_limit == -1) {
-            target_sparse_limit = get_target_sparse_limit(usb);
+            target_sparse_limit = get_target_sparse_limit(transport);
         }
         if (target_sparse_limit > 0) {
             limit = target_sparse_limit;
@@ -574,17 +623,17 @@ static int needs_erase(const char *part)
     /* The function fb_format_supported() currently returns the value
      * we want, so just call it.
      */
-     return fb_format_supported(usb, part);
+     return fb_format_supported(transport, part);
 }
 
-void do_flash(usb_handle *usb, const char *pname, const char *fname)
+void do_flash(Transport *transport, const char *pname, const char *fname)
 {
     int64_t sz64;
     void *data;
     int64_t limit;
 
     sz64 = file_size(fname);
-    limit = get_sparse_limit(usb, sz64);
+    limit = get_sparse_limit(transport, sz64);
     if (limit) {
         struct sparse_file **s = load_sparse_files(fname, limit);
         if (s == NULL) {
@@ -892,7 +941,7 @@ int main(int argc, char **argv)
         return 0;
     }
 
-    usb = open_device();
+    transport = open_device();
 
     while (argc > 0) {
         if(!strcmp(*argv, "getvar")) {
@@ -902,7 +951,7 @@ int main(int argc, char **argv)
         } else if(!strcmp(*argv, "erase")) {
             require(2);
 
-            if (fb_format_supported(usb, argv[1])) {
+            if (fb_format_supported(transport, argv[1])) {
                 fprintf(stderr, "******** Did you mean to fastboot format this partition?\n");
             }
 
@@ -963,7 +1012,7 @@ int main(int argc, char **argv)
             if (erase_first && needs_erase(pname)) {
                 fb_queue_erase(pname);
             }
-            do_flash(usb, pname, fname);
+            do_flash(transport, pname, fname);
         } else if(!strcmp(*argv, "flash:raw")) {
             char *pname = argv[1];
             char *kname = argv[2];
@@ -1014,6 +1063,6 @@ int main(int argc, char **argv)
     if (fb_queue_is_empty())
         return 0;
 
-    status = fb_execute_queue(usb);
+    status = fb_execute_queue(transport);
     return (status) ? 1 : 0;
 }
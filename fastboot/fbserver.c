@@ -0,0 +1,354 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * A stand-in for a device's bootloader that speaks fastboot over TCP on
+ * the loopback interface, for testing the tcp: transport and measuring
+ * its throughput without a device:
+ *
+ *   fbserver -p 5554 -d /tmp/flashed &
+ *   fastboot -s tcp:localhost:5554 flash system system.img
+ *
+ * Downloads are kept in memory; with -d, a flash writes the last one to
+ * <dir>/<partition>.img as it was received, sparse or not.  Each session
+ * ends with a summary of the command round trips and download rates.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+
+#define HEADER_SZ 8
+#define COMMAND_SZ 64
+
+static const char *out_dir = 0;
+static unsigned max_download = 512 * 1024 * 1024;
+
+static char *download_buf = 0;
+static unsigned download_size = 0;
+
+struct stats {
+    unsigned commands;
+    unsigned getvars;
+    unsigned downloads;
+    double download_time;
+    unsigned long long download_bytes;
+    unsigned flashes;
+};
+
+static double now(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double)tv.tv_sec + (double)tv.tv_usec / 1000000;
+}
+
+static int read_fully(int fd, void *data, size_t len)
+{
+    char *ptr = data;
+    ssize_t r;
+
+    while (len > 0) {
+        r = read(fd, ptr, len);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return -1;
+        ptr += r;
+        len -= r;
+    }
+    return 0;
+}
+
+static int write_fully(int fd, const void *data, size_t len)
+{
+    const char *ptr = data;
+    ssize_t r;
+
+    while (len > 0) {
+        r = write(fd, ptr, len);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return -1;
+        ptr += r;
+        len -= r;
+    }
+    return 0;
+}
+
+static int read_header(int fd, uint64_t *len)
+{
+    unsigned char header[HEADER_SZ];
+    int i;
+
+    if (read_fully(fd, header, HEADER_SZ)) return -1;
+    *len = 0;
+    for (i = 0; i < HEADER_SZ; i++) {
+        *len = (*len << 8) | header[i];
+    }
+    return 0;
+}
+
+static int send_packet(int fd, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+static int send_packet(int fd, const char *fmt, ...)
+{
+    char packet[HEADER_SZ + COMMAND_SZ + 1];
+    va_list ap;
+    int len, i;
+
+    va_start(ap, fmt);
+    len = vsnprintf(packet + HEADER_SZ, COMMAND_SZ + 1, fmt, ap);
+    va_end(ap);
+    if (len > COMMAND_SZ) len = COMMAND_SZ;
+    for (i = 0; i < HEADER_SZ; i++) {
+        packet[i] = (uint64_t) len >> (8 * (HEADER_SZ - 1 - i));
+    }
+    return write_fully(fd, packet, HEADER_SZ + len);
+}
+
+static int getvar(int fd, const char *name)
+{
+    if (!strcmp(name, "version")) {
+        return send_packet(fd, "OKAY0.4");
+    } else if (!strcmp(name, "product")) {
+        return send_packet(fd, "OKAYfbserver");
+    } else if (!strcmp(name, "serialno")) {
+        return send_packet(fd, "OKAYloopback");
+    } else if (!strcmp(name, "max-download-size")) {
+        return send_packet(fd, "OKAY0x%08x", max_download);
+    } else if (!strncmp(name, "partition-type:", 15)) {
+        return send_packet(fd, "OKAYraw");
+    } else if (!strncmp(name, "partition-size:", 15)) {
+        return send_packet(fd, "OKAY0x%08x", max_download);
+    }
+    return send_packet(fd, "FAILunknown variable");
+}
+
+static int download(int fd, unsigned size, struct stats *stats)
+{
+    unsigned got = 0;
+    uint64_t len;
+    double start;
+    char *buf;
+
+    if (size > max_download) {
+        return send_packet(fd, "FAILdata too large");
+    }
+    buf = realloc(download_buf, size ? size : 1);
+    if (!buf) {
+        return send_packet(fd, "FAILout of memory");
+    }
+    download_buf = buf;
+    download_size = 0;
+
+    start = now();
+    if (send_packet(fd, "DATA%08x", size)) return -1;
+    while (got < size) {
+        if (read_header(fd, &len)) return -1;
+        if (len > size - got) {
+            fprintf(stderr, "download: %llu bytes past the end\n",
+                    (unsigned long long) (len - (size - got)));
+            return -1;
+        }
+        if (read_fully(fd, download_buf + got, len)) return -1;
+        got += len;
+    }
+    download_size = size;
+
+    stats->downloads++;
+    stats->download_time += now() - start;
+    stats->download_bytes += size;
+    return send_packet(fd, "OKAY");
+}
+
+static int flash(int fd, const char *partition, struct stats *stats)
+{
+    char path[4096];
+    int out;
+
+    if (!download_size) {
+        return send_packet(fd, "FAILno image downloaded");
+    }
+    if (strchr(partition, '/')) {
+        return send_packet(fd, "FAILbad partition name");
+    }
+    if (out_dir) {
+        snprintf(path, sizeof(path), "%s/%s.img", out_dir, partition);
+        out = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (out < 0 || write_fully(out, download_buf, download_size)) {
+            if (out >= 0) close(out);
+            return send_packet(fd, "FAILcannot write %s", partition);
+        }
+        close(out);
+    }
+    stats->flashes++;
+    return send_packet(fd, "OKAY");
+}
+
+static void serve(int fd)
+{
+    struct stats stats;
+    char cmd[COMMAND_SZ + 1];
+    char handshake[4];
+    uint64_t len;
+    double start = now();
+    double idle;
+    int done = 0;
+    int r;
+
+    memset(&stats, 0, sizeof(stats));
+
+    if (read_fully(fd, handshake, 4) || memcmp(handshake, "FB", 2) ||
+        write_fully(fd, "FB01", 4)) {
+        fprintf(stderr, "fbserver: bad handshake\n");
+        return;
+    }
+
+    while (!done) {
+        if (read_header(fd, &len)) break;
+        if (len > COMMAND_SZ) {
+            fprintf(stderr, "fbserver: %llu byte command\n",
+                    (unsigned long long) len);
+            break;
+        }
+        if (read_fully(fd, cmd, len)) break;
+        cmd[len] = '\0';
+
+        stats.commands++;
+        if (!strncmp(cmd, "getvar:", 7)) {
+            r = getvar(fd, cmd + 7);
+            stats.getvars++;
+        } else if (!strncmp(cmd, "download:", 9)) {
+            r = download(fd, strtoul(cmd + 9, 0, 16), &stats);
+        } else if (!strncmp(cmd, "flash:", 6)) {
+            r = flash(fd, cmd + 6, &stats);
+        } else if (!strncmp(cmd, "erase:", 6)) {
+            r = send_packet(fd, "OKAY");
+        } else if (!strcmp(cmd, "boot") || !strcmp(cmd, "continue") ||
+                   !strcmp(cmd, "reboot") || !strcmp(cmd, "reboot-bootloader")) {
+            r = send_packet(fd, "OKAY");
+            done = 1;
+        } else {
+            r = send_packet(fd, "FAILunknown command");
+        }
+        if (r) break;
+    }
+
+    /* Time spent outside downloads is command round trips, which is what
+     * a run of getvars measures. */
+    idle = now() - start - stats.download_time;
+    fprintf(stderr, "session: %u commands", stats.commands);
+    if (stats.commands > stats.downloads) {
+        fprintf(stderr, " (%.1f us each)",
+                idle * 1000000 / (stats.commands - stats.downloads));
+    }
+    fprintf(stderr, ", %u getvars, %u downloads", stats.getvars, stats.downloads);
+    if (stats.downloads && stats.download_time > 0) {
+        fprintf(stderr, " (%llu bytes at %.1f MB/s)", stats.download_bytes,
+                stats.download_bytes / stats.download_time / 1000000);
+    }
+    fprintf(stderr, ", %u flashes\n", stats.flashes);
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "usage: fbserver [-p <port>] [-d <dir>] [-m <max download>] [-1]\n"
+            "  -p <port>    port to listen on (5554)\n"
+            "  -d <dir>     write flashed images to <dir>/<partition>.img\n"
+            "  -m <size>    largest download accepted (512M)\n"
+            "  -1           exit after the first session\n");
+}
+
+int main(int argc, char **argv)
+{
+    struct sockaddr_in addr;
+    int port = 5554;
+    int once = 0;
+    int one = 1;
+    int s, fd, c;
+
+    while ((c = getopt(argc, argv, "p:d:m:1h")) != -1) {
+        switch (c) {
+        case 'p':
+            port = atoi(optarg);
+            break;
+        case 'd':
+            out_dir = optarg;
+            break;
+        case 'm':
+            max_download = strtoul(optarg, 0, 0);
+            break;
+        case '1':
+            once = 1;
+            break;
+        default:
+            usage();
+            return 1;
+        }
+    }
+
+    s = socket(AF_INET, SOCK_STREAM, 0);
+    if (s < 0) {
+        perror("socket");
+        return 1;
+    }
+    setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    /* loopback only: anyone who can connect can write to -d */
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (bind(s, (struct sockaddr *) &addr, sizeof(addr)) || listen(s, 1)) {
+        perror("fbserver");
+        return 1;
+    }
+
+    do {
+        fd = accept(s, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            perror("accept");
+            return 1;
+        }
+        serve(fd);
+        close(fd);
+    } while (!once);
+
+    return 0;
+}
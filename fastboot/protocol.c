@@ -47,23 +47,23 @@ char *fb_get_error(void)
     return ERROR;
 }
 
-static int check_response(usb_handle *usb, unsigned int size, char *response)
+static int check_response(Transport *transport, unsigned int size, char *response)
 {
     unsigned char status[65];
     int r;
 
     for(;;) {
-        r = usb_read(usb, status, 64);
+        r = transport->read(transport, status, 64);
         if(r < 0) {
             sprintf(ERROR, "status read failed (%s)", strerror(errno));
-            usb_close(usb);
+            transport->close(transport);
             return -1;
         }
         status[r] = 0;
 
         if(r < 4) {
             sprintf(ERROR, "status malformed (%d bytes)", r);
-            usb_close(usb);
+            transport->close(transport);
             return -1;
         }
 
@@ -92,21 +92,21 @@ static int check_response(usb_handle *usb, unsigned int size, char *response)
             unsigned dsize = strtoul((char*) status + 4, 0, 16);
             if(dsize > size) {
                 strcpy(ERROR, "data size too large");
-                usb_close(usb);
+                transport->close(transport);
                 return -1;
             }
             return dsize;
         }
 
         strcpy(ERROR,"unknown status code");
-        usb_close(usb);
+        transport->close(transport);
         break;
     }
 
     return -1;
 }
 
-static int _command_start(usb_handle *usb, const char *cmd, unsigned size,
+static int _command_start(Transport *transport, const char *cmd, unsigned size,
                           char *response)
 {
     int cmdsize = strlen(cmd);
@@ -121,45 +121,45 @@ static int _command_start(usb_handle *usb, const char *cmd, unsigned size,
         return -1;
     }
 
-    if(usb_write(usb, cmd, cmdsize) != cmdsize) {
+    if(transport->write(transport, cmd, cmdsize) != cmdsize) {
         sprintf(ERROR,"command write failed (%s)", strerror(errno));
-        usb_close(usb);
+        transport->close(transport);
         return -1;
     }
 
-    return check_response(usb, size, response);
+    return check_response(transport, size, response);
 }
 
-static int _command_data(usb_handle *usb, const void *data, unsigned size)
+static int _command_data(Transport *transport, const void *data, unsigned size)
 {
     int r;
 
-    r = usb_write(usb, data, size);
+    r = transport->write(transport, data, size);
     if(r < 0) {
         sprintf(ERROR, "data transfer failure (%s)", strerror(errno));
-        usb_close(usb);
+        transport->close(transport);
         return -1;
     }
     if(r != ((int) size)) {
         sprintf(ERROR, "data transfer failure (short transfer)");
-        usb_close(usb);
+        transport->close(transport);
         return -1;
     }
 
     return r;
 }
 
-static int _command_end(usb_handle *usb)
+static int _command_end(Transport *transport)
 {
     int r;
-    r = check_response(usb, 0, 0);
+    r = check_response(transport, 0, 0);
     if(r < 0) {
         return -1;
     }
     return 0;
 }
 
-static int _command_send(usb_handle *usb, const char *cmd,
+static int _command_send(Transport *transport, const char *cmd,
                          const void *data, unsigned size,
                          char *response)
 {
@@ -168,17 +168,17 @@ static int _command_send(usb_handle *usb, const char *cmd,
         return -1;
     }
 
-    r = _command_start(usb, cmd, size, response);
+    r = _command_start(transport, cmd, size, response);
     if (r < 0) {
         return -1;
     }
 
-    r = _command_data(usb, data, size);
+    r = _command_data(transport, data, size);
     if (r < 0) {
         return -1;
     }
 
-    r = _command_end(usb);
+    r = _command_end(transport);
     if(r < 0) {
         return -1;
     }
@@ -186,31 +186,31 @@ static int _command_send(usb_handle *usb, const char *cmd,
     return size;
 }
 
-static int _command_send_no_data(usb_handle *usb, const char *cmd,
+static int _command_send_no_data(Transport *transport, const char *cmd,
                                  char *response)
 {
     int r;
 
-    return _command_start(usb, cmd, 0, response);
+    return _command_start(transport, cmd, 0, response);
 }
 
-int fb_command(usb_handle *usb, const char *cmd)
+int fb_command(Transport *transport, const char *cmd)
 {
-    return _command_send_no_data(usb, cmd, 0);
+    return _command_send_no_data(transport, cmd, 0);
 }
 
-int fb_command_response(usb_handle *usb, const char *cmd, char *response)
+int fb_command_response(Transport *transport, const char *cmd, char *response)
 {
-    return _command_send_no_data(usb, cmd, response);
+    return _command_send_no_data(transport, cmd, response);
 }
 
-int fb_download_data(usb_handle *usb, const void *data, unsigned size)
+int fb_download_data(Transport *transport, const void *data, unsigned size)
 {
     char cmd[64];
     int r;
 
     sprintf(cmd, "download:%08x", size);
-    r = _command_send(usb, cmd, data, size, 0);
+    r = _command_send(transport, cmd, data, size, 0);
 
     if(r < 0) {
         return -1;
@@ -219,41 +219,45 @@ int fb_download_data(usb_handle *usb, const void *data, unsigned size)
     }
 }
 
-#define USB_BUF_SIZE 512
-static char usb_buf[USB_BUF_SIZE];
-static int usb_buf_len;
+/* Sparse chunks are gathered into writes of the transport's write_size. */
+static char *sparse_buf;
+static int sparse_buf_size;
+static int sparse_buf_len;
+static int sparse_sent;
 
 static int fb_download_data_sparse_write(void *priv, const void *data, int len)
 {
     int r;
-    usb_handle *usb = priv;
+    Transport *transport = priv;
     int to_write;
     const char *ptr = data;
 
-    if (usb_buf_len) {
-        to_write = min(USB_BUF_SIZE - usb_buf_len, len);
+    sparse_sent += len;
 
-        memcpy(usb_buf + usb_buf_len, ptr, to_write);
-        usb_buf_len += to_write;
+    if (sparse_buf_len) {
+        to_write = min(sparse_buf_size - sparse_buf_len, len);
+
+        memcpy(sparse_buf + sparse_buf_len, ptr, to_write);
+        sparse_buf_len += to_write;
         ptr += to_write;
         len -= to_write;
     }
 
-    if (usb_buf_len == USB_BUF_SIZE) {
-        r = _command_data(usb, usb_buf, USB_BUF_SIZE);
-        if (r != USB_BUF_SIZE) {
+    if (sparse_buf_len == sparse_buf_size) {
+        r = _command_data(transport, sparse_buf, sparse_buf_size);
+        if (r != sparse_buf_size) {
             return -1;
         }
-        usb_buf_len = 0;
+        sparse_buf_len = 0;
     }
 
-    if (len > USB_BUF_SIZE) {
-        if (usb_buf_len > 0) {
-            sprintf(ERROR, "internal error: usb_buf not empty\n");
+    if (len > sparse_buf_size) {
+        if (sparse_buf_len > 0) {
+            sprintf(ERROR, "internal error: sparse_buf not empty\n");
             return -1;
         }
-        to_write = round_down(len, USB_BUF_SIZE);
-        r = _command_data(usb, ptr, to_write);
+        to_write = round_down(len, sparse_buf_size);
+        r = _command_data(transport, ptr, to_write);
         if (r != to_write) {
             return -1;
         }
@@ -262,33 +266,33 @@ static int fb_download_data_sparse_write(void *priv, const void *data, int len)
     }
 
     if (len > 0) {
-        if (len > USB_BUF_SIZE) {
-            sprintf(ERROR, "internal error: too much left for usb_buf\n");
+        if (len > sparse_buf_size) {
+            sprintf(ERROR, "internal error: too much left for sparse_buf\n");
             return -1;
         }
-        memcpy(usb_buf, ptr, len);
-        usb_buf_len = len;
+        memcpy(sparse_buf, ptr, len);
+        sparse_buf_len = len;
     }
 
     return 0;
 }
 
-static int fb_download_data_sparse_flush(usb_handle *usb)
+static int fb_download_data_sparse_flush(Transport *transport)
 {
     int r;
 
-    if (usb_buf_len > 0) {
-        r = _command_data(usb, usb_buf, usb_buf_len);
-        if (r != usb_buf_len) {
+    if (sparse_buf_len > 0) {
+        r = _command_data(transport, sparse_buf, sparse_buf_len);
+        if (r != sparse_buf_len) {
             return -1;
         }
-        usb_buf_len = 0;
+        sparse_buf_len = 0;
     }
 
     return 0;
 }
 
-int fb_download_data_sparse(usb_handle *usb, struct sparse_file *s)
+int fb_download_data_sparse(Transport *transport, struct sparse_file *s)
 {
     char cmd[64];
     int r;
@@ -297,18 +301,41 @@ int fb_download_data_sparse(usb_handle *usb, struct sparse_file *s)
         return -1;
     }
 
+    if (sparse_buf_size != (int) transport->write_size) {
+        free(sparse_buf);
+        sparse_buf_size = transport->write_size;
+        sparse_buf = malloc(sparse_buf_size);
+        if (!sparse_buf) {
+            sparse_buf_size = 0;
+            sprintf(ERROR, "out of memory");
+            return -1;
+        }
+    }
+    sparse_buf_len = 0;
+    sparse_sent = 0;
+
     sprintf(cmd, "download:%08x", size);
-    r = _command_start(usb, cmd, size, 0);
+    r = _command_start(transport, cmd, size, 0);
     if (r < 0) {
         return -1;
     }
 
-    r = sparse_file_callback(s, true, false, fb_download_data_sparse_write, usb);
+    r = sparse_file_callback(s, true, false, fb_download_data_sparse_write, transport);
     if (r < 0) {
         return -1;
     }
 
-    fb_download_data_sparse_flush(usb);
+    if (fb_download_data_sparse_flush(transport) < 0) {
+        return -1;
+    }
+
+    /* libsparse can give up on a chunk without failing the callback, and
+     * the device would then wait forever for the rest of the data. */
+    if (sparse_sent != size) {
+        sprintf(ERROR, "sparse image sent %d of %d bytes", sparse_sent, size);
+        transport->close(transport);
+        return -1;
+    }
 
-    return _command_end(usb);
+    return _command_end(transport);
 }
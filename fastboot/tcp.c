@@ -0,0 +1,279 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * fastboot over TCP.
+ *
+ * After connecting, both sides send the four bytes "FB01" and check that
+ * the other side speaks version 1 or later.  From then on every message
+ * in either direction is a packet: an 8-byte big-endian length followed
+ * by that many bytes.  Commands and responses are one packet each; the
+ * data of a download may be split over any number of packets.  A whole
+ * image is normally written as a single packet straight out of the
+ * caller's buffer, so TCP streams it at whatever rate the link allows
+ * instead of stopping for each USB-sized transfer.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+
+#include "fastboot.h"
+
+#ifdef _WIN32
+
+Transport *tcp_transport_open(const char *host, int port)
+{
+    die("network devices are not supported on this platform");
+    return 0;
+}
+
+#else
+
+#include <unistd.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+/* A device that goes away should fail the write, not kill us. */
+#ifdef MSG_NOSIGNAL
+#define TCP_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define TCP_SEND_FLAGS 0
+#endif
+
+#define TCP_HANDSHAKE "FB01"
+#define TCP_HANDSHAKE_SZ 4
+#define TCP_HEADER_SZ 8
+
+/* Sparse images are gathered into writes of this size. */
+#define TCP_WRITE_SIZE (1024 * 1024)
+
+typedef struct
+{
+    Transport transport;
+    int fd;
+    /* bytes of the current incoming packet not yet returned by read */
+    uint64_t remaining;
+} TcpTransport;
+
+static int read_fully(int fd, void *data, size_t len)
+{
+    char *ptr = data;
+    ssize_t r;
+
+    while (len > 0) {
+        r = read(fd, ptr, len);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (r == 0) {
+            errno = ECONNRESET;
+            return -1;
+        }
+        ptr += r;
+        len -= r;
+    }
+    return 0;
+}
+
+static int tcp_read(Transport *transport, void *data, int len)
+{
+    TcpTransport *tt = (TcpTransport *) transport;
+    unsigned char header[TCP_HEADER_SZ];
+    int i;
+
+    if (tt->fd < 0) {
+        errno = EBADF;
+        return -1;
+    }
+
+    /* Skip empty packets rather than return a zero-length read. */
+    while (tt->remaining == 0) {
+        if (read_fully(tt->fd, header, TCP_HEADER_SZ)) {
+            return -1;
+        }
+        for (i = 0; i < TCP_HEADER_SZ; i++) {
+            tt->remaining = (tt->remaining << 8) | header[i];
+        }
+    }
+
+    if ((uint64_t) len > tt->remaining) {
+        len = tt->remaining;
+    }
+    if (read_fully(tt->fd, data, len)) {
+        return -1;
+    }
+    tt->remaining -= len;
+    return len;
+}
+
+static int tcp_write(Transport *transport, const void *data, int len)
+{
+    TcpTransport *tt = (TcpTransport *) transport;
+    unsigned char header[TCP_HEADER_SZ];
+    struct iovec iov[2];
+    struct msghdr msg;
+    int iovcnt = 2;
+    ssize_t r;
+    int i;
+
+    if (tt->fd < 0) {
+        errno = EBADF;
+        return -1;
+    }
+
+    for (i = 0; i < TCP_HEADER_SZ; i++) {
+        header[i] = (uint64_t) len >> (8 * (TCP_HEADER_SZ - 1 - i));
+    }
+    iov[0].iov_base = header;
+    iov[0].iov_len = TCP_HEADER_SZ;
+    iov[1].iov_base = (void *) data;
+    iov[1].iov_len = len;
+
+    /* The header and the data go out together, so a command is one
+     * segment on the wire. */
+    while (iovcnt > 0) {
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov + 2 - iovcnt;
+        msg.msg_iovlen = iovcnt;
+        r = sendmsg(tt->fd, &msg, TCP_SEND_FLAGS);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        while (iovcnt > 0 && (size_t) r >= iov[2 - iovcnt].iov_len) {
+            r -= iov[2 - iovcnt].iov_len;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov[2 - iovcnt].iov_base = (char *) iov[2 - iovcnt].iov_base + r;
+            iov[2 - iovcnt].iov_len -= r;
+        }
+    }
+    return len;
+}
+
+static int tcp_close(Transport *transport)
+{
+    TcpTransport *tt = (TcpTransport *) transport;
+
+    if (tt->fd >= 0) {
+        close(tt->fd);
+        tt->fd = -1;
+    }
+    return 0;
+}
+
+static int tcp_connect(const char *host, int port)
+{
+    struct addrinfo hints;
+    struct addrinfo *addrs, *ai;
+    char service[16];
+    int fd = -1;
+    int one = 1;
+    int r;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    snprintf(service, sizeof(service), "%d", port);
+
+    r = getaddrinfo(host, service, &hints, &addrs);
+    if (r) {
+        die("cannot resolve '%s': %s", host, gai_strerror(r));
+    }
+
+    for (ai = addrs; ai; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) continue;
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(addrs);
+
+    if (fd >= 0) {
+        /* Commands and responses are small and strictly alternate, so
+         * do not let Nagle hold them back. */
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+#ifdef SO_NOSIGPIPE
+        setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+    }
+    return fd;
+}
+
+/*
+ * Returns 0 if nothing is listening yet, so that the caller can wait for
+ * the device to come up, and dies if something other than fastboot
+ * answers.
+ */
+Transport *tcp_transport_open(const char *host, int port)
+{
+    TcpTransport *tt;
+    char handshake[TCP_HANDSHAKE_SZ];
+    int fd;
+
+    fd = tcp_connect(host, port);
+    if (fd < 0) {
+        return 0;
+    }
+
+    if (send(fd, TCP_HANDSHAKE, TCP_HANDSHAKE_SZ, TCP_SEND_FLAGS) != TCP_HANDSHAKE_SZ ||
+        read_fully(fd, handshake, TCP_HANDSHAKE_SZ)) {
+        close(fd);
+        return 0;
+    }
+    if (memcmp(handshake, "FB", 2) ||
+        !isdigit((unsigned char) handshake[2]) ||
+        !isdigit((unsigned char) handshake[3]) ||
+        (handshake[2] - '0') * 10 + handshake[3] - '0' < 1) {
+        die("%s:%d is not a fastboot device", host, port);
+    }
+
+    tt = calloc(1, sizeof(TcpTransport));
+    if (!tt) {
+        close(fd);
+        return 0;
+    }
+    tt->fd = fd;
+    tt->transport.read = tcp_read;
+    tt->transport.write = tcp_write;
+    tt->transport.close = tcp_close;
+    tt->transport.write_size = TCP_WRITE_SIZE;
+    return &tt->transport;
+}
+
+#endif
@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _TRANSPORT_H_
+#define _TRANSPORT_H_
+
+#include "usb.h"
+
+typedef struct Transport Transport;
+
+/*
+ * A connection to a device in fastboot mode.  The protocol code only
+ * talks to the device through these, so it works the same over USB and
+ * over a socket.
+ */
+struct Transport
+{
+    /* Reads one response, or up to len bytes of one. */
+    int (*read)(Transport *transport, void *data, int len);
+    /* Writes all len bytes, returning len, or -1 on error. */
+    int (*write)(Transport *transport, const void *data, int len);
+    int (*close)(Transport *transport);
+
+    /* Sparse images are sent in writes of this many bytes. */
+    unsigned write_size;
+};
+
+/* usb_transport.c */
+Transport *usb_transport_open(ifc_match_func callback);
+
+/* tcp.c - "tcp:<host>[:<port>]" serial numbers */
+#define TCP_SERIAL_PREFIX "tcp:"
+#define TCP_DEFAULT_PORT 5554
+
+Transport *tcp_transport_open(const char *host, int port);
+
+#endif
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+
+#include "transport.h"
+
+/* USB bulk transfers of a multiple of the packet size avoid short
+ * packets in the middle of a download. */
+#define USB_WRITE_SIZE 512
+
+typedef struct
+{
+    Transport transport;
+    usb_handle *usb;
+} UsbTransport;
+
+static int usb_transport_read(Transport *transport, void *data, int len)
+{
+    return usb_read(((UsbTransport *) transport)->usb, data, len);
+}
+
+static int usb_transport_write(Transport *transport, const void *data, int len)
+{
+    return usb_write(((UsbTransport *) transport)->usb, data, len);
+}
+
+static int usb_transport_close(Transport *transport)
+{
+    return usb_close(((UsbTransport *) transport)->usb);
+}
+
+Transport *usb_transport_open(ifc_match_func callback)
+{
+    UsbTransport *ut;
+    usb_handle *usb = usb_open(callback);
+
+    if (!usb) {
+        return 0;
+    }
+
+    ut = calloc(1, sizeof(UsbTransport));
+    if (!ut) {
+        usb_close(usb);
+        return 0;
+    }
+    ut->usb = usb;
+    ut->transport.read = usb_transport_read;
+    ut->transport.write = usb_transport_write;
+    ut->transport.close = usb_transport_close;
+    ut->transport.write_size = USB_WRITE_SIZE;
+    return &ut->transport;
+}
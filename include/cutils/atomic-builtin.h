@@ -0,0 +1,195 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_CUTILS_ATOMIC_BUILTIN_H
+#define ANDROID_CUTILS_ATOMIC_BUILTIN_H
+
+#include <stdint.h>
+
+/*
+ * Atomic operations built on the compiler's __atomic builtins.  The
+ * compiler knows the memory model of the target, so it can for instance
+ * use a plain locked "or" where the old value is not needed.
+ *
+ * The read-modify-write operations are sequentially consistent, since
+ * the hand-written implementations have always issued full barriers and
+ * callers may depend on that.
+ */
+
+extern inline void android_compiler_barrier(void)
+{
+    __asm__ __volatile__ ("" : : : "memory");
+}
+
+#if ANDROID_SMP == 0
+extern inline void android_memory_barrier(void)
+{
+    android_compiler_barrier();
+}
+extern inline void android_memory_store_barrier(void)
+{
+    android_compiler_barrier();
+}
+#else
+extern inline void android_memory_barrier(void)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+extern inline void android_memory_store_barrier(void)
+{
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+#endif
+
+extern inline int32_t android_atomic_acquire_load(volatile const int32_t *ptr)
+{
+    return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+}
+
+extern inline int32_t android_atomic_release_load(volatile const int32_t *ptr)
+{
+    android_memory_barrier();
+    return __atomic_load_n(ptr, __ATOMIC_RELAXED);
+}
+
+extern inline void android_atomic_acquire_store(int32_t value,
+                                                volatile int32_t *ptr)
+{
+    __atomic_store_n(ptr, value, __ATOMIC_RELAXED);
+    android_memory_barrier();
+}
+
+extern inline void android_atomic_release_store(int32_t value,
+                                                volatile int32_t *ptr)
+{
+    __atomic_store_n(ptr, value, __ATOMIC_RELEASE);
+}
+
+extern inline int android_atomic_cas(int32_t old_value, int32_t new_value,
+                                     volatile int32_t *ptr)
+{
+    return !__atomic_compare_exchange_n(ptr, &old_value, new_value, 0,
+                                        __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+extern inline int android_atomic_acquire_cas(int32_t old_value,
+                                             int32_t new_value,
+                                             volatile int32_t *ptr)
+{
+    return !__atomic_compare_exchange_n(ptr, &old_value, new_value, 0,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE);
+}
+
+extern inline int android_atomic_release_cas(int32_t old_value,
+                                             int32_t new_value,
+                                             volatile int32_t *ptr)
+{
+    return !__atomic_compare_exchange_n(ptr, &old_value, new_value, 0,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+}
+
+extern inline int32_t android_atomic_add(int32_t increment,
+                                         volatile int32_t *ptr)
+{
+    return __atomic_fetch_add(ptr, increment, __ATOMIC_SEQ_CST);
+}
+
+extern inline int32_t android_atomic_inc(volatile int32_t *addr)
+{
+    return android_atomic_add(1, addr);
+}
+
+extern inline int32_t android_atomic_dec(volatile int32_t *addr)
+{
+    return android_atomic_add(-1, addr);
+}
+
+extern inline int32_t android_atomic_and(int32_t value, volatile int32_t *ptr)
+{
+    return __atomic_fetch_and(ptr, value, __ATOMIC_SEQ_CST);
+}
+
+extern inline int32_t android_atomic_or(int32_t value, volatile int32_t *ptr)
+{
+    return __atomic_fetch_or(ptr, value, __ATOMIC_SEQ_CST);
+}
+
+/* Without lock-free 64-bit builtins, libcutils falls back to spin locks. */
+#if __GCC_ATOMIC_LLONG_LOCK_FREE == 2
+
+#define ANDROID_ATOMIC_INLINE_64 1
+
+extern inline int64_t android_atomic_acquire_load64(volatile const int64_t *ptr)
+{
+    return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+}
+
+extern inline int64_t android_atomic_release_load64(volatile const int64_t *ptr)
+{
+    android_memory_barrier();
+    return __atomic_load_n(ptr, __ATOMIC_RELAXED);
+}
+
+extern inline void android_atomic_acquire_store64(int64_t value,
+                                                  volatile int64_t *ptr)
+{
+    __atomic_store_n(ptr, value, __ATOMIC_RELAXED);
+    android_memory_barrier();
+}
+
+extern inline void android_atomic_release_store64(int64_t value,
+                                                  volatile int64_t *ptr)
+{
+    __atomic_store_n(ptr, value, __ATOMIC_RELEASE);
+}
+
+extern inline int android_atomic_acquire_cas64(int64_t old_value,
+                                               int64_t new_value,
+                                               volatile int64_t *ptr)
+{
+    return !__atomic_compare_exchange_n(ptr, &old_value, new_value, 0,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE);
+}
+
+extern inline int android_atomic_release_cas64(int64_t old_value,
+                                               int64_t new_value,
+                                               volatile int64_t *ptr)
+{
+    return !__atomic_compare_exchange_n(ptr, &old_value, new_value, 0,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+}
+
+extern inline int64_t android_atomic_add64(int64_t increment,
+                                           volatile int64_t *ptr)
+{
+    return __atomic_fetch_add(ptr, increment, __ATOMIC_SEQ_CST);
+}
+
+extern inline int64_t android_atomic_and64(int64_t value,
+                                           volatile int64_t *ptr)
+{
+    return __atomic_fetch_and(ptr, value, __ATOMIC_SEQ_CST);
+}
+
+extern inline int64_t android_atomic_or64(int64_t value,
+                                          volatile int64_t *ptr)
+{
+    return __atomic_fetch_or(ptr, value, __ATOMIC_SEQ_CST);
+}
+
+#endif /* __GCC_ATOMIC_LLONG_LOCK_FREE == 2 */
+
+#endif /* ANDROID_CUTILS_ATOMIC_BUILTIN_H */
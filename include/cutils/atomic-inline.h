@@ -37,13 +37,19 @@ extern "C" {
  * void ANDROID_MEMBAR_FULL(void)
  *   Full memory barrier.  Provides a compiler reordering barrier, and
  *   on SMP systems emits an appropriate instruction.
+ *
+ * Defining ANDROID_ATOMIC_BUILTINS selects an implementation based on the
+ * compiler's __atomic builtins instead of the hand-written one for the
+ * architecture.  That needs gcc 4.7 or clang.
  */
 
 #if !defined(ANDROID_SMP)
 # error "Must define ANDROID_SMP before including atomic-inline.h"
 #endif
 
-#if defined(__arm__)
+#if defined(ANDROID_ATOMIC_BUILTINS)
+#include <cutils/atomic-builtin.h>
+#elif defined(__arm__)
 #include <cutils/atomic-arm.h>
 #elif defined(__i386__) || defined(__x86_64__)
 #include <cutils/atomic-x86.h>
@@ -34,9 +34,19 @@ extern inline void android_memory_store_barrier(void)
     android_compiler_barrier();
 }
 #else
+/*
+ * A locked instruction orders earlier loads and stores against later ones
+ * just as mfence does, but is considerably cheaper on most processors.
+ * The top of the stack is used since its cache line is almost certainly
+ * held already.
+ */
 extern inline void android_memory_barrier(void)
 {
-    __asm__ __volatile__ ("mfence" : : : "memory");
+#if defined(__x86_64__)
+    __asm__ __volatile__ ("lock; addl $0,0(%%rsp)" : : : "memory", "cc");
+#else
+    __asm__ __volatile__ ("lock; addl $0,0(%%esp)" : : : "memory", "cc");
+#endif
 }
 extern inline void android_memory_store_barrier(void)
 {
@@ -71,15 +81,23 @@ extern inline void android_atomic_release_store(int32_t value,
     *ptr = value;
 }
 
-extern inline int android_atomic_cas(int32_t old_value, int32_t new_value,
-                                     volatile int32_t *ptr)
+/* Returns the value found at *ptr, which was replaced if it was old_value. */
+extern inline int32_t android_atomic_x86_cmpxchg(int32_t old_value,
+                                                 int32_t new_value,
+                                                 volatile int32_t *ptr)
 {
     int32_t prev;
     __asm__ __volatile__ ("lock; cmpxchgl %1, %2"
                           : "=a" (prev)
                           : "q" (new_value), "m" (*ptr), "0" (old_value)
                           : "memory");
-    return prev != old_value;
+    return prev;
+}
+
+extern inline int android_atomic_cas(int32_t old_value, int32_t new_value,
+                                     volatile int32_t *ptr)
+{
+    return android_atomic_x86_cmpxchg(old_value, new_value, ptr) != old_value;
 }
 
 extern inline int android_atomic_acquire_cas(int32_t old_value,
@@ -118,24 +136,181 @@ extern inline int32_t android_atomic_dec(volatile int32_t *addr)
     return android_atomic_add(-1, addr);
 }
 
+/*
+ * x86 has no locked instruction that both ands or ors and returns the old
+ * value.  cmpxchg hands back what it found in memory, though, so a retry
+ * does not need to load *ptr again.
+ */
 extern inline int32_t android_atomic_and(int32_t value,
                                          volatile int32_t *ptr)
 {
-    int32_t prev, status;
-    do {
-        prev = *ptr;
-        status = android_atomic_cas(prev, prev & value, ptr);
-    } while (__builtin_expect(status != 0, 0));
+    int32_t prev = *ptr, seen;
+    while (__builtin_expect((seen = android_atomic_x86_cmpxchg(prev,
+                    prev & value, ptr)) != prev, 0)) {
+        prev = seen;
+    }
     return prev;
 }
 
 extern inline int32_t android_atomic_or(int32_t value, volatile int32_t *ptr)
 {
-    int32_t prev, status;
-    do {
-        prev = *ptr;
-        status = android_atomic_cas(prev, prev | value, ptr);
-    } while (__builtin_expect(status != 0, 0));
+    int32_t prev = *ptr, seen;
+    while (__builtin_expect((seen = android_atomic_x86_cmpxchg(prev,
+                    prev | value, ptr)) != prev, 0)) {
+        prev = seen;
+    }
+    return prev;
+}
+
+#define ANDROID_ATOMIC_INLINE_64 1
+
+#if defined(__x86_64__)
+
+extern inline int64_t android_atomic_x86_cmpxchg64(int64_t old_value,
+                                                   int64_t new_value,
+                                                   volatile int64_t *ptr)
+{
+    int64_t prev;
+    __asm__ __volatile__ ("lock; cmpxchgq %1, %2"
+                          : "=a" (prev)
+                          : "r" (new_value), "m" (*ptr), "0" (old_value)
+                          : "memory");
+    return prev;
+}
+
+extern inline int64_t android_atomic_acquire_load64(volatile const int64_t *ptr)
+{
+    int64_t value = *ptr;
+    android_compiler_barrier();
+    return value;
+}
+
+extern inline void android_atomic_x86_store64(int64_t value,
+                                              volatile int64_t *ptr)
+{
+    *ptr = value;
+}
+
+extern inline int64_t android_atomic_add64(int64_t increment,
+                                           volatile int64_t *ptr)
+{
+    __asm__ __volatile__ ("lock; xaddq %0, %1"
+                          : "+r" (increment), "+m" (*ptr)
+                          : : "memory");
+    return increment;
+}
+
+#else /* !__x86_64__ */
+
+/*
+ * cmpxchg8b wants the new value in ecx:ebx, but ebx may hold the GOT
+ * pointer in position-independent code, so it is swapped in and out of
+ * esi around the instruction.
+ */
+extern inline int64_t android_atomic_x86_cmpxchg64(int64_t old_value,
+                                                   int64_t new_value,
+                                                   volatile int64_t *ptr)
+{
+    int64_t prev;
+    __asm__ __volatile__ ("xchgl %%ebx, %%esi\n\t"
+                          "lock; cmpxchg8b (%%edi)\n\t"
+                          "xchgl %%ebx, %%esi"
+                          : "=A" (prev)
+                          : "0" (old_value),
+                            "S" ((uint32_t)new_value),
+                            "c" ((uint32_t)((uint64_t)new_value >> 32)),
+                            "D" (ptr)
+                          : "memory");
+    return prev;
+}
+
+/* An aligned 64-bit access through the x87 unit is a single access. */
+extern inline int64_t android_atomic_acquire_load64(volatile const int64_t *ptr)
+{
+    int64_t value;
+    __asm__ __volatile__ ("fildll %1\n\t"
+                          "fistpll %0"
+                          : "=m" (value)
+                          : "m" (*ptr));
+    android_compiler_barrier();
+    return value;
+}
+
+extern inline void android_atomic_x86_store64(int64_t value,
+                                              volatile int64_t *ptr)
+{
+    __asm__ __volatile__ ("fildll %1\n\t"
+                          "fistpll %0"
+                          : "=m" (*ptr)
+                          : "m" (value));
+}
+
+extern inline int64_t android_atomic_add64(int64_t increment,
+                                           volatile int64_t *ptr)
+{
+    int64_t prev = android_atomic_acquire_load64(ptr), seen;
+    while (__builtin_expect((seen = android_atomic_x86_cmpxchg64(prev,
+                    prev + increment, ptr)) != prev, 0)) {
+        prev = seen;
+    }
+    return prev;
+}
+
+#endif /* !__x86_64__ */
+
+extern inline int64_t android_atomic_release_load64(volatile const int64_t *ptr)
+{
+    android_memory_barrier();
+    return android_atomic_acquire_load64(ptr);
+}
+
+extern inline void android_atomic_acquire_store64(int64_t value,
+                                                  volatile int64_t *ptr)
+{
+    android_atomic_x86_store64(value, ptr);
+    android_memory_barrier();
+}
+
+extern inline void android_atomic_release_store64(int64_t value,
+                                                  volatile int64_t *ptr)
+{
+    android_compiler_barrier();
+    android_atomic_x86_store64(value, ptr);
+}
+
+extern inline int android_atomic_acquire_cas64(int64_t old_value,
+                                               int64_t new_value,
+                                               volatile int64_t *ptr)
+{
+    return android_atomic_x86_cmpxchg64(old_value, new_value, ptr) != old_value;
+}
+
+extern inline int android_atomic_release_cas64(int64_t old_value,
+                                               int64_t new_value,
+                                               volatile int64_t *ptr)
+{
+    return android_atomic_x86_cmpxchg64(old_value, new_value, ptr) != old_value;
+}
+
+extern inline int64_t android_atomic_and64(int64_t value,
+                                           volatile int64_t *ptr)
+{
+    int64_t prev = android_atomic_acquire_load64(ptr), seen;
+    while (__builtin_expect((seen = android_atomic_x86_cmpxchg64(prev,
+                    prev & value, ptr)) != prev, 0)) {
+        prev = seen;
+    }
+    return prev;
+}
+
+extern inline int64_t android_atomic_or64(int64_t value,
+                                          volatile int64_t *ptr)
+{
+    int64_t prev = android_atomic_acquire_load64(ptr), seen;
+    while (__builtin_expect((seen = android_atomic_x86_cmpxchg64(prev,
+                    prev | value, ptr)) != prev, 0)) {
+        prev = seen;
+    }
     return prev;
 }
 
@@ -106,6 +106,26 @@ int android_atomic_acquire_cas(int32_t oldvalue, int32_t newvalue,
 int android_atomic_release_cas(int32_t oldvalue, int32_t newvalue,
         volatile int32_t* addr);
 
+/*
+ * 64-bit versions of the operations above, with the same ordering.
+ *
+ * NOTE: int64_t* values must be aligned on 64-bit boundaries.  On
+ * architectures without native 64-bit atomics these are implemented with
+ * a small table of spin locks, and so must not be mixed with plain
+ * accesses to the same value from other threads.
+ */
+int64_t android_atomic_add64(int64_t value, volatile int64_t* addr);
+int64_t android_atomic_and64(int64_t value, volatile int64_t* addr);
+int64_t android_atomic_or64(int64_t value, volatile int64_t* addr);
+int64_t android_atomic_acquire_load64(volatile const int64_t* addr);
+int64_t android_atomic_release_load64(volatile const int64_t* addr);
+void android_atomic_acquire_store64(int64_t value, volatile int64_t* addr);
+void android_atomic_release_store64(int64_t value, volatile int64_t* addr);
+int android_atomic_acquire_cas64(int64_t oldvalue, int64_t newvalue,
+        volatile int64_t* addr);
+int android_atomic_release_cas64(int64_t oldvalue, int64_t newvalue,
+        volatile int64_t* addr);
+
 /*
  * Aliases for code using an older version of this header.  These are now
  * deprecated and should not be used.  The definitions will be removed
@@ -36,6 +36,12 @@ extern char16_t * strcpy8to16 (char16_t *dest, const char*s, size_t *out_len);
 extern char16_t * strcpylen8to16 (char16_t *dest, const char*s, int length,
     size_t *out_len);
 
+/* Like the above, but return NULL if s is not well-formed modified UTF-8
+ * instead of substituting U+FFFD for the bad sequences. */
+extern char16_t * strdup8to16_checked (const char* s, size_t *out_len);
+extern char16_t * strcpy8to16_checked (char16_t *dest, const char*s,
+    size_t *out_len);
+
 #ifdef __cplusplus
 }
 #endif
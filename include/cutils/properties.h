@@ -52,6 +52,24 @@ int property_set_sync(const char *key, const char *value);
 
 int property_list(void (*propfn)(const char *key, const char *value, void *cookie), void *cookie);    
 
+/* property_wait_for_value: waits up to timeout_ms for key to be set to
+** value, or to any non-empty value if value is NULL.  Sleeps until the
+** property area changes rather than polling.
+** Returns 0 once the value is seen, < 0 on timeout.
+*/
+int property_wait_for_value(const char *key, const char *value, int timeout_ms);
+
+/* property_set_batch: sets count properties with a single request to the
+** property service, which applies them together and wakes property
+** waiters once.  results[i] (if results is nonnull) receives 0 or < 0 for
+** each key.  count must not exceed PROPERTY_BATCH_MAX.
+** Returns 0 if every property was set, < 0 otherwise.
+*/
+#define PROPERTY_BATCH_MAX  64
+
+int property_set_batch(const char * const *keys, const char * const *values,
+                       int count, int *results);
+
 
 #ifdef HAVE_SYSTEM_PROPERTY_SERVER
 /*
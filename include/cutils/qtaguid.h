@@ -35,6 +35,26 @@ extern int qtaguid_tagSocket(int sockfd, int tag, uid_t uid);
 */
 extern int qtaguid_untagSocket(int sockfd);
 
+/*
+ * One entry of a qtaguid_tagSockets() batch.
+ * tag and uid are ignored when untag is set.
+ * result receives 0 or -errno for this entry.
+ */
+typedef struct {
+    int sockfd;
+    int tag;
+    uid_t uid;
+    int untag;
+    int result;
+} qtaguid_sock_cmd_t;
+
+/*
+ * Tag and/or untag several sockets in one call, holding the control
+ * file open across the whole batch.
+ * Returns 0 if every entry succeeded, else the first failure as -errno.
+ */
+extern int qtaguid_tagSockets(qtaguid_sock_cmd_t *cmds, int count);
+
 /*
  * For the given uid, switch counter sets.
  * The kernel only keeps a limited number of sets.
@@ -53,6 +73,12 @@ extern int qtaguid_setCounterSet(int counterSetNum, uid_t uid);
  */
 extern int qtaguid_deleteTagData(int tag, uid_t uid);
 
+/*
+ * Use a different control file instead of /proc/net/xt_qtaguid/ctrl,
+ * e.g. a regular file or FIFO in tests. NULL restores the default.
+ */
+extern void qtaguid_setCtrlPath(const char *path);
+
 /*
  * Enable/disable qtaguid functionnality at a lower level.
  * When pacified, the kernel will accept commands but do nothing.
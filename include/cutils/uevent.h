@@ -19,6 +19,7 @@
 
 #include <stdbool.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -27,6 +28,8 @@ extern "C" {
 int uevent_open_socket(int buf_sz, bool passcred);
 ssize_t uevent_kernel_multicast_recv(int socket, void *buffer, size_t length);
 ssize_t uevent_kernel_multicast_uid_recv(int socket, void *buffer, size_t length, uid_t *uid);
+int uevent_kernel_multicast_uid_recv_batch(int socket, struct iovec *iov, ssize_t *lengths,
+                                           int count, uid_t *uid);
 
 #ifdef __cplusplus
 }
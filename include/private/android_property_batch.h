@@ -0,0 +1,36 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Wire protocol shared by libcutils' property_set_batch() and init's
+** property service.  A batch is a prop_msg carrying PROP_MSG_SETPROP_BATCH
+** with the decimal entry count as its value, followed by that many
+** PROP_MSG_SETPROP messages.  The service answers with one int result
+** per entry once all of them are in memory.
+*/
+
+#ifndef _ANDROID_PROPERTY_BATCH_H
+#define _ANDROID_PROPERTY_BATCH_H
+
+#define PROP_MSG_SETPROP_BATCH      0x100
+
+#ifndef PROPERTY_BATCH_MAX
+#define PROPERTY_BATCH_MAX          64
+#endif
+
+/* How long the service waits for the rest of a batch */
+#define PROPERTY_BATCH_TIMEOUT_MS   2000
+
+#endif /* _ANDROID_PROPERTY_BATCH_H */
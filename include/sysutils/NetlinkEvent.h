@@ -19,13 +19,24 @@
 #include <sysutils/NetlinkListener.h>
 
 #define NL_PARAMS_MAX 32
+#define NL_PARAMS_HASH_SIZE 64  /* power of two, larger than NL_PARAMS_MAX */
 
+/*
+ * The path, subsystem and parameters of a decoded event point into the
+ * buffer that was passed to decode(), so they are only valid for as long
+ * as that buffer is; NetlinkListener reuses it once onEvent() returns.
+ */
 class NetlinkEvent {
     int  mSeq;
-    char *mPath;
+    const char *mPath;
     int  mAction;
-    char *mSubsystem;
-    char *mParams[NL_PARAMS_MAX];
+    const char *mSubsystem;
+    const char *mParams[NL_PARAMS_MAX];
+    int  mParamCount;
+    /* index + 1 into mParams by hash of the parameter name, 0 if unused */
+    unsigned char mParamIndex[NL_PARAMS_HASH_SIZE];
+    /* backing store for parameters synthesized from binary messages */
+    char mScratch[2][64];
 
 public:
     const static int NlActionUnknown;
@@ -45,10 +56,15 @@ public:
     int getAction() { return mAction; }
 
     void dump();
+    void reset();
 
  protected:
     bool parseBinaryNetlinkMessage(char *buffer, int size);
     bool parseAsciiNetlinkMessage(char *buffer, int size);
+
+ private:
+    void setParam(int idx, const char *fmt, ...);
+    void indexParams();
 };
 
 #endif
@@ -32,6 +32,7 @@ extern "C" {
 
 struct usb_host_context;
 struct usb_endpoint_descriptor;
+struct usb_stream;
 
 struct usb_descriptor_iter {
     unsigned char*  config;
@@ -206,13 +207,38 @@ void usb_request_free(struct usb_request *req);
 int usb_request_queue(struct usb_request *req);
 
  /* Waits for the results of a previous usb_request_queue operation.
-  * Returns a usb_request, or NULL for error.
+  * Returns a usb_request, or NULL for error. Stream URBs reaped meanwhile
+  * are handed back to their stream.
   */
 struct usb_request *usb_request_wait(struct usb_device *dev);
 
 /* Cancels a pending usb_request_queue() operation. */
 int usb_request_cancel(struct usb_request *req);
 
+/* Creates a stream for large transfers on a bulk endpoint.
+ * Up to num_urbs URBs are kept in flight at once and are reused across
+ * transfers. Another thread may wait in usb_request_wait() on the same
+ * device while a transfer runs; requests the stream reaps are kept for it.
+ */
+struct usb_stream *usb_stream_new(struct usb_device *dev,
+        const struct usb_endpoint_descriptor *ep_desc, int num_urbs);
+
+/* Releases all resources associated with the stream */
+void usb_stream_free(struct usb_stream *stream);
+
+/* Reads or writes a buffer of any size on the stream's endpoint.
+ * The buffer is split into URBs that are queued concurrently and retired in
+ * order. A read stops at the first short packet. timeout is in milliseconds
+ * per completion, 0 waits forever.
+ * Returns number of bytes transferred, or negative value for error.
+ * On return no URB refers to the buffer any more, unless errno is
+ * ENOTRECOVERABLE: the kernel could not give back the URBs in flight, the
+ * stream cannot be used again and the buffer must stay valid until the
+ * device is closed.
+ */
+int usb_stream_transfer(struct usb_stream *stream, void* buffer, int length,
+        unsigned int timeout);
+
 #ifdef __cplusplus
 }
 #endif
@@ -6,6 +6,7 @@ include $(CLEAR_VARS)
 LOCAL_SRC_FILES:= \
 	builtins.c \
 	init.c \
+	modules.c \
 	devices.c \
 	property_service.c \
 	util.c \
@@ -89,3 +90,33 @@ ALL_DEFAULT_INSTALLED_MODULES += $(SYMLINKS)
 # local module name
 ALL_MODULES.$(LOCAL_MODULE).INSTALLED := \
     $(ALL_MODULES.$(LOCAL_MODULE).INSTALLED) $(SYMLINKS)
+
+# load_modules scheduler test, with the module syscalls stubbed out
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := modules.c modules_test.c
+LOCAL_MODULE := init_modules_test
+LOCAL_MODULE_TAGS := optional tests
+include $(BUILD_EXECUTABLE)
+
+# Single versus batched property sets against a fake property service
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := property_batch_bench.c util.c
+LOCAL_MODULE := property_batch_bench
+LOCAL_MODULE_TAGS := optional tests
+include $(BUILD_EXECUTABLE)
+
+# wait_for_file and property_wait_for_value wake on the event, not a poll
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := wait_test.c util.c
+LOCAL_MODULE := init_wait_test
+LOCAL_MODULE_TAGS := optional tests
+LOCAL_SHARED_LIBRARIES := libcutils
+include $(BUILD_EXECUTABLE)
+
+# ueventd's uevent queue replayed over a socketpair
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := devices_test.c devices.c util.c
+LOCAL_MODULE := init_devices_test
+LOCAL_MODULE_TAGS := optional tests
+LOCAL_SHARED_LIBRARIES := libcutils
+include $(BUILD_EXECUTABLE)
@@ -48,12 +48,12 @@
 #include "init_parser.h"
 #include "util.h"
 #include "log.h"
+#include "modules.h"
 
 #include <private/android_filesystem_config.h>
 
 void add_environment(const char *name, const char *value);
 
-extern int init_module(void *, unsigned long, const char *);
 extern int init_export_rc_file(const char *);
 
 static int write_file(const char *path, const char *value)
@@ -122,23 +122,6 @@ static int _chmod(const char *path, mode_t mode)
     return ret;
 }
 
-static int insmod(const char *filename, char *options)
-{
-    void *module;
-    unsigned size;
-    int ret;
-
-    module = read_file(filename, &size);
-    if (!module)
-        return -1;
-
-    ret = init_module(module, size, options);
-
-    free(module);
-
-    return ret;
-}
-
 static int setkey(struct kbentry *kbe)
 {
     int fd, ret;
@@ -347,6 +330,18 @@ int do_insmod(int nargs, char **args)
     return do_insmod_inner(nargs, args, size);
 }
 
+int do_load_modules(int nargs, char **args)
+{
+    int nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (nargs == 3)
+        nthreads = atoi(args[2]);
+    if (nthreads < 1)
+        nthreads = 1;
+
+    return load_modules(args[1], nthreads);
+}
+
 int do_log(int nargs, char **args)
 {
     char* par[nargs+3];
@@ -27,6 +27,7 @@
 #include <string.h>
 
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <sys/un.h>
 #include <linux/netlink.h>
 
@@ -59,18 +60,6 @@ extern struct selabel_handle *sehandle;
 
 static int device_fd = -1;
 
-struct uevent {
-    const char *action;
-    const char *path;
-    const char *subsystem;
-    const char *firmware;
-    const char *partition_name;
-    const char *device_name;
-    int partition_num;
-    int major;
-    int minor;
-};
-
 struct perms_ {
     char *name;
     char *attr;
@@ -805,26 +794,138 @@ static void handle_firmware_event(struct uevent *uevent)
     }
 }
 
-#define UEVENT_MSG_LEN  1024
-void handle_device_fd()
+#define UEVENT_MSG_LEN      1024
+#define UEVENT_QUEUE_LEN    128
+#define UEVENT_RECV_BATCH   16
+
+/*
+ * Received uevents wait in this ring until they are handled, so that
+ * reading from the netlink socket is not held up behind device node
+ * creation. Each entry is parsed on arrival; the parsed fields point into
+ * the entry's own message buffer.
+ */
+struct uevent_msg {
+    char data[UEVENT_MSG_LEN+2];
+    int len;            /* -1 if the message was rejected or overflowed */
+    struct uevent uevent;
+};
+
+static struct uevent_msg *uevent_queue;
+static unsigned int uevent_queue_head;
+static unsigned int uevent_queue_count;
+
+/*
+ * Moves whatever the kernel has queued on the netlink socket into the
+ * ring, a batch per system call, without blocking. Stops when the socket
+ * is drained or the ring is full.
+ */
+static void receive_uevents(int fd)
 {
-    char msg[UEVENT_MSG_LEN+2];
+    struct iovec iov[UEVENT_RECV_BATCH];
+    ssize_t lengths[UEVENT_RECV_BATCH];
+    unsigned int tail, want, i;
+    uid_t uid;
     int n;
-    while ((n = uevent_kernel_multicast_recv(device_fd, msg, UEVENT_MSG_LEN)) > 0) {
-        if(n >= UEVENT_MSG_LEN)   /* overflow -- discard */
-            continue;
 
-        msg[n] = '\0';
-        msg[n+1] = '\0';
+    while (uevent_queue_count < UEVENT_QUEUE_LEN) {
+        tail = (uevent_queue_head + uevent_queue_count) % UEVENT_QUEUE_LEN;
+        want = UEVENT_QUEUE_LEN - uevent_queue_count;
+        if (want > UEVENT_RECV_BATCH)
+            want = UEVENT_RECV_BATCH;
+
+        for (i = 0; i < want; i++) {
+            iov[i].iov_base = uevent_queue[(tail + i) % UEVENT_QUEUE_LEN].data;
+            iov[i].iov_len = UEVENT_MSG_LEN;
+        }
+
+        n = uevent_kernel_multicast_uid_recv_batch(fd, iov, lengths, want, &uid);
+        if (n <= 0)
+            break;
 
-        struct uevent uevent;
-        parse_event(msg, &uevent);
+        for (i = 0; i < (unsigned int) n; i++) {
+            struct uevent_msg *m = &uevent_queue[(tail + i) % UEVENT_QUEUE_LEN];
 
-        handle_device_event(&uevent);
-        handle_firmware_event(&uevent);
+            if (lengths[i] < 0 || lengths[i] >= UEVENT_MSG_LEN) {
+                /* rejected or overflow -- discard */
+                m->len = -1;
+                continue;
+            }
+            m->len = lengths[i];
+            m->data[m->len] = '\0';
+            m->data[m->len+1] = '\0';
+            parse_event(m->data, &m->uevent);
+        }
+        uevent_queue_count += n;
     }
 }
 
+/*
+ * A "change" event only refreshes sysfs permissions, so when another
+ * change for the same device is already queued behind it, it can be
+ * dropped.
+ */
+static int is_superseded(unsigned int pos)
+{
+    struct uevent *uevent = &uevent_queue[pos].uevent;
+    unsigned int i;
+
+    if (strcmp(uevent->action, "change"))
+        return 0;
+
+    for (i = 1; i < uevent_queue_count; i++) {
+        struct uevent_msg *later =
+            &uevent_queue[(pos + i) % UEVENT_QUEUE_LEN];
+        if (later->len >= 0 && !strcmp(later->uevent.action, "change") &&
+                !strcmp(later->uevent.path, uevent->path) &&
+                !strcmp(later->uevent.subsystem, uevent->subsystem))
+            return 1;
+    }
+    return 0;
+}
+
+void handle_uevents(int fd, void (*handle_event)(struct uevent *uevent))
+{
+    struct uevent_msg *m;
+
+    if (!uevent_queue) {
+        uevent_queue = calloc(UEVENT_QUEUE_LEN, sizeof(*uevent_queue));
+        if (!uevent_queue) {
+            ERROR("cannot allocate uevent queue\n");
+            return;
+        }
+    }
+
+    receive_uevents(fd);
+    while (uevent_queue_count > 0) {
+        m = &uevent_queue[uevent_queue_head];
+        if (m->len >= 0) {
+            if (is_superseded(uevent_queue_head)) {
+                log_event_print("dropping duplicate change for '%s'\n",
+                                m->uevent.path);
+            } else {
+                handle_event(&m->uevent);
+            }
+        }
+
+        uevent_queue_head = (uevent_queue_head + 1) % UEVENT_QUEUE_LEN;
+        uevent_queue_count--;
+
+        /* pick up anything that arrived while that event was handled */
+        receive_uevents(fd);
+    }
+}
+
+static void handle_uevent(struct uevent *uevent)
+{
+    handle_device_event(uevent);
+    handle_firmware_event(uevent);
+}
+
+void handle_device_fd()
+{
+    handle_uevents(device_fd, handle_uevent);
+}
+
 /* Coldboot walks parts of the /sys tree and pokes the uevent files
 ** to cause the kernel to regenerate device add events that happened
 ** before init's device manager was started
@@ -888,8 +989,9 @@ void device_init(void)
         sehandle = selinux_android_file_context_handle();
     }
 #endif
-    /* is 64K enough? udev uses 16MB! */
-    device_fd = uevent_open_socket(64*1024, true);
+    /* udev uses 16MB; 2MB lets a hotplug storm queue up while
+     * device nodes are being created */
+    device_fd = uevent_open_socket(2*1024*1024, true);
     if(device_fd < 0)
         return;
 
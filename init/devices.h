@@ -19,7 +19,23 @@
 
 #include <sys/stat.h>
 
+struct uevent {
+    const char *action;
+    const char *path;
+    const char *subsystem;
+    const char *firmware;
+    const char *partition_name;
+    const char *device_name;
+    int partition_num;
+    int major;
+    int minor;
+};
+
 extern void handle_device_fd();
+/* Receives the uevents queued on fd and passes each to handle_event, except
+ * change events superseded by a later one; handle_device_fd() does this on
+ * the netlink socket with ueventd's handlers. */
+extern void handle_uevents(int fd, void (*handle_event)(struct uevent *uevent));
 extern void device_init(void);
 extern int add_dev_perms(const char *name, const char *attr,
                          mode_t perm, unsigned int uid,
@@ -0,0 +1,338 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Replays uevents through ueventd's queue over a datagram socketpair, in
+ * place of the netlink socket, and checks which events reach the handler.
+ *
+ * uevent_kernel_multicast_uid_recv_batch() is stubbed with the same
+ * recvmmsg() minus the kernel sender check, which a socketpair cannot pass;
+ * messages sent as "reject@..." stand for the ones that fail it.  Every
+ * message carries its sequence number as PARTN, which the queue parses but
+ * never looks at, so the handler can tell exactly which events it got.
+ *
+ * Two small replays check the result event by event: a queue with
+ * duplicate change events, and events arriving while another is handled.
+ * Then a writer thread sends a hotplug storm as fast as the socket takes it
+ * while each handled event costs a little time, and the test checks that
+ * events stay in order and that only change events superseded by a later
+ * one for the same device are dropped.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cutils/uevent.h>
+
+#include "devices.h"
+
+#define MAX_EVENTS      20000
+#define STORM_DEVICES   50
+#define HANDLE_US       20
+
+struct sent {
+    char action[16];
+    char path[64];
+    char subsystem[32];
+    int rejected;
+    int handled;
+};
+
+static struct sent sent[MAX_EVENTS];
+static int sent_count;
+static int handled[MAX_EVENTS];
+static int handled_count;
+static int out_of_order;
+static int recv_calls;
+static int recv_messages;
+static int sock[2];
+static int handle_us;
+static void (*on_handle)(int seq);
+
+/* Same layout as the kernel's struct mmsghdr, as in libcutils/uevent.c */
+struct test_mmsghdr {
+    struct msghdr msg_hdr;
+    unsigned int msg_len;
+};
+
+int uevent_kernel_multicast_uid_recv_batch(int socket, struct iovec *iov,
+                                           ssize_t *lengths, int count,
+                                           uid_t *user)
+{
+    struct test_mmsghdr msgs[16];
+    int i, n;
+
+    *user = 0;
+    if (count > 16)
+        count = 16;
+    memset(msgs, 0, sizeof(msgs));
+    for (i = 0; i < count; i++) {
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    n = syscall(__NR_recvmmsg, socket, msgs, count, MSG_DONTWAIT, NULL);
+    if (n < 0)
+        return errno == EAGAIN ? 0 : -1;
+    recv_calls++;
+    recv_messages += n;
+    for (i = 0; i < n; i++) {
+        lengths[i] = msgs[i].msg_len;
+        if (!strncmp(iov[i].iov_base, "reject@", 7)) {
+            memset(iov[i].iov_base, 0, iov[i].iov_len);
+            lengths[i] = -1;
+        }
+    }
+    return n;
+}
+
+void klog_write(int level, const char *fmt, ...)
+{
+}
+
+/* Sends one uevent and returns its sequence number */
+static int send_event(const char *action, const char *path, const char *subsystem)
+{
+    char msg[256];
+    int seq = sent_count++;
+    int len;
+
+    strcpy(sent[seq].action, action);
+    strcpy(sent[seq].path, path);
+    strcpy(sent[seq].subsystem, subsystem);
+    sent[seq].rejected = !strcmp(action, "reject");
+    sent[seq].handled = 0;
+    len = snprintf(msg, sizeof(msg), "%s@%s", action, path) + 1;
+    len += snprintf(msg + len, sizeof(msg) - len, "ACTION=%s", action) + 1;
+    len += snprintf(msg + len, sizeof(msg) - len, "DEVPATH=%s", path) + 1;
+    len += snprintf(msg + len, sizeof(msg) - len, "SUBSYSTEM=%s", subsystem) + 1;
+    len += snprintf(msg + len, sizeof(msg) - len, "PARTN=%d", seq) + 1;
+    if (send(sock[1], msg, len, 0) != len) {
+        perror("send");
+        exit(1);
+    }
+    return seq;
+}
+
+static void handle_event(struct uevent *uevent)
+{
+    int seq = uevent->partition_num;
+
+    if (seq < 0 || seq >= sent_count || strcmp(uevent->action, sent[seq].action) ||
+            strcmp(uevent->path, sent[seq].path) ||
+            strcmp(uevent->subsystem, sent[seq].subsystem)) {
+        fprintf(stderr, "handled an event that was not sent: %s %s\n",
+                uevent->action, uevent->path);
+        out_of_order++;
+        return;
+    }
+    if (handled_count > 0 && seq <= handled[handled_count - 1])
+        out_of_order++;
+    handled[handled_count++] = seq;
+    sent[seq].handled = 1;
+    if (handle_us)
+        usleep(handle_us);
+    if (on_handle)
+        on_handle(seq);
+}
+
+static void reset(void)
+{
+    sent_count = handled_count = out_of_order = 0;
+    recv_calls = recv_messages = 0;
+    handle_us = 0;
+    on_handle = NULL;
+}
+
+static int expect(const char *name, const int *want, int count)
+{
+    int i;
+
+    if (out_of_order || handled_count != count ||
+            memcmp(handled, want, count * sizeof(int))) {
+        fprintf(stderr, "%s: handled", name);
+        for (i = 0; i < handled_count; i++)
+            fprintf(stderr, " %d", handled[i]);
+        fprintf(stderr, ", expected");
+        for (i = 0; i < count; i++)
+            fprintf(stderr, " %d", want[i]);
+        fprintf(stderr, "\n");
+        return 1;
+    }
+    return 0;
+}
+
+static int test_duplicates(void)
+{
+    /* 0 and 2 give way to 6, 5 is another subsystem and 4 never arrives */
+    int want[] = { 1, 3, 5, 6, 7 };
+    int failures;
+
+    reset();
+    send_event("change", "/devices/battery", "power_supply");           /* 0 */
+    send_event("change", "/devices/usb", "power_supply");               /* 1 */
+    send_event("change", "/devices/battery", "power_supply");           /* 2 */
+    send_event("add", "/devices/virtual/input/input1", "input");        /* 3 */
+    send_event("reject", "/devices/battery", "power_supply");           /* 4 */
+    send_event("change", "/devices/battery", "platform");               /* 5 */
+    send_event("change", "/devices/battery", "power_supply");           /* 6 */
+    send_event("remove", "/devices/virtual/input/input1", "input");     /* 7 */
+    handle_uevents(sock[0], handle_event);
+
+    failures = expect("duplicates", want, sizeof(want) / sizeof(int));
+    if (recv_messages != 8 || recv_calls != 1) {
+        fprintf(stderr, "duplicates: 8 queued events took %d receives\n", recv_calls);
+        failures++;
+    }
+    return failures;
+}
+
+static void send_more(int seq)
+{
+    if (seq != 0)
+        return;
+    send_event("change", "/devices/battery", "power_supply");           /* 3 */
+    send_event("change", "/devices/battery", "power_supply");           /* 4 */
+    send_event("add", "/devices/virtual/input/input2", "input");        /* 5 */
+}
+
+static int test_arrivals(void)
+{
+    int want[] = { 0, 1, 2, 4, 5 };
+
+    reset();
+    on_handle = send_more;
+    send_event("add", "/devices/virtual/input/input0", "input");        /* 0 */
+    send_event("add", "/devices/virtual/input/input1", "input");        /* 1 */
+    send_event("add", "/devices/virtual/misc/uinput", "misc");          /* 2 */
+    handle_uevents(sock[0], handle_event);
+
+    /* 3 to 5 arrive while 0 is handled and join the queue behind 2 */
+    return expect("arrivals", want, sizeof(want) / sizeof(int));
+}
+
+static volatile int storm_sent;
+
+static void *storm_writer(void *arg)
+{
+    char path[64];
+    int i;
+
+    for (i = 0; sent_count < MAX_EVENTS - 2; i++) {
+        snprintf(path, sizeof(path), "/devices/virtual/input/input%d",
+                 i % STORM_DEVICES);
+        switch (i % 5) {
+        case 0:
+            send_event("add", path, "input");
+            break;
+        case 4:
+            send_event("remove", path, "input");
+            break;
+        default:
+            send_event("change", path, "input");
+            break;
+        }
+        if (i % 7 == 0)
+            send_event("change", "/devices/battery", "power_supply");
+    }
+    storm_sent = 1;
+    return NULL;
+}
+
+static int test_storm(void)
+{
+    pthread_t writer;
+    struct pollfd pfd;
+    int i, j, dropped = 0, failures = 0;
+
+    reset();
+    storm_sent = 0;
+    handle_us = HANDLE_US;
+    pthread_create(&writer, NULL, storm_writer, NULL);
+    pfd.fd = sock[0];
+    pfd.events = POLLIN;
+    for (;;) {
+        if (poll(&pfd, 1, 10) > 0) {
+            handle_uevents(sock[0], handle_event);
+        } else if (storm_sent) {
+            break;
+        }
+    }
+    pthread_join(writer, NULL);
+
+    if (out_of_order) {
+        fprintf(stderr, "storm: %d events handled out of order\n", out_of_order);
+        failures++;
+    }
+    for (i = 0; i < sent_count; i++) {
+        if (sent[i].handled)
+            continue;
+        if (sent[i].rejected)
+            continue;
+        if (strcmp(sent[i].action, "change")) {
+            fprintf(stderr, "storm: %s %s (%d) was dropped\n",
+                    sent[i].action, sent[i].path, i);
+            failures++;
+            continue;
+        }
+        for (j = i + 1; j < sent_count; j++) {
+            if (!strcmp(sent[j].action, "change") &&
+                    !strcmp(sent[j].path, sent[i].path) &&
+                    !strcmp(sent[j].subsystem, sent[i].subsystem))
+                break;
+        }
+        if (j == sent_count) {
+            fprintf(stderr, "storm: last change for %s (%d) was dropped\n",
+                    sent[i].path, i);
+            failures++;
+        }
+        dropped++;
+    }
+    printf("storm: %d events, %d handled, %d superseded changes dropped, "
+           "%d receives\n", sent_count, handled_count, dropped, recv_calls);
+    if (handled_count + dropped != sent_count) {
+        fprintf(stderr, "storm: %d events unaccounted for\n",
+                sent_count - handled_count - dropped);
+        failures++;
+    }
+    return failures;
+}
+
+int main(int argc, char *argv[])
+{
+    int failures = 0;
+
+    if (socketpair(AF_UNIX, SOCK_DGRAM, 0, sock) < 0) {
+        perror("socketpair");
+        return 1;
+    }
+    fcntl(sock[0], F_SETFL, O_NONBLOCK);
+
+    failures += test_duplicates();
+    failures += test_arrivals();
+    failures += test_storm();
+
+    printf("%d failures\n", failures);
+    return failures ? 1 : 0;
+}
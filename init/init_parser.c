@@ -123,6 +123,7 @@ int lookup_keyword(const char *s)
         if (!strcmp(s, "oglevel")) return K_loglevel;
         if (!strcmp(s, "og")) return K_log;
         if (!strcmp(s, "oad_persist_props")) return K_load_persist_props;
+        if (!strcmp(s, "oad_modules")) return K_load_modules;
         break;
     case 'm':
         if (!strcmp(s, "kdir")) return K_mkdir;
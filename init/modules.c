@@ -0,0 +1,336 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "modules.h"
+#include "util.h"
+#include "log.h"
+
+extern int init_module(void *, unsigned long, const char *);
+
+#define MAX_MODULE_THREADS 4
+
+struct module {
+    char *path;
+    int *deps;
+    int ndeps;
+    int *users;
+    int nusers;
+    int pending;
+    int failed;
+};
+
+struct module_loader {
+    struct module *mods;
+    int count;
+    int *ready;
+    int nready;
+    int running;
+    int remaining;
+    int errors;
+    int (*load)(const char *path);
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
+int insmod(const char *filename, const char *options)
+{
+    void *module;
+    unsigned size;
+    int ret;
+
+#ifdef __NR_finit_module
+    struct stat sb;
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    // for security reasons, disallow world-writable
+    // or group-writable files, as read_file() does
+    if (fstat(fd, &sb) < 0 || (sb.st_mode & (S_IWGRP | S_IWOTH)) != 0) {
+        ERROR("skipping insecure module '%s'\n", filename);
+        close(fd);
+        return -1;
+    }
+
+    ret = syscall(__NR_finit_module, fd, options, 0);
+    close(fd);
+    if (ret == 0 || errno != ENOSYS)
+        return ret;
+#endif
+
+    module = read_file(filename, &size);
+    if (!module)
+        return -1;
+
+    ret = init_module(module, size, options);
+
+    free(module);
+
+    return ret;
+}
+
+static int find_module(struct module_loader *ld, const char *path)
+{
+    int i;
+
+    for (i = 0; i < ld->count; i++) {
+        if (!strcmp(ld->mods[i].path, path))
+            return i;
+    }
+    return -1;
+}
+
+static int add_module(struct module_loader *ld, const char *dir,
+                      const char *name, int *cap)
+{
+    char path[PATH_MAX];
+    int i;
+
+    if (name[0] == '/')
+        snprintf(path, sizeof(path), "%s", name);
+    else
+        snprintf(path, sizeof(path), "%s/%s", dir, name);
+
+    i = find_module(ld, path);
+    if (i >= 0)
+        return i;
+
+    if (ld->count == *cap) {
+        int new_cap = *cap ? *cap * 2 : 32;
+        struct module *mods = realloc(ld->mods, new_cap * sizeof(*mods));
+        if (!mods)
+            return -1;
+        ld->mods = mods;
+        *cap = new_cap;
+    }
+
+    memset(&ld->mods[ld->count], 0, sizeof(struct module));
+    ld->mods[ld->count].path = strdup(path);
+    if (!ld->mods[ld->count].path)
+        return -1;
+    return ld->count++;
+}
+
+static int append_int(int **array, int *count, int value)
+{
+    int *a = realloc(*array, (*count + 1) * sizeof(int));
+    if (!a)
+        return -1;
+    a[(*count)++] = value;
+    *array = a;
+    return 0;
+}
+
+/* Parses modules.dep lines of the form "a.ko: b.ko c.ko", where a.ko
+ * depends on b.ko and c.ko.  Relative names are resolved against the
+ * directory that holds the dependency file.
+ */
+static int parse_modules_dep(struct module_loader *ld, const char *dep_file)
+{
+    char dir[PATH_MAX];
+    char *data, *line, *next, *tok, *save;
+    char *slash;
+    int cap = 0;
+    int m, d;
+
+    data = read_file(dep_file, 0);
+    if (!data)
+        return -1;
+
+    strlcpy(dir, dep_file, sizeof(dir));
+    slash = strrchr(dir, '/');
+    if (slash)
+        *slash = 0;
+    else
+        strcpy(dir, ".");
+
+    for (line = data; line && *line; line = next) {
+        next = strchr(line, '\n');
+        if (next)
+            *next++ = 0;
+
+        tok = strchr(line, ':');
+        if (!tok)
+            continue;
+        *tok++ = 0;
+
+        m = add_module(ld, dir, line, &cap);
+        if (m < 0)
+            goto oops;
+
+        for (tok = strtok_r(tok, " \t", &save); tok;
+                tok = strtok_r(NULL, " \t", &save)) {
+            d = add_module(ld, dir, tok, &cap);
+            if (d < 0)
+                goto oops;
+            if (append_int(&ld->mods[m].deps, &ld->mods[m].ndeps, d) ||
+                    append_int(&ld->mods[d].users, &ld->mods[d].nusers, m))
+                goto oops;
+        }
+    }
+
+    free(data);
+    return 0;
+
+oops:
+    free(data);
+    return -1;
+}
+
+static void *module_worker(void *arg)
+{
+    struct module_loader *ld = arg;
+    struct module *mod;
+    int i, ret, err;
+
+    pthread_mutex_lock(&ld->lock);
+    for (;;) {
+        while (ld->nready == 0 && ld->remaining > 0) {
+            if (ld->running == 0) {
+                ERROR("circular module dependency, %d modules not loaded\n",
+                      ld->remaining);
+                ld->errors += ld->remaining;
+                ld->remaining = 0;
+                pthread_cond_broadcast(&ld->cond);
+                break;
+            }
+            pthread_cond_wait(&ld->cond, &ld->lock);
+        }
+        if (ld->remaining == 0)
+            break;
+
+        mod = &ld->mods[ld->ready[--ld->nready]];
+        ld->running++;
+        pthread_mutex_unlock(&ld->lock);
+
+        ret = 0;
+        err = 0;
+        if (!mod->failed) {
+            ret = ld->load(mod->path);
+            err = errno;
+        }
+
+        pthread_mutex_lock(&ld->lock);
+        ld->running--;
+        ld->remaining--;
+        if (mod->failed) {
+            ERROR("skipping '%s': a dependency failed to load\n", mod->path);
+            ld->errors++;
+        } else if (ret < 0 && err != EEXIST) {
+            ERROR("insmod '%s' failed: %s\n", mod->path, strerror(err));
+            mod->failed = 1;
+            ld->errors++;
+        }
+        for (i = 0; i < mod->nusers; i++) {
+            struct module *user = &ld->mods[mod->users[i]];
+            if (mod->failed)
+                user->failed = 1;
+            if (--user->pending == 0)
+                ld->ready[ld->nready++] = mod->users[i];
+        }
+        pthread_cond_broadcast(&ld->cond);
+    }
+    pthread_mutex_unlock(&ld->lock);
+
+    return NULL;
+}
+
+/* Loads every module named in a modules.dep style file.  Modules whose
+ * dependencies are satisfied are loaded concurrently by up to nthreads
+ * workers; a module is only loaded once all of its dependencies are.
+ */
+int load_modules_with(const char *dep_file, int nthreads,
+                      int (*load)(const char *path))
+{
+    struct module_loader ld;
+    pthread_t threads[MAX_MODULE_THREADS];
+    int started = 0;
+    int i;
+
+    memset(&ld, 0, sizeof(ld));
+    ld.load = load;
+    pthread_mutex_init(&ld.lock, NULL);
+    pthread_cond_init(&ld.cond, NULL);
+
+    if (parse_modules_dep(&ld, dep_file) < 0) {
+        ERROR("cannot parse '%s'\n", dep_file);
+        ld.errors = 1;
+        goto out;
+    }
+
+    ld.ready = malloc((ld.count + 1) * sizeof(int));
+    if (!ld.ready) {
+        ld.errors = 1;
+        goto out;
+    }
+    for (i = 0; i < ld.count; i++) {
+        ld.mods[i].pending = ld.mods[i].ndeps;
+        if (ld.mods[i].pending == 0)
+            ld.ready[ld.nready++] = i;
+    }
+    ld.remaining = ld.count;
+
+    if (nthreads > MAX_MODULE_THREADS)
+        nthreads = MAX_MODULE_THREADS;
+    if (nthreads > ld.count)
+        nthreads = ld.count;
+
+    // the calling thread is one of the workers
+    for (i = 1; i < nthreads; i++) {
+        if (pthread_create(&threads[started], NULL, module_worker, &ld) == 0)
+            started++;
+    }
+    module_worker(&ld);
+    for (i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+
+    INFO("loaded %d of %d modules from '%s' with %d threads\n",
+         ld.count - ld.errors, ld.count, dep_file, started + 1);
+
+out:
+    for (i = 0; i < ld.count; i++) {
+        free(ld.mods[i].path);
+        free(ld.mods[i].deps);
+        free(ld.mods[i].users);
+    }
+    free(ld.mods);
+    free(ld.ready);
+    pthread_mutex_destroy(&ld.lock);
+    pthread_cond_destroy(&ld.cond);
+
+    return ld.errors ? -1 : 0;
+}
+
+static int insmod_no_options(const char *path)
+{
+    return insmod(path, "");
+}
+
+int load_modules(const char *dep_file, int nthreads)
+{
+    return load_modules_with(dep_file, nthreads, insmod_no_options);
+}
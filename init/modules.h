@@ -0,0 +1,29 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _INIT_MODULES_H_
+#define _INIT_MODULES_H_
+
+int insmod(const char *filename, const char *options);
+int load_modules(const char *dep_file, int nthreads);
+
+/* load_modules() with insmod() replaced by load, which returns 0 or -1
+ * with errno set.  Used by modules_test to run the scheduler without
+ * loading anything. */
+int load_modules_with(const char *dep_file, int nthreads,
+                      int (*load)(const char *path));
+
+#endif
@@ -0,0 +1,340 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Runs the load_modules scheduler over made up dependency graphs with the
+ * file and module syscalls stubbed out, and checks that every module starts
+ * loading only after all of its dependencies have loaded, that no more than
+ * the requested number of modules load at once, and that failures and
+ * cycles are contained.
+ *
+ * It then estimates module loading time for a graph shaped like a typical
+ * device's: each stub load sleeps for the time given in the table, and the
+ * wall time is reported for 1, 2 and 4 workers next to the length of the
+ * longest dependency chain, which no number of workers can beat.  The
+ * estimate assumes loads mostly wait (on storage, firmware or hardware);
+ * module init that is CPU bound only gains with as many CPUs.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "modules.h"
+
+#define MODULE_DIR      "/lib/modules"
+#define DEP_FILE        MODULE_DIR "/modules.dep"
+#define MAX_MODULES     32
+
+struct fake_module {
+    const char *name;
+    const char *deps;
+    int load_ms;
+    int result;         /* errno to fail the load with, or 0 */
+};
+
+static const struct fake_module boot_graph[] = {
+    { "kernel/lib/crc16.ko",                "",                                     3 },
+    { "kernel/fs/mbcache.ko",               "",                                     2 },
+    { "kernel/fs/jbd2.ko",                  "kernel/lib/crc16.ko",                  6 },
+    { "kernel/fs/ext4.ko",
+            "kernel/fs/jbd2.ko kernel/fs/mbcache.ko kernel/lib/crc16.ko",          18 },
+    { "kernel/net/rfkill.ko",               "",                                     3 },
+    { "kernel/net/cfg80211.ko",             "kernel/net/rfkill.ko",                20 },
+    { "kernel/net/mac80211.ko",             "kernel/net/cfg80211.ko",              25 },
+    { "kernel/drivers/net/wlan.ko",
+            "kernel/net/mac80211.ko kernel/net/cfg80211.ko",                       40 },
+    { "kernel/net/bluetooth.ko",            "kernel/net/rfkill.ko",                15 },
+    { "kernel/drivers/bluetooth/hci_uart.ko", "kernel/net/bluetooth.ko",            6 },
+    { "kernel/drivers/media/v4l2-core.ko",  "",                                    10 },
+    { "kernel/drivers/media/videobuf2.ko",  "kernel/drivers/media/v4l2-core.ko",    5 },
+    { "kernel/drivers/media/camera.ko",
+            "kernel/drivers/media/videobuf2.ko kernel/drivers/media/v4l2-core.ko", 30 },
+    { "kernel/sound/snd.ko",                "",                                     8 },
+    { "kernel/sound/snd-pcm.ko",            "kernel/sound/snd.ko",                  6 },
+    { "kernel/sound/snd-soc-core.ko",       "kernel/sound/snd-pcm.ko",              9 },
+    { "kernel/sound/codec.ko",              "kernel/sound/snd-soc-core.ko",        12 },
+    { "kernel/drivers/input/touchscreen.ko", "",                                   14 },
+    { "kernel/drivers/gpu/graphics.ko",     "",                                    35 },
+    { "kernel/drivers/usb/gadget.ko",       "",                                     7 },
+    { NULL }
+};
+
+/* c fails, so d and e (which needs d) must not load; a and b still do */
+static const struct fake_module failing_graph[] = {
+    { "a.ko", "" },
+    { "b.ko", "a.ko" },
+    { "c.ko", "", 0, ENOEXEC },
+    { "d.ko", "c.ko a.ko" },
+    { "e.ko", "d.ko" },
+    { "f.ko", "", 0, EEXIST },      /* already loaded counts as loaded */
+    { "g.ko", "f.ko" },
+    { NULL }
+};
+
+static const struct fake_module cyclic_graph[] = {
+    { "a.ko", "" },
+    { "b.ko", "c.ko" },
+    { "c.ko", "b.ko" },
+    { NULL }
+};
+
+static struct {
+    const struct fake_module *graph;
+    int count;
+    int loaded[MAX_MODULES];
+    int attempts[MAX_MODULES];
+    int running;
+    int max_running;
+    int violations;
+    int errors_logged;
+    pthread_mutex_t lock;
+} t;
+
+static const char *dep_file_text;
+
+/* Stubs for what modules.c would otherwise get from init and the kernel */
+
+void *read_file(const char *fn, unsigned *_sz)
+{
+    char *data;
+
+    if (strcmp(fn, DEP_FILE) != 0 || !dep_file_text) {
+        errno = ENOENT;
+        return NULL;
+    }
+    data = strdup(dep_file_text);
+    if (data && _sz)
+        *_sz = strlen(data);
+    return data;
+}
+
+void klog_write(int level, const char *fmt, ...)
+{
+    va_list ap;
+
+    if (level <= 3) {
+        pthread_mutex_lock(&t.lock);
+        t.errors_logged++;
+        pthread_mutex_unlock(&t.lock);
+    }
+    if (getenv("MODULES_TEST_VERBOSE")) {
+        va_start(ap, fmt);
+        vfprintf(stderr, fmt, ap);
+        va_end(ap);
+    }
+}
+
+int init_module(void *module, unsigned long len, const char *options)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+static int find(const char *name)
+{
+    int i;
+
+    for (i = 0; i < t.count; i++) {
+        if (!strcmp(t.graph[i].name, name))
+            return i;
+    }
+    return -1;
+}
+
+static int deps_loaded(int m)
+{
+    char deps[256], *dep, *save;
+
+    strcpy(deps, t.graph[m].deps);
+    for (dep = strtok_r(deps, " ", &save); dep; dep = strtok_r(NULL, " ", &save)) {
+        if (!t.loaded[find(dep)])
+            return 0;
+    }
+    return 1;
+}
+
+static int fake_load(const char *path)
+{
+    int m = -1;
+
+    if (!strncmp(path, MODULE_DIR "/", strlen(MODULE_DIR "/")))
+        m = find(path + strlen(MODULE_DIR "/"));
+    if (m < 0) {
+        fprintf(stderr, "asked to load unknown module %s\n", path);
+        pthread_mutex_lock(&t.lock);
+        t.violations++;
+        pthread_mutex_unlock(&t.lock);
+        errno = ENOENT;
+        return -1;
+    }
+
+    pthread_mutex_lock(&t.lock);
+    t.attempts[m]++;
+    if (!deps_loaded(m)) {
+        fprintf(stderr, "%s started before its dependencies\n", t.graph[m].name);
+        t.violations++;
+    }
+    if (++t.running > t.max_running)
+        t.max_running = t.running;
+    pthread_mutex_unlock(&t.lock);
+
+    usleep(t.graph[m].load_ms * 1000);
+
+    pthread_mutex_lock(&t.lock);
+    t.running--;
+    if (t.graph[m].result == 0 || t.graph[m].result == EEXIST)
+        t.loaded[m] = 1;
+    pthread_mutex_unlock(&t.lock);
+
+    if (t.graph[m].result) {
+        errno = t.graph[m].result;
+        return -1;
+    }
+    return 0;
+}
+
+static char *make_dep_file(const struct fake_module *graph)
+{
+    static char text[4096];
+    int i;
+
+    text[0] = 0;
+    for (i = 0; graph[i].name; i++) {
+        strcat(text, graph[i].name);
+        strcat(text, ": ");
+        strcat(text, graph[i].deps);
+        strcat(text, "\n");
+    }
+    return text;
+}
+
+static int run(const struct fake_module *graph, int nthreads, int *ms)
+{
+    struct timeval start, end;
+    int ret;
+
+    memset(t.loaded, 0, sizeof(t.loaded));
+    memset(t.attempts, 0, sizeof(t.attempts));
+    t.graph = graph;
+    for (t.count = 0; graph[t.count].name; t.count++)
+        ;
+    t.running = t.max_running = t.violations = t.errors_logged = 0;
+    dep_file_text = make_dep_file(graph);
+
+    gettimeofday(&start, NULL);
+    ret = load_modules_with(DEP_FILE, nthreads, fake_load);
+    gettimeofday(&end, NULL);
+    if (ms)
+        *ms = (end.tv_sec - start.tv_sec) * 1000 +
+              (end.tv_usec - start.tv_usec) / 1000;
+    return ret;
+}
+
+/* Length of the longest chain of loads ending at module m */
+static int chain_ms(const struct fake_module *graph, int m)
+{
+    char deps[256], *dep, *save;
+    int longest = 0, d, len;
+
+    strcpy(deps, graph[m].deps);
+    for (dep = strtok_r(deps, " ", &save); dep; dep = strtok_r(NULL, " ", &save)) {
+        for (d = 0; strcmp(graph[d].name, dep); d++)
+            ;
+        len = chain_ms(graph, d);
+        if (len > longest)
+            longest = len;
+    }
+    return longest + graph[m].load_ms;
+}
+
+int main(int argc, char *argv[])
+{
+    int threads[] = { 1, 2, 4 };
+    int failures = 0;
+    int i, n, ms, critical = 0, total = 0;
+
+    pthread_mutex_init(&t.lock, NULL);
+
+    for (n = 0; n < 3; n++) {
+        if (run(boot_graph, threads[n], &ms) != 0 || t.violations) {
+            fprintf(stderr, "boot graph with %d threads failed\n", threads[n]);
+            failures++;
+        }
+        for (i = 0; i < t.count; i++) {
+            if (t.attempts[i] != 1) {
+                fprintf(stderr, "%s loaded %d times\n", t.graph[i].name,
+                        t.attempts[i]);
+                failures++;
+            }
+        }
+        if (t.max_running > threads[n]) {
+            fprintf(stderr, "%d loads at once with %d threads\n",
+                    t.max_running, threads[n]);
+            failures++;
+        }
+        if (threads[n] > 1 && t.max_running < 2) {
+            fprintf(stderr, "no loads overlapped with %d threads\n", threads[n]);
+            failures++;
+        }
+        printf("%d thread%s: %4d ms\n", threads[n], threads[n] > 1 ? "s" : " ", ms);
+    }
+    for (i = 0; boot_graph[i].name; i++) {
+        total += boot_graph[i].load_ms;
+        if (chain_ms(boot_graph, i) > critical)
+            critical = chain_ms(boot_graph, i);
+    }
+    printf("sum of loads %d ms, longest dependency chain %d ms\n", total, critical);
+
+    if (run(failing_graph, 4, NULL) == 0) {
+        fprintf(stderr, "failed module not reported\n");
+        failures++;
+    }
+    if (t.violations || t.attempts[find("d.ko")] || t.attempts[find("e.ko")] ||
+            !t.loaded[find("b.ko")] || !t.loaded[find("g.ko")]) {
+        fprintf(stderr, "failure not contained to the dependents of c.ko\n");
+        failures++;
+    }
+    if (t.errors_logged != 3) {
+        fprintf(stderr, "expected 3 errors for c.ko, d.ko and e.ko, got %d\n",
+                t.errors_logged);
+        failures++;
+    }
+
+    if (run(cyclic_graph, 2, NULL) == 0) {
+        fprintf(stderr, "dependency cycle not reported\n");
+        failures++;
+    }
+    if (t.violations || !t.loaded[find("a.ko")] ||
+            t.attempts[find("b.ko")] || t.attempts[find("c.ko")]) {
+        fprintf(stderr, "dependency cycle not handled\n");
+        failures++;
+    }
+
+    dep_file_text = NULL;
+    if (load_modules_with(DEP_FILE, 4, fake_load) == 0) {
+        fprintf(stderr, "missing modules.dep not reported\n");
+        failures++;
+    }
+
+    printf("%d failures\n", failures);
+    return failures ? 1 : 0;
+}
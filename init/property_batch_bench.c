@@ -0,0 +1,375 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Compares setting properties one connection at a time with the batched
+ * protocol of property_set_batch(), against a fake property service.
+ *
+ * The service follows init's handle_property_set_fd(): it waits for the
+ * socket in poll(), accepts, reads the peer credentials and the message,
+ * updates a fake property area in memory and bumps its serial with a futex
+ * wake, which a few waiter threads sleep on.  Single sets are acknowledged by
+ * closing the socket, as bionic's __system_property_set() expects; batches
+ * use init's recv_full() and get one result per entry.
+ *
+ * Finally a client sends a batch one byte at a time, slower than the batch
+ * timeout allows in total but faster than it allows per byte, and the
+ * service has to give up on it after PROPERTY_BATCH_TIMEOUT_MS.
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <linux/futex.h>
+
+#include <private/android_property_batch.h>
+
+#include "util.h"
+
+/* As in bionic's sys/_system_properties.h */
+#define PROP_NAME_MAX       32
+#define PROP_VALUE_MAX      92
+#define PROP_MSG_SETPROP    1
+#define PA_COUNT_MAX        247
+
+typedef struct prop_msg {
+    unsigned cmd;
+    char name[PROP_NAME_MAX];
+    char value[PROP_VALUE_MAX];
+} prop_msg;
+
+#define PROP_MSG_QUIT       0x7fff
+
+#define PROPERTIES          64
+#define ROUNDS              200
+#define WAITERS             4
+#define DRIP_INTERVAL_MS    50
+
+static struct {
+    volatile int serial;
+    int count;
+    struct {
+        char name[PROP_NAME_MAX];
+        char value[PROP_VALUE_MAX];
+    } info[PA_COUNT_MAX];
+} area;
+
+static struct sockaddr_un service_addr;
+static socklen_t service_addr_len;
+static volatile int stopping;
+static int waiter_wakeups;
+static int service_wakeups;
+static long long last_batch_ms;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void klog_write(int level, const char *fmt, ...)
+{
+}
+
+static int futex(volatile int *addr, int op, int val)
+{
+    return syscall(__NR_futex, addr, op, val, NULL, NULL, 0);
+}
+
+static int area_set(const char *name, const char *value)
+{
+    int i;
+
+    for (i = 0; i < area.count; i++) {
+        if (!strcmp(area.info[i].name, name))
+            break;
+    }
+    if (i == area.count) {
+        if (area.count == PA_COUNT_MAX)
+            return -1;
+        strcpy(area.info[area.count++].name, name);
+    }
+    strcpy(area.info[i].value, value);
+    return 0;
+}
+
+static void area_publish(void)
+{
+    __sync_fetch_and_add(&area.serial, 1);
+    futex(&area.serial, FUTEX_WAKE, INT_MAX);
+}
+
+static void *waiter(void *arg)
+{
+    int serial;
+
+    while (!stopping) {
+        serial = area.serial;
+        futex(&area.serial, FUTEX_WAIT, serial);
+        if (area.serial != serial) {
+            pthread_mutex_lock(&stats_lock);
+            waiter_wakeups++;
+            pthread_mutex_unlock(&stats_lock);
+        }
+    }
+    return NULL;
+}
+
+static void handle_batch(int s, prop_msg *hdr)
+{
+    prop_msg msgs[PROPERTY_BATCH_MAX];
+    int results[PROPERTY_BATCH_MAX];
+    long long start = gettime_ms();
+    int count = atoi(hdr->value);
+    int i;
+
+    if (count <= 0 || count > PROPERTY_BATCH_MAX)
+        return;
+    if (recv_full(s, msgs, count * sizeof(prop_msg),
+                  start + PROPERTY_BATCH_TIMEOUT_MS) == 0) {
+        for (i = 0; i < count; i++)
+            results[i] = area_set(msgs[i].name, msgs[i].value);
+        area_publish();
+        send(s, results, count * sizeof(int), MSG_NOSIGNAL);
+    }
+    last_batch_ms = gettime_ms() - start;
+}
+
+static void *service(void *arg)
+{
+    int fd = *(int *) arg;
+    struct pollfd pfd;
+    struct ucred cr;
+    socklen_t cr_size;
+    prop_msg msg;
+    int s, quit = 0;
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    while (!quit) {
+        if (poll(&pfd, 1, -1) <= 0)
+            continue;
+        service_wakeups++;
+        s = accept(fd, NULL, NULL);
+        if (s < 0)
+            continue;
+        cr_size = sizeof(cr);
+        getsockopt(s, SOL_SOCKET, SO_PEERCRED, &cr, &cr_size);
+        if (recv(s, &msg, sizeof(msg), 0) == sizeof(msg)) {
+            msg.name[PROP_NAME_MAX-1] = 0;
+            msg.value[PROP_VALUE_MAX-1] = 0;
+            if (msg.cmd == PROP_MSG_SETPROP) {
+                area_set(msg.name, msg.value);
+                area_publish();
+            } else if (msg.cmd == PROP_MSG_SETPROP_BATCH) {
+                handle_batch(s, &msg);
+            } else if (msg.cmd == PROP_MSG_QUIT) {
+                quit = 1;
+            }
+        }
+        close(s);
+    }
+    return NULL;
+}
+
+static int connect_service(void)
+{
+    int s = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (s >= 0 && connect(s, (struct sockaddr *) &service_addr,
+                          service_addr_len) < 0) {
+        close(s);
+        return -1;
+    }
+    return s;
+}
+
+/* What __system_property_set() does for each property */
+static int set_one(const char *name, const char *value)
+{
+    struct pollfd pfd;
+    prop_msg msg;
+    int s = connect_service();
+
+    if (s < 0)
+        return -1;
+    memset(&msg, 0, sizeof(msg));
+    msg.cmd = PROP_MSG_SETPROP;
+    strcpy(msg.name, name);
+    strcpy(msg.value, value);
+    if (send(s, &msg, sizeof(msg), MSG_NOSIGNAL) != sizeof(msg)) {
+        close(s);
+        return -1;
+    }
+    pfd.fd = s;
+    pfd.events = 0;
+    poll(&pfd, 1, 250);
+    close(s);
+    return 0;
+}
+
+/* What property_set_batch() does */
+static int set_batch(char names[][PROP_NAME_MAX], char values[][PROP_VALUE_MAX],
+                     int count)
+{
+    prop_msg msgs[PROPERTY_BATCH_MAX + 1];
+    int results[PROPERTY_BATCH_MAX];
+    int s, i, len, r;
+
+    memset(msgs, 0, (count + 1) * sizeof(prop_msg));
+    msgs[0].cmd = PROP_MSG_SETPROP_BATCH;
+    snprintf(msgs[0].value, sizeof(msgs[0].value), "%d", count);
+    for (i = 0; i < count; i++) {
+        msgs[i + 1].cmd = PROP_MSG_SETPROP;
+        strcpy(msgs[i + 1].name, names[i]);
+        strcpy(msgs[i + 1].value, values[i]);
+    }
+
+    s = connect_service();
+    if (s < 0)
+        return -1;
+    len = (count + 1) * sizeof(prop_msg);
+    if (send(s, msgs, len, MSG_NOSIGNAL) != len) {
+        close(s);
+        return -1;
+    }
+    len = count * sizeof(int);
+    for (i = 0; i < len; i += r) {
+        r = recv(s, (char *) results + i, len - i, 0);
+        if (r <= 0)
+            break;
+    }
+    close(s);
+    return i == len ? 0 : -1;
+}
+
+static long long now_us(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+static void report(const char *what, long long us, int wakeups, int waits)
+{
+    int n = PROPERTIES * ROUNDS;
+
+    printf("%-8s %6.1f us/property, %.2f service wakeups/property, "
+           "%.2f waiter wakeups/property\n", what, (double) us / n,
+           (double) wakeups / n, (double) waits / (n * WAITERS));
+}
+
+int main(int argc, char *argv[])
+{
+    char names[PROPERTIES][PROP_NAME_MAX];
+    char values[PROPERTIES][PROP_VALUE_MAX];
+    pthread_t service_thread, waiters[WAITERS];
+    prop_msg msg;
+    long long start, single_us, batch_us;
+    int single_wakeups, single_waits;
+    int fd, s, i, round, failures = 0;
+
+    for (i = 0; i < PROPERTIES; i++) {
+        snprintf(names[i], sizeof(names[i]), "bench.prop.%d", i);
+        snprintf(values[i], sizeof(values[i]), "value %d", i);
+    }
+
+    memset(&service_addr, 0, sizeof(service_addr));
+    service_addr.sun_family = AF_UNIX;
+    snprintf(service_addr.sun_path + 1, sizeof(service_addr.sun_path) - 1,
+             "property_batch_bench.%d", getpid());
+    service_addr_len = offsetof(struct sockaddr_un, sun_path) + 1 +
+                       strlen(service_addr.sun_path + 1);
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || bind(fd, (struct sockaddr *) &service_addr, service_addr_len) < 0 ||
+            listen(fd, 8) < 0) {
+        perror("property service socket");
+        return 1;
+    }
+    pthread_create(&service_thread, NULL, service, &fd);
+    for (i = 0; i < WAITERS; i++)
+        pthread_create(&waiters[i], NULL, waiter, NULL);
+
+    start = now_us();
+    for (round = 0; round < ROUNDS; round++) {
+        for (i = 0; i < PROPERTIES; i++) {
+            if (set_one(names[i], values[i]) < 0)
+                failures++;
+        }
+    }
+    single_us = now_us() - start;
+    single_wakeups = service_wakeups;
+    single_waits = waiter_wakeups;
+
+    start = now_us();
+    for (round = 0; round < ROUNDS; round++) {
+        if (set_batch(names, values, PROPERTIES) < 0)
+            failures++;
+    }
+    batch_us = now_us() - start;
+
+    report("single", single_us, single_wakeups, single_waits);
+    report("batched", batch_us, service_wakeups - single_wakeups,
+           waiter_wakeups - single_waits);
+    if (area.count != PROPERTIES) {
+        fprintf(stderr, "area holds %d properties, expected %d\n",
+                area.count, PROPERTIES);
+        failures++;
+    }
+
+    // a batch whose bytes trickle in must still time out as a whole
+    s = connect_service();
+    memset(&msg, 0, sizeof(msg));
+    msg.cmd = PROP_MSG_SETPROP_BATCH;
+    strcpy(msg.value, "4");
+    send(s, &msg, sizeof(msg), MSG_NOSIGNAL);
+    start = gettime_ms();
+    memset(&msg, 0, sizeof(msg));
+    for (i = 0; i < (int) (4 * sizeof(prop_msg)); i++) {
+        if (send(s, &msg, 1, MSG_NOSIGNAL) != 1)
+            break;
+        usleep(DRIP_INTERVAL_MS * 1000);
+    }
+    close(s);
+    printf("trickled batch dropped after %lld ms (%d of %d bytes sent)\n",
+           last_batch_ms, i, (int) (4 * sizeof(prop_msg)));
+    if (last_batch_ms > PROPERTY_BATCH_TIMEOUT_MS + 500) {
+        fprintf(stderr, "trickled batch held the service for %lld ms\n",
+                last_batch_ms);
+        failures++;
+    }
+
+    s = connect_service();
+    msg.cmd = PROP_MSG_QUIT;
+    send(s, &msg, sizeof(msg), MSG_NOSIGNAL);
+    close(s);
+    pthread_join(service_thread, NULL);
+
+    stopping = 1;
+    area_publish();
+    for (i = 0; i < WAITERS; i++)
+        pthread_join(waiters[i], NULL);
+
+    printf("%d failures\n", failures);
+    return failures ? 1 : 0;
+}
@@ -34,11 +34,13 @@
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <sys/select.h>
+#include <sys/poll.h>
 #include <sys/types.h>
 #include <netinet/in.h>
 #include <sys/mman.h>
 #include <sys/atomics.h>
 #include <private/android_filesystem_config.h>
+#include <private/android_property_batch.h>
 
 #ifdef HAVE_SELINUX
 #include <selinux/selinux.h>
@@ -59,6 +61,9 @@ static int property_area_inited = 0;
 
 static int property_set_fd = -1;
 
+/* Set while a batch is applied, so the area serial is bumped only once */
+static int property_batch_active = 0;
+
 /* White list of permissions for setting property services. */
 #ifndef PROPERTY_PERMS
 struct {
@@ -384,8 +389,10 @@ int property_set(const char *name, const char *value)
 
         pa = __system_property_area__;
         update_prop_info(pi, value, valuelen);
-        pa->serial++;
-        __futex_wake(&pa->serial, INT32_MAX);
+        if (!property_batch_active) {
+            pa->serial++;
+            __futex_wake(&pa->serial, INT32_MAX);
+        }
     } else {
         pa = __system_property_area__;
         if(pa->count == PA_COUNT_MAX) return -1;
@@ -399,8 +406,10 @@ int property_set(const char *name, const char *value)
             (namelen << 24) | (((unsigned) pi) - ((unsigned) pa));
 
         pa->count++;
-        pa->serial++;
-        __futex_wake(&pa->serial, INT32_MAX);
+        if (!property_batch_active) {
+            pa->serial++;
+            __futex_wake(&pa->serial, INT32_MAX);
+        }
     }
     /* If name starts with "net." treat as a DNS property. */
     if (strncmp("net.", name, strlen("net.")) == 0)  {
@@ -430,6 +439,72 @@ int property_set(const char *name, const char *value)
     return 0;
 }
 
+/* Applies a batch of properties sent by property_set_batch().  All of the
+ * values are written before the area serial is bumped once, so waiters
+ * wake a single time and see the whole batch.
+ */
+static void handle_property_set_batch(int s, prop_msg *hdr, struct ucred *cr,
+                                      char *source_ctx)
+{
+    prop_msg *msgs;
+    int results[PROPERTY_BATCH_MAX];
+    int count, changed = 0;
+    int i;
+
+    hdr->value[PROP_VALUE_MAX-1] = 0;
+    count = atoi(hdr->value);
+    if (count <= 0 || count > PROPERTY_BATCH_MAX) {
+        ERROR("sys_prop: invalid batch size %d\n", count);
+        return;
+    }
+
+    msgs = malloc(count * sizeof(prop_msg));
+    if (!msgs)
+        return;
+
+    // one budget for the whole batch, so a client trickling bytes cannot
+    // hold up init's main loop for longer than that
+    if (recv_full(s, msgs, count * sizeof(prop_msg),
+                  gettime_ms() + PROPERTY_BATCH_TIMEOUT_MS) < 0) {
+        ERROR("sys_prop: short batch from pid:%d errno: %d\n", cr->pid, errno);
+        free(msgs);
+        return;
+    }
+
+    property_batch_active = 1;
+    for (i = 0; i < count; i++) {
+        prop_msg *msg = &msgs[i];
+
+        msg->name[PROP_NAME_MAX-1] = 0;
+        msg->value[PROP_VALUE_MAX-1] = 0;
+        results[i] = -1;
+
+        if (msg->cmd != PROP_MSG_SETPROP || memcmp(msg->name, "ctl.", 4) == 0) {
+            // ctl.* messages start and stop services and are not batched
+            ERROR("sys_prop: unsupported batch entry [%s] pid:%d\n",
+                  msg->name, cr->pid);
+        } else if (check_perms(msg->name, cr->uid, cr->gid, source_ctx)) {
+            results[i] = property_set((char*) msg->name, (char*) msg->value);
+            if (results[i] == 0)
+                changed = 1;
+        } else {
+            ERROR("sys_prop: permission denied uid:%d  name:%s\n",
+                  cr->uid, msg->name);
+        }
+    }
+    property_batch_active = 0;
+
+    if (changed) {
+        prop_area *pa = __system_property_area__;
+        pa->serial++;
+        __futex_wake(&pa->serial, INT32_MAX);
+    }
+
+    // As for single properties, only reply once everything is in memory.
+    TEMP_FAILURE_RETRY(send(s, results, count * sizeof(int), MSG_NOSIGNAL));
+    free(msgs);
+}
+
 void handle_property_set_fd()
 {
     prop_msg msg;
@@ -499,6 +574,17 @@ void handle_property_set_fd()
 
         break;
 
+    case PROP_MSG_SETPROP_BATCH:
+#ifdef HAVE_SELINUX
+        getpeercon(s, &source_ctx);
+#endif
+        handle_property_set_batch(s, &msg, &cr, source_ctx);
+        close(s);
+#ifdef HAVE_SELINUX
+        freecon(source_ctx);
+#endif
+        break;
+
     default:
         close(s);
         break;
@@ -22,6 +22,8 @@
 #include <ctype.h>
 #include <errno.h>
 #include <time.h>
+#include <limits.h>
+#include <unistd.h>
 
 #ifdef HAVE_SELINUX
 #include <selinux/label.h>
@@ -31,6 +33,8 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <sys/inotify.h>
+#include <poll.h>
 
 /* for ANDROID_SOCKET_* */
 #include <cutils/sockets.h>
@@ -279,6 +283,19 @@ time_t gettime(void)
     return ts.tv_sec;
 }
 
+/*
+ * gettime_ms() - returns the time in milliseconds of the system's monotonic
+ * clock or zero on error.
+ */
+long long gettime_ms(void)
+{
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0)
+        return 0;
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
 int mkdir_recursive(const char *pathname, mode_t mode)
 {
     char buf[128];
@@ -357,14 +374,134 @@ void remove_link(const char *oldpath, const char *newpath)
         unlink(newpath);
 }
 
+/* Receives exactly len bytes, giving up if they have not all arrived by
+ * deadline (in gettime_ms() time), however the client paces them.
+ */
+int recv_full(int s, void *buf, int len, long long deadline)
+{
+    struct pollfd pfd;
+    char *p = buf;
+    long long remaining;
+    int r;
+
+    pfd.fd = s;
+    pfd.events = POLLIN;
+    while (len > 0) {
+        remaining = deadline - gettime_ms();
+        if (remaining <= 0) {
+            errno = ETIMEDOUT;
+            return -1;
+        }
+        pfd.revents = 0;
+        r = TEMP_FAILURE_RETRY(poll(&pfd, 1, remaining));
+        if (r <= 0) {
+            if (r == 0)
+                errno = ETIMEDOUT;
+            return -1;
+        }
+        r = TEMP_FAILURE_RETRY(recv(s, p, len, 0));
+        if (r <= 0)
+            return -1;
+        p += r;
+        len -= r;
+    }
+    return 0;
+}
+
+/*
+ * Watches the deepest existing ancestor directory of filename for new
+ * entries.  Returns the watch descriptor, or -1 if there is nothing to watch.
+ */
+static int watch_parent(int ifd, const char *filename)
+{
+    char dir[PATH_MAX];
+    char *slash;
+    struct stat info;
+
+    if (strlcpy(dir, filename, sizeof(dir)) >= sizeof(dir))
+        return -1;
+
+    while ((slash = strrchr(dir, '/')) != NULL) {
+        if (slash == dir)
+            slash[1] = 0;
+        else
+            *slash = 0;
+        if (stat(dir, &info) == 0 && S_ISDIR(info.st_mode))
+            return inotify_add_watch(ifd, dir, IN_CREATE | IN_MOVED_TO);
+        if (slash == dir)
+            break;
+    }
+    return -1;
+}
+
+/*
+ * wait_for_file - waits up to timeout seconds for filename to appear.
+ * Rather than polling, sleeps on inotify events for the nearest existing
+ * parent directory, moving down the path as intermediate directories
+ * are created.
+ *
+ * The inotify instance and its last watch are kept for the next call:
+ * closing the instance, and on older kernels removing a watch, waits for an
+ * RCU grace period, which would otherwise delay every wakeup by several ms.
+ */
+static int wait_ifd = -1;
+static int wait_wd = -1;
+
 int wait_for_file(const char *filename, int timeout)
 {
     struct stat info;
-    time_t timeout_time = gettime() + timeout;
-    int ret = -1;
+    long long timeout_time = gettime_ms() + timeout * 1000LL;
+    long long remaining;
+    struct pollfd pfd;
+    char events[512];
+    int wd;
+    int ret;
+
+    if ((ret = stat(filename, &info)) == 0)
+        return 0;
+
+    if (wait_ifd < 0) {
+        wait_ifd = inotify_init();
+        if (wait_ifd >= 0) {
+            fcntl(wait_ifd, F_SETFD, FD_CLOEXEC);
+            fcntl(wait_ifd, F_SETFL, O_NONBLOCK);
+        }
+    }
+    if (wait_ifd < 0) {
+        while (gettime_ms() < timeout_time && ((ret = stat(filename, &info)) < 0))
+            usleep(10000);
+        return ret;
+    }
+
+    pfd.fd = wait_ifd;
+    pfd.events = POLLIN;
+    for (;;) {
+        /* drop the events seen so far, and any left from an earlier call */
+        while (read(wait_ifd, events, sizeof(events)) > 0)
+            ;
+
+        wd = watch_parent(wait_ifd, filename);
+        if (wait_wd >= 0 && wd != wait_wd)
+            inotify_rm_watch(wait_ifd, wait_wd);
+        wait_wd = wd;
+
+        /* re-check now that the watch is in place to close the race */
+        if ((ret = stat(filename, &info)) == 0)
+            break;
+
+        remaining = timeout_time - gettime_ms();
+        if (remaining <= 0)
+            break;
 
-    while (gettime() < timeout_time && ((ret = stat(filename, &info)) < 0))
-        usleep(10000);
+        if (wd < 0) {
+            /* nothing to watch, fall back to a short nap */
+            usleep(10000);
+            continue;
+        }
+
+        pfd.revents = 0;
+        poll(&pfd, 1, remaining);
+    }
 
     return ret;
 }
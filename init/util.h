@@ -29,6 +29,8 @@ int create_socket(const char *name, int type, mode_t perm,
                   uid_t uid, gid_t gid);
 void *read_file(const char *fn, unsigned *_sz);
 time_t gettime(void);
+long long gettime_ms(void);
+int recv_full(int s, void *buf, int len, long long deadline);
 unsigned int decode_uid(const char *s);
 
 int mkdir_recursive(const char *pathname, mode_t mode);
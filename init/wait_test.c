@@ -0,0 +1,235 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Checks that wait_for_file() and property_wait_for_value() sleep until the
+ * event they wait for rather than polling, and wake promptly when it comes.
+ *
+ * The waits run on the main thread while a second thread makes the change
+ * after a delay.  Each case reports how long after the change the wait
+ * returned, and how often the waiting thread was scheduled out meanwhile
+ * (voluntary context switches, from getrusage(RUSAGE_THREAD)): a 10 ms poll
+ * sleeps about WAIT_MS / 10 times, a wait on inotify or the property serial
+ * futex only a few.  Property waits also wake for unrelated property
+ * changes, so run this on an otherwise quiet device.  Needs root to set
+ * properties.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <cutils/properties.h>
+
+#include "util.h"
+
+#define WAIT_MS         500
+#define STEP_MS         50
+#define MAX_LATENCY_MS  20
+#define MAX_SWITCHES    8
+
+#define TEST_PROP       "debug.init_wait_test"
+
+enum change {
+    CREATE_FILE,
+    CREATE_PATH,
+    RENAME_FILE,
+    NO_FILE,
+    SET_PROPERTY,
+    SET_PROPERTIES,
+    NO_PROPERTY,
+};
+
+static char dir[PATH_MAX];
+static char path[PATH_MAX];
+
+struct waker {
+    enum change change;
+    long long changed_ms;
+};
+
+static void create(const char *fn)
+{
+    int fd = open(fn, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+
+    if (fd < 0) {
+        fprintf(stderr, "cannot create %s: %s\n", fn, strerror(errno));
+        exit(1);
+    }
+    close(fd);
+}
+
+static void *make_change(void *arg)
+{
+    struct waker *w = arg;
+    char tmp[PATH_MAX];
+
+    usleep(WAIT_MS * 1000);
+    switch (w->change) {
+    case CREATE_FILE:
+        w->changed_ms = gettime_ms();
+        create(path);
+        break;
+    case CREATE_PATH:
+        /* the wait has to follow the path down as it appears */
+        snprintf(tmp, sizeof(tmp), "%s/a", dir);
+        mkdir(tmp, 0700);
+        usleep(STEP_MS * 1000);
+        snprintf(tmp, sizeof(tmp), "%s/a/b", dir);
+        mkdir(tmp, 0700);
+        usleep(STEP_MS * 1000);
+        w->changed_ms = gettime_ms();
+        create(path);
+        break;
+    case RENAME_FILE:
+        snprintf(tmp, sizeof(tmp), "%s/tmp", dir);
+        create(tmp);
+        w->changed_ms = gettime_ms();
+        rename(tmp, path);
+        break;
+    case SET_PROPERTY:
+        w->changed_ms = gettime_ms();
+        property_set(TEST_PROP, "done");
+        break;
+    case SET_PROPERTIES:
+        /* each value wakes the waiter, which has to go back to sleep */
+        property_set(TEST_PROP, "one");
+        usleep(STEP_MS * 1000);
+        property_set(TEST_PROP, "two");
+        usleep(STEP_MS * 1000);
+        w->changed_ms = gettime_ms();
+        property_set(TEST_PROP, "done");
+        break;
+    default:
+        break;
+    }
+    return NULL;
+}
+
+static long thread_switches(void)
+{
+    struct rusage ru;
+
+    getrusage(RUSAGE_THREAD, &ru);
+    return ru.ru_nvcsw;
+}
+
+static void cleanup(void)
+{
+    char tmp[PATH_MAX];
+
+    snprintf(tmp, sizeof(tmp), "%s/file", dir);
+    unlink(tmp);
+    snprintf(tmp, sizeof(tmp), "%s/a/b/file", dir);
+    unlink(tmp);
+    snprintf(tmp, sizeof(tmp), "%s/a/b", dir);
+    rmdir(tmp);
+    snprintf(tmp, sizeof(tmp), "%s/a", dir);
+    rmdir(tmp);
+}
+
+/* Runs one wait, with the change made by another thread unless it is NO_* */
+static int run(const char *name, enum change change)
+{
+    struct waker w;
+    pthread_t thread;
+    long long start, end, latency;
+    long switches;
+    int ret, failures = 0;
+    int is_file = change <= NO_FILE;
+    int changes = change != NO_FILE && change != NO_PROPERTY;
+
+    cleanup();
+    if (!is_file)
+        property_set(TEST_PROP, "");
+    snprintf(path, sizeof(path), change == CREATE_PATH ? "%s/a/b/file" : "%s/file",
+             dir);
+    w.change = change;
+    w.changed_ms = 0;
+    if (changes)
+        pthread_create(&thread, NULL, make_change, &w);
+
+    switches = thread_switches();
+    start = gettime_ms();
+    if (is_file)
+        ret = wait_for_file(path, changes ? 10 : 1);    /* in seconds */
+    else
+        ret = property_wait_for_value(TEST_PROP, "done", changes ? 10000 : WAIT_MS);
+    end = gettime_ms();
+    switches = thread_switches() - switches;
+
+    if (changes) {
+        pthread_join(thread, NULL);
+        latency = end - w.changed_ms;
+        printf("%-22s woke %3lld ms after the change, %2ld context switches\n",
+               name, latency, switches);
+        if (ret != 0) {
+            fprintf(stderr, "%s: wait failed\n", name);
+            failures++;
+        } else if (latency > MAX_LATENCY_MS) {
+            fprintf(stderr, "%s: woke %lld ms late\n", name, latency);
+            failures++;
+        }
+    } else {
+        printf("%-22s gave up after %4lld ms, %2ld context switches\n",
+               name, end - start, switches);
+        if (ret == 0) {
+            fprintf(stderr, "%s: wait did not time out\n", name);
+            failures++;
+        }
+    }
+    if (switches > MAX_SWITCHES) {
+        fprintf(stderr, "%s: waiter woke %ld times, it is polling\n", name, switches);
+        failures++;
+    }
+    return failures;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *base = getenv("TMPDIR");
+    int failures = 0;
+
+    if (!base)
+        base = "/data/local/tmp";
+    snprintf(dir, sizeof(dir), "%s/init_wait_test.%d", base, getpid());
+    if (mkdir(dir, 0700) < 0) {
+        fprintf(stderr, "cannot create %s: %s\n", dir, strerror(errno));
+        return 1;
+    }
+
+    failures += run("file created", CREATE_FILE);
+    failures += run("path created", CREATE_PATH);
+    failures += run("file renamed", RENAME_FILE);
+    failures += run("no file", NO_FILE);
+    failures += run("property set", SET_PROPERTY);
+    failures += run("property set 3 times", SET_PROPERTIES);
+    failures += run("no property", NO_PROPERTY);
+
+    cleanup();
+    rmdir(dir);
+    printf("%d failures\n", failures);
+    return failures ? 1 : 0;
+}
@@ -66,6 +66,23 @@ LOCAL_MODULE := libcorkscrew_test
 LOCAL_MODULE_TAGS := optional
 include $(BUILD_EXECUTABLE)
 
+# Build unwinding tests, with and without frame pointers.
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := unwind_test.c
+LOCAL_CFLAGS += -std=gnu99 -Werror -fno-omit-frame-pointer
+LOCAL_SHARED_LIBRARIES := libcorkscrew
+LOCAL_MODULE := libcorkscrew_unwind_test
+LOCAL_MODULE_TAGS := optional tests
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := unwind_test.c
+LOCAL_CFLAGS += -std=gnu99 -Werror -fomit-frame-pointer
+LOCAL_SHARED_LIBRARIES := libcorkscrew
+LOCAL_MODULE := libcorkscrew_unwind_test_nofp
+LOCAL_MODULE_TAGS := optional tests
+include $(BUILD_EXECUTABLE)
+
 
 ifeq ($(HOST_OS)-$(HOST_ARCH),linux-x86)
 
@@ -90,4 +107,23 @@ LOCAL_MODULE := libcorkscrew_test
 LOCAL_MODULE_TAGS := optional
 include $(BUILD_HOST_EXECUTABLE)
 
+# Build unwinding tests, with and without frame pointers.
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := unwind_test.c
+LOCAL_CFLAGS += -std=gnu99 -Werror -fno-omit-frame-pointer
+LOCAL_SHARED_LIBRARIES := libcorkscrew
+LOCAL_LDLIBS += -lpthread -lrt
+LOCAL_MODULE := libcorkscrew_unwind_test
+LOCAL_MODULE_TAGS := optional
+include $(BUILD_HOST_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := unwind_test.c
+LOCAL_CFLAGS += -std=gnu99 -Werror -fomit-frame-pointer
+LOCAL_SHARED_LIBRARIES := libcorkscrew
+LOCAL_LDLIBS += -lpthread -lrt
+LOCAL_MODULE := libcorkscrew_unwind_test_nofp
+LOCAL_MODULE_TAGS := optional
+include $(BUILD_HOST_EXECUTABLE)
+
 endif # linux-x86
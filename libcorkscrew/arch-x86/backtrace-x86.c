@@ -16,6 +16,23 @@
 
 /*
  * Backtracing functions for x86.
+ *
+ * Frames are unwound using the DWARF call frame information (CFI) that the
+ * compiler emits into the .eh_frame section.  For every instruction of a
+ * function it describes how to compute the canonical frame address (CFA, the
+ * value of esp before the call) and where the caller's registers were saved,
+ * so it works whether or not the code keeps a frame pointer.
+ *
+ * The frame description entry (FDE) that covers a given program counter is
+ * found by binary searching the table in the .eh_frame_hdr section, which
+ * is located through the PT_GNU_EH_FRAME program header of the module.
+ * When unwinding another process using ptrace(), a copy of that table is
+ * kept with each map of the ptrace_context_t so that a lookup does not cost
+ * a system call per probe.  The common information entries (CIE) that FDEs
+ * refer to are parsed once per unwind and shared by all frames using them.
+ *
+ * Frames without call frame information, such as hand-written assembly,
+ * are unwound by following the ebp frame pointer chain as before.
  */
 
 #define LOG_TAG "Corkscrew"
@@ -23,13 +40,18 @@
 
 #include "../backtrace-arch.h"
 #include "../backtrace-helper.h"
+#include "../ptrace-arch.h"
+#include "dwarf.h"
 #include <corkscrew/ptrace.h>
 
 #include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
 #include <signal.h>
 #include <stdbool.h>
 #include <limits.h>
 #include <errno.h>
+#include <elf.h>
 #include <sys/ptrace.h>
 #include <cutils/log.h>
 
@@ -80,41 +102,885 @@ typedef struct ucontext {
 
 #endif /* __ BIONIC__ */
 
+#ifndef PT_GNU_EH_FRAME
+#define PT_GNU_EH_FRAME 0x6474e550
+#endif
+
+static const uint32_t ELF_MAGIC = 0x464C457f; // "ELF\0177"
+
+/* Maximum number of modules and CIEs remembered during one unwind. */
+#define FDE_TABLE_CACHE_SIZE 8
+#define CIE_CACHE_SIZE 8
+
+/* Maximum nesting of DW_CFA_remember_state. */
+#define MAX_REMEMBERED_STATES 8
+
 /* Unwind state. */
 typedef struct {
-    uint32_t ebp;
-    uint32_t eip;
-    uint32_t esp;
+    uint32_t regs[DWARF_REGS];
 } unwind_state_t;
 
+/* How to recover a register of the caller. */
+enum {
+    RULE_SAME_VALUE = 0,    // unchanged, the default for callee-saved registers
+    RULE_UNDEFINED,         // not recoverable; for the return address, the outermost frame
+    RULE_OFFSET,            // saved at CFA + value
+    RULE_VAL_OFFSET,        // is CFA + value
+    RULE_REGISTER,          // saved in register value
+    RULE_UNSUPPORTED,       // described by a DWARF expression, which we don't evaluate
+};
+
+typedef struct {
+    uint8_t rule;
+    int32_t value;
+} reg_rule_t;
+
+/* A row of the call frame information table. */
+typedef struct {
+    bool cfa_valid;
+    uint32_t cfa_reg;
+    int32_t cfa_offset;
+    reg_rule_t regs[DWARF_REGS];
+} cfi_row_t;
+
+/* Parsed common information entry. */
+typedef struct {
+    uintptr_t cie;          // address of the CIE, or 0 if the slot is unused
+    uint32_t code_align;
+    int32_t data_align;
+    uint32_t ra_reg;
+    uint8_t fde_encoding;
+    bool has_augmentation_data;
+    bool signal_frame;
+    cfi_row_t initial_row;  // the row after running the initial instructions
+} cie_info_t;
+
+/* Where to find the FDEs for the code in a map. */
+typedef struct {
+    const map_info_t* mi;   // NULL if the slot is unused
+    uintptr_t eh_frame_hdr;
+    uintptr_t table;        // .eh_frame_hdr search table, if there is no index
+    size_t fde_count;
+    const fde_index_entry_t* fde_index;
+} fde_table_t;
+
+/* Reads a stream of bytes, such as call frame instructions.  Local memory
+ * is read directly once the map containing it is known to be readable;
+ * remote memory is read a word at a time. */
+typedef struct {
+    const memory_t* memory;
+    uintptr_t ptr;
+    const map_info_t* mi;
+    uintptr_t word_ptr;
+    uint32_t word;
+} byte_stream_t;
+
+typedef struct {
+    const memory_t* memory;
+    const map_info_t* map_info_list;
+    byte_stream_t stack;
+    fde_table_t fde_tables[FDE_TABLE_CACHE_SIZE];
+    size_t next_fde_table;
+    cie_info_t cies[CIE_CACHE_SIZE];
+    size_t next_cie;
+} unwind_context_t;
+
+static void init_byte_stream(byte_stream_t* stream, const memory_t* memory, uintptr_t ptr) {
+    stream->memory = memory;
+    stream->ptr = ptr;
+    stream->mi = NULL;
+    stream->word_ptr = 1; // never word aligned, so nothing is cached yet
+    stream->word = 0;
+}
+
+static bool try_next_byte(byte_stream_t* stream, uint8_t* out_value) {
+    uintptr_t ptr = stream->ptr;
+    if (stream->memory->tid < 0) {
+        if (!stream->mi || ptr < stream->mi->start || ptr >= stream->mi->end) {
+            stream->mi = find_map_info(stream->memory->map_info_list, ptr);
+            if (!stream->mi || !stream->mi->is_readable) {
+                ALOGV("try_next_byte: pointer 0x%08x not in a readable map", ptr);
+                stream->mi = NULL;
+                *out_value = 0;
+                return false;
+            }
+        }
+        *out_value = *(const uint8_t*)ptr;
+    } else {
+        uintptr_t word_ptr = ptr & ~3;
+        if (word_ptr != stream->word_ptr) {
+            if (!try_get_word(stream->memory, word_ptr, &stream->word)) {
+                *out_value = 0;
+                return false;
+            }
+            stream->word_ptr = word_ptr;
+        }
+        *out_value = stream->word >> ((ptr & 3) * 8);
+    }
+    stream->ptr = ptr + 1;
+    return true;
+}
+
+/* Reads a little-endian value of up to four bytes. */
+static bool try_next_bytes(byte_stream_t* stream, size_t count, uint32_t* out_value) {
+    uint32_t value = 0;
+    for (size_t i = 0; i < count; i++) {
+        uint8_t byte;
+        if (!try_next_byte(stream, &byte)) {
+            return false;
+        }
+        value |= (uint32_t)byte << (i * 8);
+    }
+    *out_value = value;
+    return true;
+}
+
+static bool try_get_stream_word(byte_stream_t* stream, uintptr_t ptr, uint32_t* out_value) {
+    stream->ptr = ptr;
+    return try_next_bytes(stream, 4, out_value);
+}
+
+static bool try_next_uleb128(byte_stream_t* stream, uint32_t* out_value) {
+    uint32_t value = 0;
+    uint32_t shift = 0;
+    uint8_t byte;
+    do {
+        if (!try_next_byte(stream, &byte)) {
+            return false;
+        }
+        if (shift < 32) {
+            value |= (uint32_t)(byte & 0x7f) << shift;
+        }
+        shift += 7;
+    } while (byte & 0x80);
+    *out_value = value;
+    return true;
+}
+
+static bool try_next_sleb128(byte_stream_t* stream, int32_t* out_value) {
+    uint32_t value = 0;
+    uint32_t shift = 0;
+    uint8_t byte;
+    do {
+        if (!try_next_byte(stream, &byte)) {
+            return false;
+        }
+        if (shift < 32) {
+            value |= (uint32_t)(byte & 0x7f) << shift;
+        }
+        shift += 7;
+    } while (byte & 0x80);
+    if (shift < 32 && (byte & 0x40)) {
+        value |= ~0U << shift;
+    }
+    *out_value = (int32_t)value;
+    return true;
+}
+
+/* Reads a pointer encoded as described by a DW_EH_PE_* value.  Data relative
+ * pointers are only supported when a data_base is given. */
+static bool try_next_encoded(byte_stream_t* stream, uint8_t encoding, uintptr_t data_base,
+        uintptr_t* out_value) {
+    uintptr_t place = stream->ptr;
+    uint32_t value;
+    int32_t svalue;
+    switch (encoding & 0x0f) {
+    case DW_EH_PE_absptr:
+    case DW_EH_PE_udata4:
+    case DW_EH_PE_sdata4:
+        if (!try_next_bytes(stream, 4, &value)) {
+            return false;
+        }
+        break;
+    case DW_EH_PE_udata2:
+        if (!try_next_bytes(stream, 2, &value)) {
+            return false;
+        }
+        break;
+    case DW_EH_PE_sdata2:
+        if (!try_next_bytes(stream, 2, &value)) {
+            return false;
+        }
+        value = (int16_t)value;
+        break;
+    case DW_EH_PE_udata8:
+    case DW_EH_PE_sdata8: {
+        // Addresses are 32 bits wide, so the high word is ignored.
+        uint32_t high;
+        if (!try_next_bytes(stream, 4, &value) || !try_next_bytes(stream, 4, &high)) {
+            return false;
+        }
+        break;
+    }
+    case DW_EH_PE_uleb128:
+        if (!try_next_uleb128(stream, &value)) {
+            return false;
+        }
+        break;
+    case DW_EH_PE_sleb128:
+        if (!try_next_sleb128(stream, &svalue)) {
+            return false;
+        }
+        value = svalue;
+        break;
+    default:
+        ALOGV("try_next_encoded: unsupported encoding 0x%02x", encoding);
+        return false;
+    }
+
+    switch (encoding & 0x70) {
+    case 0:
+        break;
+    case DW_EH_PE_pcrel:
+        value += place;
+        break;
+    case DW_EH_PE_datarel:
+        if (!data_base) {
+            return false;
+        }
+        value += data_base;
+        break;
+    default:
+        ALOGV("try_next_encoded: unsupported encoding 0x%02x", encoding);
+        return false;
+    }
+
+    if ((encoding & DW_EH_PE_indirect)
+            && !try_get_word(stream->memory, value, &value)) {
+        return false;
+    }
+    *out_value = value;
+    return true;
+}
+
+uintptr_t find_eh_frame_hdr(const memory_t* memory, uintptr_t elf_start) {
+    byte_stream_t stream;
+    init_byte_stream(&stream, memory, elf_start);
+
+    uint32_t elf_magic;
+    uint32_t elf_phoff;
+    uint32_t elf_phentsize_ehsize;
+    uint32_t elf_shentsize_phnum;
+    if (!try_get_stream_word(&stream, elf_start, &elf_magic)
+            || elf_magic != ELF_MAGIC
+            || !try_get_stream_word(&stream, elf_start + offsetof(Elf32_Ehdr, e_phoff),
+                    &elf_phoff)
+            || !try_get_stream_word(&stream, elf_start + offsetof(Elf32_Ehdr, e_ehsize),
+                    &elf_phentsize_ehsize)
+            || !try_get_stream_word(&stream, elf_start + offsetof(Elf32_Ehdr, e_phnum),
+                    &elf_shentsize_phnum)) {
+        return 0;
+    }
+
+    // The ELF header is at the start of the first loadable segment, which
+    // tells us how far the module has been moved from its link address.
+    uint32_t elf_phentsize = elf_phentsize_ehsize >> 16;
+    uint32_t elf_phnum = elf_shentsize_phnum & 0xffff;
+    bool have_load_bias = false;
+    uintptr_t load_bias = 0;
+    uintptr_t eh_frame_hdr_vaddr = 0;
+    for (uint32_t i = 0; i < elf_phnum; i++) {
+        uintptr_t elf_phdr = elf_start + elf_phoff + i * elf_phentsize;
+        uint32_t elf_phdr_type;
+        uint32_t elf_phdr_offset;
+        uint32_t elf_phdr_vaddr;
+        if (!try_get_stream_word(&stream, elf_phdr + offsetof(Elf32_Phdr, p_type),
+                        &elf_phdr_type)
+                || !try_get_stream_word(&stream, elf_phdr + offsetof(Elf32_Phdr, p_offset),
+                        &elf_phdr_offset)
+                || !try_get_stream_word(&stream, elf_phdr + offsetof(Elf32_Phdr, p_vaddr),
+                        &elf_phdr_vaddr)) {
+            return 0;
+        }
+        if (elf_phdr_type == PT_LOAD && !have_load_bias) {
+            load_bias = elf_start - (elf_phdr_vaddr - elf_phdr_offset);
+            have_load_bias = true;
+        } else if (elf_phdr_type == PT_GNU_EH_FRAME) {
+            eh_frame_hdr_vaddr = elf_phdr_vaddr;
+        }
+    }
+    if (!have_load_bias || !eh_frame_hdr_vaddr) {
+        return 0;
+    }
+    ALOGV("find_eh_frame_hdr: elf_start=0x%08x, eh_frame_hdr=0x%08x",
+            elf_start, load_bias + eh_frame_hdr_vaddr);
+    return load_bias + eh_frame_hdr_vaddr;
+}
+
+bool parse_eh_frame_hdr(const memory_t* memory, uintptr_t eh_frame_hdr,
+        uintptr_t* out_table, size_t* out_fde_count) {
+    byte_stream_t stream;
+    init_byte_stream(&stream, memory, eh_frame_hdr);
+
+    uint8_t version;
+    uint8_t eh_frame_ptr_encoding;
+    uint8_t fde_count_encoding;
+    uint8_t table_encoding;
+    uintptr_t eh_frame;
+    uintptr_t fde_count;
+    if (!try_next_byte(&stream, &version)
+            || !try_next_byte(&stream, &eh_frame_ptr_encoding)
+            || !try_next_byte(&stream, &fde_count_encoding)
+            || !try_next_byte(&stream, &table_encoding)
+            || version != 1
+            || !try_next_encoded(&stream, eh_frame_ptr_encoding, eh_frame_hdr, &eh_frame)
+            || !try_next_encoded(&stream, fde_count_encoding, eh_frame_hdr, &fde_count)) {
+        ALOGV("parse_eh_frame_hdr: cannot parse header at 0x%08x", eh_frame_hdr);
+        return false;
+    }
+
+    // The table is only searchable if all of its entries have the same size.
+    if (table_encoding != (DW_EH_PE_datarel | DW_EH_PE_sdata4) || (stream.ptr & 3)) {
+        ALOGV("parse_eh_frame_hdr: unsupported table encoding 0x%02x", table_encoding);
+        return false;
+    }
+    *out_table = stream.ptr;
+    *out_fde_count = fde_count;
+    return true;
+}
+
+static const fde_table_t* get_fde_table(unwind_context_t* context, uintptr_t pc) {
+    for (size_t i = 0; i < FDE_TABLE_CACHE_SIZE; i++) {
+        const fde_table_t* table = &context->fde_tables[i];
+        if (table->mi && pc >= table->mi->start && pc < table->mi->end) {
+            return table;
+        }
+    }
+
+    const map_info_t* mi = find_map_info(context->map_info_list, pc);
+    if (!mi) {
+        return NULL;
+    }
+
+    fde_table_t* table = &context->fde_tables[context->next_fde_table++ % FDE_TABLE_CACHE_SIZE];
+    memset(table, 0, sizeof(*table));
+    table->mi = mi;
+    if (context->memory->tid < 0) {
+        table->eh_frame_hdr = find_eh_frame_hdr(context->memory, mi->start);
+    } else if (mi->data) {
+        const map_info_data_t* data = (const map_info_data_t*)mi->data;
+        table->eh_frame_hdr = data->eh_frame_hdr;
+        table->fde_index = data->fde_index;
+        table->fde_count = data->fde_count;
+    }
+    if (table->eh_frame_hdr && !table->fde_index) {
+        if (!parse_eh_frame_hdr(context->memory, table->eh_frame_hdr,
+                &table->table, &table->fde_count)) {
+            table->fde_count = 0;
+        } else if (context->memory->tid < 0) {
+            // Make sure the whole table can be read directly.
+            const map_info_t* table_mi = find_map_info(context->map_info_list, table->table);
+            if (!table_mi || !table_mi->is_readable
+                    || table->fde_count > (table_mi->end - table->table) / 8) {
+                table->fde_count = 0;
+            }
+        }
+    }
+    ALOGV("get_fde_table: module='%s', eh_frame_hdr=0x%08x, fde_count=%d, indexed=%d",
+            mi->name, table->eh_frame_hdr, table->fde_count, table->fde_index != NULL);
+    return table;
+}
+
+/* Finds the FDE whose range may contain pc: the last entry of the table
+ * that starts at or before it. */
+static uintptr_t find_fde(unwind_context_t* context, uintptr_t pc) {
+    const fde_table_t* table = get_fde_table(context, pc);
+    if (!table) {
+        return 0;
+    }
+
+    uintptr_t fde = 0;
+    size_t low = 0;
+    size_t high = table->fde_count;
+    while (low < high) {
+        size_t index = low + (high - low) / 2;
+        uintptr_t entry_pc;
+        uintptr_t entry_fde;
+        if (table->fde_index) {
+            entry_pc = table->fde_index[index].pc;
+            entry_fde = table->fde_index[index].fde;
+        } else if (context->memory->tid < 0) {
+            const int32_t* entry = (const int32_t*)(table->table + index * 8);
+            entry_pc = table->eh_frame_hdr + entry[0];
+            entry_fde = table->eh_frame_hdr + entry[1];
+        } else {
+            uint32_t entry_prel_pc;
+            uint32_t entry_prel_fde;
+            if (!try_get_word(context->memory, table->table + index * 8, &entry_prel_pc)
+                    || !try_get_word(context->memory, table->table + index * 8 + 4,
+                            &entry_prel_fde)) {
+                return 0;
+            }
+            entry_pc = table->eh_frame_hdr + entry_prel_pc;
+            entry_fde = table->eh_frame_hdr + entry_prel_fde;
+        }
+        if (pc < entry_pc) {
+            high = index;
+        } else {
+            fde = entry_fde;
+            low = index + 1;
+        }
+    }
+    return fde;
+}
+
+static void set_reg_rule(cfi_row_t* row, uint32_t reg, uint8_t rule, int32_t value) {
+    if (reg < DWARF_REGS) {
+        row->regs[reg].rule = rule;
+        row->regs[reg].value = value;
+    }
+}
+
+/* Runs call frame instructions up to the row that applies to pc.  The
+ * initial row is NULL while running the CIE's own initial instructions. */
+static bool execute_cfa_program(byte_stream_t* stream, uintptr_t end,
+        const cie_info_t* cie, const cfi_row_t* initial_row,
+        uintptr_t loc, uintptr_t pc, cfi_row_t* row) {
+    cfi_row_t remembered[MAX_REMEMBERED_STATES];
+    size_t remembered_count = 0;
+
+    while (stream->ptr < end) {
+        uint8_t op;
+        uint32_t reg;
+        uint32_t operand;
+        int32_t soperand;
+        uint32_t delta;
+        if (!try_next_byte(stream, &op)) {
+            return false;
+        }
+
+        switch (op & 0xc0) {
+        case DW_CFA_advance_loc:
+            loc += (op & 0x3f) * cie->code_align;
+            if (loc > pc) {
+                return true;
+            }
+            continue;
+        case DW_CFA_offset:
+            if (!try_next_uleb128(stream, &operand)) {
+                return false;
+            }
+            set_reg_rule(row, op & 0x3f, RULE_OFFSET, operand * cie->data_align);
+            continue;
+        case DW_CFA_restore:
+            reg = op & 0x3f;
+            if (reg < DWARF_REGS) {
+                row->regs[reg] = initial_row ? initial_row->regs[reg] : (reg_rule_t){0, 0};
+            }
+            continue;
+        }
+
+        switch (op) {
+        case DW_CFA_nop:
+            break;
+        case DW_CFA_set_loc:
+            if (!try_next_encoded(stream, cie->fde_encoding, 0, &loc)) {
+                return false;
+            }
+            if (loc > pc) {
+                return true;
+            }
+            break;
+        case DW_CFA_advance_loc1:
+        case DW_CFA_advance_loc2:
+        case DW_CFA_advance_loc4:
+            if (!try_next_bytes(stream, op == DW_CFA_advance_loc1 ? 1
+                    : op == DW_CFA_advance_loc2 ? 2 : 4, &delta)) {
+                return false;
+            }
+            loc += delta * cie->code_align;
+            if (loc > pc) {
+                return true;
+            }
+            break;
+        case DW_CFA_offset_extended:
+        case DW_CFA_val_offset:
+        case DW_CFA_GNU_negative_offset_extended:
+            if (!try_next_uleb128(stream, &reg) || !try_next_uleb128(stream, &operand)) {
+                return false;
+            }
+            set_reg_rule(row, reg, op == DW_CFA_val_offset ? RULE_VAL_OFFSET : RULE_OFFSET,
+                    (op == DW_CFA_GNU_negative_offset_extended ? -1 : 1)
+                            * (int32_t)operand * cie->data_align);
+            break;
+        case DW_CFA_offset_extended_sf:
+        case DW_CFA_val_offset_sf:
+            if (!try_next_uleb128(stream, &reg) || !try_next_sleb128(stream, &soperand)) {
+                return false;
+            }
+            set_reg_rule(row, reg, op == DW_CFA_val_offset_sf ? RULE_VAL_OFFSET : RULE_OFFSET,
+                    soperand * cie->data_align);
+            break;
+        case DW_CFA_restore_extended:
+            if (!try_next_uleb128(stream, &reg)) {
+                return false;
+            }
+            if (reg < DWARF_REGS) {
+                row->regs[reg] = initial_row ? initial_row->regs[reg] : (reg_rule_t){0, 0};
+            }
+            break;
+        case DW_CFA_undefined:
+        case DW_CFA_same_value:
+            if (!try_next_uleb128(stream, &reg)) {
+                return false;
+            }
+            set_reg_rule(row, reg, op == DW_CFA_undefined ? RULE_UNDEFINED : RULE_SAME_VALUE, 0);
+            break;
+        case DW_CFA_register:
+            if (!try_next_uleb128(stream, &reg) || !try_next_uleb128(stream, &operand)) {
+                return false;
+            }
+            set_reg_rule(row, reg, RULE_REGISTER, operand);
+            break;
+        case DW_CFA_remember_state:
+            if (remembered_count == MAX_REMEMBERED_STATES) {
+                ALOGV("execute_cfa_program: too many remembered states");
+                return false;
+            }
+            remembered[remembered_count++] = *row;
+            break;
+        case DW_CFA_restore_state:
+            if (!remembered_count) {
+                return false;
+            }
+            *row = remembered[--remembered_count];
+            break;
+        case DW_CFA_def_cfa:
+            if (!try_next_uleb128(stream, &reg) || !try_next_uleb128(stream, &operand)) {
+                return false;
+            }
+            row->cfa_valid = true;
+            row->cfa_reg = reg;
+            row->cfa_offset = operand;
+            break;
+        case DW_CFA_def_cfa_sf:
+            if (!try_next_uleb128(stream, &reg) || !try_next_sleb128(stream, &soperand)) {
+                return false;
+            }
+            row->cfa_valid = true;
+            row->cfa_reg = reg;
+            row->cfa_offset = soperand * cie->data_align;
+            break;
+        case DW_CFA_def_cfa_register:
+            if (!try_next_uleb128(stream, &reg)) {
+                return false;
+            }
+            row->cfa_reg = reg;
+            break;
+        case DW_CFA_def_cfa_offset:
+            if (!try_next_uleb128(stream, &operand)) {
+                return false;
+            }
+            row->cfa_offset = operand;
+            break;
+        case DW_CFA_def_cfa_offset_sf:
+            if (!try_next_sleb128(stream, &soperand)) {
+                return false;
+            }
+            row->cfa_offset = soperand * cie->data_align;
+            break;
+        case DW_CFA_def_cfa_expression:
+            if (!try_next_uleb128(stream, &operand)) {
+                return false;
+            }
+            stream->ptr += operand;
+            row->cfa_valid = false;
+            break;
+        case DW_CFA_expression:
+        case DW_CFA_val_expression:
+            if (!try_next_uleb128(stream, &reg) || !try_next_uleb128(stream, &operand)) {
+                return false;
+            }
+            stream->ptr += operand;
+            set_reg_rule(row, reg, RULE_UNSUPPORTED, 0);
+            break;
+        case DW_CFA_GNU_args_size:
+            if (!try_next_uleb128(stream, &operand)) {
+                return false;
+            }
+            break;
+        default:
+            ALOGV("execute_cfa_program: unknown instruction 0x%02x", op);
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool parse_cie(const memory_t* memory, uintptr_t cie, cie_info_t* info) {
+    byte_stream_t stream;
+    init_byte_stream(&stream, memory, cie);
+
+    uint32_t length;
+    uint32_t id;
+    uint8_t version;
+    if (!try_next_bytes(&stream, 4, &length) || !length || length == 0xffffffff
+            || !try_next_bytes(&stream, 4, &id) || id
+            || !try_next_byte(&stream, &version) || (version != 1 && version != 3)) {
+        ALOGV("parse_cie: unsupported CIE at 0x%08x", cie);
+        return false;
+    }
+    uintptr_t end = cie + 4 + length;
+
+    char augmentation[8];
+    size_t augmentation_length = 0;
+    for (;;) {
+        uint8_t c;
+        if (!try_next_byte(&stream, &c)) {
+            return false;
+        }
+        if (!c) {
+            break;
+        }
+        if (augmentation_length == sizeof(augmentation) - 1) {
+            return false;
+        }
+        augmentation[augmentation_length++] = c;
+    }
+    augmentation[augmentation_length] = '\0';
+
+    memset(info, 0, sizeof(*info));
+    info->cie = cie;
+    info->fde_encoding = DW_EH_PE_absptr;
+    if (augmentation[0] == 'e' && augmentation[1] == 'h') {
+        stream.ptr += 4; // old GCC exception table pointer
+    }
+    uint8_t ra_reg;
+    if (!try_next_uleb128(&stream, &info->code_align)
+            || !try_next_sleb128(&stream, &info->data_align)) {
+        return false;
+    }
+    if (version == 1) {
+        if (!try_next_byte(&stream, &ra_reg)) {
+            return false;
+        }
+        info->ra_reg = ra_reg;
+    } else if (!try_next_uleb128(&stream, &info->ra_reg)) {
+        return false;
+    }
+
+    if (augmentation[0] == 'z') {
+        uint32_t augmentation_data_length;
+        if (!try_next_uleb128(&stream, &augmentation_data_length)) {
+            return false;
+        }
+        uintptr_t augmentation_data_end = stream.ptr + augmentation_data_length;
+        for (const char* p = augmentation + 1; *p; p++) {
+            uint8_t encoding;
+            uintptr_t personality;
+            if (*p == 'R') {
+                if (!try_next_byte(&stream, &info->fde_encoding)) {
+                    return false;
+                }
+            } else if (*p == 'P') {
+                // Only the size of the personality routine pointer matters.
+                if (!try_next_byte(&stream, &encoding)
+                        || !try_next_encoded(&stream, encoding & 0x0f, 0, &personality)) {
+                    return false;
+                }
+            } else if (*p == 'L') {
+                if (!try_next_byte(&stream, &encoding)) {
+                    return false;
+                }
+            } else if (*p == 'S') {
+                info->signal_frame = true;
+            } else {
+                break;
+            }
+        }
+        stream.ptr = augmentation_data_end;
+        info->has_augmentation_data = true;
+    } else if (augmentation[0] && strcmp(augmentation, "eh")) {
+        ALOGV("parse_cie: unknown augmentation '%s' in CIE at 0x%08x", augmentation, cie);
+        return false;
+    }
+
+    return execute_cfa_program(&stream, end, info, NULL, 0, UINTPTR_MAX, &info->initial_row);
+}
+
+static const cie_info_t* get_cie(unwind_context_t* context, uintptr_t cie) {
+    for (size_t i = 0; i < CIE_CACHE_SIZE; i++) {
+        if (context->cies[i].cie == cie) {
+            return &context->cies[i];
+        }
+    }
+
+    cie_info_t* info = &context->cies[context->next_cie++ % CIE_CACHE_SIZE];
+    if (!parse_cie(context->memory, cie, info)) {
+        info->cie = 0;
+        return NULL;
+    }
+    return info;
+}
+
+/* Computes the row of the call frame information table for pc.
+ * Returns false if there is no FDE that covers it. */
+static bool find_cfi_row(unwind_context_t* context, uintptr_t pc,
+        const cie_info_t** out_cie, cfi_row_t* out_row) {
+    uintptr_t fde = find_fde(context, pc);
+    if (!fde) {
+        return false;
+    }
+
+    byte_stream_t stream;
+    init_byte_stream(&stream, context->memory, fde);
+
+    uint32_t length;
+    uint32_t cie_offset;
+    if (!try_next_bytes(&stream, 4, &length) || !length || length == 0xffffffff
+            || !try_next_bytes(&stream, 4, &cie_offset) || !cie_offset) {
+        ALOGV("find_cfi_row: invalid FDE at 0x%08x", fde);
+        return false;
+    }
+    uintptr_t end = fde + 4 + length;
+
+    const cie_info_t* cie = get_cie(context, fde + 4 - cie_offset);
+    if (!cie) {
+        return false;
+    }
+
+    uintptr_t pc_begin;
+    uintptr_t pc_range;
+    if (!try_next_encoded(&stream, cie->fde_encoding, 0, &pc_begin)
+            || !try_next_encoded(&stream, cie->fde_encoding & 0x0f, 0, &pc_range)) {
+        return false;
+    }
+    if (pc < pc_begin || pc - pc_begin >= pc_range) {
+        ALOGV("find_cfi_row: pc 0x%08x not covered by FDE at 0x%08x", pc, fde);
+        return false;
+    }
+    if (cie->has_augmentation_data) {
+        uint32_t augmentation_data_length;
+        if (!try_next_uleb128(&stream, &augmentation_data_length)) {
+            return false;
+        }
+        stream.ptr += augmentation_data_length;
+    }
+
+    *out_row = cie->initial_row;
+    if (!execute_cfa_program(&stream, end, cie, &cie->initial_row, pc_begin, pc, out_row)) {
+        return false;
+    }
+    *out_cie = cie;
+    return true;
+}
+
+/* Unwinds a frame using call frame information. */
+static bool step_cfi(unwind_context_t* context, unwind_state_t* state, uintptr_t pc,
+        bool* out_signal_frame) {
+    const cie_info_t* cie;
+    cfi_row_t row;
+    if (!find_cfi_row(context, pc, &cie, &row)
+            || !row.cfa_valid || row.cfa_reg >= DWARF_REGS || cie->ra_reg >= DWARF_REGS) {
+        return false;
+    }
+
+    uint32_t cfa = state->regs[row.cfa_reg] + row.cfa_offset;
+    unwind_state_t caller;
+    for (uint32_t reg = 0; reg < DWARF_REGS; reg++) {
+        const reg_rule_t* rule = &row.regs[reg];
+        switch (rule->rule) {
+        case RULE_SAME_VALUE:
+            caller.regs[reg] = state->regs[reg];
+            break;
+        case RULE_OFFSET:
+            if (!try_get_stream_word(&context->stack, cfa + rule->value, &caller.regs[reg])) {
+                return false;
+            }
+            break;
+        case RULE_VAL_OFFSET:
+            caller.regs[reg] = cfa + rule->value;
+            break;
+        case RULE_REGISTER:
+            if ((uint32_t)rule->value >= DWARF_REGS) {
+                return false;
+            }
+            caller.regs[reg] = state->regs[rule->value];
+            break;
+        case RULE_UNSUPPORTED:
+            if (reg == cie->ra_reg) {
+                return false;
+            }
+            caller.regs[reg] = 0;
+            break;
+        default:
+            caller.regs[reg] = 0;
+            break;
+        }
+    }
+    caller.regs[DWARF_ESP] = cfa;
+    caller.regs[DWARF_EIP] = caller.regs[cie->ra_reg];
+    if (row.regs[cie->ra_reg].rule == RULE_UNDEFINED) {
+        caller.regs[DWARF_EIP] = 0; // outermost frame
+    }
+
+    ALOGV("step_cfi: pc=0x%08x, cfa=0x%08x, caller eip=0x%08x, ebp=0x%08x",
+            pc, cfa, caller.regs[DWARF_EIP], caller.regs[DWARF_EBP]);
+    *state = caller;
+    *out_signal_frame = cie->signal_frame;
+    return true;
+}
+
+/* Unwinds a frame by following the frame pointer. */
+static bool step_frame_pointer(unwind_context_t* context, unwind_state_t* state) {
+    uint32_t ebp = state->regs[DWARF_EBP];
+    if (!ebp
+            || !try_get_stream_word(&context->stack, ebp + 4, &state->regs[DWARF_EIP])
+            || !try_get_stream_word(&context->stack, ebp, &state->regs[DWARF_EBP])) {
+        return false;
+    }
+    state->regs[DWARF_ESP] = ebp + 8;
+    return true;
+}
+
 uintptr_t rewind_pc_arch(const memory_t* memory __attribute__((unused)), uintptr_t pc) {
     // TODO: Implement for x86.
     return pc;
 }
 
 static ssize_t unwind_backtrace_common(const memory_t* memory,
-        const map_info_t* map_info_list __attribute__((unused)),
+        const map_info_t* map_info_list,
         unwind_state_t* state, backtrace_frame_t* backtrace,
         size_t ignore_depth, size_t max_depth) {
     size_t ignored_frames = 0;
     size_t returned_frames = 0;
 
-    for (size_t index = 0; state->ebp && returned_frames < max_depth; index++) {
+    // This may run in a signal handler, so the context lives on the stack.
+    unwind_context_t context;
+    memset(&context, 0, sizeof(context));
+    context.memory = memory;
+    context.map_info_list = map_info_list;
+    init_byte_stream(&context.stack, memory, 0);
+
+    // Only the first frame and frames interrupted by a signal are at the
+    // exact pc; the others are at a return address, which may already be
+    // outside of the calling function.
+    bool exact_pc = true;
+    for (size_t index = 0; state->regs[DWARF_EIP] && returned_frames < max_depth; index++) {
+        uint32_t eip = state->regs[DWARF_EIP];
+        uint32_t esp = state->regs[DWARF_ESP];
         backtrace_frame_t* frame = add_backtrace_entry(
-                index ? rewind_pc_arch(memory, state->eip) : state->eip,
+                index ? rewind_pc_arch(memory, eip) : eip,
                 backtrace, ignore_depth, max_depth,
                 &ignored_frames, &returned_frames);
-        uint32_t next_esp = state->ebp + 8;
+
+        bool signal_frame = false;
+        if (!step_cfi(&context, state, exact_pc ? eip : eip - 1, &signal_frame)) {
+            if (!step_frame_pointer(&context, state)) {
+                break;
+            }
+        }
+        exact_pc = signal_frame;
+
+        uint32_t next_esp = state->regs[DWARF_ESP];
         if (frame) {
-            frame->stack_top = state->esp;
-            if (state->esp < next_esp) {
-                frame->stack_size = next_esp - state->esp;
+            frame->stack_top = esp;
+            if (esp < next_esp) {
+                frame->stack_size = next_esp - esp;
             }
         }
-        state->esp = next_esp;
-        if (!try_get_word(memory, state->ebp + 4, &state->eip)
-                || !try_get_word(memory, state->ebp, &state->ebp)
-                || !state->eip) {
+        if (!signal_frame && next_esp <= esp) {
+            ALOGV("unwind_backtrace_common: stack did not unwind, esp=0x%08x", esp);
             break;
         }
     }
@@ -128,9 +994,15 @@ ssize_t unwind_backtrace_signal_arch(siginfo_t* siginfo __attribute__((unused)),
     const ucontext_t* uc = (const ucontext_t*)sigcontext;
 
     unwind_state_t state;
-    state.ebp = uc->uc_mcontext.gregs[REG_EBP];
-    state.esp = uc->uc_mcontext.gregs[REG_ESP];
-    state.eip = uc->uc_mcontext.gregs[REG_EIP];
+    state.regs[DWARF_EAX] = uc->uc_mcontext.gregs[REG_EAX];
+    state.regs[DWARF_ECX] = uc->uc_mcontext.gregs[REG_ECX];
+    state.regs[DWARF_EDX] = uc->uc_mcontext.gregs[REG_EDX];
+    state.regs[DWARF_EBX] = uc->uc_mcontext.gregs[REG_EBX];
+    state.regs[DWARF_ESP] = uc->uc_mcontext.gregs[REG_ESP];
+    state.regs[DWARF_EBP] = uc->uc_mcontext.gregs[REG_EBP];
+    state.regs[DWARF_ESI] = uc->uc_mcontext.gregs[REG_ESI];
+    state.regs[DWARF_EDI] = uc->uc_mcontext.gregs[REG_EDI];
+    state.regs[DWARF_EIP] = uc->uc_mcontext.gregs[REG_EIP];
 
     memory_t memory;
     init_memory(&memory, map_info_list);
@@ -146,9 +1018,15 @@ ssize_t unwind_backtrace_ptrace_arch(pid_t tid, const ptrace_context_t* context,
     }
 
     unwind_state_t state;
-    state.ebp = regs.ebp;
-    state.eip = regs.eip;
-    state.esp = regs.esp;
+    state.regs[DWARF_EAX] = regs.eax;
+    state.regs[DWARF_ECX] = regs.ecx;
+    state.regs[DWARF_EDX] = regs.edx;
+    state.regs[DWARF_EBX] = regs.ebx;
+    state.regs[DWARF_ESP] = regs.esp;
+    state.regs[DWARF_EBP] = regs.ebp;
+    state.regs[DWARF_ESI] = regs.esi;
+    state.regs[DWARF_EDI] = regs.edi;
+    state.regs[DWARF_EIP] = regs.eip;
 
     memory_t memory;
     init_memory_ptrace(&memory, tid);
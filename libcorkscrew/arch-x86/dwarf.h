@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* DWARF call frame information for x86. */
+
+#ifndef _CORKSCREW_DWARF_X86_H
+#define _CORKSCREW_DWARF_X86_H
+
+#include <corkscrew/ptrace.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Pointer encodings used by .eh_frame and .eh_frame_hdr. */
+#define DW_EH_PE_absptr   0x00
+#define DW_EH_PE_uleb128  0x01
+#define DW_EH_PE_udata2   0x02
+#define DW_EH_PE_udata4   0x03
+#define DW_EH_PE_udata8   0x04
+#define DW_EH_PE_sleb128  0x09
+#define DW_EH_PE_sdata2   0x0a
+#define DW_EH_PE_sdata4   0x0b
+#define DW_EH_PE_sdata8   0x0c
+#define DW_EH_PE_pcrel    0x10
+#define DW_EH_PE_datarel  0x30
+#define DW_EH_PE_indirect 0x80
+#define DW_EH_PE_omit     0xff
+
+/* Call frame instructions.  The first three carry an operand in their
+ * low six bits. */
+#define DW_CFA_advance_loc              0x40
+#define DW_CFA_offset                   0x80
+#define DW_CFA_restore                  0xc0
+#define DW_CFA_nop                      0x00
+#define DW_CFA_set_loc                  0x01
+#define DW_CFA_advance_loc1             0x02
+#define DW_CFA_advance_loc2             0x03
+#define DW_CFA_advance_loc4             0x04
+#define DW_CFA_offset_extended          0x05
+#define DW_CFA_restore_extended         0x06
+#define DW_CFA_undefined                0x07
+#define DW_CFA_same_value               0x08
+#define DW_CFA_register                 0x09
+#define DW_CFA_remember_state           0x0a
+#define DW_CFA_restore_state            0x0b
+#define DW_CFA_def_cfa                  0x0c
+#define DW_CFA_def_cfa_register         0x0d
+#define DW_CFA_def_cfa_offset           0x0e
+#define DW_CFA_def_cfa_expression       0x0f
+#define DW_CFA_expression               0x10
+#define DW_CFA_offset_extended_sf       0x11
+#define DW_CFA_def_cfa_sf               0x12
+#define DW_CFA_def_cfa_offset_sf        0x13
+#define DW_CFA_val_offset               0x14
+#define DW_CFA_val_offset_sf            0x15
+#define DW_CFA_val_expression           0x16
+#define DW_CFA_GNU_args_size            0x2e
+#define DW_CFA_GNU_negative_offset_extended 0x2f
+
+/* DWARF register numbers for x86. */
+enum {
+    DWARF_EAX = 0, DWARF_ECX, DWARF_EDX, DWARF_EBX,
+    DWARF_ESP, DWARF_EBP, DWARF_ESI, DWARF_EDI,
+    DWARF_EIP,
+    DWARF_REGS
+};
+
+/*
+ * Finds the .eh_frame_hdr section of the ELF image whose header is at
+ * elf_start, using the PT_GNU_EH_FRAME program header.
+ * Returns its absolute address, or 0 if there is none.
+ */
+uintptr_t find_eh_frame_hdr(const memory_t* memory, uintptr_t elf_start);
+
+/*
+ * Decodes an .eh_frame_hdr section.  Returns the address of its binary
+ * search table and the number of entries in it, or false if the section
+ * has no table in a format we can search.
+ */
+bool parse_eh_frame_hdr(const memory_t* memory, uintptr_t eh_frame_hdr,
+        uintptr_t* out_table, size_t* out_fde_count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _CORKSCREW_DWARF_X86_H
@@ -17,15 +17,74 @@
 #define LOG_TAG "Corkscrew"
 //#define LOG_NDEBUG 0
 
+#define _LARGEFILE64_SOURCE 1 // For pread64() in glibc.
+
 #include "../ptrace-arch.h"
+#include "dwarf.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
 #include <cutils/log.h>
 
-void load_ptrace_map_info_data_arch(pid_t pid __attribute__((unused)),
-                                    map_info_t* mi __attribute__((unused)),
-                                    map_info_data_t* data __attribute__((unused))) {
+/* Copies the .eh_frame_hdr search table of a module into this process,
+ * so that looking up an FDE does not need a ptrace() call per probe.
+ * The table is read in one go from /proc/<pid>/mem, which the tracer
+ * is allowed to access. */
+static fde_index_entry_t* load_fde_index(pid_t pid, uintptr_t eh_frame_hdr,
+        uintptr_t table, size_t fde_count) {
+    if (!fde_count || fde_count > SIZE_MAX / sizeof(fde_index_entry_t)) {
+        return NULL;
+    }
+    fde_index_entry_t* index = (fde_index_entry_t*)malloc(fde_count * sizeof(fde_index_entry_t));
+    if (!index) {
+        return NULL;
+    }
+
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "/proc/%d/mem", pid);
+    int fd = open(path, O_RDONLY);
+    ssize_t size = fde_count * sizeof(fde_index_entry_t);
+    if (fd < 0 || pread64(fd, index, size, (off64_t)table) != size) {
+        ALOGV("Could not read the FDE table of pid %d at 0x%08x, errno=%d", pid, table, errno);
+        if (fd >= 0) {
+            close(fd);
+        }
+        free(index);
+        return NULL;
+    }
+    close(fd);
+
+    // The entries are relative to the start of .eh_frame_hdr.
+    for (size_t i = 0; i < fde_count; i++) {
+        index[i].pc += eh_frame_hdr;
+        index[i].fde += eh_frame_hdr;
+    }
+    return index;
+}
+
+void load_ptrace_map_info_data_arch(pid_t pid, map_info_t* mi, map_info_data_t* data) {
+    memory_t memory;
+    init_memory_ptrace(&memory, pid);
+
+    uintptr_t table;
+    size_t fde_count;
+    data->eh_frame_hdr = find_eh_frame_hdr(&memory, mi->start);
+    if (data->eh_frame_hdr
+            && parse_eh_frame_hdr(&memory, data->eh_frame_hdr, &table, &fde_count)) {
+        data->fde_index = load_fde_index(pid, data->eh_frame_hdr, table, fde_count);
+        if (data->fde_index) {
+            data->fde_count = fde_count;
+        }
+    }
+    ALOGV("Parsed eh_frame_hdr info for %s: eh_frame_hdr=0x%08x, fde_count=%d",
+            mi->name, data->eh_frame_hdr, data->fde_count);
 }
 
 void free_ptrace_map_info_data_arch(map_info_t* mi __attribute__((unused)),
-                                    map_info_data_t* data __attribute__((unused))) {
+                                    map_info_data_t* data) {
+    free(data->fde_index);
 }
@@ -27,12 +27,26 @@
 extern "C" {
 #endif
 
+#ifdef __i386__
+/* An entry of the .eh_frame_hdr binary search table, with both
+ * addresses made absolute. */
+typedef struct {
+    uintptr_t pc;
+    uintptr_t fde;
+} fde_index_entry_t;
+#endif
+
 /* Custom extra data we stuff into map_info_t structures as part
  * of our ptrace_context_t. */
 typedef struct {
 #ifdef __arm__
     uintptr_t exidx_start;
     size_t exidx_size;
+#endif
+#ifdef __i386__
+    uintptr_t eh_frame_hdr;
+    fde_index_entry_t* fde_index; // local copy of the search table, or NULL
+    size_t fde_count;
 #endif
     symbol_table_t* symbol_table;
 } map_info_data_t;
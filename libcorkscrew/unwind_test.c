@@ -0,0 +1,233 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Unwinds a deep call chain, from another thread using a signal and from
+ * another process using ptrace(), and reports how many of its frames were
+ * recovered and how long unwinding took per frame.
+ *
+ * The test is built both with and without frame pointers, so that unwinding
+ * from call frame information can be compared with following the frame
+ * pointer chain.
+ */
+
+#include <corkscrew/backtrace.h>
+#include <corkscrew/ptrace.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#define DEPTH 48
+#define MAX_DEPTH 64
+#define ITERATIONS 100
+
+/* Return addresses of the chain, outermost first; the last one is the
+ * return address of the leaf. */
+static uintptr_t g_return_addresses[DEPTH + 1];
+static volatile pid_t g_leaf_tid;
+static volatile int g_done;
+static int g_report_fd = -1;
+
+static pid_t get_tid() {
+    return syscall(__NR_gettid);
+}
+
+static int64_t now_ns() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+__attribute__ ((noinline)) static int leaf(int depth) {
+    g_return_addresses[depth] = (uintptr_t)__builtin_return_address(0);
+    if (g_report_fd >= 0 && write(g_report_fd, g_return_addresses,
+            sizeof(g_return_addresses)) != sizeof(g_return_addresses)) {
+        /* the parent sees the pipe close early and reports it */
+        _exit(1);
+    }
+    g_leaf_tid = get_tid();
+    while (!g_done) {
+    }
+    return depth;
+}
+
+static int level_b(int depth);
+
+/* The two levels have differently sized frames, so that a wrong stack
+ * adjustment anywhere in the chain shows up as a missing frame. */
+__attribute__ ((noinline)) static int level_a(int depth) {
+    volatile int pad[4];
+    pad[0] = depth;
+    g_return_addresses[depth] = (uintptr_t)__builtin_return_address(0);
+    int result = depth + 1 < DEPTH ? level_b(depth + 1) : leaf(depth + 1);
+    return result + pad[0];
+}
+
+__attribute__ ((noinline)) static int level_b(int depth) {
+    volatile int pad[19];
+    pad[0] = depth;
+    g_return_addresses[depth] = (uintptr_t)__builtin_return_address(0);
+    int result = depth + 1 < DEPTH ? level_a(depth + 1) : leaf(depth + 1);
+    return result * 3 + pad[0];
+}
+
+static void* chain_thread(void* arg __attribute__((unused))) {
+    level_a(0);
+    return NULL;
+}
+
+static bool matches(uintptr_t pc, uintptr_t return_address) {
+    // Architectures that rewind the pc to the call instruction are allowed
+    // a few bytes of slack.
+    return return_address - pc <= 4;
+}
+
+/* Counts the frames above the leaf that match the recorded return
+ * addresses, stopping at the first mismatch.  The leaf may have been
+ * stopped in a function it calls, so its caller is looked for among
+ * the first few frames. */
+static size_t count_matching_frames(const backtrace_frame_t* frames, ssize_t frame_count) {
+    ssize_t first = 1;
+    while (first < frame_count && first < 4
+            && !matches(frames[first].absolute_pc, g_return_addresses[DEPTH])) {
+        first++;
+    }
+
+    size_t matched = 0;
+    for (ssize_t i = first; i < frame_count && matched <= DEPTH; i++) {
+        uintptr_t expected = g_return_addresses[DEPTH - matched];
+        if (!matches(frames[i].absolute_pc, expected)) {
+            fprintf(stderr, "frame %d: pc %08x, expected %08x\n",
+                    (int)i, (unsigned)frames[i].absolute_pc, (unsigned)expected);
+            break;
+        }
+        matched++;
+    }
+    return matched;
+}
+
+static int report(const char* mode, const backtrace_frame_t* frames, ssize_t frame_count,
+        int64_t elapsed_ns, size_t unwinds) {
+    size_t matched = count_matching_frames(frames, frame_count);
+    printf("%s: %u/%u frames", mode, (unsigned)matched, DEPTH + 1);
+    if (elapsed_ns && frame_count > 0) {
+        printf(", %lld ns per frame", (long long)(elapsed_ns / unwinds / frame_count));
+    }
+    printf("\n");
+    return matched == DEPTH + 1 ? 0 : 1;
+}
+
+static int test_signal() {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, chain_thread, NULL)) {
+        fprintf(stderr, "pthread_create failed\n");
+        return 1;
+    }
+    while (!g_leaf_tid) {
+        usleep(1000);
+    }
+
+    // The handoff to the signal handler dominates the time taken here, so
+    // only the accuracy is reported.
+    backtrace_frame_t frames[MAX_DEPTH];
+    ssize_t frame_count = unwind_backtrace_thread(g_leaf_tid, frames, 0, MAX_DEPTH);
+    g_done = 1;
+    pthread_join(thread, NULL);
+
+    if (frame_count < 0) {
+        fprintf(stderr, "unwind_backtrace_thread failed\n");
+        return 1;
+    }
+    return report("signal", frames, frame_count, 0, 1);
+}
+
+static int test_ptrace() {
+    int fds[2];
+    if (pipe(fds)) {
+        perror("pipe");
+        return 1;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return 1;
+    }
+    if (!pid) {
+        close(fds[0]);
+        g_report_fd = fds[1];
+        level_a(0);
+        _exit(0);
+    }
+    close(fds[1]);
+
+    int result = 1;
+    ssize_t n = read(fds[0], g_return_addresses, sizeof(g_return_addresses));
+    close(fds[0]);
+    if (n != sizeof(g_return_addresses)) {
+        fprintf(stderr, "child did not report its call chain\n");
+        goto out;
+    }
+
+    int status;
+    if (ptrace(PTRACE_ATTACH, pid, 0, 0) || waitpid(pid, &status, 0) != pid) {
+        perror("ptrace attach");
+        goto out;
+    }
+
+    int64_t start = now_ns();
+    ptrace_context_t* context = load_ptrace_context(pid);
+    int64_t load_ns = now_ns() - start;
+
+    backtrace_frame_t frames[MAX_DEPTH];
+    ssize_t frame_count = 0;
+    start = now_ns();
+    for (size_t i = 0; i < ITERATIONS; i++) {
+        frame_count = unwind_backtrace_ptrace(pid, context, frames, 0, MAX_DEPTH);
+    }
+    int64_t elapsed_ns = now_ns() - start;
+
+    printf("ptrace: context loaded in %lld us\n", (long long)(load_ns / 1000));
+    if (frame_count < 0) {
+        fprintf(stderr, "unwind_backtrace_ptrace failed\n");
+    } else {
+        result = report("ptrace", frames, frame_count, elapsed_ns, ITERATIONS);
+    }
+    free_ptrace_context(context);
+    ptrace(PTRACE_DETACH, pid, 0, 0);
+
+out:
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+    return result;
+}
+
+int main() {
+    int failures = test_signal() + test_ptrace();
+    printf("%d failures\n", failures);
+    return failures ? 1 : 0;
+}
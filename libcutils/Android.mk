@@ -23,6 +23,14 @@ else
 endif
 hostSmpFlag := -DANDROID_SMP=0
 
+# Architectures listed here take their atomic operations from the
+# compiler's __atomic builtins instead of the hand-written inline assembly
+# in <cutils/atomic-$(arch).h>.  This needs gcc 4.7 or later.
+atomicBuiltinArchs :=
+ifneq ($(filter $(TARGET_ARCH),$(atomicBuiltinArchs)),)
+    targetSmpFlag += -DANDROID_ATOMIC_BUILTINS
+endif
+
 commonSources := \
 	array.c \
 	hashmap.c \
@@ -166,3 +174,38 @@ LOCAL_SRC_FILES := str_parms.c hashmap.c memory.c
 LOCAL_SHARED_LIBRARIES := liblog
 LOCAL_MODULE_TAGS := optional
 include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := tst_qtaguid
+LOCAL_CFLAGS += -DTEST_QTAGUID
+LOCAL_SRC_FILES := qtaguid.c
+LOCAL_SHARED_LIBRARIES := liblog
+LOCAL_MODULE_TAGS := optional
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := tst_atomic
+LOCAL_SRC_FILES := atomic_test.c
+LOCAL_CFLAGS += $(targetSmpFlag)
+LOCAL_SHARED_LIBRARIES := libcutils
+LOCAL_MODULE_TAGS := optional
+include $(BUILD_EXECUTABLE)
+
+# The target toolchain may predate the __atomic builtins, so the builtin
+# implementation is tested with the host compiler.
+ifeq ($(HOST_OS),linux)
+include $(CLEAR_VARS)
+LOCAL_MODULE := tst_atomic_builtins
+LOCAL_SRC_FILES := atomic_test.c
+LOCAL_CFLAGS += -DANDROID_SMP=1 -DANDROID_ATOMIC_BUILTINS
+LOCAL_LDLIBS := -lpthread
+LOCAL_MODULE_TAGS := optional
+include $(BUILD_HOST_EXECUTABLE)
+endif
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := tst_jstring
+LOCAL_SRC_FILES := jstring_test.c
+LOCAL_SHARED_LIBRARIES := libcutils
+LOCAL_MODULE_TAGS := optional
+include $(BUILD_EXECUTABLE)
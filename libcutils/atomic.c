@@ -17,3 +17,106 @@
 #define inline
 
 #include <cutils/atomic-inline.h>
+
+#if !defined(ANDROID_ATOMIC_INLINE_64)
+
+#include <sched.h>
+
+/*
+ * 64-bit operations for architectures that have no native ones.  Each
+ * value is guarded by one of a small number of spin locks, picked by its
+ * address, so unrelated values rarely contend.
+ */
+#define LOCK_COUNT 16
+
+static volatile int32_t locks[LOCK_COUNT];
+
+static volatile int32_t *lock64(volatile const int64_t *addr)
+{
+    volatile int32_t *lock = &locks[((uintptr_t)addr >> 3) % LOCK_COUNT];
+
+    while (android_atomic_acquire_cas(0, 1, lock) != 0) {
+        sched_yield();
+    }
+    return lock;
+}
+
+static void unlock64(volatile int32_t *lock)
+{
+    android_atomic_release_store(0, lock);
+}
+
+int64_t android_atomic_add64(int64_t value, volatile int64_t *addr)
+{
+    volatile int32_t *lock = lock64(addr);
+    int64_t prev = *addr;
+    *addr = prev + value;
+    unlock64(lock);
+    return prev;
+}
+
+int64_t android_atomic_and64(int64_t value, volatile int64_t *addr)
+{
+    volatile int32_t *lock = lock64(addr);
+    int64_t prev = *addr;
+    *addr = prev & value;
+    unlock64(lock);
+    return prev;
+}
+
+int64_t android_atomic_or64(int64_t value, volatile int64_t *addr)
+{
+    volatile int32_t *lock = lock64(addr);
+    int64_t prev = *addr;
+    *addr = prev | value;
+    unlock64(lock);
+    return prev;
+}
+
+int64_t android_atomic_acquire_load64(volatile const int64_t *addr)
+{
+    volatile int32_t *lock = lock64(addr);
+    int64_t value = *addr;
+    unlock64(lock);
+    return value;
+}
+
+/* the barriers that come with taking and dropping the lock give both
+ * acquire and release ordering */
+int64_t android_atomic_release_load64(volatile const int64_t *addr)
+{
+    return android_atomic_acquire_load64(addr);
+}
+
+void android_atomic_release_store64(int64_t value, volatile int64_t *addr)
+{
+    volatile int32_t *lock = lock64(addr);
+    *addr = value;
+    unlock64(lock);
+}
+
+void android_atomic_acquire_store64(int64_t value, volatile int64_t *addr)
+{
+    android_atomic_release_store64(value, addr);
+}
+
+int android_atomic_acquire_cas64(int64_t oldvalue, int64_t newvalue,
+        volatile int64_t *addr)
+{
+    volatile int32_t *lock = lock64(addr);
+    int changed = 1;
+    if (*addr == oldvalue) {
+        *addr = newvalue;
+        changed = 0;
+    }
+    unlock64(lock);
+    return changed;
+}
+
+int android_atomic_release_cas64(int64_t oldvalue, int64_t newvalue,
+        volatile int64_t *addr)
+{
+    return android_atomic_acquire_cas64(oldvalue, newvalue, addr);
+}
+
+#endif /* !ANDROID_ATOMIC_INLINE_64 */
@@ -0,0 +1,364 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Hammers the atomic operations from several threads, checks the results
+ * for lost updates and torn 64-bit values, runs the store-buffering and
+ * message-passing litmus tests, and reports the cost of each operation
+ * under contention.
+ *
+ * Built for the target with its usual implementation, and for the host
+ * with ANDROID_ATOMIC_BUILTINS, which older target compilers lack.
+ * Waiting threads yield, so that the test also finishes on one core,
+ * except in the store-buffering test, which needs two.
+ */
+
+#include <cutils/atomic.h>
+#include <cutils/atomic-inline.h>
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define THREADS     4
+#define ITERATIONS  200000
+#define LITMUS_RUNS 100000
+
+enum {
+    OP_ADD,
+    OP_OR_AND,
+    OP_CAS,
+    OP_ADD64,
+    OP_OR_AND64,
+    OP_COUNT
+};
+
+static const char *op_names[OP_COUNT] = {
+    "add", "or/and", "cas loop", "add64", "or/and64",
+};
+
+static volatile int32_t counter;
+static volatile int32_t flags;
+static volatile int64_t counter64;
+static volatile int64_t flags64;
+static volatile int32_t go;
+static int errors;
+
+static int64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+struct worker {
+    pthread_t thread;
+    int op;
+    int id;
+    int errors;
+};
+
+static void *hammer(void *arg)
+{
+    struct worker *w = arg;
+    int32_t bit = 1 << w->id;
+    int64_t bit64 = 1LL << (w->id * 8 + 4);
+    int32_t prev;
+    int64_t prev64;
+    int i;
+
+    while (!android_atomic_acquire_load(&go))
+        sched_yield();
+
+    for (i = 0; i < ITERATIONS; i++) {
+        switch (w->op) {
+        case OP_ADD:
+            android_atomic_inc(&counter);
+            android_atomic_add(2, &counter);
+            break;
+        case OP_OR_AND:
+            /* nobody else touches our bit, so we must see it flip */
+            prev = android_atomic_or(bit, &flags);
+            if (prev & bit)
+                w->errors++;
+            prev = android_atomic_and(~bit, &flags);
+            if (!(prev & bit))
+                w->errors++;
+            break;
+        case OP_CAS:
+            do {
+                prev = android_atomic_acquire_load(&counter);
+            } while (android_atomic_release_cas(prev, prev + 3, &counter));
+            break;
+        case OP_ADD64:
+            /* carries into the upper half on every call */
+            android_atomic_add64(0x100000001LL, &counter64);
+            android_atomic_add64(0xffffffffLL * 2, &counter64);
+            break;
+        case OP_OR_AND64:
+            prev64 = android_atomic_or64(bit64, &flags64);
+            if (prev64 & bit64)
+                w->errors++;
+            prev64 = android_atomic_and64(~bit64, &flags64);
+            if (!(prev64 & bit64))
+                w->errors++;
+            break;
+        }
+    }
+    return NULL;
+}
+
+static void run_op(int op)
+{
+    struct worker workers[THREADS];
+    int64_t start, elapsed;
+    int64_t expected;
+    int i, bad = 0;
+
+    counter = 0;
+    flags = 0;
+    counter64 = 0;
+    flags64 = 0;
+    go = 0;
+    for (i = 0; i < THREADS; i++) {
+        workers[i].op = op;
+        workers[i].id = i;
+        workers[i].errors = 0;
+        pthread_create(&workers[i].thread, NULL, hammer, &workers[i]);
+    }
+    start = now_ns();
+    android_atomic_release_store(1, &go);
+    for (i = 0; i < THREADS; i++) {
+        pthread_join(workers[i].thread, NULL);
+        bad += workers[i].errors;
+    }
+    elapsed = now_ns() - start;
+
+    expected = (int64_t)THREADS * ITERATIONS * 3;
+    switch (op) {
+    case OP_ADD:
+    case OP_CAS:
+        bad += counter != (int32_t)expected;
+        break;
+    case OP_OR_AND:
+        bad += flags != 0;
+        break;
+    case OP_ADD64:
+        bad += android_atomic_acquire_load64(&counter64) !=
+                (int64_t)THREADS * ITERATIONS * (0x100000001LL + 0xffffffffLL * 2);
+        break;
+    case OP_OR_AND64:
+        bad += android_atomic_acquire_load64(&flags64) != 0;
+        break;
+    }
+
+    printf("%-10s %6.1f ns per operation, %d threads%s\n", op_names[op],
+           (double)elapsed / ((int64_t)THREADS * ITERATIONS * 2), THREADS,
+           bad ? ", FAILED" : "");
+    errors += bad;
+}
+
+/* Two 64-bit values whose halves differ, so a torn load is visible. */
+#define PATTERN_A 0x0123456789abcdefLL
+#define PATTERN_B (~PATTERN_A)
+
+static volatile int64_t shared64 = PATTERN_A;
+static volatile int32_t stop;
+
+static void *store64_thread(void *arg)
+{
+    int i = 0;
+    (void)arg;
+    while (!android_atomic_acquire_load(&stop)) {
+        android_atomic_release_store64((i++ & 1) ? PATTERN_B : PATTERN_A, &shared64);
+    }
+    return NULL;
+}
+
+static void test_tearing()
+{
+    pthread_t thread;
+    int64_t value;
+    int i, torn = 0;
+
+    stop = 0;
+    pthread_create(&thread, NULL, store64_thread, NULL);
+    for (i = 0; i < ITERATIONS * 4; i++) {
+        value = android_atomic_acquire_load64(&shared64);
+        if (value != PATTERN_A && value != PATTERN_B)
+            torn++;
+    }
+    android_atomic_release_store(1, &stop);
+    pthread_join(thread, NULL);
+
+    printf("load64/store64: %d torn values in %d loads\n", torn, ITERATIONS * 4);
+    errors += torn != 0;
+}
+
+/*
+ * Store buffering: each thread stores to one variable and loads the
+ * other.  With a full barrier in between, both cannot load zero; without
+ * one, store buffers let it happen.  Both threads busy-spin, never yield,
+ * so that runs start within a cache line transfer of each other: thread 0
+ * resets the variables and bumps sb_start, thread 1 waits for it, and
+ * thread 0 waits for thread 1's sb_done before the next run.  A short,
+ * varying delay before each store sweeps the two windows across each
+ * other.  This needs a CPU per thread, so it is skipped on one core.
+ */
+static volatile int32_t sb_start, sb_done;
+static volatile int32_t x, y;
+static int32_t r0[LITMUS_RUNS], r1[LITMUS_RUNS];
+static int fenced;
+
+static void *sb_thread(void *arg)
+{
+    int id = (int)(intptr_t)arg;
+    volatile int32_t *mine = id ? &y : &x;
+    volatile int32_t *theirs = id ? &x : &y;
+    int32_t *result = id ? r1 : r0;
+    unsigned int seed = id + 1;
+    volatile int delay;
+    int i;
+
+    for (i = 0; i < LITMUS_RUNS; i++) {
+        if (id == 0) {
+            while (android_atomic_acquire_load(&sb_done) != i)
+                ;
+            x = y = 0;
+            android_atomic_release_store(i + 1, &sb_start);
+        } else {
+            while (android_atomic_acquire_load(&sb_start) != i + 1)
+                ;
+        }
+        seed = seed * 1103515245 + 12345;
+        for (delay = (seed >> 16) % 32; delay > 0; delay--)
+            ;
+        if (fenced) {
+            android_atomic_acquire_store(1, mine);
+        } else {
+            *mine = 1;
+        }
+        result[i] = *theirs;
+        if (id == 1)
+            android_atomic_release_store(i + 1, &sb_done);
+    }
+    return NULL;
+}
+
+static int test_store_buffering(int with_barrier)
+{
+    pthread_t threads[2];
+    int i, both_zero = 0;
+
+    fenced = with_barrier;
+    sb_start = sb_done = 0;
+    pthread_create(&threads[0], NULL, sb_thread, (void *)0);
+    pthread_create(&threads[1], NULL, sb_thread, (void *)1);
+    pthread_join(threads[0], NULL);
+    pthread_join(threads[1], NULL);
+    for (i = 0; i < LITMUS_RUNS; i++) {
+        if (r0[i] == 0 && r1[i] == 0)
+            both_zero++;
+    }
+
+    printf("store buffering %s barrier: %d/%d runs saw both loads return 0\n",
+           with_barrier ? "with" : "without", both_zero, LITMUS_RUNS);
+    return both_zero;
+}
+
+/* Message passing: data written before a release store of the flag must
+ * be seen by whoever sees the flag with an acquire load. */
+static volatile int32_t mp_data, mp_flag;
+
+static void *mp_writer(void *arg)
+{
+    int i;
+    (void)arg;
+    for (i = 1; i <= LITMUS_RUNS; i++) {
+        mp_data = i;
+        android_atomic_release_store(i, &mp_flag);
+        while (android_atomic_acquire_load(&mp_flag) != -i)
+            sched_yield();
+    }
+    return NULL;
+}
+
+static int test_message_passing()
+{
+    pthread_t thread;
+    int i, stale = 0;
+
+    mp_flag = 0;
+    pthread_create(&thread, NULL, mp_writer, NULL);
+    for (i = 1; i <= LITMUS_RUNS; i++) {
+        while (android_atomic_acquire_load(&mp_flag) != i)
+            sched_yield();
+        if (mp_data != i)
+            stale++;
+        android_atomic_release_store(-i, &mp_flag);
+    }
+    pthread_join(thread, NULL);
+
+    printf("message passing: %d/%d runs saw stale data\n", stale, LITMUS_RUNS);
+    return stale;
+}
+
+static void bench_barrier()
+{
+    int64_t start, elapsed;
+    int i;
+
+    start = now_ns();
+    for (i = 0; i < ITERATIONS * 10; i++)
+        android_memory_barrier();
+    elapsed = now_ns() - start;
+    printf("memory barrier: %.1f ns\n", (double)elapsed / (ITERATIONS * 10));
+}
+
+int main()
+{
+    int op;
+
+#if defined(ANDROID_ATOMIC_BUILTINS)
+    printf("__atomic builtins, SMP=%d\n", ANDROID_SMP);
+#else
+    printf("inline assembly, SMP=%d\n", ANDROID_SMP);
+#endif
+    for (op = 0; op < OP_COUNT; op++)
+        run_op(op);
+    test_tearing();
+    bench_barrier();
+
+    errors += test_message_passing() != 0;
+    if (sysconf(_SC_NPROCESSORS_ONLN) < 2) {
+        printf("store buffering: skipped, needs two CPUs\n");
+    } else if (test_store_buffering(0) == 0) {
+        /* a harness that cannot show the reordering proves nothing
+         * about the barrier that prevents it */
+        printf("store buffering: no reordering without the barrier, "
+               "so the barrier cannot be tested\n");
+        errors += ANDROID_SMP;
+    } else if (ANDROID_SMP) {
+        errors += test_store_buffering(1) != 0;
+    }
+
+    printf("%d failures\n", errors);
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,298 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Compares the UTF-8 <-> UTF-16 conversions in libcutils against the same
+ * sources built without their SIMD fast paths, on random strings at
+ * random alignments, checks the validating variants against a simple
+ * reference, and reports the throughput of both builds on ASCII, mostly
+ * ASCII and CJK text.
+ */
+
+#include <cutils/jstring.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* The scalar versions, under other names.  The sources call some of them
+ * before defining them. */
+size_t scalar_strlen8to16(const char* utf8Str);
+char16_t *scalar_strcpy8to16(char16_t *dest, const char *s, size_t *out_len);
+size_t scalar_strnlen16to8(const char16_t *s, size_t n);
+char *scalar_strncpy16to8(char *dest, const char16_t *s, size_t n);
+
+#define JSTRING_NO_SIMD
+#define strdup8to16 scalar_strdup8to16
+#define strlen8to16 scalar_strlen8to16
+#define strcpy8to16 scalar_strcpy8to16
+#define strcpylen8to16 scalar_strcpylen8to16
+#define strdup8to16_checked scalar_strdup8to16_checked
+#define strcpy8to16_checked scalar_strcpy8to16_checked
+#define strnlen16to8 scalar_strnlen16to8
+#define strncpy16to8 scalar_strncpy16to8
+#define strndup16to8 scalar_strndup16to8
+#include "strdup8to16.c"
+#include "strdup16to8.c"
+#undef strdup8to16
+#undef strlen8to16
+#undef strcpy8to16
+#undef strcpylen8to16
+#undef strdup8to16_checked
+#undef strcpy8to16_checked
+#undef strnlen16to8
+#undef strncpy16to8
+#undef strndup16to8
+
+#define ROUNDS      20000
+#define MAX_CHARS   300
+#define BENCH_BYTES (1 << 20)
+
+static int failures;
+
+/* Appends a random piece of text: an ASCII run, a well-formed character
+ * of 2 to 4 bytes, or a random byte. */
+static size_t random_piece(unsigned char *p)
+{
+    unsigned int c;
+    size_t i, n;
+
+    switch (rand() % 8) {
+    case 0:
+        p[0] = 0x80 + rand() % 0x80;
+        return 1;
+    case 1:
+        c = 0x80 + rand() % 0x780;
+        p[0] = 0xc0 | (c >> 6);
+        p[1] = 0x80 | (c & 0x3f);
+        return 2;
+    case 2:
+        c = 0x800 + rand() % 0xf800;
+        p[0] = 0xe0 | (c >> 12);
+        p[1] = 0x80 | ((c >> 6) & 0x3f);
+        p[2] = 0x80 | (c & 0x3f);
+        return 3;
+    case 3:
+        c = 0x10000 + rand() % 0x100000;
+        p[0] = 0xf0 | (c >> 18);
+        p[1] = 0x80 | ((c >> 12) & 0x3f);
+        p[2] = 0x80 | ((c >> 6) & 0x3f);
+        p[3] = 0x80 | (c & 0x3f);
+        return 4;
+    default:
+        n = 1 + rand() % 40;
+        for (i = 0; i < n; i++)
+            p[i] = 1 + rand() % 0x7f;
+        return n;
+    }
+}
+
+/* A byte-at-a-time statement of what strcpy8to16_checked accepts. */
+static int reference_valid(const unsigned char *s)
+{
+    while (*s) {
+        unsigned int c = *s, cp, len, i, min;
+
+        if (c < 0x80) {
+            s++;
+            continue;
+        }
+        if (c == 0xc0 && s[1] == 0x80) {
+            s += 2;
+            continue;
+        }
+        if (c >= 0xc0 && c < 0xe0) {
+            len = 2; cp = c & 0x1f; min = 0x80;
+        } else if (c >= 0xe0 && c < 0xf0) {
+            len = 3; cp = c & 0x0f; min = 0x800;
+        } else if (c >= 0xf0 && c < 0xf8) {
+            len = 4; cp = c & 0x07; min = 0x10000;
+        } else {
+            return 0;
+        }
+        for (i = 1; i < len; i++) {
+            if ((s[i] & 0xc0) != 0x80)
+                return 0;
+            cp = (cp << 6) | (s[i] & 0x3f);
+        }
+        if (cp < min || cp > 0x10ffff)
+            return 0;
+        s += len;
+    }
+    return 1;
+}
+
+static void fail(const char *what, int round)
+{
+    if (failures++ < 10)
+        fprintf(stderr, "round %d: %s differs\n", round, what);
+}
+
+static void fuzz8to16()
+{
+    unsigned char storage[MAX_CHARS * 4 + 64];
+    char16_t out[MAX_CHARS * 4 + 8], ref[MAX_CHARS * 4 + 8];
+    size_t out_len, ref_len, len;
+    int round, valid, limit;
+
+    for (round = 0; round < ROUNDS; round++) {
+        /* start at any alignment */
+        unsigned char *s = storage + rand() % 16;
+        len = 0;
+        while (len < (size_t) (rand() % MAX_CHARS))
+            len += random_piece(s + len);
+        s[len] = '\0';
+
+        if (strlen8to16((char *) s) != scalar_strlen8to16((char *) s))
+            fail("strlen8to16", round);
+
+        strcpy8to16(out, (char *) s, &out_len);
+        scalar_strcpy8to16(ref, (char *) s, &ref_len);
+        if (out_len != ref_len || memcmp(out, ref, out_len * sizeof(char16_t)))
+            fail("strcpy8to16", round);
+
+        limit = len ? rand() % (len + 1) : 0;
+        strcpylen8to16(out, (char *) s, limit, &out_len);
+        scalar_strcpylen8to16(ref, (char *) s, limit, &ref_len);
+        if (out_len != ref_len || memcmp(out, ref, out_len * sizeof(char16_t)))
+            fail("strcpylen8to16", round);
+
+        valid = reference_valid(s);
+        scalar_strcpy8to16(ref, (char *) s, &ref_len);
+        if ((strcpy8to16_checked(out, (char *) s, &out_len) != NULL) != valid)
+            fail("validity", round);
+        else if (valid && (out_len != ref_len
+                || memcmp(out, ref, out_len * sizeof(char16_t))))
+            fail("strcpy8to16_checked", round);
+    }
+}
+
+static void fuzz16to8()
+{
+    char16_t storage[MAX_CHARS + 8];
+    char out[MAX_CHARS * 3 + 1], ref[MAX_CHARS * 3 + 1];
+    size_t len, i, run;
+    int round;
+
+    for (round = 0; round < ROUNDS; round++) {
+        char16_t *s = storage + rand() % 8;
+        len = rand() % MAX_CHARS;
+        for (i = 0; i < len; i += run) {
+            unsigned int kind = rand() % 4, j;
+            run = 1 + rand() % 40;
+            if (run > len - i)
+                run = len - i;
+            for (j = 0; j < run; j++) {
+                switch (kind) {
+                case 0: s[i + j] = rand() % 0x10000; break;
+                case 1: s[i + j] = rand() % 0x100; break;
+                default: s[i + j] = rand() % 0x80; break;
+                }
+            }
+        }
+
+        if (strnlen16to8(s, len) != scalar_strnlen16to8(s, len))
+            fail("strnlen16to8", round);
+        strncpy16to8(out, s, len);
+        scalar_strncpy16to8(ref, s, len);
+        if (memcmp(out, ref, scalar_strnlen16to8(s, len) + 1))
+            fail("strncpy16to8", round);
+    }
+}
+
+static double now_s()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Builds BENCH_BYTES of text where one character in `every` is a
+ * three-byte CJK character and the rest are ASCII. */
+static char *make_text(int every)
+{
+    char *text = malloc(BENCH_BYTES + 4);
+    size_t n = 0;
+    int i = 0;
+
+    while (n < BENCH_BYTES) {
+        if (every && i++ % every == 0) {
+            text[n++] = (char) 0xe4;
+            text[n++] = (char) 0xb8;
+            text[n++] = (char) 0x80;
+        } else {
+            text[n++] = 'a' + i % 26;
+        }
+    }
+    text[n] = '\0';
+    return text;
+}
+
+static void bench(const char *name, int every)
+{
+    char *text = make_text(every);
+    size_t len = strlen8to16(text), out_len;
+    char16_t *utf16 = malloc(len * sizeof(char16_t));
+    char *utf8 = malloc(strlen(text) + 1);
+    double t, scalar8, simd8, scalar16, simd16;
+    int i, reps = 20;
+
+    /* fault the buffers in first */
+    scalar_strcpy8to16(utf16, text, &out_len);
+    scalar_strncpy16to8(utf8, utf16, out_len);
+
+    t = now_s();
+    for (i = 0; i < reps; i++)
+        scalar_strcpy8to16(utf16, text, &out_len);
+    scalar8 = now_s() - t;
+    t = now_s();
+    for (i = 0; i < reps; i++)
+        strcpy8to16(utf16, text, &out_len);
+    simd8 = now_s() - t;
+
+    t = now_s();
+    for (i = 0; i < reps; i++)
+        scalar_strncpy16to8(utf8, utf16, out_len);
+    scalar16 = now_s() - t;
+    t = now_s();
+    for (i = 0; i < reps; i++)
+        strncpy16to8(utf8, utf16, out_len);
+    simd16 = now_s() - t;
+
+    printf("%-12s 8to16 %7.0f -> %7.0f MB/s   16to8 %7.0f -> %7.0f MB/s\n", name,
+           reps * BENCH_BYTES / scalar8 / 1e6, reps * BENCH_BYTES / simd8 / 1e6,
+           reps * BENCH_BYTES / scalar16 / 1e6, reps * BENCH_BYTES / simd16 / 1e6);
+    free(text);
+    free(utf16);
+    free(utf8);
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned int seed = (argc > 1) ? (unsigned int) atoi(argv[1]) : (unsigned int) time(NULL);
+
+    srand(seed);
+    fuzz8to16();
+    fuzz16to8();
+
+    bench("ASCII", 0);
+    bench("1/20 CJK", 20);
+    bench("CJK", 1);
+
+    printf("seed %u: %d failures\n", seed, failures);
+    return failures ? 1 : 0;
+}
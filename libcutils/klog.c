@@ -42,6 +42,14 @@ void klog_init(void)
     }
 }
 
+void klog_close(void)
+{
+    if (klog_fd >= 0) {
+        close(klog_fd);
+        klog_fd = -1;
+    }
+}
+
 #define LOG_BUF_MAX 512
 
 void klog_write(int level, const char *fmt, ...)
@@ -30,6 +30,11 @@
 
 #define _REALLY_INCLUDE_SYS__SYSTEM_PROPERTIES_H_
 #include <sys/_system_properties.h>
+#include <stdio.h>
+#include <time.h>
+#include <sys/atomics.h>
+#include <sys/socket.h>
+#include <private/android_property_batch.h>
 
 int property_set(const char *key, const char *value)
 {
@@ -57,6 +62,125 @@ int property_get(const char *key, char *value, const char *default_value)
     return len;
 }
 
+static long long property_now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+/*
+ * Sleeps on the property area serial, which init bumps and futex-wakes on
+ * every property change, instead of polling property_get().
+ */
+int property_wait_for_value(const char *key, const char *value, int timeout_ms)
+{
+    char current[PROP_VALUE_MAX];
+    prop_area *pa = __system_property_area__;
+    long long deadline = property_now_ms() + timeout_ms;
+    long long remaining;
+    struct timespec ts;
+    unsigned serial;
+
+    for (;;) {
+        serial = pa->serial;
+        if (__system_property_get(key, current) > 0 &&
+                (value == NULL || strcmp(current, value) == 0)) {
+            return 0;
+        }
+
+        remaining = deadline - property_now_ms();
+        if (remaining <= 0) {
+            return -1;
+        }
+        ts.tv_sec = remaining / 1000;
+        ts.tv_nsec = (remaining % 1000) * 1000000;
+        __futex_wait(&pa->serial, serial, &ts);
+    }
+}
+
+static int property_set_batch_fallback(const char * const *keys,
+        const char * const *values, int count, int *results)
+{
+    int i, r, ret = 0;
+
+    for (i = 0; i < count; i++) {
+        r = __system_property_set(keys[i], values[i]);
+        if (results)
+            results[i] = r;
+        if (r < 0)
+            ret = -1;
+    }
+    return ret;
+}
+
+int property_set_batch(const char * const *keys, const char * const *values,
+                       int count, int *results)
+{
+    prop_msg *msgs;
+    int replies[PROPERTY_BATCH_MAX];
+    int len, fd, i, r, ret = 0;
+
+    if (count <= 0 || count > PROPERTY_BATCH_MAX)
+        return -1;
+
+    for (i = 0; i < count; i++) {
+        if (strlen(keys[i]) >= PROP_NAME_MAX || strlen(values[i]) >= PROP_VALUE_MAX)
+            return -1;
+    }
+
+    msgs = calloc(count + 1, sizeof(prop_msg));
+    if (!msgs)
+        return -1;
+
+    msgs[0].cmd = PROP_MSG_SETPROP_BATCH;
+    snprintf(msgs[0].value, sizeof(msgs[0].value), "%d", count);
+    for (i = 0; i < count; i++) {
+        msgs[i + 1].cmd = PROP_MSG_SETPROP;
+        strcpy(msgs[i + 1].name, keys[i]);
+        strcpy(msgs[i + 1].value, values[i]);
+    }
+
+    fd = socket_local_client(PROP_SERVICE_NAME, ANDROID_SOCKET_NAMESPACE_RESERVED,
+            SOCK_STREAM);
+    if (fd < 0) {
+        free(msgs);
+        return -1;
+    }
+
+    len = (count + 1) * sizeof(prop_msg);
+    r = TEMP_FAILURE_RETRY(send(fd, msgs, len, MSG_NOSIGNAL));
+    free(msgs);
+    if (r != len) {
+        close(fd);
+        return -1;
+    }
+
+    len = count * sizeof(int);
+    for (i = 0; i < len; i += r) {
+        r = TEMP_FAILURE_RETRY(recv(fd, (char *) replies + i, len - i, 0));
+        if (r <= 0)
+            break;
+    }
+    close(fd);
+
+    if (i == 0) {
+        // An older property service closes the connection without
+        // answering a batch it does not understand.
+        return property_set_batch_fallback(keys, values, count, results);
+    } else if (i < len) {
+        return -1;
+    }
+
+    for (i = 0; i < count; i++) {
+        if (results)
+            results[i] = replies[i];
+        if (replies[i] < 0)
+            ret = -1;
+    }
+    return ret;
+}
+
 int property_list(void (*propfn)(const char *key, const char *value, void *cookie), 
                   void *cookie)
 {
@@ -333,3 +457,40 @@ int property_list(void (*propfn)(const char *key, const char *value, void *cooki
 }
 
 #endif
+
+#ifndef HAVE_LIBC_SYSTEM_PROPERTIES
+int property_wait_for_value(const char *key, const char *value, int timeout_ms)
+{
+    char current[PROPERTY_VALUE_MAX];
+
+    for (;;) {
+        if (property_get(key, current, NULL) > 0 &&
+                (value == NULL || strcmp(current, value) == 0)) {
+            return 0;
+        }
+        if (timeout_ms <= 0) {
+            return -1;
+        }
+        usleep(10 * 1000);
+        timeout_ms -= 10;
+    }
+}
+
+int property_set_batch(const char * const *keys, const char * const *values,
+                       int count, int *results)
+{
+    int i, r, ret = 0;
+
+    if (count <= 0 || count > PROPERTY_BATCH_MAX)
+        return -1;
+
+    for (i = 0; i < count; i++) {
+        r = property_set(keys[i], values[i]);
+        if (results)
+            results[i] = r;
+        if (r < 0)
+            ret = -1;
+    }
+    return ret;
+}
+#endif
@@ -27,6 +27,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <sys/stat.h>
 
 static const char* CTRL_PROCPATH = "/proc/net/xt_qtaguid/ctrl";
 static const int CTRL_MAX_INPUT_LEN = 128;
@@ -53,21 +54,71 @@ void qtaguid_resTrack(void) {
 }
 
 /*
+ * The control file is opened once and kept open for the life of the
+ * process, instead of once per command. ctrlLock protects ctrlFd, ctrlPath
+ * and the tag cache.
+ */
+static pthread_mutex_t ctrlLock = PTHREAD_MUTEX_INITIALIZER;
+static const char *ctrlPath = NULL;
+static int ctrlFd = -1;
+
+/*
+ * Remembers the last tag applied to a socket, keyed by fd and inode so a
+ * reused fd number is not mistaken for the socket it replaced. Re-tagging
+ * a socket with the tag and uid it already has is then skipped.
+ */
+#define TAG_CACHE_SIZE 64
+
+struct tag_cache_entry {
+    int used;
+    int sockfd;
+    ino_t ino;
+    uint64_t kTag;
+    uid_t uid;
+};
+
+static struct tag_cache_entry tagCache[TAG_CACHE_SIZE];
+
+static void tag_cache_clear_locked(void) {
+    memset(tagCache, 0, sizeof(tagCache));
+}
+
+/*
+ * Lets tests point the library at a stand-in for the kernel control file.
+ * NULL restores the default. Any open control fd is closed.
+ */
+void qtaguid_setCtrlPath(const char *path) {
+    pthread_mutex_lock(&ctrlLock);
+    ctrlPath = path;
+    if (ctrlFd >= 0) {
+        close(ctrlFd);
+        ctrlFd = -1;
+    }
+    tag_cache_clear_locked();
+    pthread_mutex_unlock(&ctrlLock);
+}
+
+/*
+ * Must be called with ctrlLock held.
  * Returns:
  *   0 on success.
  *   -errno on failure.
  */
-static int write_ctrl(const char *cmd) {
-    int fd, res, savedErrno;
+static int write_ctrl_locked(const char *cmd) {
+    int res, savedErrno;
 
     ALOGV("write_ctrl(%s)", cmd);
 
-    fd = TEMP_FAILURE_RETRY(open(CTRL_PROCPATH, O_WRONLY));
-    if (fd < 0) {
-        return -errno;
+    if (ctrlFd < 0) {
+        ctrlFd = TEMP_FAILURE_RETRY(open(ctrlPath ? ctrlPath : CTRL_PROCPATH, O_WRONLY));
+        if (ctrlFd < 0) {
+            return -errno;
+        }
+        TEMP_FAILURE_RETRY(fcntl(ctrlFd, F_SETFD, FD_CLOEXEC));
     }
 
-    res = TEMP_FAILURE_RETRY(write(fd, cmd, strlen(cmd)));
+    /* The kernel parses exactly one command per write() */
+    res = TEMP_FAILURE_RETRY(write(ctrlFd, cmd, strlen(cmd)));
     if (res < 0) {
         savedErrno = errno;
     } else {
@@ -76,10 +127,18 @@ static int write_ctrl(const char *cmd) {
     if (res < 0) {
         ALOGI("Failed write_ctrl(%s) res=%d errno=%d", cmd, res, savedErrno);
     }
-    close(fd);
     return -savedErrno;
 }
 
+static int write_ctrl(const char *cmd) {
+    int res;
+
+    pthread_mutex_lock(&ctrlLock);
+    res = write_ctrl_locked(cmd);
+    pthread_mutex_unlock(&ctrlLock);
+    return res;
+}
+
 static int write_param(const char *param_path, const char *value) {
     int param_fd;
     int res;
@@ -96,34 +155,56 @@ static int write_param(const char *param_path, const char *value) {
     return 0;
 }
 
-int qtaguid_tagSocket(int sockfd, int tag, uid_t uid) {
+static int tag_socket_locked(int sockfd, int tag, uid_t uid) {
     char lineBuf[CTRL_MAX_INPUT_LEN];
+    struct tag_cache_entry *entry = &tagCache[sockfd & (TAG_CACHE_SIZE - 1)];
+    struct stat sb;
     int res;
     uint64_t kTag = ((uint64_t)tag << 32);
 
-    pthread_once(&resTrackInitDone, qtaguid_resTrack);
+    if (fstat(sockfd, &sb) < 0) {
+        sb.st_ino = 0;
+    } else if (entry->used && entry->sockfd == sockfd && entry->ino == sb.st_ino &&
+            entry->kTag == kTag && entry->uid == uid) {
+        ALOGV("Socket %d already tagged with tag %llx for uid %d", sockfd, kTag, uid);
+        return 0;
+    }
 
     snprintf(lineBuf, sizeof(lineBuf), "t %d %llu %d", sockfd, kTag, uid);
 
     ALOGV("Tagging socket %d with tag %llx{%u,0} for uid %d", sockfd, kTag, tag, uid);
 
-    res = write_ctrl(lineBuf);
+    res = write_ctrl_locked(lineBuf);
     if (res < 0) {
         ALOGI("Tagging socket %d with tag %llx(%d) for uid %d failed errno=%d",
              sockfd, kTag, tag, uid, res);
+        if (entry->sockfd == sockfd) {
+            entry->used = 0;
+        }
+    } else if (sb.st_ino != 0) {
+        entry->used = 1;
+        entry->sockfd = sockfd;
+        entry->ino = sb.st_ino;
+        entry->kTag = kTag;
+        entry->uid = uid;
     }
 
     return res;
 }
 
-int qtaguid_untagSocket(int sockfd) {
+static int untag_socket_locked(int sockfd) {
     char lineBuf[CTRL_MAX_INPUT_LEN];
+    struct tag_cache_entry *entry = &tagCache[sockfd & (TAG_CACHE_SIZE - 1)];
     int res;
 
     ALOGV("Untagging socket %d", sockfd);
 
+    if (entry->sockfd == sockfd) {
+        entry->used = 0;
+    }
+
     snprintf(lineBuf, sizeof(lineBuf), "u %d", sockfd);
-    res = write_ctrl(lineBuf);
+    res = write_ctrl_locked(lineBuf);
     if (res < 0) {
         ALOGI("Untagging socket %d failed errno=%d", sockfd, res);
     }
@@ -131,6 +212,49 @@ int qtaguid_untagSocket(int sockfd) {
     return res;
 }
 
+int qtaguid_tagSocket(int sockfd, int tag, uid_t uid) {
+    int res;
+
+    pthread_once(&resTrackInitDone, qtaguid_resTrack);
+
+    pthread_mutex_lock(&ctrlLock);
+    res = tag_socket_locked(sockfd, tag, uid);
+    pthread_mutex_unlock(&ctrlLock);
+
+    return res;
+}
+
+int qtaguid_untagSocket(int sockfd) {
+    int res;
+
+    pthread_mutex_lock(&ctrlLock);
+    res = untag_socket_locked(sockfd);
+    pthread_mutex_unlock(&ctrlLock);
+
+    return res;
+}
+
+int qtaguid_tagSockets(qtaguid_sock_cmd_t *cmds, int count) {
+    int i, res = 0;
+
+    pthread_once(&resTrackInitDone, qtaguid_resTrack);
+
+    pthread_mutex_lock(&ctrlLock);
+    for (i = 0; i < count; i++) {
+        if (cmds[i].untag) {
+            cmds[i].result = untag_socket_locked(cmds[i].sockfd);
+        } else {
+            cmds[i].result = tag_socket_locked(cmds[i].sockfd, cmds[i].tag, cmds[i].uid);
+        }
+        if (cmds[i].result < 0 && res == 0) {
+            res = cmds[i].result;
+        }
+    }
+    pthread_mutex_unlock(&ctrlLock);
+
+    return res;
+}
+
 int qtaguid_setCounterSet(int counterSetNum, uid_t uid) {
     char lineBuf[CTRL_MAX_INPUT_LEN];
     int res;
@@ -152,7 +276,11 @@ int qtaguid_deleteTagData(int tag, uid_t uid) {
     pthread_once(&resTrackInitDone, qtaguid_resTrack);
 
     snprintf(lineBuf, sizeof(lineBuf), "d %llu %d", kTag, uid);
-    res = write_ctrl(lineBuf);
+    pthread_mutex_lock(&ctrlLock);
+    /* deleting tag data also untags matching sockets */
+    tag_cache_clear_locked();
+    res = write_ctrl_locked(lineBuf);
+    pthread_mutex_unlock(&ctrlLock);
     if (res < 0) {
         ALOGI("Deleteing tag data with tag %llx/%d for uid %d failed with cnt=%d errno=%d",
              kTag, tag, uid, cnt, errno);
@@ -175,3 +303,84 @@ int qtaguid_setPacifier(int on) {
     }
     return 0;
 }
+
+#ifdef TEST_QTAGUID
+#include <stdlib.h>
+#include <sys/socket.h>
+
+static int check_ctrl(const char *path, const char *expected) {
+    char buf[1024];
+    int fd, len;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    len = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (len < 0) {
+        return -1;
+    }
+    buf[len] = '\0';
+    if (strcmp(buf, expected)) {
+        fprintf(stderr, "control file has\n%s\nexpected\n%s\n", buf, expected);
+        return -1;
+    }
+    return 0;
+}
+
+int main(void)
+{
+    char path[] = "/tmp/qtaguid_ctrl.XXXXXX";
+    char expected[512];
+    qtaguid_sock_cmd_t cmds[3];
+    int sv[2];
+    int fd, failures = 0;
+
+    fd = mkstemp(path);
+    if (fd < 0 || socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+        perror("setup");
+        return 1;
+    }
+    close(fd);
+    qtaguid_setCtrlPath(path);
+
+    /* the second, identical tag is served from the cache */
+    qtaguid_tagSocket(sv[0], 1, 1000);
+    qtaguid_tagSocket(sv[0], 1, 1000);
+    qtaguid_tagSocket(sv[0], 2, 1000);
+    qtaguid_untagSocket(sv[0]);
+    qtaguid_tagSocket(sv[0], 2, 1000);
+
+    memset(cmds, 0, sizeof(cmds));
+    cmds[0].sockfd = sv[1];
+    cmds[0].tag = 3;
+    cmds[0].uid = 1001;
+    cmds[1].sockfd = sv[0];
+    cmds[1].untag = 1;
+    cmds[2].sockfd = sv[1];
+    cmds[2].tag = 3;
+    cmds[2].uid = 1001;
+    if (qtaguid_tagSockets(cmds, 3) < 0) {
+        failures++;
+    }
+
+    snprintf(expected, sizeof(expected),
+             "t %d %llu 1000"
+             "t %d %llu 1000"
+             "u %d"
+             "t %d %llu 1000"
+             "t %d %llu 1001"
+             "u %d",
+             sv[0], 1ULL << 32, sv[0], 2ULL << 32, sv[0], sv[0], 2ULL << 32,
+             sv[1], 3ULL << 32, sv[0]);
+    if (check_ctrl(path, expected) < 0) {
+        failures++;
+    }
+
+    qtaguid_setCtrlPath(NULL);
+    unlink(path);
+    printf("%d failures\n", failures);
+    return failures ? 1 : 0;
+}
+#endif
@@ -21,6 +21,65 @@
 #include <assert.h>
 #include <stdlib.h>
 
+#if defined(JSTRING_NO_SIMD)
+/* scalar only, for comparing against */
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define ASCII_SSE2 1
+#elif defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define ASCII_NEON 1
+#endif
+
+/*
+ * Narrows the run of ASCII characters at the start of src, 16 at a time,
+ * into dest if it is not NULL, and returns how many were converted.  The
+ * run ends before the first character that is \0 or not ASCII, and no
+ * more than len characters are looked at.
+ */
+static inline size_t ascii16to8(char *dest, const char16_t *src, size_t len)
+{
+    size_t n = 0;
+
+#if defined(ASCII_SSE2) || defined(ASCII_NEON)
+    /*
+     * Narrowing with unsigned saturation leaves characters from 1 to 0x7f
+     * alone and turns everything else into 0 or a byte of 0x80 or more,
+     * so the result is all ASCII exactly when the input was.
+     */
+    while (len - n >= 16) {
+#if defined(ASCII_SSE2)
+        __m128i a = _mm_loadu_si128((const __m128i *) (src + n));
+        __m128i b = _mm_loadu_si128((const __m128i *) (src + n + 8));
+        __m128i v = _mm_packus_epi16(a, b);
+        if (_mm_movemask_epi8(_mm_cmpgt_epi8(v, _mm_setzero_si128())) != 0xffff)
+            break;
+        if (dest)
+            _mm_storeu_si128((__m128i *) (dest + n), v);
+#else
+        uint8x16_t v = vcombine_u8(
+                vqmovun_s16(vreinterpretq_s16_u16(vld1q_u16(src + n))),
+                vqmovun_s16(vreinterpretq_s16_u16(vld1q_u16(src + n + 8))));
+        uint8x16_t ascii = vcgtq_s8(vreinterpretq_s8_u8(v), vdupq_n_s8(0));
+        uint8x8_t all = vand_u8(vget_low_u8(ascii), vget_high_u8(ascii));
+        if (vget_lane_u64(vreinterpret_u64_u8(all), 0) != ~0ULL)
+            break;
+        if (dest)
+            vst1q_u8((uint8_t *) (dest + n), v);
+#endif
+        n += 16;
+    }
+
+    /* the rest of the run, up to the character that stopped it */
+    while (n < len && src[n] - 1u < 0x7f) {
+        if (dest)
+            dest[n] = src[n];
+        n++;
+    }
+#endif
+    return n;
+}
+
 
 /**
  * Given a UTF-16 string, compute the length of the corresponding UTF-8
@@ -55,8 +114,20 @@ extern size_t strnlen16to8(const char16_t* utf16Str, size_t len)
     /* Fast path for the usual case where 3*len is < SIZE_MAX-1.
      */
     if (len < (SIZE_MAX-1)/3) {
-        while (len--) {
-            unsigned int uic = *utf16Str++;
+        while (len) {
+            size_t n;
+            unsigned int uic;
+
+            if (*utf16Str - 1u < 0x7f
+                    && (n = ascii16to8(NULL, utf16Str, len)) != 0) {
+                utf8Len += n;
+                utf16Str += n;
+                len -= n;
+                continue;
+            }
+
+            uic = *utf16Str++;
+            len--;
 
             if (uic > 0x07ff)
                 utf8Len += 3;
@@ -112,8 +183,20 @@ extern char* strncpy16to8(char* utf8Str, const char16_t* utf16Str, size_t len)
      * strnlen16to8() properly or at a minimum checked the result of
      * its malloc(SIZE_MAX) in case of overflow.
      */
-    while (len--) {
-        unsigned int uic = *utf16Str++;
+    while (len) {
+        size_t n;
+        unsigned int uic;
+
+        if (*utf16Str - 1u < 0x7f
+                && (n = ascii16to8(utf8cur, utf16Str, len)) != 0) {
+            utf8cur += n;
+            utf16Str += n;
+            len -= n;
+            continue;
+        }
+
+        uic = *utf16Str++;
+        len--;
 
         if (uic > 0x07ff) {
             *utf8cur++ = (uic >> 12) | 0xe0;
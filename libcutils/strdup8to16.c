@@ -20,6 +20,16 @@
 #include <stdlib.h>
 #include <limits.h>
 
+#if defined(JSTRING_NO_SIMD)
+/* scalar only, for comparing against */
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define ASCII_SSE2 1
+#elif defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define ASCII_NEON 1
+#endif
+
 /* See http://www.unicode.org/reports/tr22/ for discussion
  * on invalid sequences
  */
@@ -35,6 +45,65 @@
 
 #define UNICODE_UPPER_LIMIT 0x10fffd    
 
+/*
+ * Widens the run of ASCII characters at the start of src, 16 at a time,
+ * into dest if it is not NULL, and returns how many were converted.  The
+ * run ends before the first byte that is zero or not ASCII, and no more
+ * than max bytes are looked at.
+ *
+ * Most text is ASCII, so this skips the per-character decoding for most
+ * of it.
+ */
+static inline size_t ascii8to16(char16_t *dest, const char *src, size_t max)
+{
+    size_t n = 0;
+#if defined(ASCII_SSE2) || defined(ASCII_NEON)
+    const unsigned char *s = (const unsigned char *) src;
+
+    /* aligned loads never reach into a page the string does not */
+    while (n < max && ((uintptr_t) (s + n) & 15)) {
+        if (s[n] - 1u >= 0x7f)
+            return n;
+        if (dest)
+            dest[n] = s[n];
+        n++;
+    }
+
+    while (max - n >= 16) {
+#if defined(ASCII_SSE2)
+        /* bytes from 1 to 0x7f are the ones greater than zero as signed */
+        __m128i zero = _mm_setzero_si128();
+        __m128i v = _mm_load_si128((const __m128i *) (s + n));
+        if (_mm_movemask_epi8(_mm_cmpgt_epi8(v, zero)) != 0xffff)
+            break;
+        if (dest) {
+            _mm_storeu_si128((__m128i *) (dest + n), _mm_unpacklo_epi8(v, zero));
+            _mm_storeu_si128((__m128i *) (dest + n + 8), _mm_unpackhi_epi8(v, zero));
+        }
+#else
+        uint8x16_t v = vld1q_u8(s + n);
+        uint8x16_t ascii = vcgtq_s8(vreinterpretq_s8_u8(v), vdupq_n_s8(0));
+        uint8x8_t all = vand_u8(vget_low_u8(ascii), vget_high_u8(ascii));
+        if (vget_lane_u64(vreinterpret_u64_u8(all), 0) != ~0ULL)
+            break;
+        if (dest) {
+            vst1q_u16(dest + n, vmovl_u8(vget_low_u8(v)));
+            vst1q_u16(dest + n + 8, vmovl_u8(vget_high_u8(v)));
+        }
+#endif
+        n += 16;
+    }
+
+    /* the rest of the run, up to the character that stopped it */
+    while (n < max && s[n] - 1u < 0x7f) {
+        if (dest)
+            dest[n] = s[n];
+        n++;
+    }
+#endif
+    return n;
+}
+
 /**
  * out_len is an out parameter (which may not be null) containing the
  * length of the UTF-16 string (which may contain embedded \0's)
@@ -68,10 +137,21 @@ extern char16_t * strdup8to16 (const char* s, size_t *out_len)
 extern size_t strlen8to16 (const char* utf8Str)
 {
     size_t len = 0;
+    size_t n;
     int ic;
     int expected = 0;
 
-    while ((ic = *utf8Str++) != '\0') {
+    for (;;) {
+        if ((unsigned char) *utf8Str - 1u < 0x7f) {
+            n = ascii8to16(NULL, utf8Str, SIZE_MAX);
+            len += n;
+            utf8Str += n;
+            expected = 0;
+        }
+
+        if ((ic = *utf8Str++) == '\0')
+            break;
+
         /* bytes that start 0? or 11 are lead bytes and count as characters.*/
         /* bytes that start 10 are extention bytes and are not counted */
          
@@ -152,10 +232,18 @@ extern char16_t * strcpy8to16 (char16_t *utf16Str, const char*utf8Str,
                                        size_t *out_len)
 {   
     char16_t *dest = utf16Str;
+    size_t n;
 
     while (*utf8Str != '\0') {
         uint32_t ret;
 
+        if ((unsigned char) *utf8Str < 0x80
+                && (n = ascii8to16(dest, utf8Str, SIZE_MAX)) != 0) {
+            dest += n;
+            utf8Str += n;
+            continue;
+        }
+
         ret = getUtf32FromUtf8(&utf8Str);
 
         if (ret <= 0xffff) {
@@ -190,9 +278,17 @@ extern char16_t * strcpylen8to16 (char16_t *utf16Str, const char*utf8Str,
     char16_t *dest = utf16Str;
 
     const char *end = utf8Str + length; /* This line */
+    size_t n;
     while (utf8Str < end) {             /* and this line changed. */
         uint32_t ret;
 
+        if ((unsigned char) *utf8Str < 0x80
+                && (n = ascii8to16(dest, utf8Str, end - utf8Str)) != 0) {
+            dest += n;
+            utf8Str += n;
+            continue;
+        }
+
         ret = getUtf32FromUtf8(&utf8Str);
 
         if (ret <= 0xffff) {
@@ -212,3 +308,98 @@ extern char16_t * strcpylen8to16 (char16_t *utf16Str, const char*utf8Str,
 
     return utf16Str;
 }
+
+/*
+ * Returns the number of bytes in the well-formed modified UTF-8 sequence
+ * at s, or 0 if there is none.  Besides the usual forms, that allows the
+ * two byte encoding of \0 and encoded surrogates, which is how Java
+ * writes supplementary characters.
+ */
+static int validUtf8Seq(const unsigned char *s)
+{
+    unsigned char c = s[0];
+
+    if (c < 0x80)
+        return c != 0;
+    if (c == 0xc0)
+        return s[1] == 0x80 ? 2 : 0;
+    if (c < 0xc2 || c > 0xf4 || (s[1] & 0xc0) != 0x80)
+        return 0;
+    if (c < 0xe0)
+        return 2;
+    if ((s[2] & 0xc0) != 0x80 || (c == 0xe0 && s[1] < 0xa0))
+        return 0;
+    if (c < 0xf0)
+        return 3;
+    if ((s[3] & 0xc0) != 0x80 || (c == 0xf0 && s[1] < 0x90)
+            || (c == 0xf4 && s[1] > 0x8f))
+        return 0;
+    return 4;
+}
+
+/**
+ * Like strcpy8to16, but returns NULL instead of substituting
+ * UTF16_REPLACEMENT_CHAR if utf8Str is not well-formed.  utf16Str
+ * needs room for strlen8to16(utf8Str) characters, and is left with
+ * undefined contents on failure.
+ */
+extern char16_t * strcpy8to16_checked (char16_t *utf16Str,
+                                       const char *utf8Str, size_t *out_len)
+{
+    char16_t *dest = utf16Str;
+    size_t n;
+
+    while (*utf8Str != '\0') {
+        uint32_t ret;
+
+        if ((unsigned char) *utf8Str < 0x80
+                && (n = ascii8to16(dest, utf8Str, SIZE_MAX)) != 0) {
+            dest += n;
+            utf8Str += n;
+            continue;
+        }
+
+        if (!validUtf8Seq((const unsigned char *) utf8Str))
+            return NULL;
+        ret = getUtf32FromUtf8(&utf8Str);
+
+        if (ret <= 0xffff) {
+            *dest++ = (char16_t) ret;
+        } else {
+            *dest++ = 0xd800 | ((ret - 0x10000) >> 10);
+            *dest++ = 0xdc00 | ((ret - 0x10000) &  0x3ff);
+        }
+    }
+
+    *out_len = dest - utf16Str;
+
+    return utf16Str;
+}
+
+/**
+ * Like strdup8to16, but returns NULL if s is not well-formed modified
+ * UTF-8.
+ */
+extern char16_t * strdup8to16_checked (const char* s, size_t *out_len)
+{
+    char16_t *ret;
+    size_t len;
+
+    if (s == NULL) return NULL;
+
+    len = strlen8to16(s);
+
+    // fail on overflow
+    if (len && SIZE_MAX/len < sizeof(char16_t))
+        return NULL;
+
+    ret = (char16_t *) malloc (sizeof(char16_t) * len);
+    if (ret == NULL)
+        return NULL;
+
+    if (strcpy8to16_checked (ret, s, out_len) == NULL) {
+        free(ret);
+        return NULL;
+    }
+    return ret;
+}
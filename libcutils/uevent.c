@@ -21,11 +21,41 @@
 #include <string.h>
 #include <strings.h>
 #include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
 #include <sys/un.h>
 #include <unistd.h>
 
 #include <linux/netlink.h>
 
+/*
+ * Checks that a received message has root credentials and was multicast
+ * by the kernel. Sets "user" to the sender's uid when it is known.
+ */
+static int check_kernel_msg(struct msghdr *hdr, struct sockaddr_nl *addr,
+                            uid_t *user)
+{
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(hdr);
+    if (cmsg == NULL || cmsg->cmsg_type != SCM_CREDENTIALS) {
+        /* ignoring netlink message with no sender credentials */
+        return -1;
+    }
+
+    struct ucred *cred = (struct ucred *)CMSG_DATA(cmsg);
+    *user = cred->uid;
+    if (cred->uid != 0) {
+        /* ignoring netlink message from non-root user */
+        return -1;
+    }
+
+    if (addr->nl_groups == 0 || addr->nl_pid != 0) {
+        /* ignoring non-kernel or unicast netlink message */
+        return -1;
+    }
+
+    return 0;
+}
+
 /**
  * Like recv(), but checks that messages actually originate from the kernel.
  */
@@ -66,31 +96,89 @@ ssize_t uevent_kernel_multicast_uid_recv(int socket, void *buffer,
         return n;
     }
 
-    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr);
-    if (cmsg == NULL || cmsg->cmsg_type != SCM_CREDENTIALS) {
-        /* ignoring netlink message with no sender credentials */
-        goto out;
+    if (check_kernel_msg(&hdr, &addr, user) < 0) {
+        /* clear residual potentially malicious data */
+        bzero(buffer, length);
+        errno = EIO;
+        return -1;
     }
 
-    struct ucred *cred = (struct ucred *)CMSG_DATA(cmsg);
-    *user = cred->uid;
-    if (cred->uid != 0) {
-        /* ignoring netlink message from non-root user */
-        goto out;
-    }
+    return n;
+}
 
-    if (addr.nl_groups == 0 || addr.nl_pid != 0) {
-        /* ignoring non-kernel or unicast netlink message */
-        goto out;
+#ifndef MSG_WAITFORONE
+#define MSG_WAITFORONE 0x10000
+#endif
+
+/* Same layout as the kernel's struct mmsghdr, which not every libc has */
+struct uevent_mmsghdr {
+    struct msghdr msg_hdr;
+    unsigned int msg_len;
+};
+
+#define UEVENT_BATCH_MAX 16
+
+/**
+ * Receives up to "count" messages in one system call, message i into
+ * iov[i], blocking only until the first one arrives. lengths[i] is set to
+ * the length of message i, or to -1 if it failed the checks done by
+ * uevent_kernel_multicast_uid_recv(); its buffer is then cleared and
+ * "user" is set as described above.
+ *
+ * Returns the number of messages received, or -1 on error. Falls back to
+ * receiving a single message where recvmmsg() is not available.
+ */
+int uevent_kernel_multicast_uid_recv_batch(int socket, struct iovec *iov,
+                                           ssize_t *lengths, int count,
+                                           uid_t *user)
+{
+    *user = -1;
+    if (count > UEVENT_BATCH_MAX) {
+        count = UEVENT_BATCH_MAX;
     }
 
-    return n;
+#ifdef __NR_recvmmsg
+    if (count > 1) {
+        struct uevent_mmsghdr msgs[UEVENT_BATCH_MAX];
+        struct sockaddr_nl addrs[UEVENT_BATCH_MAX];
+        char control[UEVENT_BATCH_MAX][CMSG_SPACE(sizeof(struct ucred))];
+        int i, n;
+
+        memset(msgs, 0, count * sizeof(msgs[0]));
+        for (i = 0; i < count; i++) {
+            msgs[i].msg_hdr.msg_name = &addrs[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            msgs[i].msg_hdr.msg_control = control[i];
+            msgs[i].msg_hdr.msg_controllen = sizeof(control[i]);
+        }
+
+        n = syscall(__NR_recvmmsg, socket, msgs, count, MSG_WAITFORONE, NULL);
+        if (n >= 0) {
+            for (i = 0; i < n; i++) {
+                uid_t uid = -1;
+                lengths[i] = msgs[i].msg_len;
+                if (check_kernel_msg(&msgs[i].msg_hdr, &addrs[i], &uid) < 0) {
+                    bzero(iov[i].iov_base, iov[i].iov_len);
+                    lengths[i] = -1;
+                    *user = uid;
+                }
+            }
+            return n;
+        }
+        if (errno != ENOSYS) {
+            return -1;
+        }
+    }
+#endif
 
-out:
-    /* clear residual potentially malicious data */
-    bzero(buffer, length);
-    errno = EIO;
-    return -1;
+    lengths[0] = uevent_kernel_multicast_uid_recv(socket, iov[0].iov_base,
+                                                  iov[0].iov_len, user);
+    if (lengths[0] < 0) {
+        return errno == EIO ? 1 : -1;
+    }
+    return lengths[0] == 0 ? 0 : 1;
 }
 
 int uevent_open_socket(int buf_sz, bool passcred)
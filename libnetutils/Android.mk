@@ -14,3 +14,10 @@ LOCAL_SHARED_LIBRARIES := \
 LOCAL_MODULE:= libnetutils
 
 include $(BUILD_SHARED_LIBRARY)
+
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := packet.c packet_test.c
+LOCAL_MODULE := dhcp_packet_test
+LOCAL_MODULE_TAGS := optional tests
+LOCAL_SHARED_LIBRARIES := libcutils liblog
+include $(BUILD_EXECUTABLE)
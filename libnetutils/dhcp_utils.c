@@ -30,8 +30,6 @@ static const char DAEMON_PROP_NAME[]   = "init.svc.dhcpcd";
 static const char HOSTNAME_PROP_NAME[] = "net.hostname";
 static const char DHCP_PROP_NAME_PREFIX[]  = "dhcp";
 static const char DHCP_CONFIG_PATH[]   = "/system/etc/dhcpcd/dhcpcd.conf";
-static const int NAP_TIME = 200;   /* wait for 200ms at a time */
-                                  /* when polling for property values */
 static const char DAEMON_NAME_RENEW[]  = "iprenew";
 static char errmsg[100];
 /* interface length for dhcpcd daemon start (dhcpcd_<interface> as defined in init.rc file)
@@ -65,23 +63,7 @@ void get_p2p_interface_replacement(const char *interface, char *p2p_interface) {
  */
 static int wait_for_property(const char *name, const char *desired_value, int maxwait)
 {
-    char value[PROPERTY_VALUE_MAX] = {'\0'};
-    int maxnaps = (maxwait * 1000) / NAP_TIME;
-
-    if (maxnaps < 1) {
-        maxnaps = 1;
-    }
-
-    while (maxnaps-- > 0) {
-        usleep(NAP_TIME * 1000);
-        if (property_get(name, value, NULL)) {
-            if (desired_value == NULL || 
-                    strcmp(value, desired_value) == 0) {
-                return 0;
-            }
-        }
-    }
-    return -1; /* failure */
+    return property_wait_for_value(name, desired_value, maxwait * 1000);
 }
 
 static int fill_ip_info(const char *interface,
@@ -433,7 +433,7 @@ int dhcp_init_ifc(const char *ifname)
                     return dhcp_configure(ifname, &info);
                 }
                 errno = ETIME;
-                close(s);
+                close_raw_socket(s);
                 return -1;
             }
             timeout = timeout * 2;
@@ -510,11 +510,11 @@ int dhcp_init_ifc(const char *ifname)
         case STATE_REQUESTING:
             if (info.type == DHCPACK) {
                 printerr("configuring %s\n", ifname);
-                close(s);
+                close_raw_socket(s);
                 return dhcp_configure(ifname, &info);
             } else if (info.type == DHCPNAK) {
                 printerr("configuration request denied\n");
-                close(s);
+                close_raw_socket(s);
                 return -1;
             } else {
                 printerr("ignoring %s message in state %d\n",
@@ -523,7 +523,7 @@ int dhcp_init_ifc(const char *ifname)
             break;
         }
     }
-    close(s);
+    close_raw_socket(s);
     return 0;
 }
 
@@ -17,12 +17,14 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <sys/uio.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <netinet/ip.h>
 #include <netinet/udp.h>
 #include <linux/if_packet.h>
 #include <linux/if_ether.h>
+#include <linux/filter.h>
 #include <errno.h>
 
 #ifdef ANDROID
@@ -36,9 +38,92 @@
 #endif
 
 #include "dhcpmsg.h"
+#include "packet.h"
 
 int fatal();
 
+/*
+ * Classic BPF program run by the kernel on every frame the raw socket
+ * sees. Only unfragmented UDP datagrams addressed to the DHCP client port
+ * are queued, so the client is not woken up for unrelated broadcast
+ * traffic. The socket is SOCK_DGRAM, so offset 0 is the IP header.
+ */
+static struct sock_filter dhcp_filter_insns[] = {
+    /* IP protocol must be UDP */
+    BPF_STMT(BPF_LD  + BPF_B   + BPF_ABS, 9),
+    BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K,   IPPROTO_UDP, 0, 6),
+    /* no fragments: offset must be zero */
+    BPF_STMT(BPF_LD  + BPF_H   + BPF_ABS, 6),
+    BPF_JUMP(BPF_JMP + BPF_JSET + BPF_K,  0x1fff, 4, 0),
+    /* X = IP header length, UDP destination port must be bootpc */
+    BPF_STMT(BPF_LDX + BPF_B   + BPF_MSH, 0),
+    BPF_STMT(BPF_LD  + BPF_H   + BPF_IND, 2),
+    BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K,   PORT_BOOTP_CLIENT, 0, 1),
+    BPF_STMT(BPF_RET + BPF_K,             0xffff),
+    BPF_STMT(BPF_RET + BPF_K,             0),
+};
+
+int attach_dhcp_filter(int s)
+{
+    struct sock_fprog prog;
+
+    prog.len = sizeof(dhcp_filter_insns) / sizeof(dhcp_filter_insns[0]);
+    prog.filter = dhcp_filter_insns;
+    return setsockopt(s, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog));
+}
+
+/*
+ * Optional PACKET_RX_RING receive path. Frames are delivered into a ring
+ * shared with the kernel, so a burst of replies can be consumed without a
+ * read() per frame. Only one ring exists at a time since the DHCP client
+ * only ever has one raw socket open.
+ */
+#define RX_FRAME_SIZE   2048
+#define RX_FRAME_COUNT  32
+
+static struct {
+    int fd;
+    uint8_t *map;
+    size_t map_size;
+    unsigned int frame;
+} rx_ring = { -1, NULL, 0, 0 };
+
+static void setup_rx_ring(int s)
+{
+    struct tpacket_req req;
+    unsigned int block_size = getpagesize();
+    void *map;
+
+    if (block_size < RX_FRAME_SIZE) {
+        return;
+    }
+    req.tp_block_size = block_size;
+    req.tp_frame_size = RX_FRAME_SIZE;
+    req.tp_frame_nr = RX_FRAME_COUNT;
+    req.tp_block_nr = RX_FRAME_COUNT / (block_size / RX_FRAME_SIZE);
+    if (req.tp_block_nr == 0) {
+        req.tp_block_nr = 1;
+        req.tp_frame_nr = block_size / RX_FRAME_SIZE;
+    }
+
+    if (setsockopt(s, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0) {
+        return;
+    }
+    map = mmap(NULL, req.tp_block_size * req.tp_block_nr,
+               PROT_READ | PROT_WRITE, MAP_SHARED, s, 0);
+    if (map == MAP_FAILED) {
+        /* tear the ring down again so plain reads keep working */
+        memset(&req, 0, sizeof(req));
+        setsockopt(s, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req));
+        return;
+    }
+
+    rx_ring.fd = s;
+    rx_ring.map = map;
+    rx_ring.map_size = req.tp_block_size * req.tp_block_nr;
+    rx_ring.frame = 0;
+}
+
 int open_raw_socket(const char *ifname __attribute__((unused)), uint8_t *hwaddr, int if_index)
 {
     int s, flag;
@@ -48,6 +133,15 @@ int open_raw_socket(const char *ifname __attribute__((unused)), uint8_t *hwaddr,
         return fatal("socket(PF_PACKET)");
     }
 
+    /*
+     * Attach the filter before binding, so that as little unrelated
+     * traffic as possible is queued. If it can't be attached,
+     * receive_packet() still does all the checks itself.
+     */
+    if (attach_dhcp_filter(s) < 0) {
+        ALOGW("cannot attach DHCP socket filter: %s", strerror(errno));
+    }
+
     memset(&bindaddr, 0, sizeof(bindaddr));
     bindaddr.sll_family = AF_PACKET;
     bindaddr.sll_protocol = htons(ETH_P_IP);
@@ -59,9 +153,21 @@ int open_raw_socket(const char *ifname __attribute__((unused)), uint8_t *hwaddr,
         return fatal("Cannot bind raw socket to interface");
     }
 
+    setup_rx_ring(s);
+
     return s;
 }
 
+void close_raw_socket(int s)
+{
+    if (rx_ring.fd == s) {
+        munmap(rx_ring.map, rx_ring.map_size);
+        rx_ring.fd = -1;
+        rx_ring.map = NULL;
+    }
+    close(s);
+}
+
 static uint32_t checksum(void *buffer, unsigned int count, uint32_t startsum)
 {
     uint16_t *up = (uint16_t *)buffer;
@@ -153,21 +259,53 @@ int send_packet(int s, int if_index, struct dhcp_msg *msg, int size,
     return sendmsg(s, &msghdr, 0);
 }
 
+struct dhcp_packet {
+    struct iphdr ip;
+    struct udphdr udp;
+    struct dhcp_msg dhcp;
+};
+
+/*
+ * Copies the next frame out of the RX ring and hands the slot back to the
+ * kernel. Returns the number of bytes copied, or -1 if the ring is empty.
+ */
+static int read_rx_ring(struct dhcp_packet *packet)
+{
+    struct tpacket_hdr *hdr;
+    int len;
+
+    hdr = (struct tpacket_hdr *)(rx_ring.map + rx_ring.frame * RX_FRAME_SIZE);
+    if (!(hdr->tp_status & TP_STATUS_USER)) {
+        return -1;
+    }
+
+    len = hdr->tp_snaplen;
+    if (len > (int)sizeof(*packet)) {
+        len = sizeof(*packet);
+    }
+    memcpy(packet, (uint8_t *)hdr + hdr->tp_net, len);
+
+    __sync_synchronize();
+    hdr->tp_status = TP_STATUS_KERNEL;
+    rx_ring.frame = (rx_ring.frame + 1) % (rx_ring.map_size / RX_FRAME_SIZE);
+    return len;
+}
+
 int receive_packet(int s, struct dhcp_msg *msg)
 {
     int nread;
     int is_valid;
-    struct dhcp_packet {
-        struct iphdr ip;
-        struct udphdr udp;
-        struct dhcp_msg dhcp;
-    } packet;
+    struct dhcp_packet packet;
     int dhcp_size;
     uint32_t sum;
     uint16_t temp;
     uint32_t saddr, daddr;
 
-    nread = read(s, &packet, sizeof(packet));
+    if (rx_ring.fd == s) {
+        nread = read_rx_ring(&packet);
+    } else {
+        nread = read(s, &packet, sizeof(packet));
+    }
     if (nread < 0) {
         return -1;
     }
@@ -192,6 +330,10 @@ int receive_packet(int s, struct dhcp_msg *msg)
     } else if (packet.ip.protocol != IPPROTO_UDP) {
 #if VERBOSE
         ALOGD("IP protocol (%d) is not UDP", packet.ip.protocol);
+#endif
+    } else if (packet.ip.frag_off & htons(IP_OFFMASK)) {
+#if VERBOSE
+        ALOGD("IP packet is a non-initial fragment");
 #endif
     } else if (packet.udp.dest != htons(PORT_BOOTP_CLIENT)) {
 #if VERBOSE
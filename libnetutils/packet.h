@@ -18,6 +18,8 @@
 #define _WIFI_PACKET_H_
 
 int open_raw_socket(const char *ifname, uint8_t *hwaddr, int if_index);
+void close_raw_socket(int s);
+int attach_dhcp_filter(int s);
 int send_packet(int s, int if_index, struct dhcp_msg *msg, int size,
                 uint32_t saddr, uint32_t daddr, uint32_t sport, uint32_t dport);
 int receive_packet(int s, struct dhcp_msg *msg);
@@ -0,0 +1,210 @@
+/*
+ * Copyright 2012, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Feeds a mix of DHCP and unrelated IP traffic through the DHCP socket
+ * filter and receive_packet(), and reports how many times the receiver is
+ * woken up per accepted packet with and without the filter attached.
+ *
+ * A SOCK_DGRAM socketpair stands in for the raw packet socket: like a
+ * SOCK_DGRAM packet socket, each datagram starts at the IP header, and the
+ * kernel runs attached socket filters on it the same way.
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+
+#include "dhcpmsg.h"
+#include "packet.h"
+
+#define ROUNDS      64
+#define BATCH       8
+
+enum {
+    PKT_DHCP,
+    PKT_TCP,
+    PKT_UDP_DNS,
+    PKT_UDP_SERVER,
+    PKT_FRAGMENT,
+    PKT_COUNT
+};
+
+int fatal(const char *reason)
+{
+    fprintf(stderr, "%s: %s\n", reason, strerror(errno));
+    return -1;
+}
+
+static uint32_t sum16(const void *buffer, unsigned int count, uint32_t sum)
+{
+    const uint8_t *p = buffer;
+
+    while (count > 1) {
+        sum += (p[0] << 8) | p[1];
+        p += 2;
+        count -= 2;
+    }
+    if (count > 0) {
+        sum += p[0] << 8;
+    }
+    return sum;
+}
+
+static uint16_t fold(uint32_t sum)
+{
+    while (sum >> 16) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return htons(~sum & 0xffff);
+}
+
+static int build_packet(uint8_t *buf, int type)
+{
+    struct iphdr *ip = (struct iphdr *)buf;
+    struct udphdr *udp = (struct udphdr *)(buf + sizeof(*ip));
+    struct dhcp_msg *msg = (struct dhcp_msg *)(udp + 1);
+    int payload = sizeof(*msg);
+    uint32_t sum;
+    uint16_t word;
+
+    memset(buf, 0, sizeof(*ip) + sizeof(*udp) + payload);
+    msg->op = OP_BOOTREPLY;
+    msg->xid = htonl(0x12345678);
+    msg->options[0] = OPT_COOKIE1;
+    msg->options[1] = OPT_COOKIE2;
+    msg->options[2] = OPT_COOKIE3;
+    msg->options[3] = OPT_COOKIE4;
+    msg->options[4] = OPT_END;
+
+    ip->version = IPVERSION;
+    ip->ihl = sizeof(*ip) >> 2;
+    ip->tot_len = htons(sizeof(*ip) + sizeof(*udp) + payload);
+    ip->ttl = IPDEFTTL;
+    ip->protocol = (type == PKT_TCP) ? IPPROTO_TCP : IPPROTO_UDP;
+    ip->saddr = htonl(0xc0a80101);
+    ip->daddr = htonl(0xffffffff);
+    if (type == PKT_FRAGMENT) {
+        ip->frag_off = htons(185);
+    }
+    ip->check = fold(sum16(ip, sizeof(*ip), 0));
+
+    udp->source = htons(PORT_BOOTP_SERVER);
+    switch (type) {
+    case PKT_UDP_DNS:
+        udp->dest = htons(53);
+        break;
+    case PKT_UDP_SERVER:
+        udp->dest = htons(PORT_BOOTP_SERVER);
+        break;
+    default:
+        udp->dest = htons(PORT_BOOTP_CLIENT);
+        break;
+    }
+    udp->len = htons(sizeof(*udp) + payload);
+
+    sum = sum16(&ip->saddr, 8, 0);
+    word = htons(IPPROTO_UDP);
+    sum = sum16(&word, 2, sum);
+    sum = sum16(&udp->len, 2, sum);
+    sum = sum16(udp, sizeof(*udp) + payload, sum);
+    udp->check = fold(sum);
+
+    return sizeof(*ip) + sizeof(*udp) + payload;
+}
+
+static int run(int filtered, int *wakeups, int *accepted, int *expected)
+{
+    uint8_t buf[sizeof(struct iphdr) + sizeof(struct udphdr) +
+                sizeof(struct dhcp_msg)];
+    struct dhcp_msg msg;
+    struct pollfd pfd;
+    int sv[2];
+    int round, i, len, type;
+
+    if (socketpair(AF_UNIX, SOCK_DGRAM, 0, sv) < 0) {
+        return fatal("socketpair");
+    }
+    if (filtered && attach_dhcp_filter(sv[1]) < 0) {
+        return fatal("attach_dhcp_filter");
+    }
+
+    *wakeups = *accepted = *expected = 0;
+    for (round = 0; round < ROUNDS; round++) {
+        /* Mostly noise, with an occasional DHCP reply */
+        for (i = 0; i < BATCH; i++) {
+            type = (rand() % 4 == 0) ? PKT_DHCP : 1 + rand() % (PKT_COUNT - 1);
+            if (type == PKT_DHCP) {
+                (*expected)++;
+            }
+            len = build_packet(buf, type);
+            if (send(sv[0], buf, len, 0) != len) {
+                return fatal("send");
+            }
+        }
+
+        pfd.fd = sv[1];
+        pfd.events = POLLIN;
+        while (poll(&pfd, 1, 0) > 0) {
+            (*wakeups)++;
+            if (receive_packet(sv[1], &msg) >= 0) {
+                (*accepted)++;
+            }
+        }
+    }
+
+    close(sv[0]);
+    close(sv[1]);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned int seed = (argc > 1) ? (unsigned int)atoi(argv[1]) : (unsigned int)getpid();
+    int wakeups, accepted, expected;
+    int failures = 0;
+    int filtered;
+
+    for (filtered = 0; filtered <= 1; filtered++) {
+        srand(seed);
+        if (run(filtered, &wakeups, &accepted, &expected) < 0) {
+            return 1;
+        }
+        printf("%s: %d wakeups, %d accepted, %.2f wakeups per packet\n",
+               filtered ? "filtered" : "unfiltered", wakeups, accepted,
+               accepted ? (double)wakeups / accepted : 0.0);
+        if (accepted != expected) {
+            fprintf(stderr, "expected %d DHCP packets, got %d\n",
+                    expected, accepted);
+            failures++;
+        }
+        if (filtered && wakeups != accepted) {
+            fprintf(stderr, "filter let %d unrelated packets through\n",
+                    wakeups - accepted);
+            failures++;
+        }
+    }
+
+    printf("seed %u: %d failures\n", seed, failures);
+    return failures ? 1 : 0;
+}
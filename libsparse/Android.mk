@@ -90,6 +90,16 @@ LOCAL_STATIC_LIBRARIES := \
 include $(BUILD_HOST_EXECUTABLE)
 
 
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := sparse_len_test.c
+LOCAL_MODULE := sparse_len_test
+LOCAL_MODULE_TAGS := optional tests
+LOCAL_STATIC_LIBRARIES := \
+    libsparse_host \
+    libz
+include $(BUILD_HOST_EXECUTABLE)
+
+
 include $(CLEAR_VARS)
 LOCAL_MODULE := simg_dump.py
 LOCAL_SRC_FILES := simg_dump.py
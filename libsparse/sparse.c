@@ -189,33 +189,76 @@ int sparse_file_callback(struct sparse_file *s, bool sparse, bool crc,
 	return ret;
 }
 
-static int out_counter_write(void *priv, const void *data, int len)
+/*
+ * Returns the number of bytes that a backed block will occupy in the output,
+ * computed from the block metadata alone so that no backing data is read.
+ */
+static int64_t sparse_file_block_len(struct sparse_file *s,
+		struct backed_block *bb, bool sparse)
 {
-	int64_t *count = priv;
-	*count += len;
+	unsigned int len = backed_block_len(bb);
+
+	switch (backed_block_type(bb)) {
+	case BACKED_BLOCK_DATA:
+	case BACKED_BLOCK_FILE:
+	case BACKED_BLOCK_FD:
+		if (sparse) {
+			return sizeof(chunk_header_t) + ALIGN(len, s->block_size);
+		}
+		return ALIGN(len, s->block_size);
+	case BACKED_BLOCK_FILL:
+		if (sparse) {
+			return sizeof(chunk_header_t) + sizeof(uint32_t);
+		}
+		return len;
+	}
+
 	return 0;
 }
 
+/* Returns the number of bytes a skip of len bytes will occupy in the output */
+static int64_t sparse_file_skip_len(int64_t len, bool sparse)
+{
+	if (sparse) {
+		return sizeof(chunk_header_t);
+	}
+	return len;
+}
+
 int64_t sparse_file_len(struct sparse_file *s, bool sparse, bool crc)
 {
-	int ret;
-	int chunks = sparse_count_chunks(s);
+	struct backed_block *bb;
+	unsigned int last_block = 0;
 	int64_t count = 0;
-	struct output_file *out;
+	int64_t pad;
 
-	out = output_file_open_callback(out_counter_write, &count,
-			s->block_size, s->len, false, sparse, chunks, crc);
-	if (!out) {
-		return -1;
+	if (sparse) {
+		count += sizeof(sparse_header_t);
 	}
 
-	ret = write_all_blocks(s, out);
-
-	output_file_close(out);
+	for (bb = backed_block_iter_new(s->backed_block_list); bb;
+			bb = backed_block_iter_next(bb)) {
+		if (backed_block_block(bb) > last_block) {
+			unsigned int blocks = backed_block_block(bb) - last_block;
+			count += sparse_file_skip_len((int64_t)blocks * s->block_size,
+					sparse);
+		}
+		count += sparse_file_block_len(s, bb, sparse);
+		last_block = backed_block_block(bb) +
+				DIV_ROUND_UP(backed_block_len(bb), s->block_size);
+	}
 
-	if (ret < 0) {
+	pad = s->len - (int64_t)last_block * s->block_size;
+	if (pad < 0) {
 		return -1;
 	}
+	if (pad > 0) {
+		count += sparse_file_skip_len(pad, sparse);
+	}
+
+	if (sparse && crc) {
+		count += sizeof(chunk_header_t) + sizeof(uint32_t);
+	}
 
 	return count;
 }
@@ -224,7 +267,6 @@ static struct backed_block *move_chunks_up_to_len(struct sparse_file *from,
 		struct sparse_file *to, unsigned int len)
 {
 	int64_t count = 0;
-	struct output_file *out_counter;
 	struct backed_block *last_bb = NULL;
 	struct backed_block *bb;
 	struct backed_block *start;
@@ -239,16 +281,9 @@ static struct backed_block *move_chunks_up_to_len(struct sparse_file *from,
 	len -= overhead;
 
 	start = backed_block_iter_new(from->backed_block_list);
-	out_counter = output_file_open_callback(out_counter_write, &count,
-			to->block_size, to->len, false, true, 0, false);
-	if (!out_counter) {
-		return NULL;
-	}
 
 	for (bb = start; bb; bb = backed_block_iter_next(bb)) {
-		count = 0;
-		/* will call out_counter_write to update count */
-		sparse_file_write_block(out_counter, bb);
+		count = sparse_file_block_len(to, bb, true);
 		if (file_len + count > len) {
 			/*
 			 * If the remaining available size is more than 1/8th of the
@@ -269,8 +304,6 @@ out:
 	backed_block_list_move(from->backed_block_list,
 		to->backed_block_list, start, last_bb);
 
-	output_file_close(out_counter);
-
 	return bb;
 }
 
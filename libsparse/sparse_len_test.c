@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Checks that sparse_file_len(), which sizes the output from the backed
+ * block metadata alone, agrees with the number of bytes actually produced
+ * by sparse_file_callback() for randomly laid out sparse files.
+ */
+
+#define _FILE_OFFSET_BITS 64
+#define _LARGEFILE64_SOURCE 1
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sparse/sparse.h>
+
+#define BLOCK_SIZE 4096
+#define MAX_BLOCKS 4096
+
+static int count_write(void *priv, const void *data, int len)
+{
+	int64_t *count = priv;
+	*count += len;
+	return 0;
+}
+
+static struct sparse_file *random_sparse_file(char *data, int fd)
+{
+	struct sparse_file *s;
+	unsigned int block = 0;
+	unsigned int blocks;
+	unsigned int len;
+
+	s = sparse_file_new(BLOCK_SIZE, (int64_t)MAX_BLOCKS * BLOCK_SIZE);
+	if (!s) {
+		return NULL;
+	}
+
+	for (;;) {
+		block += rand() % 64;
+		blocks = 1 + rand() % 128;
+		if (block + blocks > MAX_BLOCKS) {
+			break;
+		}
+
+		len = blocks * BLOCK_SIZE;
+		/* Occasionally leave the last block partially filled */
+		if (rand() % 4 == 0) {
+			len -= rand() % BLOCK_SIZE;
+		}
+
+		switch (rand() % 3) {
+		case 0:
+			sparse_file_add_data(s, data + (int64_t)block * BLOCK_SIZE,
+					len, block);
+			break;
+		case 1:
+			sparse_file_add_fill(s, rand(), blocks * BLOCK_SIZE, block);
+			break;
+		case 2:
+			sparse_file_add_fd(s, fd, (int64_t)block * BLOCK_SIZE, len,
+					block);
+			break;
+		}
+		block += blocks;
+	}
+
+	return s;
+}
+
+static int check_len(struct sparse_file *s, bool sparse, bool crc)
+{
+	int64_t expected = 0;
+	int64_t len;
+	int ret;
+
+	ret = sparse_file_callback(s, sparse, crc, count_write, &expected);
+	if (ret < 0) {
+		fprintf(stderr, "sparse_file_callback failed: %d\n", ret);
+		return -1;
+	}
+
+	len = sparse_file_len(s, sparse, crc);
+	if (len != expected) {
+		fprintf(stderr, "sparse=%d crc=%d: sparse_file_len %lld, wrote %lld\n",
+				sparse, crc, (long long)len, (long long)expected);
+		return -1;
+	}
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	char tmpname[] = "/tmp/sparse_len_test.XXXXXX";
+	unsigned int iterations = 100;
+	unsigned int seed = getpid();
+	unsigned int i;
+	int failures = 0;
+	char *data;
+	int fd;
+
+	if (argc > 1) {
+		iterations = atoi(argv[1]);
+	}
+	if (argc > 2) {
+		seed = atoi(argv[2]);
+	}
+	srand(seed);
+
+	data = malloc((size_t)MAX_BLOCKS * BLOCK_SIZE);
+	if (!data) {
+		perror("malloc");
+		return 1;
+	}
+	for (i = 0; i < MAX_BLOCKS * BLOCK_SIZE; i++) {
+		data[i] = rand();
+	}
+
+	fd = mkstemp(tmpname);
+	if (fd < 0) {
+		perror("mkstemp");
+		return 1;
+	}
+	unlink(tmpname);
+	if (write(fd, data, (size_t)MAX_BLOCKS * BLOCK_SIZE) !=
+			(ssize_t)MAX_BLOCKS * BLOCK_SIZE) {
+		perror("write");
+		return 1;
+	}
+
+	for (i = 0; i < iterations; i++) {
+		struct sparse_file *s = random_sparse_file(data, fd);
+		if (!s) {
+			fprintf(stderr, "failed to create sparse file\n");
+			return 1;
+		}
+
+		if (check_len(s, true, false) < 0 ||
+				check_len(s, true, true) < 0 ||
+				check_len(s, false, false) < 0) {
+			failures++;
+		}
+
+		sparse_file_destroy(s);
+	}
+
+	close(fd);
+	free(data);
+
+	printf("%u iterations, seed %u: %d failures\n", iterations, seed, failures);
+
+	return failures ? 1 : 0;
+}
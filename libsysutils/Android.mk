@@ -24,4 +24,11 @@ LOCAL_SHARED_LIBRARIES := libcutils
 
 include $(BUILD_SHARED_LIBRARY)
 
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := tests/netlink_replay.cpp
+LOCAL_MODULE := netlink_replay
+LOCAL_MODULE_TAGS := optional tests
+LOCAL_SHARED_LIBRARIES := libsysutils libcutils
+include $(BUILD_EXECUTABLE)
+
 endif
@@ -13,6 +13,8 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#include <stdarg.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -40,32 +42,80 @@ const int NetlinkEvent::NlActionLinkUp = 4;
 const int NetlinkEvent::NlActionLinkDown = 5;
 
 NetlinkEvent::NetlinkEvent() {
+    reset();
+}
+
+NetlinkEvent::~NetlinkEvent() {
+}
+
+void NetlinkEvent::reset() {
+    mSeq = 0;
     mAction = NlActionUnknown;
-    memset(mParams, 0, sizeof(mParams));
     mPath = NULL;
     mSubsystem = NULL;
+    mParamCount = 0;
+    memset(mParams, 0, sizeof(mParams));
+    memset(mParamIndex, 0, sizeof(mParamIndex));
 }
 
-NetlinkEvent::~NetlinkEvent() {
+void NetlinkEvent::dump() {
     int i;
-    if (mPath)
-        free(mPath);
-    if (mSubsystem)
-        free(mSubsystem);
-    for (i = 0; i < NL_PARAMS_MAX; i++) {
+
+    for (i = 0; i < mParamCount; i++) {
         if (!mParams[i])
-            break;
-        free(mParams[i]);
+            continue;
+        SLOGD("NL param '%s'\n", mParams[i]);
     }
 }
 
-void NetlinkEvent::dump() {
-    int i;
+/* FNV-1a over the parameter name, up to '=' or the end of the string */
+static unsigned int param_hash(const char *name, size_t *lenp) {
+    unsigned int h = 2166136261u;
+    const char *p;
 
-    for (i = 0; i < NL_PARAMS_MAX; i++) {
-        if (!mParams[i])
-            break;
-        SLOGD("NL param '%s'\n", mParams[i]);
+    for (p = name; *p && *p != '='; p++) {
+        h ^= (unsigned char) *p;
+        h *= 16777619u;
+    }
+    *lenp = p - name;
+    return h;
+}
+
+void NetlinkEvent::setParam(int idx, const char *fmt, ...) {
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(mScratch[idx], sizeof(mScratch[idx]), fmt, ap);
+    va_end(ap);
+    mParams[idx] = mScratch[idx];
+    if (mParamCount <= idx)
+        mParamCount = idx + 1;
+}
+
+/*
+ * Builds the open-addressed hash index used by findParam().  When a name
+ * appears more than once, the first occurrence wins, as it always has.
+ */
+void NetlinkEvent::indexParams() {
+    memset(mParamIndex, 0, sizeof(mParamIndex));
+    for (int i = 0; i < mParamCount; i++) {
+        const char *param = mParams[i];
+        size_t len;
+        unsigned int slot;
+
+        if (!param)
+            continue;
+        slot = param_hash(param, &len) & (NL_PARAMS_HASH_SIZE - 1);
+        if (param[len] != '=')
+            continue;
+        while (mParamIndex[slot]) {
+            const char *other = mParams[mParamIndex[slot] - 1];
+            if (!strncmp(other, param, len) && other[len] == '=')
+                break;
+            slot = (slot + 1) & (NL_PARAMS_HASH_SIZE - 1);
+        }
+        if (!mParamIndex[slot])
+            mParamIndex[slot] = i + 1;
     }
 }
 
@@ -99,13 +149,10 @@ bool NetlinkEvent::parseBinaryNetlinkMessage(char *buffer, int size) {
             while(RTA_OK(rta, len)) {
                 switch(rta->rta_type) {
                 case IFLA_IFNAME:
-                    char buffer[16 + IFNAMSIZ];
-                    snprintf(buffer, sizeof(buffer), "INTERFACE=%s",
-                             (char *) RTA_DATA(rta));
-                    mParams[0] = strdup(buffer);
+                    setParam(0, "INTERFACE=%s", (char *) RTA_DATA(rta));
                     mAction = (ifi->ifi_flags & IFF_LOWER_UP) ?
                       NlActionLinkUp : NlActionLinkDown;
-                    mSubsystem = strdup("net");
+                    mSubsystem = "net";
                     break;
                 }
 
@@ -122,9 +169,9 @@ bool NetlinkEvent::parseBinaryNetlinkMessage(char *buffer, int size) {
             }
             pm = (ulog_packet_msg_t *)NLMSG_DATA(nh);
             devname = pm->indev_name[0] ? pm->indev_name : pm->outdev_name;
-            asprintf(&mParams[0], "ALERT_NAME=%s", pm->prefix);
-            asprintf(&mParams[1], "INTERFACE=%s", devname);
-            mSubsystem = strdup("qlog");
+            setParam(0, "ALERT_NAME=%s", pm->prefix);
+            setParam(1, "INTERFACE=%s", devname);
+            mSubsystem = "qlog";
             mAction = NlActionChange;
 
         } else {
@@ -133,6 +180,7 @@ bool NetlinkEvent::parseBinaryNetlinkMessage(char *buffer, int size) {
         nh = NLMSG_NEXT(nh, size);
     }
 
+    indexParams();
     return true;
 }
 
@@ -158,7 +206,8 @@ has_prefix(const char* str, const char* end, const char* prefix, size_t prefixle
 
 /*
  * Parse an ASCII-formatted message from a NETLINK_KOBJECT_UEVENT
- * netlink socket.
+ * netlink socket.  Nothing is copied: the path, subsystem and parameters
+ * are left pointing at the NUL-separated strings in the buffer.
  */
 bool NetlinkEvent::parseAsciiNetlinkMessage(char *buffer, int size) {
     const char *s = buffer;
@@ -183,7 +232,7 @@ bool NetlinkEvent::parseAsciiNetlinkMessage(char *buffer, int size) {
                     return false;
                 }
             }
-            mPath = strdup(p+1);
+            mPath = p+1;
             first = 0;
         } else {
             const char* a;
@@ -197,17 +246,20 @@ bool NetlinkEvent::parseAsciiNetlinkMessage(char *buffer, int size) {
             } else if ((a = HAS_CONST_PREFIX(s, end, "SEQNUM=")) != NULL) {
                 mSeq = atoi(a);
             } else if ((a = HAS_CONST_PREFIX(s, end, "SUBSYSTEM=")) != NULL) {
-                mSubsystem = strdup(a);
+                mSubsystem = a;
             } else if (param_idx < NL_PARAMS_MAX) {
-                mParams[param_idx++] = strdup(s);
+                mParams[param_idx++] = s;
             }
         }
         s += strlen(s) + 1;
     }
+    mParamCount = param_idx;
+    indexParams();
     return true;
 }
 
 bool NetlinkEvent::decode(char *buffer, int size, int format) {
+    reset();
     if (format == NetlinkListener::NETLINK_FORMAT_BINARY) {
         return parseBinaryNetlinkMessage(buffer, size);
     } else {
@@ -216,11 +268,15 @@ bool NetlinkEvent::decode(char *buffer, int size, int format) {
 }
 
 const char *NetlinkEvent::findParam(const char *paramName) {
-    size_t len = strlen(paramName);
-    for (int i = 0; i < NL_PARAMS_MAX && mParams[i] != NULL; ++i) {
-        const char *ptr = mParams[i] + len;
-        if (!strncmp(mParams[i], paramName, len) && *ptr == '=')
-            return ++ptr;
+    size_t len;
+    unsigned int slot = param_hash(paramName, &len) & (NL_PARAMS_HASH_SIZE - 1);
+
+    while (mParamIndex[slot]) {
+        const char *param = mParams[mParamIndex[slot] - 1];
+        if (!strncmp(param, paramName, len) && param[len] == '=' &&
+                paramName[len] == '\0')
+            return param + len + 1;
+        slot = (slot + 1) & (NL_PARAMS_HASH_SIZE - 1);
     }
 
     SLOGE("NetlinkEvent::FindParam(): Parameter '%s' not found", paramName);
@@ -17,6 +17,7 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <linux/netlink.h>
 #include <string.h>
 
@@ -41,28 +42,55 @@ NetlinkListener::NetlinkListener(int socket, int format) :
                             SocketListener(socket, false), mFormat(format) {
 }
 
+/*
+ * uevents are at most a few KB, so the receive buffer is carved into
+ * slots and filled with a batch of messages per system call.  Binary
+ * (NETLINK_ROUTE) messages can be larger and are still read one at a time
+ * into the whole buffer.
+ */
+#define UEVENT_BATCH 8
+
 bool NetlinkListener::onDataAvailable(SocketClient *cli)
 {
     int socket = cli->getSocket();
-    ssize_t count;
+    struct iovec iov[UEVENT_BATCH];
+    ssize_t lengths[UEVENT_BATCH];
+    int count, i;
     uid_t uid = -1;
 
-    count = TEMP_FAILURE_RETRY(uevent_kernel_multicast_uid_recv(
-                                       socket, mBuffer, sizeof(mBuffer), &uid));
+    if (mFormat == NETLINK_FORMAT_BINARY) {
+        iov[0].iov_base = mBuffer;
+        iov[0].iov_len = sizeof(mBuffer);
+        lengths[0] = TEMP_FAILURE_RETRY(uevent_kernel_multicast_uid_recv(
+                                               socket, mBuffer, sizeof(mBuffer), &uid));
+        count = (lengths[0] < 0 && errno != EIO) ? -1 : 1;
+    } else {
+        for (i = 0; i < UEVENT_BATCH; i++) {
+            iov[i].iov_base = mBuffer + i * (sizeof(mBuffer) / UEVENT_BATCH);
+            iov[i].iov_len = sizeof(mBuffer) / UEVENT_BATCH;
+        }
+        count = TEMP_FAILURE_RETRY(uevent_kernel_multicast_uid_recv_batch(
+                                           socket, iov, lengths, UEVENT_BATCH, &uid));
+    }
     if (count < 0) {
-        if (uid > 0)
-            LOG_EVENT_INT(65537, uid);
         SLOGE("recvmsg failed (%s)", strerror(errno));
         return false;
     }
 
-    NetlinkEvent *evt = new NetlinkEvent();
-    if (!evt->decode(mBuffer, count, mFormat)) {
-        SLOGE("Error decoding NetlinkEvent");
-    } else {
-        onEvent(evt);
+    NetlinkEvent evt;
+    for (i = 0; i < count; i++) {
+        if (lengths[i] < 0) {
+            if (uid > 0)
+                LOG_EVENT_INT(65537, uid);
+            SLOGE("recvmsg failed (%s)", strerror(EIO));
+            continue;
+        }
+        if (!evt.decode((char *) iov[i].iov_base, lengths[i], mFormat)) {
+            SLOGE("Error decoding NetlinkEvent");
+        } else {
+            onEvent(&evt);
+        }
     }
 
-    delete evt;
     return true;
 }
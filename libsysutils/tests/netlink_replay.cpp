@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Captures uevents from the kernel into a file, and replays such a
+ * capture through NetlinkEvent::decode() and findParam() to measure the
+ * per-event parsing cost.  findParam() logs every name it cannot find, so
+ * the timed replay only looks up the names a first, untimed pass found.
+ *
+ *   netlink_replay capture <file> <count>
+ *   netlink_replay replay <file> [iterations]
+ *
+ * Captures are a sequence of records, each a native-endian uint32_t
+ * length followed by the raw message.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cutils/uevent.h>
+#include <sysutils/NetlinkEvent.h>
+
+static const char *kLookups[] = {
+    "DEVPATH", "DEVNAME", "DEVTYPE", "MAJOR", "MINOR", "PARTN", "INTERFACE",
+};
+
+static int capture(const char *path, int count) {
+    char buffer[64 * 1024];
+    FILE *out;
+    int sock;
+    int i;
+
+    sock = uevent_open_socket(256 * 1024, true);
+    if (sock < 0) {
+        fprintf(stderr, "cannot open uevent socket: %s\n", strerror(errno));
+        return 1;
+    }
+    out = fopen(path, "w");
+    if (!out) {
+        fprintf(stderr, "cannot create %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+
+    for (i = 0; i < count; ) {
+        ssize_t n = uevent_kernel_multicast_recv(sock, buffer, sizeof(buffer));
+        if (n <= 0)
+            continue;
+        uint32_t len = n;
+        fwrite(&len, sizeof(len), 1, out);
+        fwrite(buffer, 1, len, out);
+        i++;
+    }
+
+    fclose(out);
+    close(sock);
+    printf("captured %d uevents into %s\n", count, path);
+    return 0;
+}
+
+struct record {
+    char *msg;
+    uint32_t len;
+    unsigned int present;   /* bit k set if kLookups[k] is in the event */
+};
+
+static int replay(const char *path, int iterations) {
+    static const unsigned int kNumLookups = sizeof(kLookups) / sizeof(kLookups[0]);
+    struct timespec start, end;
+    struct record *records;
+    char *data;
+    long size, off;
+    FILE *in;
+    int count = 0, events = 0, found = 0, missing = 0;
+    unsigned int k;
+    int i, r;
+
+    in = fopen(path, "r");
+    if (!in) {
+        fprintf(stderr, "cannot open %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    fseek(in, 0, SEEK_END);
+    size = ftell(in);
+    rewind(in);
+    data = (char *) malloc(size);
+    records = (struct record *) malloc((size / sizeof(uint32_t) + 1) * sizeof(*records));
+    if (!data || !records || fread(data, 1, size, in) != (size_t) size) {
+        fprintf(stderr, "cannot read %s\n", path);
+        return 1;
+    }
+    fclose(in);
+
+    /*
+     * decode() only NUL-terminates the message, which uevents already are,
+     * and leaves the event pointing into it, so events are parsed in place
+     * as NetlinkListener does with its receive buffer.
+     */
+    NetlinkEvent evt;
+    for (off = 0; off + (long) sizeof(uint32_t) <= size; count++) {
+        struct record *rec = &records[count];
+        memcpy(&rec->len, data + off, sizeof(rec->len));
+        off += sizeof(rec->len);
+        if (rec->len == 0 || off + rec->len > (unsigned long) size)
+            break;
+        rec->msg = data + off;
+        off += rec->len;
+
+        rec->present = 0;
+        if (evt.decode(rec->msg, rec->len)) {
+            for (k = 0; k < kNumLookups; k++) {
+                if (evt.findParam(kLookups[k]))
+                    rec->present |= 1 << k;
+                else
+                    missing++;
+            }
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < iterations; i++) {
+        for (r = 0; r < count; r++) {
+            if (evt.decode(records[r].msg, records[r].len)) {
+                for (k = 0; k < kNumLookups; k++) {
+                    if ((records[r].present & (1 << k)) && evt.findParam(kLookups[k]))
+                        found++;
+                }
+            }
+            events++;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+    printf("%d events, %d params found, %.0f ns per event "
+           "(%d missing params per pass not looked up)\n",
+           events, found, events ? ns / events : 0.0, missing);
+    free(records);
+    free(data);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc >= 4 && !strcmp(argv[1], "capture"))
+        return capture(argv[2], atoi(argv[3]));
+    if (argc >= 3 && !strcmp(argv[1], "replay"))
+        return replay(argv[2], argc >= 4 ? atoi(argv[3]) : 1000);
+
+    fprintf(stderr, "usage: %s capture <file> <count>\n"
+                    "       %s replay <file> [iterations]\n", argv[0], argv[0]);
+    return 1;
+}
@@ -28,6 +28,16 @@ LOCAL_SRC_FILES := usbhost.c
 
 include $(BUILD_HOST_STATIC_LIBRARY)
 
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := usb_stream_test
+LOCAL_MODULE_TAGS := optional tests
+LOCAL_SRC_FILES := usb_stream_test.c
+LOCAL_STATIC_LIBRARIES := libusbhost
+LOCAL_LDLIBS := -lpthread
+
+include $(BUILD_HOST_EXECUTABLE)
+
 endif
 
 # Shared library for target
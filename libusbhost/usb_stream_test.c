@@ -0,0 +1,581 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Runs usb_stream transfers against a fake usbfs device and checks that data
+ * arrives complete and in order, that short reads, errors and timeouts leave
+ * no URB in flight, and reports the throughput reached at each queue depth.
+ *
+ * The fake device keeps a virtual clock. A URB occupies the bus for its
+ * length divided by BUS_BYTES_PER_US, and the host sees it complete
+ * COMPLETION_US later. Completions that are ready together are reaped in
+ * reverse order, so the stream has to put them back in sequence itself.
+ * Requests and streams share the device, and each has to hand the other's
+ * completions back.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include <linux/usbdevice_fs.h>
+
+#include "usbhost/usbhost.h"
+#include "usbfs.h"
+
+#define MAX_URB_SIZE        16384       /* MAX_USBFS_BUFFER_SIZE in usbhost.c */
+#define FAKE_QUEUE          64
+
+#define BUS_BYTES_PER_US    40          /* high speed bulk, roughly */
+#define COMPLETION_US       150         /* interrupt and wakeup */
+#define SYSCALL_US          2
+
+#define NEVER               (1LL << 62)
+
+struct fake_urb {
+    struct usbdevfs_urb *urb;
+    long long done_at;
+    int status;
+    int actual;
+    int in_offset;
+};
+
+static struct {
+    /* submitted and not yet complete, in bus order */
+    struct fake_urb queue[FAKE_QUEUE];
+    int queued;
+    /* complete and not yet reaped */
+    struct fake_urb ready[FAKE_QUEUE];
+    int nready;
+
+    long long now;
+    long long bus_free;
+    int max_in_flight;
+    int oversized;
+    int bad_waits;
+
+    /* IN endpoint: bytes the device has to send */
+    const unsigned char *source;
+    int in_avail;
+    int in_pos;
+    int in_disabled;
+    int in_silent;
+
+    /* OUT endpoint: where the device puts what it receives */
+    unsigned char *sink;
+    int sink_size;
+    int sink_len;
+
+    /* fault injection */
+    int submits;
+    int fail_submit_at;
+    int urbs;
+    int fail_urb_at;
+    int halted;
+    int reap_errno;
+    int reap_errors;
+    int reaps;
+    int disconnect_at;
+} fake;
+
+static void fake_reset(void)
+{
+    memset(&fake, 0, sizeof(fake));
+    fake.fail_submit_at = -1;
+    fake.fail_urb_at = -1;
+    fake.disconnect_at = -1;
+}
+
+static int in_flight(void)
+{
+    return fake.queued + fake.nready;
+}
+
+/* Moves every URB the host can see as complete by 'when' to the ready list */
+static void fake_advance(long long when)
+{
+    int i, j;
+
+    if (when > fake.now)
+        fake.now = when;
+    for (i = 0, j = 0; i < fake.queued; i++) {
+        if (fake.queue[i].done_at <= fake.now)
+            fake.ready[fake.nready++] = fake.queue[i];
+        else
+            fake.queue[j++] = fake.queue[i];
+    }
+    fake.queued = j;
+}
+
+static long long next_completion(void)
+{
+    long long next = NEVER;
+    int i;
+
+    for (i = 0; i < fake.queued; i++) {
+        if (fake.queue[i].done_at < next)
+            next = fake.queue[i].done_at;
+    }
+    return next;
+}
+
+static int fake_submit(struct usbdevfs_urb *urb)
+{
+    struct fake_urb *f;
+    int len = urb->buffer_length;
+    long long start;
+
+    if (fake.submits++ == fake.fail_submit_at) {
+        errno = ENOMEM;
+        return -1;
+    }
+    if (len > MAX_URB_SIZE) {
+        fake.oversized++;
+        errno = EINVAL;
+        return -1;
+    }
+
+    f = &fake.queue[fake.queued++];
+    memset(f, 0, sizeof(*f));
+    f->urb = urb;
+    if (in_flight() > fake.max_in_flight)
+        fake.max_in_flight = in_flight();
+
+    if (urb->endpoint & USB_DIR_IN) {
+        if (!(urb->flags & USBDEVFS_URB_BULK_CONTINUATION))
+            fake.in_disabled = 0;
+        if (fake.in_disabled) {
+            // usbfs cancels the rest of a transfer after a short packet
+            f->status = -ECONNRESET;
+            f->done_at = fake.bus_free > fake.now ? fake.bus_free : fake.now;
+            return 0;
+        }
+    }
+
+    if (fake.halted || fake.urbs++ == fake.fail_urb_at) {
+        fake.halted = 1;
+        f->status = -EPIPE;
+    } else if (urb->endpoint & USB_DIR_IN) {
+        f->in_offset = fake.in_pos;
+        f->actual = fake.in_avail - fake.in_pos;
+        if (f->actual > len)
+            f->actual = len;
+        fake.in_pos += f->actual;
+        if (f->actual < len && (urb->flags & USBDEVFS_URB_SHORT_NOT_OK)) {
+            f->status = -EREMOTEIO;
+            fake.in_disabled = 1;
+        }
+    } else {
+        if (fake.sink) {
+            if (fake.sink_len + len > fake.sink_size) {
+                errno = EOVERFLOW;
+                fake.queued--;
+                return -1;
+            }
+            memcpy(fake.sink + fake.sink_len, urb->buffer, len);
+        }
+        fake.sink_len += len;
+        f->actual = len;
+    }
+
+    start = fake.bus_free > fake.now ? fake.bus_free : fake.now;
+    fake.bus_free = start + f->actual / BUS_BYTES_PER_US;
+    f->done_at = fake.bus_free + COMPLETION_US;
+    if ((urb->endpoint & USB_DIR_IN) && fake.in_silent)
+        f->done_at = NEVER;
+    return 0;
+}
+
+static int fake_reap(void *arg, int block)
+{
+    struct fake_urb *f;
+    struct usbdevfs_urb *urb;
+
+    if (fake.reaps++ == fake.disconnect_at) {
+        // usbfs kills and frees everything it holds for the device
+        fake.queued = fake.nready = 0;
+        fake.reap_errno = ENODEV;
+        fake.reap_errors = -1;
+    }
+    if (fake.reap_errors) {
+        if (fake.reap_errors > 0)
+            fake.reap_errors--;
+        errno = fake.reap_errno;
+        return -1;
+    }
+    fake_advance(fake.now);
+    if (fake.nready == 0 && block) {
+        if (fake.queued == 0 || next_completion() == NEVER) {
+            // the kernel would wait forever here
+            fake.bad_waits++;
+            errno = EDEADLK;
+            return -1;
+        }
+        fake_advance(next_completion());
+    }
+    if (fake.nready == 0) {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    f = &fake.ready[--fake.nready];
+    urb = f->urb;
+    if (f->actual && (urb->endpoint & USB_DIR_IN))
+        memcpy(urb->buffer, fake.source + f->in_offset, f->actual);
+    urb->status = f->status;
+    urb->actual_length = f->actual;
+    *(struct usbdevfs_urb **)arg = urb;
+    return 0;
+}
+
+static int fake_discard(struct usbdevfs_urb *urb)
+{
+    int i;
+
+    for (i = 0; i < fake.queued; i++) {
+        if (fake.queue[i].urb == urb) {
+            fake.queue[i].status = -ENOENT;
+            fake.queue[i].actual = 0;
+            fake.queue[i].done_at = fake.now;
+            fake_advance(fake.now);
+            return 0;
+        }
+    }
+    errno = EINVAL;
+    return -1;
+}
+
+static int fake_ioctl(int fd, unsigned long request, void *arg)
+{
+    fake.now += SYSCALL_US;
+    switch (request) {
+    case USBDEVFS_SUBMITURB:
+        return fake_submit(arg);
+    case USBDEVFS_REAPURB:
+        return fake_reap(arg, 1);
+    case USBDEVFS_REAPURBNDELAY:
+        return fake_reap(arg, 0);
+    case USBDEVFS_DISCARDURB:
+        return fake_discard(arg);
+    }
+    errno = ENOTTY;
+    return -1;
+}
+
+static int fake_poll(struct pollfd *fds, nfds_t nfds, int timeout)
+{
+    long long next;
+
+    fake.now += SYSCALL_US;
+    fake_advance(fake.now);
+    if (fake.nready == 0) {
+        next = next_completion();
+        if (next == NEVER && timeout < 0) {
+            fake.bad_waits++;
+            return 0;
+        }
+        if (timeout >= 0 && next > fake.now + timeout * 1000LL) {
+            fake.now += timeout * 1000LL;
+            return 0;
+        }
+        fake_advance(next);
+    }
+    fds[0].revents = POLLOUT;
+    return 1;
+}
+
+static const struct usbfs_ops fake_ops = {
+    fake_ioctl,
+    fake_poll,
+};
+
+static struct usb_device *device;
+static struct usb_endpoint_descriptor ep_in, ep_out, ep_int;
+static unsigned char *pattern;
+static int failures;
+
+#define PATTERN_SIZE    (32 << 20)
+
+static void check(int ok, const char *test, const char *what)
+{
+    if (!ok) {
+        fprintf(stderr, "%s: %s\n", test, what);
+        failures++;
+    }
+}
+
+static void check_result(const char *test, int res, int expected, int err)
+{
+    char msg[128];
+
+    if (expected < 0) {
+        snprintf(msg, sizeof(msg), "returned %d (%s), expected failure with %s",
+                res, strerror(errno), strerror(err));
+        check(res < 0 && errno == err, test, msg);
+    } else {
+        snprintf(msg, sizeof(msg), "returned %d (%s), expected %d",
+                res, res < 0 ? strerror(errno) : "ok", expected);
+        check(res == expected, test, msg);
+    }
+    check(fake.oversized == 0, test, "URB larger than usbfs accepts");
+    check(fake.bad_waits == 0, test, "waited with nothing in flight");
+}
+
+static void test_write(int depth, int length)
+{
+    struct usb_stream *stream = usb_stream_new(device, &ep_out, depth);
+    unsigned char *sink = malloc(length);
+    int res;
+
+    fake_reset();
+    fake.sink = sink;
+    fake.sink_size = length;
+    res = usb_stream_transfer(stream, pattern, length, 0);
+    check_result("write", res, length, 0);
+    check(fake.sink_len == length && memcmp(sink, pattern, length) == 0,
+            "write", "device received data out of order");
+    check(fake.max_in_flight <= depth, "write", "more URBs in flight than asked for");
+    check(in_flight() == 0, "write", "URBs left in flight");
+    usb_stream_free(stream);
+    free(sink);
+}
+
+static void test_read(int depth, int length, int avail)
+{
+    struct usb_stream *stream = usb_stream_new(device, &ep_in, depth);
+    unsigned char *buf = malloc(length + 1);
+    int expected = avail < length ? avail : length;
+    int res;
+
+    fake_reset();
+    fake.source = pattern;
+    fake.in_avail = avail;
+    memset(buf, 0, length + 1);
+    res = usb_stream_transfer(stream, buf, length, 0);
+    check_result("read", res, expected, 0);
+    check(memcmp(buf, pattern, expected) == 0, "read", "data out of order");
+    check(in_flight() == 0, "read", "URBs left in flight after a short read");
+
+    // the next transfer starts fresh with whatever the device sends next
+    fake.in_avail += 5000;
+    memset(buf, 0, length + 1);
+    res = usb_stream_transfer(stream, buf, length, 0);
+    if (avail < length) {
+        check_result("read again", res, 5000, 0);
+        check(memcmp(buf, pattern + fake.in_pos - 5000, 5000) == 0,
+                "read again", "picked up data from the previous transfer");
+    }
+    check(in_flight() == 0, "read again", "URBs left in flight");
+    usb_stream_free(stream);
+    free(buf);
+}
+
+static void test_failures(void)
+{
+    struct usb_stream *stream;
+    unsigned char *buf = malloc(1 << 20);
+    int res;
+
+    // a stalled endpoint part way through a write
+    stream = usb_stream_new(device, &ep_out, 8);
+    fake_reset();
+    fake.fail_urb_at = 5;
+    res = usb_stream_transfer(stream, pattern, 1 << 20, 0);
+    check_result("stall", res, -1, EPIPE);
+    check(in_flight() == 0, "stall", "URBs left in flight");
+
+    // usbfs refusing a URB
+    fake_reset();
+    fake.fail_submit_at = 10;
+    res = usb_stream_transfer(stream, pattern, 1 << 20, 0);
+    check_result("submit", res, -1, ENOMEM);
+    check(in_flight() == 0, "submit", "URBs left in flight");
+    usb_stream_free(stream);
+
+    // a device that never answers
+    stream = usb_stream_new(device, &ep_in, 8);
+    fake_reset();
+    fake.source = pattern;
+    fake.in_avail = 1 << 20;
+    fake.in_silent = 1;
+    res = usb_stream_transfer(stream, buf, 1 << 20, 50);
+    check_result("timeout", res, -1, ETIMEDOUT);
+    check(in_flight() == 0, "timeout", "URBs left in flight");
+
+    // reaping fails, but keeps going once retried
+    fake_reset();
+    fake.source = pattern;
+    fake.in_avail = 1 << 20;
+    fake.in_silent = 1;
+    fake.reap_errno = EINTR;
+    fake.reap_errors = 3;
+    res = usb_stream_transfer(stream, buf, 1 << 20, 50);
+    check_result("interrupted", res, -1, ETIMEDOUT);
+    check(in_flight() == 0, "interrupted", "URBs left in flight");
+
+    // the device goes away: usbfs drops every URB and reports ENODEV
+    fake_reset();
+    fake.source = pattern;
+    fake.in_avail = 1 << 20;
+    fake.disconnect_at = 2;
+    res = usb_stream_transfer(stream, buf, 1 << 20, 0);
+    check_result("disconnect", res, -1, ENODEV);
+    fake_reset();
+    fake.source = pattern;
+    fake.in_avail = 4096;
+    res = usb_stream_transfer(stream, buf, 1 << 20, 0);
+    check_result("reconnect", res, 4096, 0);
+
+    // URBs that cannot be taken back: the stream must not be used again
+    fake_reset();
+    fake.source = pattern;
+    fake.in_avail = 1 << 20;
+    fake.in_silent = 1;
+    fake.reap_errno = EIO;
+    fake.reap_errors = 1000;
+    res = usb_stream_transfer(stream, buf, 1 << 20, 50);
+    check_result("unreclaimable", res, -1, ENOTRECOVERABLE);
+    fake.reap_errors = 0;
+    fake.submits = 0;
+    res = usb_stream_transfer(stream, buf, 4096, 0);
+    check_result("dead stream", res, -1, ENOTRECOVERABLE);
+    check(fake.submits == 0, "dead stream", "URBs reused while still in flight");
+    usb_stream_free(stream);
+
+    free(buf);
+}
+
+/* A stream and a request on the same device each reap the other's URBs */
+static void test_shared(void)
+{
+    struct usb_stream *stream = usb_stream_new(device, &ep_in, 4);
+    struct usb_request *req = usb_request_new(device, &ep_int);
+    unsigned char *buf = malloc(1 << 20);
+    unsigned char event[64];
+    int res;
+
+    // the request completes while the stream is reading
+    fake_reset();
+    fake.source = pattern;
+    fake.in_avail = 1 << 20;
+    req->buffer = event;
+    req->buffer_length = sizeof(event);
+    check(usb_request_queue(req) == 0, "request in stream", "cannot queue request");
+    res = usb_stream_transfer(stream, buf, 1 << 20, 0);
+    check_result("request in stream", res, 1 << 20, 0);
+    check(memcmp(buf, pattern, 1 << 20) == 0, "request in stream", "data out of order");
+    check(usb_request_wait(device) == req && req->actual_length == sizeof(event),
+            "request in stream", "request reaped by the stream was lost");
+    check(fake.bad_waits == 0, "request in stream", "waited with nothing in flight");
+
+    // a stream's URBs complete while only the request is waited for
+    fake_reset();
+    fake.source = pattern;
+    fake.in_avail = 1 << 20;
+    fake.reap_errno = EIO;
+    fake.reap_errors = 2;
+    res = usb_stream_transfer(stream, buf, 1 << 20, 0);
+    check_result("stream in request", res, -1, ENOTRECOVERABLE);
+    check(usb_request_queue(req) == 0, "stream in request", "cannot queue request");
+    check(usb_request_wait(device) == req && req->actual_length == sizeof(event),
+            "stream in request", "stream URB returned as a request");
+    check(in_flight() == 0, "stream in request", "URBs left in flight");
+
+    usb_stream_free(stream);
+    usb_request_free(req);
+    free(buf);
+}
+
+/* The pre-stream way to move a large buffer: one URB at a time */
+static double request_throughput(int length)
+{
+    struct usb_request *req = usb_request_new(device, &ep_out);
+    int offset;
+
+    fake_reset();
+    for (offset = 0; offset < length; offset += req->actual_length) {
+        req->buffer = pattern + offset;
+        req->buffer_length = length - offset;
+        if (usb_request_queue(req) < 0 || usb_request_wait(device) != req) {
+            failures++;
+            break;
+        }
+    }
+    usb_request_free(req);
+    return (double)length / fake.now;
+}
+
+static double stream_throughput(int depth, int length)
+{
+    struct usb_stream *stream = usb_stream_new(device, &ep_out, depth);
+
+    fake_reset();
+    if (usb_stream_transfer(stream, pattern, length, 0) != length)
+        failures++;
+    usb_stream_free(stream);
+    return (double)length / fake.now;
+}
+
+int main(int argc, char *argv[])
+{
+    int depths[] = { 1, 2, 4, 8, 16 };
+    int i, fd;
+
+    pattern = malloc(PATTERN_SIZE);
+    srand(1);
+    for (i = 0; i < PATTERN_SIZE; i++)
+        pattern[i] = rand();
+
+    fd = open("/dev/null", O_RDONLY);
+    device = usb_device_new("/dev/bus/usb/001/001", fd);
+    if (!device) {
+        perror("usb_device_new");
+        return 1;
+    }
+    ep_in.bEndpointAddress = USB_DIR_IN | 1;
+    ep_in.bmAttributes = USB_ENDPOINT_XFER_BULK;
+    ep_out.bEndpointAddress = USB_DIR_OUT | 2;
+    ep_out.bmAttributes = USB_ENDPOINT_XFER_BULK;
+    ep_int.bEndpointAddress = USB_DIR_OUT | 3;
+    ep_int.bmAttributes = USB_ENDPOINT_XFER_INT;
+    usb_host_set_usbfs_ops(&fake_ops);
+
+    for (i = 0; i < (int)(sizeof(depths) / sizeof(depths[0])); i++) {
+        test_write(depths[i], (1 << 20) + 12345);
+        test_read(depths[i], 1 << 20, 300000);
+        test_read(depths[i], 4 * MAX_URB_SIZE, 4 * MAX_URB_SIZE);
+        test_read(depths[i], 1 << 20, 0);
+    }
+    test_write(4, 0);
+    test_failures();
+    test_shared();
+
+    printf("usb_request:      %6.1f MB/s\n", request_throughput(PATTERN_SIZE));
+    for (i = 0; i < (int)(sizeof(depths) / sizeof(depths[0])); i++) {
+        printf("usb_stream x%-2d:   %6.1f MB/s\n", depths[i],
+                stream_throughput(depths[i], PATTERN_SIZE));
+    }
+
+    usb_host_set_usbfs_ops(NULL);
+    usb_device_close(device);
+    free(pattern);
+    printf("%d failures\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,36 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __LIBUSBHOST_USBFS_H
+#define __LIBUSBHOST_USBFS_H
+
+#include <poll.h>
+
+/* The calls libusbhost makes on an open usbfs device file.
+ * The defaults go to the kernel; tests install a fake device with
+ * usb_host_set_usbfs_ops() so transfers can run on a plain Linux host.
+ */
+struct usbfs_ops {
+    int (*ioctl)(int fd, unsigned long request, void *arg);
+    int (*poll)(struct pollfd *fds, nfds_t nfds, int timeout);
+};
+
+/* Replaces the usbfs backend, or restores the kernel one if ops is NULL.
+ * Must not be called while any transfer is in progress.
+ */
+void usb_host_set_usbfs_ops(const struct usbfs_ops *ops);
+
+#endif /* __LIBUSBHOST_USBFS_H */
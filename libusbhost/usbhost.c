@@ -42,12 +42,14 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <ctype.h>
+#include <poll.h>
 #include <pthread.h>
 
 #include <linux/usbdevice_fs.h>
 #include <asm/byteorder.h>
 
 #include "usbhost/usbhost.h"
+#include "usbfs.h"
 
 #define DEV_DIR             "/dev"
 #define USB_FS_DIR          "/dev/bus/usb"
@@ -62,12 +64,51 @@ struct usb_host_context {
     int fd;
 };
 
+static int usbfs_kernel_ioctl(int fd, unsigned long request, void *arg)
+{
+    return ioctl(fd, request, arg);
+}
+
+static const struct usbfs_ops usbfs_kernel_ops = {
+    usbfs_kernel_ioctl,
+    poll,
+};
+
+static const struct usbfs_ops *usbfs = &usbfs_kernel_ops;
+
+/* Every URB we submit, so that whoever reaps it can hand it to its owner */
+struct usb_urb {
+    struct usbdevfs_urb urb;    /* must be first */
+    struct usb_stream *stream;  /* owning stream, or NULL for a usb_request */
+    struct usb_urb *next;       /* on the device's list of reaped requests */
+    int busy;
+    int done;
+};
+
+struct usb_stream {
+    struct usb_device *dev;
+    unsigned char type;
+    unsigned char endpoint;
+    int num_urbs;
+    int dead;       /* URBs could not be reclaimed, see usb_stream_cancel() */
+    struct usb_urb *urbs;
+};
+
 struct usb_device {
     char dev_name[64];
     unsigned char desc[4096];
     int desc_length;
     int fd;
     int writeable;
+
+    /* Only one thread at a time waits in usbfs for completions, the others
+     * wait for it on reaped. Stream URBs are marked done and requests go on
+     * the completed list, whichever thread reaped them. */
+    pthread_mutex_t lock;
+    pthread_cond_t reaped;
+    int reaping;
+    struct usb_urb *completed;
+    struct usb_urb **completed_tail;
 };
 
 static inline int badname(const char *name)
@@ -160,6 +201,11 @@ struct usb_host_context *usb_host_init()
     return context;
 }
 
+void usb_host_set_usbfs_ops(const struct usbfs_ops *ops)
+{
+    usbfs = ops ? ops : &usbfs_kernel_ops;
+}
+
 void usb_host_cleanup(struct usb_host_context *context)
 {
     close(context->fd);
@@ -288,6 +334,8 @@ retry:
 void usb_device_close(struct usb_device *device)
 {
     close(device->fd);
+    pthread_cond_destroy(&device->reaped);
+    pthread_mutex_destroy(&device->lock);
     free(device);
 }
 
@@ -310,6 +358,9 @@ struct usb_device *usb_device_new(const char *dev_name, int fd)
     device->desc_length = length;
     // assume we are writeable, since usb_device_get_fd will only return writeable fds
     device->writeable = 1;
+    pthread_mutex_init(&device->lock, NULL);
+    pthread_cond_init(&device->reaped, NULL);
+    device->completed_tail = &device->completed;
     return device;
 
 failed:
@@ -478,12 +529,12 @@ struct usb_descriptor_header *usb_descriptor_iter_next(struct usb_descriptor_ite
 
 int usb_device_claim_interface(struct usb_device *device, unsigned int interface)
 {
-    return ioctl(device->fd, USBDEVFS_CLAIMINTERFACE, &interface);
+    return usbfs->ioctl(device->fd, USBDEVFS_CLAIMINTERFACE, &interface);
 }
 
 int usb_device_release_interface(struct usb_device *device, unsigned int interface)
 {
-    return ioctl(device->fd, USBDEVFS_RELEASEINTERFACE, &interface);
+    return usbfs->ioctl(device->fd, USBDEVFS_RELEASEINTERFACE, &interface);
 }
 
 int usb_device_connect_kernel_driver(struct usb_device *device,
@@ -494,7 +545,7 @@ int usb_device_connect_kernel_driver(struct usb_device *device,
     ctl.ifno = interface;
     ctl.ioctl_code = (connect ? USBDEVFS_CONNECT : USBDEVFS_DISCONNECT);
     ctl.data = NULL;
-    return ioctl(device->fd, USBDEVFS_IOCTL, &ctl);
+    return usbfs->ioctl(device->fd, USBDEVFS_IOCTL, &ctl);
 }
 
 int usb_device_control_transfer(struct usb_device *device,
@@ -520,7 +571,7 @@ int usb_device_control_transfer(struct usb_device *device,
     ctrl.wLength = length;
     ctrl.data = buffer;
     ctrl.timeout = timeout;
-    return ioctl(device->fd, USBDEVFS_CONTROL, &ctrl);
+    return usbfs->ioctl(device->fd, USBDEVFS_CONTROL, &ctrl);
 }
 
 int usb_device_bulk_transfer(struct usb_device *device,
@@ -540,15 +591,109 @@ int usb_device_bulk_transfer(struct usb_device *device,
     ctrl.len = length;
     ctrl.data = buffer;
     ctrl.timeout = timeout;
-    return ioctl(device->fd, USBDEVFS_BULK, &ctrl);
+    return usbfs->ioctl(device->fd, USBDEVFS_BULK, &ctrl);
+}
+
+/* Hands a reaped URB to its owner. Called with dev->lock held. */
+static void usb_device_complete(struct usb_device *dev, struct usb_urb *u)
+{
+    if (u->stream) {
+        // a dead stream may be gone by now, so only touch the URB
+        u->busy = 0;
+        u->done = 1;
+    } else {
+        u->next = NULL;
+        *dev->completed_tail = u;
+        dev->completed_tail = &u->next;
+    }
+}
+
+/* Waits for URBs to complete, reaps them and hands them to their owners.
+ * timeout is in milliseconds, or -1 to wait forever. If another thread is
+ * already waiting in usbfs, waits for it instead.
+ * Returns 0 once something may have completed, so the caller should look
+ * again, or -1 with errno set (ETIMEDOUT if nothing completed in time).
+ * Called with dev->lock held, which is dropped while waiting.
+ */
+static int usb_device_reap(struct usb_device *dev, int timeout)
+{
+    struct usbdevfs_urb *urb;
+    struct pollfd pfd;
+    struct timespec ts;
+    struct timeval tv;
+    int res, reaped = 0, error = 0;
+
+    if (dev->reaping) {
+        if (timeout < 0) {
+            pthread_cond_wait(&dev->reaped, &dev->lock);
+            return 0;
+        }
+        gettimeofday(&tv, NULL);
+        ts.tv_sec = tv.tv_sec + timeout / 1000;
+        ts.tv_nsec = tv.tv_usec * 1000 + (timeout % 1000) * 1000000;
+        if (ts.tv_nsec >= 1000000000) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000;
+        }
+        if (pthread_cond_timedwait(&dev->reaped, &dev->lock, &ts) == ETIMEDOUT) {
+            errno = ETIMEDOUT;
+            return -1;
+        }
+        return 0;
+    }
+
+    dev->reaping = 1;
+    pthread_mutex_unlock(&dev->lock);
+
+    if (timeout > 0) {
+        pfd.fd = dev->fd;
+        pfd.events = POLLOUT;
+        do {
+            res = usbfs->poll(&pfd, 1, timeout);
+        } while (res < 0 && errno == EINTR);
+        if (res <= 0)
+            error = res ? errno : ETIMEDOUT;
+    }
+    while (!error) {
+        urb = NULL;
+        res = usbfs->ioctl(dev->fd, timeout < 0 && !reaped ?
+                USBDEVFS_REAPURB : USBDEVFS_REAPURBNDELAY, &urb);
+        if (res < 0) {
+            if (errno == EINTR)
+                continue;
+            // what was reaped is handed over before an error is reported,
+            // and the caller simply looks again if poll() woke it for nothing
+            if (!reaped && errno != EAGAIN)
+                error = errno;
+            break;
+        }
+        D("[ urb @%p status = %d, actual = %d ]\n",
+            urb, urb->status, urb->actual_length);
+        pthread_mutex_lock(&dev->lock);
+        usb_device_complete(dev, (struct usb_urb *)urb);
+        pthread_mutex_unlock(&dev->lock);
+        reaped++;
+    }
+
+    pthread_mutex_lock(&dev->lock);
+    dev->reaping = 0;
+    pthread_cond_broadcast(&dev->reaped);
+    if (error) {
+        D("[ reap urb - error %d ]\n", error);
+        errno = error;
+        return -1;
+    }
+    return 0;
 }
 
 struct usb_request *usb_request_new(struct usb_device *dev,
         const struct usb_endpoint_descriptor *ep_desc)
 {
-    struct usbdevfs_urb *urb = calloc(1, sizeof(struct usbdevfs_urb));
-    if (!urb)
+    struct usb_urb *u = calloc(1, sizeof(struct usb_urb));
+    struct usbdevfs_urb *urb;
+    if (!u)
         return NULL;
+    urb = &u->urb;
 
     if ((ep_desc->bmAttributes & USB_ENDPOINT_XFERTYPE_MASK) == USB_ENDPOINT_XFER_BULK)
         urb->type = USBDEVFS_URB_TYPE_BULK;
@@ -556,14 +701,14 @@ struct usb_request *usb_request_new(struct usb_device *dev,
         urb->type = USBDEVFS_URB_TYPE_INTERRUPT;
     else {
         D("Unsupported endpoint type %d", ep_desc->bmAttributes & USB_ENDPOINT_XFERTYPE_MASK);
-        free(urb);
+        free(u);
         return NULL;
     }
     urb->endpoint = ep_desc->bEndpointAddress;
 
     struct usb_request *req = calloc(1, sizeof(struct usb_request));
     if (!req) {
-        free(urb);
+        free(u);
         return NULL;
     }
 
@@ -596,7 +741,7 @@ int usb_request_queue(struct usb_request *req)
         urb->buffer_length = req->buffer_length;
 
     do {
-        res = ioctl(req->dev->fd, USBDEVFS_SUBMITURB, urb);
+        res = usbfs->ioctl(req->dev->fd, USBDEVFS_SUBMITURB, urb);
     } while((res < 0) && (errno == EINTR));
 
     return res;
@@ -604,33 +749,230 @@ int usb_request_queue(struct usb_request *req)
 
 struct usb_request *usb_request_wait(struct usb_device *dev)
 {
-    struct usbdevfs_urb *urb = NULL;
+    struct usb_urb *u;
     struct usb_request *req = NULL;
-    int res;
 
-    while (1) {
-        int res = ioctl(dev->fd, USBDEVFS_REAPURB, &urb);
-        D("USBDEVFS_REAPURB returned %d\n", res);
-        if (res < 0) {
-            if(errno == EINTR) {
-                continue;
-            }
-            D("[ reap urb - error ]\n");
-            return NULL;
-        } else {
-            D("[ urb @%p status = %d, actual = %d ]\n",
-                urb, urb->status, urb->actual_length);
-            req = (struct usb_request*)urb->usercontext;
-            req->actual_length = urb->actual_length;
-        }
-        break;
+    pthread_mutex_lock(&dev->lock);
+    while (!dev->completed) {
+        if (usb_device_reap(dev, -1) < 0)
+            goto out;
     }
+    u = dev->completed;
+    dev->completed = u->next;
+    if (!dev->completed)
+        dev->completed_tail = &dev->completed;
+    req = (struct usb_request*)u->urb.usercontext;
+    req->actual_length = u->urb.actual_length;
+out:
+    pthread_mutex_unlock(&dev->lock);
     return req;
 }
 
 int usb_request_cancel(struct usb_request *req)
 {
     struct usbdevfs_urb *urb = ((struct usbdevfs_urb*)req->private_data);
-    return ioctl(req->dev->fd, USBDEVFS_DISCARDURB, &urb);
+    return usbfs->ioctl(req->dev->fd, USBDEVFS_DISCARDURB, &urb);
 }
 
+
+struct usb_stream *usb_stream_new(struct usb_device *dev,
+        const struct usb_endpoint_descriptor *ep_desc, int num_urbs)
+{
+    struct usb_stream *stream;
+    int type = ep_desc->bmAttributes & USB_ENDPOINT_XFERTYPE_MASK;
+    int i;
+
+    if (type != USB_ENDPOINT_XFER_BULK) {
+        D("Unsupported stream endpoint type %d", type);
+        errno = EINVAL;
+        return NULL;
+    }
+    if (num_urbs < 1)
+        num_urbs = 1;
+
+    stream = calloc(1, sizeof(struct usb_stream));
+    if (!stream)
+        return NULL;
+    stream->urbs = calloc(num_urbs, sizeof(struct usb_urb));
+    if (!stream->urbs) {
+        free(stream);
+        return NULL;
+    }
+    for (i = 0; i < num_urbs; i++)
+        stream->urbs[i].stream = stream;
+
+    stream->dev = dev;
+    stream->type = USBDEVFS_URB_TYPE_BULK;
+    stream->endpoint = ep_desc->bEndpointAddress;
+    stream->num_urbs = num_urbs;
+    return stream;
+}
+
+void usb_stream_free(struct usb_stream *stream)
+{
+    // the kernel may still complete the URBs of a dead stream
+    if (!stream->dead)
+        free(stream->urbs);
+    free(stream);
+}
+
+static int usb_stream_submit(struct usb_stream *stream, struct usb_urb *surb,
+        char *buffer, int length, int first)
+{
+    struct usbdevfs_urb *urb = &surb->urb;
+    int res;
+
+    memset(urb, 0, sizeof(*urb));
+    urb->type = stream->type;
+    urb->endpoint = stream->endpoint;
+    urb->status = -1;
+    urb->buffer = buffer;
+    urb->buffer_length = length;
+    urb->usercontext = stream;
+    if (stream->endpoint & USB_DIR_IN) {
+        // stop the endpoint queue at the first short packet, so that
+        // later URBs do not pick up data belonging to the next transfer
+        urb->flags = USBDEVFS_URB_SHORT_NOT_OK;
+        if (!first)
+            urb->flags |= USBDEVFS_URB_BULK_CONTINUATION;
+    }
+
+    do {
+        res = usbfs->ioctl(stream->dev->fd, USBDEVFS_SUBMITURB, urb);
+    } while((res < 0) && (errno == EINTR));
+
+    if (res == 0) {
+        surb->busy = 1;
+        surb->done = 0;
+    }
+    return res;
+}
+
+/* Cancels all URBs still in flight and reaps them, so that the kernel no
+ * longer refers to the caller's buffer when the transfer returns.
+ * Returns -1 if that is not possible; the stream is then marked dead and its
+ * URBs are never reused or freed. Called with the device lock held.
+ */
+static int usb_stream_cancel(struct usb_stream *stream)
+{
+    int i, busy = 0;
+
+    for (i = 0; i < stream->num_urbs; i++) {
+        if (stream->urbs[i].busy) {
+            usbfs->ioctl(stream->dev->fd, USBDEVFS_DISCARDURB, &stream->urbs[i].urb);
+            busy++;
+        }
+    }
+    while (busy) {
+        if (usb_device_reap(stream->dev, -1) < 0) {
+            if (errno != ENODEV) {
+                D("stream %p: cannot reclaim %d urbs\n", stream, busy);
+                stream->dead = 1;
+                return -1;
+            }
+            // usbfs kills every URB of a device when it is disconnected
+            for (i = 0; i < stream->num_urbs; i++) {
+                if (stream->urbs[i].busy) {
+                    stream->urbs[i].urb.status = -ENODEV;
+                    stream->urbs[i].urb.actual_length = 0;
+                    stream->urbs[i].busy = 0;
+                    stream->urbs[i].done = 1;
+                }
+            }
+        }
+        busy = 0;
+        for (i = 0; i < stream->num_urbs; i++) {
+            if (stream->urbs[i].busy)
+                busy++;
+        }
+    }
+    return 0;
+}
+
+int usb_stream_transfer(struct usb_stream *stream, void* buffer, int length,
+        unsigned int timeout)
+{
+    char *buf = buffer;
+    int nchunks = (length + MAX_USBFS_BUFFER_SIZE - 1) / MAX_USBFS_BUFFER_SIZE;
+    int submitted = 0;
+    int completed = 0;
+    int total = 0;
+    int stop = 0;
+    int error = 0;
+    int res;
+
+    if (stream->dead) {
+        errno = ENOTRECOVERABLE;
+        return -1;
+    }
+
+    // a zero length transfer is still a single (empty) URB
+    if (nchunks == 0)
+        nchunks = 1;
+
+    pthread_mutex_lock(&stream->dev->lock);
+    while (completed < submitted || (!stop && submitted < nchunks)) {
+        // keep the pipeline full
+        while (!stop && submitted < nchunks &&
+                submitted - completed < stream->num_urbs) {
+            int offset = submitted * MAX_USBFS_BUFFER_SIZE;
+            int len = length - offset;
+            if (len > MAX_USBFS_BUFFER_SIZE)
+                len = MAX_USBFS_BUFFER_SIZE;
+            res = usb_stream_submit(stream,
+                    &stream->urbs[submitted % stream->num_urbs],
+                    buf + offset, len, submitted == 0);
+            if (res < 0) {
+                error = errno;
+                stop = 1;
+                break;
+            }
+            submitted++;
+        }
+
+        // retire completions in submission order
+        if (completed < submitted) {
+            struct usb_urb *surb =
+                    &stream->urbs[completed % stream->num_urbs];
+            if (surb->done) {
+                surb->done = 0;
+                completed++;
+                if (surb->urb.status < 0 && surb->urb.status != -EREMOTEIO) {
+                    if (!stop)
+                        error = -surb->urb.status;
+                    stop = 1;
+                } else if (!stop) {
+                    total += surb->urb.actual_length;
+                    if (surb->urb.actual_length < surb->urb.buffer_length)
+                        stop = 1;
+                }
+                continue;
+            }
+        }
+
+        // the transfer is over early, take back whatever is still queued
+        if (stop) {
+            if (usb_stream_cancel(stream) < 0) {
+                error = ENOTRECOVERABLE;
+                break;
+            }
+            continue;
+        }
+
+        if (usb_device_reap(stream->dev, timeout ? (int)timeout : -1) < 0) {
+            error = errno;
+            stop = 1;
+        }
+    }
+
+    // discard anything left over from a cancelled transfer
+    for (res = 0; res < stream->num_urbs; res++)
+        stream->urbs[res].done = 0;
+    pthread_mutex_unlock(&stream->dev->lock);
+
+    if (error) {
+        errno = error;
+        return -1;
+    }
+    return total;
+}
@@ -5,6 +5,7 @@
 #include <cutils/sockets.h>
 #include <cutils/logprint.h>
 #include <cutils/event_tag_map.h>
+#include <cutils/hashmap.h>
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -16,6 +17,7 @@
 #include <errno.h>
 #include <assert.h>
 #include <ctype.h>
+#include <regex.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <arpa/inet.h>
@@ -37,9 +39,11 @@ struct queued_entry_t {
         unsigned char buf[LOGGER_ENTRY_MAX_LEN + 1] __attribute__((aligned(4)));
         struct logger_entry entry __attribute__((aligned(4)));
     };
+    int64_t euid;   // -1 unless read with the v2 ABI
     queued_entry_t* next;
 
     queued_entry_t() {
+        euid = -1;
         next = NULL;
     }
 };
@@ -96,9 +100,245 @@ static int g_outFD = -1;
 static off_t g_outByteCount = 0;
 static int g_printBinary = 0;
 static int g_devCount = 0;
+static const char * g_inputFileName = NULL;
 
 static EventTagMap* g_eventTagMap = NULL;
 
+/*
+ * Content filters.  These look at the raw logger_entry as soon as it has
+ * been read, so that entries nobody wants are dropped before they are
+ * queued, parsed or formatted.  The header fields are checked first; the
+ * message text must then match at least one -m string or -e pattern.
+ */
+
+struct id_set_t {
+    int32_t* ids;       // sorted
+    size_t count;
+};
+
+struct text_filter_t {
+    const char* literal;    // must occur in any message that matches
+    size_t literalLen;
+    bool isRegex;
+    regex_t regex;
+    text_filter_t* next;
+};
+
+static id_set_t g_pids;
+static id_set_t g_tids;
+static id_set_t g_uids;
+static text_filter_t* g_textFilters = NULL;
+static bool g_filtering = false;
+
+/* adds a comma-separated list of ids to the set */
+static int addIds(id_set_t* set, const char* list)
+{
+    const char* p = list;
+    char* end;
+
+    do {
+        long id = strtol(p, &end, 10);
+        if (end == p || (*end != ',' && *end != '\0') || id < 0 || id > INT32_MAX) {
+            return -1;
+        }
+
+        set->ids = (int32_t*) realloc(set->ids, (set->count + 1) * sizeof(int32_t));
+        size_t i = set->count++;
+        while (i > 0 && set->ids[i - 1] > id) {
+            set->ids[i] = set->ids[i - 1];
+            i--;
+        }
+        set->ids[i] = id;
+
+        p = end + 1;
+    } while (*end == ',');
+
+    g_filtering = true;
+    return 0;
+}
+
+/* an empty set matches everything */
+static bool idSetMatches(const id_set_t* set, int64_t id)
+{
+    size_t lo = 0, hi = set->count;
+
+    if (set->count == 0) {
+        return true;
+    }
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (set->ids[mid] < id) {
+            lo = mid + 1;
+        } else if (set->ids[mid] > id) {
+            hi = mid;
+        } else {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Finds the longest run of literal characters that any match of the
+ * extended regular expression re must contain, and copies it to out.
+ * Returns its length, which is 0 when there is no such run, for example
+ * because of a top-level alternation.  Anything inside brackets or a
+ * group, and a character followed by '*', '?' or '{', ends the run; a
+ * character followed by '+' ends one run and starts the next.
+ */
+static size_t requiredLiteral(const char* re, char* out, size_t outSize)
+{
+    char run[256];
+    size_t runLen = 0, bestLen = 0;
+    bool lastWasLiteral = false;
+    int depth = 0;
+
+    for (const char* p = re; ; p++) {
+        char c = *p;
+        bool literal = false;
+
+        if (c == '\\' && p[1] != '\0' && !isalnum((unsigned char) p[1])) {
+            c = *++p;
+            literal = (depth == 0);
+        } else if (c == '\\' && p[1] != '\0') {
+            p++;        // \w, \b and friends
+        } else if (c == '[') {
+            p++;
+            if (*p == '^') p++;
+            if (*p == ']') p++;
+            while (*p != '\0' && *p != ']') p++;
+            if (*p == '\0') break;
+        } else if (c == '(') {
+            depth++;
+        } else if (c == ')') {
+            depth--;
+        } else if (c == '|') {
+            if (depth == 0) return 0;
+        } else if (c == '*' || c == '?' || c == '{') {
+            // the previous character may be absent
+            if (lastWasLiteral) runLen--;
+            if (c == '{') {
+                while (*p != '\0' && *p != '}') p++;
+                if (*p == '\0') break;
+            }
+        } else if (c != '\0' && c != '+' && c != '.' && c != '^' && c != '$') {
+            literal = (depth == 0);
+        }
+
+        if (literal && runLen < sizeof(run)) {
+            run[runLen++] = c;
+            lastWasLiteral = true;
+            continue;
+        }
+
+        if (runLen > bestLen && runLen <= outSize) {
+            memcpy(out, run, runLen);
+            bestLen = runLen;
+        }
+        if (c == '+' && lastWasLiteral) {
+            // the last repetition is followed by what comes next
+            run[0] = run[runLen - 1];
+            runLen = 1;
+        } else {
+            runLen = 0;
+        }
+        lastWasLiteral = false;
+        if (c == '\0') break;
+    }
+    return bestLen;
+}
+
+static int addTextFilter(const char* pattern, bool isRegex)
+{
+    text_filter_t* filter = new text_filter_t();
+
+    filter->isRegex = isRegex;
+    if (isRegex) {
+        char literal[256];
+        if (regcomp(&filter->regex, pattern, REG_EXTENDED | REG_NOSUB) != 0) {
+            delete filter;
+            return -1;
+        }
+        filter->literalLen = requiredLiteral(pattern, literal, sizeof(literal));
+        filter->literal = strndup(literal, filter->literalLen);
+    } else {
+        filter->literal = pattern;
+        filter->literalLen = strlen(pattern);
+    }
+
+    filter->next = g_textFilters;
+    g_textFilters = filter;
+    g_filtering = true;
+    return 0;
+}
+
+/* memchr skips ahead to each candidate first byte at memory speed */
+static bool containsLiteral(const char* text, size_t len, const char* lit, size_t litLen)
+{
+    const char* end = text + len;
+
+    if (litLen == 0) {
+        return true;
+    }
+    while ((size_t) (end - text) >= litLen) {
+        const char* p = (const char*) memchr(text, lit[0], end - text - litLen + 1);
+        if (p == NULL) {
+            return false;
+        }
+        if (memcmp(p + 1, lit + 1, litLen - 1) == 0) {
+            return true;
+        }
+        text = p + 1;
+    }
+    return false;
+}
+
+/* message must be NUL-terminated at message[len] */
+static bool textMatches(const char* message, size_t len)
+{
+    if (g_textFilters == NULL) {
+        return true;
+    }
+    for (text_filter_t* f = g_textFilters; f != NULL; f = f->next) {
+        if (!containsLiteral(message, len, f->literal, f->literalLen)) {
+            continue;
+        }
+        if (!f->isRegex || regexec(&f->regex, message, 0, NULL, 0) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Checks the raw entry against the filters.  The text of binary (event)
+ * entries is only known once they are decoded, so processBuffer checks
+ * that instead.
+ */
+static bool entryMatches(log_device_t* dev, queued_entry_t* entry)
+{
+    struct logger_entry* buf = &entry->entry;
+
+    if (!idSetMatches(&g_pids, buf->pid) || !idSetMatches(&g_tids, buf->tid)
+            || (g_uids.count > 0 && !idSetMatches(&g_uids, entry->euid))) {
+        return false;
+    }
+    if (dev->binary || g_textFilters == NULL) {
+        return true;
+    }
+
+    // <priority:1><tag:N>\0<message:N>\0
+    if (buf->len < 3) {
+        return true;    // let processBuffer complain about it
+    }
+    const char* tagEnd = (const char*) memchr(buf->msg + 1, '\0', buf->len - 1);
+    if (tagEnd == NULL) {
+        return true;
+    }
+    const char* message = tagEnd + 1;
+    return textMatches(message, strlen(message));
+}
+
 static int openLogFile (const char *pathname)
 {
     return open(pathname, O_WRONLY | O_APPEND | O_CREAT, S_IRUSR | S_IWUSR);
@@ -157,6 +397,266 @@ void printBinary(struct logger_entry *buf)
     } while (ret < 0 && errno == EINTR);
 }
 
+/*
+ * Statistics mode (-S).  Instead of printing entries, count them and the
+ * ring buffer space they take by tag, by pid and by priority, and report
+ * totals and recent rates.  Each counter keeps one-second slots of
+ * history indexed by the entry's own timestamp, so that a recorded log
+ * gives the same rates as a live one, and recording an entry costs a
+ * hash lookup and a few additions.
+ */
+
+#define STATS_SLOTS     60      // seconds of history, the longest window
+#define STATS_SHORT     10      // seconds in the short window
+#define STATS_TOP       10      // tags and pids shown in each report
+
+struct log_stats_t {
+    const char* tag;            // key in g_tagStats
+    int32_t pid;                // key in g_pidStats
+    uint64_t entries;
+    uint64_t bytes;
+    int32_t slotSec[STATS_SLOTS];
+    uint32_t slotEntries[STATS_SLOTS];
+    uint32_t slotBytes[STATS_SLOTS];
+};
+
+static int g_statsInterval = -1;        // seconds between reports, -1 if off
+static Hashmap* g_tagStats = NULL;
+static Hashmap* g_pidStats = NULL;
+static log_stats_t g_priStats[ANDROID_LOG_SILENT + 1];
+static log_stats_t g_totalStats;
+static int32_t g_statsFirstSec = 0;
+static int32_t g_statsLastSec = 0;
+static char g_statsBuf[256];
+
+static int tagHash(void* key)
+{
+    return hashmapHash(key, strlen((const char*) key));
+}
+
+static bool tagEquals(void* keyA, void* keyB)
+{
+    return strcmp((const char*) keyA, (const char*) keyB) == 0;
+}
+
+static int pidHash(void* key)
+{
+    return *(int32_t*) key;
+}
+
+static bool pidEquals(void* keyA, void* keyB)
+{
+    return *(int32_t*) keyA == *(int32_t*) keyB;
+}
+
+static void statsAdd(log_stats_t* stats, int32_t sec, uint32_t bytes)
+{
+    unsigned slot = (uint32_t) sec % STATS_SLOTS;
+
+    if (stats->slotSec[slot] != sec) {
+        stats->slotSec[slot] = sec;
+        stats->slotEntries[slot] = 0;
+        stats->slotBytes[slot] = 0;
+    }
+    stats->slotEntries[slot]++;
+    stats->slotBytes[slot] += bytes;
+    stats->entries++;
+    stats->bytes += bytes;
+}
+
+/* sums the slots for the window seconds up to and including now */
+static void statsWindow(const log_stats_t* stats, int32_t now, int window,
+        uint64_t* entries, uint64_t* bytes)
+{
+    *entries = 0;
+    *bytes = 0;
+    for (int i = 0; i < STATS_SLOTS; i++) {
+        if (stats->slotSec[i] <= now && stats->slotSec[i] > now - window) {
+            *entries += stats->slotEntries[i];
+            *bytes += stats->slotBytes[i];
+        }
+    }
+}
+
+static void statsRecord(log_device_t* dev, struct logger_entry* buf)
+{
+    uint32_t bytes = sizeof(struct logger_entry) + buf->len;
+    int32_t sec = buf->sec;
+    const char* tag = NULL;
+    char tagBuf[16];
+    int pri;
+
+    if (dev->binary) {
+        // the tag is a little-endian index into the event tag map
+        pri = ANDROID_LOG_INFO;
+        if (buf->len >= 4) {
+            const uint8_t* p = (const uint8_t*) buf->msg;
+            int index = p[0] | (p[1] << 8) | (p[2] << 16) | (p[3] << 24);
+            if (g_eventTagMap != NULL) {
+                tag = android_lookupEventTag(g_eventTagMap, index);
+            }
+            if (tag == NULL) {
+                snprintf(tagBuf, sizeof(tagBuf), "[%d]", index);
+                tag = tagBuf;
+            }
+        }
+    } else {
+        // <priority:1><tag:N>\0<message:N>\0, terminated when it was read
+        pri = (buf->len > 0) ? buf->msg[0] : (int) ANDROID_LOG_UNKNOWN;
+        if (buf->len > 1) {
+            tag = buf->msg + 1;
+        }
+    }
+    if (tag == NULL) {
+        tag = "";
+    }
+    if (pri < 0 || pri > ANDROID_LOG_SILENT) {
+        pri = ANDROID_LOG_UNKNOWN;
+    }
+
+    if (g_tagStats == NULL) {
+        g_tagStats = hashmapCreate(256, tagHash, tagEquals);
+        g_pidStats = hashmapCreate(256, pidHash, pidEquals);
+        g_statsFirstSec = g_statsLastSec = sec;
+    }
+
+    log_stats_t* stats = (log_stats_t*) hashmapGet(g_tagStats, (void*) tag);
+    if (stats == NULL) {
+        stats = (log_stats_t*) calloc(1, sizeof(log_stats_t));
+        stats->tag = strdup(tag);
+        hashmapPut(g_tagStats, (void*) stats->tag, stats);
+    }
+    statsAdd(stats, sec, bytes);
+
+    stats = (log_stats_t*) hashmapGet(g_pidStats, &buf->pid);
+    if (stats == NULL) {
+        stats = (log_stats_t*) calloc(1, sizeof(log_stats_t));
+        stats->pid = buf->pid;
+        hashmapPut(g_pidStats, &stats->pid, stats);
+    }
+    statsAdd(stats, sec, bytes);
+
+    statsAdd(&g_priStats[pri], sec, bytes);
+    statsAdd(&g_totalStats, sec, bytes);
+
+    if (sec < g_statsFirstSec) g_statsFirstSec = sec;
+    if (sec > g_statsLastSec) g_statsLastSec = sec;
+}
+
+static void statsPrintf(const char* fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(g_statsBuf, sizeof(g_statsBuf), fmt, ap);
+    va_end(ap);
+    if (write(g_outFD, g_statsBuf, strlen(g_statsBuf)) < 0) {
+        perror("output error");
+        exit(-1);
+    }
+}
+
+static void statsPrintRow(const char* name, const log_stats_t* stats, int32_t now)
+{
+    uint64_t shortEntries, shortBytes, longEntries, longBytes;
+
+    statsWindow(stats, now, STATS_SHORT, &shortEntries, &shortBytes);
+    statsWindow(stats, now, STATS_SLOTS, &longEntries, &longBytes);
+    statsPrintf("%-24.24s %9llu %11llu %9.1f %9.0f %9.1f %9.0f\n", name,
+            (unsigned long long) stats->entries, (unsigned long long) stats->bytes,
+            (double) shortEntries / STATS_SHORT, (double) shortBytes / STATS_SHORT,
+            (double) longEntries / STATS_SLOTS, (double) longBytes / STATS_SLOTS);
+}
+
+struct stats_list_t {
+    log_stats_t** items;
+    size_t count;
+};
+
+static bool statsCollect(void* key, void* value, void* context)
+{
+    stats_list_t* list = (stats_list_t*) context;
+    list->items[list->count++] = (log_stats_t*) value;
+    return true;
+}
+
+/* busiest first: by bytes in the long window, then by bytes overall */
+static int32_t g_statsSortNow;
+
+static int statsCompare(const void* a, const void* b)
+{
+    const log_stats_t* sa = *(const log_stats_t* const*) a;
+    const log_stats_t* sb = *(const log_stats_t* const*) b;
+    uint64_t ea, ba, eb, bb;
+
+    statsWindow(sa, g_statsSortNow, STATS_SLOTS, &ea, &ba);
+    statsWindow(sb, g_statsSortNow, STATS_SLOTS, &eb, &bb);
+    if (ba != bb) {
+        return (ba > bb) ? -1 : 1;
+    }
+    if (sa->bytes != sb->bytes) {
+        return (sa->bytes > sb->bytes) ? -1 : 1;
+    }
+    return 0;
+}
+
+static void statsPrintTop(Hashmap* map, const char* what, int32_t now)
+{
+    stats_list_t list;
+    char name[16];
+
+    list.count = 0;
+    list.items = (log_stats_t**) malloc(hashmapSize(map) * sizeof(log_stats_t*));
+    hashmapForEach(map, statsCollect, &list);
+    g_statsSortNow = now;
+    qsort(list.items, list.count, sizeof(log_stats_t*), statsCompare);
+
+    statsPrintf("%s (%d busiest of %d)\n", what,
+            (int) (list.count < STATS_TOP ? list.count : STATS_TOP), (int) list.count);
+    for (size_t i = 0; i < list.count && i < STATS_TOP; i++) {
+        if (list.items[i]->tag != NULL) {
+            statsPrintRow(list.items[i]->tag, list.items[i], now);
+        } else {
+            snprintf(name, sizeof(name), "%d", list.items[i]->pid);
+            statsPrintRow(name, list.items[i], now);
+        }
+    }
+    free(list.items);
+}
+
+/*
+ * Rates are for the windows ending at now: the time of the newest entry
+ * when dumping or replaying a log, and the current time when following
+ * one, so that a tag that has gone quiet drops out.
+ */
+static void statsReport(int32_t now)
+{
+    static const char* priNames[ANDROID_LOG_SILENT + 1] = {
+        "unknown", "default", "verbose", "debug", "info", "warn", "error",
+        "fatal", "silent",
+    };
+
+    if (g_tagStats == NULL) {
+        statsPrintf("--------- no log entries\n");
+        return;
+    }
+
+    statsPrintf("--------- %llu entries, %llu bytes, over %d s\n",
+            (unsigned long long) g_totalStats.entries,
+            (unsigned long long) g_totalStats.bytes,
+            g_statsLastSec - g_statsFirstSec + 1);
+    statsPrintf("%-24s %9s %11s %9s %9s %9s %9s\n", "", "entries", "bytes",
+            "10s ent/s", "10s B/s", "60s ent/s", "60s B/s");
+    statsPrintRow("total", &g_totalStats, now);
+    for (int pri = ANDROID_LOG_SILENT; pri >= ANDROID_LOG_UNKNOWN; pri--) {
+        if (g_priStats[pri].entries > 0) {
+            statsPrintRow(priNames[pri], &g_priStats[pri], now);
+        }
+    }
+    statsPrintTop(g_tagStats, "tags", now);
+    statsPrintTop(g_pidStats, "pids", now);
+}
+
 static void processBuffer(log_device_t* dev, struct logger_entry *buf)
 {
     int bytesWritten = 0;
@@ -176,6 +676,10 @@ static void processBuffer(log_device_t* dev, struct logger_entry *buf)
         goto error;
     }
 
+    if (dev->binary && !textMatches(entry.message, entry.messageLen)) {
+        goto error;
+    }
+
     if (android_log_shouldPrintLine(g_logformat, entry.tag, entry.priority)) {
         if (false && g_devCount > 1) {
             binaryMsgBuf[0] = dev->label;
@@ -238,6 +742,11 @@ static void skipNextEntry(log_device_t* dev) {
 }
 
 static void printNextEntry(log_device_t* dev) {
+    if (g_statsInterval >= 0) {
+        statsRecord(dev, &dev->queue->entry);
+        skipNextEntry(dev);
+        return;
+    }
     maybePrintStart(dev);
     if (g_printBinary) {
         printBinary(&dev->queue->entry);
@@ -257,6 +766,7 @@ static void readLogLines(log_device_t* devices)
 
     int result;
     fd_set readset;
+    time_t nextReport = time(NULL) + g_statsInterval;
 
     for (dev=devices; dev; dev = dev->next) {
         if (dev->fd > max) {
@@ -267,13 +777,25 @@ static void readLogLines(log_device_t* devices)
     while (1) {
         do {
             timeval timeout = { 0, 5000 /* 5ms */ }; // If we oversleep it's ok, i.e. ignore EINTR.
+            timeval* wait = &timeout;
+            if (sleep) {
+                // in statistics mode, wake up for the next report
+                timeout.tv_sec = 1;
+                timeout.tv_usec = 0;
+                wait = (g_statsInterval > 0) ? &timeout : NULL;
+            }
             FD_ZERO(&readset);
             for (dev=devices; dev; dev = dev->next) {
                 FD_SET(dev->fd, &readset);
             }
-            result = select(max + 1, &readset, NULL, NULL, sleep ? NULL : &timeout);
+            result = select(max + 1, &readset, NULL, NULL, wait);
         } while (result == -1 && errno == EINTR);
 
+        if (g_statsInterval > 0 && !g_nonblock && time(NULL) >= nextReport) {
+            statsReport(time(NULL));
+            nextReport = time(NULL) + g_statsInterval;
+        }
+
         if (result >= 0) {
             for (dev=devices; dev; dev = dev->next) {
                 if (FD_ISSET(dev->fd, &readset)) {
@@ -296,6 +818,19 @@ static void readLogLines(log_device_t* devices)
                         fprintf(stderr, "read: Unexpected EOF!\n");
                         exit(EXIT_FAILURE);
                     }
+                    else if (g_uids.count > 0) {
+                        // read with the v2 ABI, which carries the euid;
+                        // move the payload down to where v1 has it
+                        struct logger_entry_v2* v2 = (struct logger_entry_v2*) entry->buf;
+                        if (v2->len != ret - v2->hdr_size) {
+                            fprintf(stderr, "read: unexpected length. Expected %d, got %d\n",
+                                    v2->len, ret - v2->hdr_size);
+                            exit(EXIT_FAILURE);
+                        }
+                        entry->euid = v2->euid;
+                        memmove(entry->entry.msg, entry->buf + v2->hdr_size, v2->len);
+                        entry->entry.__pad = 0;
+                    }
                     else if (entry->entry.len != ret - sizeof(struct logger_entry)) {
                         fprintf(stderr, "read: unexpected length. Expected %d, got %d\n",
                                 entry->entry.len, ret - sizeof(struct logger_entry));
@@ -304,6 +839,11 @@ static void readLogLines(log_device_t* devices)
 
                     entry->entry.msg[entry->entry.len] = '\0';
 
+                    if (g_filtering && !entryMatches(dev, entry)) {
+                        delete entry;
+                        continue;
+                    }
+
                     dev->enqueue(entry);
                     ++queued_lines;
                 }
@@ -328,6 +868,9 @@ static void readLogLines(log_device_t* devices)
 
                 // the caller requested to just dump the log and exit
                 if (g_nonblock) {
+                    if (g_statsInterval >= 0) {
+                        statsReport(g_statsLastSec);
+                    }
                     return;
                 }
             } else {
@@ -352,6 +895,54 @@ next:
     }
 }
 
+/*
+ * Replays entries recorded with -B, as though they came from a text log
+ * device.  There is nothing to interleave them with, so each is printed
+ * as soon as it is read.
+ */
+static void readRecordedLines(const char* path)
+{
+    log_device_t dev((char*) path, false, 'f');
+    queued_entry_t* entry = new queued_entry_t();
+    static char iobuf[64 * 1024];
+    FILE* fp;
+
+    fp = fopen(path, "r");
+    if (fp == NULL) {
+        fprintf(stderr, "Unable to open recorded log '%s': %s\n", path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    setvbuf(fp, iobuf, _IOFBF, sizeof(iobuf));
+
+    while (fread(entry->buf, sizeof(struct logger_entry), 1, fp) == 1) {
+        if (entry->entry.len > LOGGER_ENTRY_MAX_LEN - sizeof(struct logger_entry)
+                || (entry->entry.len > 0
+                    && fread(entry->entry.msg, entry->entry.len, 1, fp) != 1)) {
+            fprintf(stderr, "%s: truncated or corrupt entry\n", path);
+            exit(EXIT_FAILURE);
+        }
+        entry->entry.msg[entry->entry.len] = '\0';
+
+        if (g_filtering && !entryMatches(&dev, entry)) {
+            continue;
+        }
+        if (g_statsInterval >= 0) {
+            statsRecord(&dev, &entry->entry);
+        } else if (g_printBinary) {
+            printBinary(&entry->entry);
+        } else {
+            processBuffer(&dev, &entry->entry);
+        }
+    }
+
+    delete entry;
+    fclose(fp);
+
+    if (g_statsInterval >= 0) {
+        statsReport(g_statsLastSec);
+    }
+}
+
 static int clearLog(int logfd)
 {
     return ioctl(logfd, LOGGER_FLUSH_LOG);
@@ -411,7 +1002,18 @@ static void show_help(const char *cmd)
                     "                  or 'events'. Multiple -b parameters are allowed and the\n"
                     "                  results are interleaved. The default is -b main -b system.\n"
                     "  -B              output the log in binary\n"
-                    "  -C              colored output");
+                    "  -C              colored output\n"
+                    "  -i <filename>   read a log recorded with -B instead of the devices\n"
+                    "  -m <text>       print only messages containing <text>\n"
+                    "  -e <regex>      print only messages matching the extended regex\n"
+                    "                  <regex>. Messages matching any -m or -e are printed\n"
+                    "  -p <pid>[,...]  print only entries from these processes\n"
+                    "  -T <tid>[,...]  print only entries from these threads\n"
+                    "  -u <uid>[,...]  print only entries logged by these uids\n"
+                    "                  (needs a v2 logger driver)\n"
+                    "  -S [<seconds>]  instead of printing entries, count them by tag, pid\n"
+                    "                  and priority, and report every <seconds> (10), or\n"
+                    "                  once at the end with -d, -t or -i");
 
 
     fprintf(stderr,"\nfilterspecs are a series of \n"
@@ -435,6 +1037,126 @@ static void show_help(const char *cmd)
 }
 
 
+static void filter_run_tests()
+{
+    char lit[256];
+    size_t len;
+    id_set_t set = { NULL, 0 };
+
+#define LITERAL(re, expect) \
+    len = requiredLiteral(re, lit, sizeof(lit)); \
+    assert(len == strlen(expect) && memcmp(lit, expect, len) == 0)
+
+    LITERAL("wakelock", "wakelock");
+    LITERAL("^ActivityManager: Start proc [0-9]+", "ActivityManager: Start proc ");
+    LITERAL("ab*cdef", "cdef");
+    LITERAL("abcd?e", "abc");
+    LITERAL("x{2}yz", "yz");
+    LITERAL("a+bc", "abc");
+    LITERAL("xca+b", "xca");
+    LITERAL("gc.*freed", "freed");
+    LITERAL("fo(o|p)bar", "bar");
+    LITERAL("crash\\.dump", "crash.dump");
+    LITERAL("\\bANR\\b", "ANR");
+    LITERAL("error|fail", "");
+    LITERAL("[abc]", "");
+#undef LITERAL
+
+    assert(containsLiteral("GC_CONCURRENT freed 1024K", 25, "freed", 5));
+    assert(!containsLiteral("GC_CONCURRENT free 1024K", 24, "freed", 5));
+    assert(!containsLiteral("free", 4, "freed", 5));
+    assert(containsLiteral("anything", 8, "", 0));
+
+    assert(addIds(&set, "300,12,4000") == 0);
+    assert(addIds(&set, "7") == 0);
+    assert(set.count == 4 && set.ids[0] == 7 && set.ids[3] == 4000);
+    assert(idSetMatches(&set, 12) && idSetMatches(&set, 4000));
+    assert(!idSetMatches(&set, 13) && !idSetMatches(&set, -1));
+    assert(addIds(&set, "12,") < 0 && addIds(&set, "x") < 0 && addIds(&set, "-3") < 0);
+    free(set.ids);
+
+    assert(textMatches("anything", 8));
+    assert(addTextFilter("Start proc [a-z.]+ for activity", true) == 0);
+    assert(addTextFilter("low memory", false) == 0);
+    assert(textMatches("Start proc com.android.phone for activity", 41));
+    assert(!textMatches("Start proc 1234 for activity", 28));
+    assert(textMatches("system is running low memory now", 32));
+    assert(!textMatches("Start process", 13));
+}
+
+/* Feeds a short recording through the statistics and checks the tables. */
+static void stats_run_tests()
+{
+    static const struct {
+        int32_t sec;
+        int32_t pid;
+        char pri;
+        const char* tag;
+        const char* msg;
+    } recording[] = {
+        { 1000, 100, ANDROID_LOG_INFO,    "ActivityManager", "Start proc com.android.phone" },
+        { 1000, 100, ANDROID_LOG_DEBUG,   "dalvikvm",        "GC_CONCURRENT freed 1024K" },
+        { 1030, 200, ANDROID_LOG_DEBUG,   "dalvikvm",        "GC_FOR_ALLOC freed 12K" },
+        { 1055, 200, ANDROID_LOG_WARN,    "RILJ",            "no response" },
+        { 1058, 200, ANDROID_LOG_DEBUG,   "dalvikvm",        "GC_EXPLICIT freed 1K" },
+        { 1059, 300, ANDROID_LOG_VERBOSE, "dalvikvm",        "x" },
+        // one slot around from 1000, so it must not count toward 1000's
+        { 1060, 300, ANDROID_LOG_VERBOSE, "ActivityManager", "y" },
+    };
+    log_device_t dev((char*) "test", false, 't');
+    queued_entry_t* entry = new queued_entry_t();
+    uint64_t bytes[7], entries, windowBytes;
+    int32_t pid;
+
+    for (size_t i = 0; i < sizeof(recording) / sizeof(recording[0]); i++) {
+        size_t tagLen = strlen(recording[i].tag) + 1;
+        size_t msgLen = strlen(recording[i].msg) + 1;
+
+        memset(&entry->entry, 0, sizeof(entry->entry));
+        entry->entry.len = 1 + tagLen + msgLen;
+        entry->entry.pid = entry->entry.tid = recording[i].pid;
+        entry->entry.sec = recording[i].sec;
+        entry->entry.msg[0] = recording[i].pri;
+        memcpy(entry->entry.msg + 1, recording[i].tag, tagLen);
+        memcpy(entry->entry.msg + 1 + tagLen, recording[i].msg, msgLen);
+        bytes[i] = sizeof(struct logger_entry) + entry->entry.len;
+        statsRecord(&dev, &entry->entry);
+    }
+    delete entry;
+
+    assert(g_totalStats.entries == 7);
+    assert(g_statsFirstSec == 1000 && g_statsLastSec == 1060);
+    assert(hashmapSize(g_tagStats) == 3 && hashmapSize(g_pidStats) == 3);
+
+    log_stats_t* dalvik = (log_stats_t*) hashmapGet(g_tagStats, (void*) "dalvikvm");
+    assert(dalvik->entries == 4);
+    assert(dalvik->bytes == bytes[1] + bytes[2] + bytes[4] + bytes[5]);
+
+    pid = 200;
+    log_stats_t* p200 = (log_stats_t*) hashmapGet(g_pidStats, &pid);
+    assert(p200->entries == 3 && p200->bytes == bytes[2] + bytes[3] + bytes[4]);
+
+    assert(g_priStats[ANDROID_LOG_DEBUG].entries == 3);
+    assert(g_priStats[ANDROID_LOG_VERBOSE].entries == 2);
+    assert(g_priStats[ANDROID_LOG_ERROR].entries == 0);
+
+    // the ten seconds up to 1060 hold 1055..1060
+    statsWindow(&g_totalStats, 1060, STATS_SHORT, &entries, &windowBytes);
+    assert(entries == 4);
+    assert(windowBytes == bytes[3] + bytes[4] + bytes[5] + bytes[6]);
+
+    // the minute up to 1060 has lost 1000 to 1060, which shares its slot
+    statsWindow(&g_totalStats, 1060, STATS_SLOTS, &entries, &windowBytes);
+    assert(entries == 5);
+    log_stats_t* am = (log_stats_t*) hashmapGet(g_tagStats, (void*) "ActivityManager");
+    statsWindow(am, 1060, STATS_SLOTS, &entries, &windowBytes);
+    assert(am->entries == 2 && entries == 1 && windowBytes == bytes[6]);
+
+    // and a window ending before the newest entry leaves it out
+    statsWindow(dalvik, 1058, STATS_SHORT, &entries, &windowBytes);
+    assert(entries == 1 && windowBytes == bytes[4]);
+}
+
 } /* namespace android */
 
 static int setLogFormat(const char * formatString)
@@ -476,6 +1198,8 @@ int main(int argc, char **argv)
 
     if (argc == 2 && 0 == strcmp(argv[1], "--test")) {
         logprint_run_tests();
+        android::filter_run_tests();
+        android::stats_run_tests();
         exit(0);
     }
 
@@ -487,7 +1211,7 @@ int main(int argc, char **argv)
     for (;;) {
         int ret;
 
-        ret = getopt(argc, argv, "cdt:gsQf:r::n:v:b:BC");
+        ret = getopt(argc, argv, "cdt:gsQf:r::n:v:b:BCi:m:e:p:T:u:S::");
 
         if (ret < 0) {
             break;
@@ -548,6 +1272,46 @@ int main(int argc, char **argv)
                 android::g_printBinary = 1;
             break;
 
+            case 'i':
+                android::g_inputFileName = optarg;
+            break;
+
+            case 'S':
+                if (optarg == NULL) {
+                    android::g_statsInterval = 10;
+                } else if (isdigit(optarg[0]) && atoi(optarg) > 0) {
+                    android::g_statsInterval = atoi(optarg);
+                } else {
+                    fprintf(stderr,"Invalid parameter to -S\n");
+                    android::show_help(argv[0]);
+                    exit(-1);
+                }
+            break;
+
+            case 'm':
+                android::addTextFilter(optarg, false);
+            break;
+
+            case 'e':
+                if (android::addTextFilter(optarg, true) < 0) {
+                    fprintf(stderr, "Invalid regular expression '%s'\n", optarg);
+                    exit(-1);
+                }
+            break;
+
+            case 'p':
+            case 'T':
+            case 'u': {
+                android::id_set_t* set = (ret == 'p') ? &android::g_pids
+                        : (ret == 'T') ? &android::g_tids : &android::g_uids;
+                if (android::addIds(set, optarg) < 0) {
+                    fprintf(stderr, "Invalid parameter to -%c\n", ret);
+                    android::show_help(argv[0]);
+                    exit(-1);
+                }
+            }
+            break;
+
             case 'f':
                 // redirect output to a file
 
@@ -737,6 +1501,11 @@ int main(int argc, char **argv)
         }
     }
 
+    if (android::g_inputFileName != NULL) {
+        android::readRecordedLines(android::g_inputFileName);
+        return 0;
+    }
+
     dev = devices;
     while (dev) {
         dev->fd = open(dev->device, mode);
@@ -746,6 +1515,14 @@ int main(int argc, char **argv)
             exit(EXIT_FAILURE);
         }
 
+        if (android::g_uids.count > 0 && mode == O_RDONLY) {
+            int version = 2;
+            if (ioctl(dev->fd, LOGGER_SET_VERSION, &version) < 0) {
+                fprintf(stderr, "-u needs a logger driver that reports uids\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+
         if (clearLog) {
             int ret;
             ret = android::clearLog(dev->fd);
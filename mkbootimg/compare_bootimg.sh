@@ -0,0 +1,55 @@
+#!/bin/sh
+#
+# Checks that two builds of mkbootimg produce byte-identical boot images,
+# with and without a second stage, with a NONE ramdisk and with a larger
+# page size.  The second build is also run with its output going to a
+# pipe and to a FIFO, which cannot seek back to write the header.
+# Usage: compare_bootimg.sh old-mkbootimg new-mkbootimg
+
+if [ $# -ne 2 ]; then
+	echo "usage: $0 old-mkbootimg new-mkbootimg" >&2
+	exit 2
+fi
+old=$1
+new=$2
+dir=${TMPDIR:-/tmp}/compare_bootimg.$$
+mkdir -p $dir || exit 1
+trap 'rm -rf $dir' EXIT
+
+# sizes that are not a multiple of any page size, so padding is exercised
+head -c 3000001 /dev/urandom > $dir/kernel
+head -c 1234567 /dev/urandom > $dir/ramdisk
+head -c 77777 /dev/urandom > $dir/second
+
+failed=0
+check() {
+	name=$1
+	shift
+	args="--kernel $dir/kernel --cmdline console=ttyS0 --board cmp $*"
+	if ! $old $args -o $dir/old.img; then
+		echo "$name: old mkbootimg failed"
+		failed=1
+		return
+	fi
+	$new $args -o $dir/new.img &&
+		cmp $dir/old.img $dir/new.img || { echo "$name: file differs"; failed=1; }
+	$new $args -o /dev/stdout | cat > $dir/pipe.img &&
+		cmp $dir/old.img $dir/pipe.img || { echo "$name: pipe differs"; failed=1; }
+	rm -f $dir/fifo
+	mkfifo $dir/fifo
+	cat $dir/fifo > $dir/fifo.img &
+	$new $args -o $dir/fifo
+	wait
+	cmp $dir/old.img $dir/fifo.img || { echo "$name: fifo differs"; failed=1; }
+}
+
+check ramdisk "--ramdisk $dir/ramdisk"
+check second "--ramdisk $dir/ramdisk --second $dir/second"
+check none "--ramdisk NONE"
+check none-second "--ramdisk NONE --second $dir/second"
+check pagesize "--ramdisk $dir/ramdisk --second $dir/second --pagesize 4096"
+
+if [ $failed -eq 0 ]; then
+	echo "all images identical"
+fi
+exit $failed
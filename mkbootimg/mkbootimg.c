@@ -25,36 +25,6 @@
 #include "mincrypt/sha.h"
 #include "bootimg.h"
 
-static void *load_file(const char *fn, unsigned *_sz)
-{
-    char *data;
-    int sz;
-    int fd;
-
-    data = 0;
-    fd = open(fn, O_RDONLY);
-    if(fd < 0) return 0;
-
-    sz = lseek(fd, 0, SEEK_END);
-    if(sz < 0) goto oops;
-
-    if(lseek(fd, 0, SEEK_SET) != 0) goto oops;
-
-    data = (char*) malloc(sz);
-    if(data == 0) goto oops;
-
-    if(read(fd, data, sz) != sz) goto oops;
-    close(fd);
-
-    if(_sz) *_sz = sz;
-    return data;
-
-oops:
-    close(fd);
-    if(data != 0) free(data);
-    return 0;
-}
-
 int usage(void)
 {
     fprintf(stderr,"usage: mkbootimg\n"
@@ -80,7 +50,7 @@ int write_padding(int fd, unsigned pagesize, unsigned itemsize)
     unsigned pagemask = pagesize - 1;
     unsigned count;
 
-    if((itemsize & pagemask) == 0) {
+    if(fd < 0 || (itemsize & pagemask) == 0) {
         return 0;
     }
 
@@ -93,23 +63,119 @@ int write_padding(int fd, unsigned pagesize, unsigned itemsize)
     }
 }
 
+static unsigned char copy_buf[1024 * 1024];
+
+static int write_all(int fd, const void *data, unsigned len)
+{
+    const char *p = data;
+    int r;
+
+    while(len > 0) {
+        r = write(fd, p, len);
+        if(r < 0) {
+            if(errno == EINTR) continue;
+            return -1;
+        }
+        p += r;
+        len -= r;
+    }
+    return 0;
+}
+
+/* Copies fn to the output through a large buffer, hashing the data on the
+ * way so it never has to be held in memory or read twice.  Either out < 0
+ * or ctx == NULL skips that half.
+ * Stores the number of bytes copied in *_sz and returns 0, or -1 on error. */
+static int copy_and_hash(int out, const char *fn, SHA_CTX *ctx, unsigned *_sz)
+{
+    unsigned sz = 0;
+    int fd;
+    int r;
+
+    fd = open(fn, O_RDONLY);
+    if(fd < 0) return -1;
+
+    for(;;) {
+        r = read(fd, copy_buf, sizeof(copy_buf));
+        if(r < 0) {
+            if(errno == EINTR) continue;
+            goto oops;
+        }
+        if(r == 0) break;
+        if(ctx) SHA_update(ctx, copy_buf, r);
+        if(out >= 0 && write_all(out, copy_buf, r)) goto oops;
+        sz += r;
+    }
+    close(fd);
+
+    *_sz = sz;
+    return 0;
+
+oops:
+    close(fd);
+    return -1;
+}
+
+/* Copies the kernel, ramdisk and second stage, each padded to a page, and
+ * stores their sizes in hdr.  With out < 0 the images are only read; with
+ * ctx set the id of the header is computed on the way.
+ * Returns 0, 1 when an image could not be read (already reported), or -1
+ * when the output could not be written. */
+static int copy_images(int out, boot_img_hdr *hdr, SHA_CTX *ctx,
+                       const char *kernel_fn, const char *ramdisk_fn,
+                       const char *second_fn)
+{
+    unsigned pagesize = hdr->page_size;
+    const uint8_t *sha;
+
+    if(copy_and_hash(out, kernel_fn, ctx, &hdr->kernel_size)) {
+        fprintf(stderr,"error: could not load kernel '%s'\n", kernel_fn);
+        return 1;
+    }
+    if(ctx) SHA_update(ctx, &hdr->kernel_size, sizeof(hdr->kernel_size));
+    if(write_padding(out, pagesize, hdr->kernel_size)) return -1;
+
+    if(!strcmp(ramdisk_fn,"NONE")) {
+        hdr->ramdisk_size = 0;
+    } else if(copy_and_hash(out, ramdisk_fn, ctx, &hdr->ramdisk_size)) {
+        fprintf(stderr,"error: could not load ramdisk '%s'\n", ramdisk_fn);
+        return 1;
+    }
+    if(ctx) SHA_update(ctx, &hdr->ramdisk_size, sizeof(hdr->ramdisk_size));
+    if(write_padding(out, pagesize, hdr->ramdisk_size)) return -1;
+
+    if(second_fn) {
+        if(copy_and_hash(out, second_fn, ctx, &hdr->second_size)) {
+            fprintf(stderr,"error: could not load secondstage '%s'\n", second_fn);
+            return 1;
+        }
+        if(write_padding(out, pagesize, hdr->ramdisk_size)) return -1;
+    }
+    if(ctx) SHA_update(ctx, &hdr->second_size, sizeof(hdr->second_size));
+
+    if(ctx) {
+        sha = SHA_final(ctx);
+        memcpy(hdr->id, sha,
+               SHA_DIGEST_SIZE > sizeof(hdr->id) ? sizeof(hdr->id) : SHA_DIGEST_SIZE);
+    }
+    return 0;
+}
+
 int main(int argc, char **argv)
 {
-    boot_img_hdr hdr;
+    boot_img_hdr hdr, sizes;
 
     char *kernel_fn = 0;
-    void *kernel_data = 0;
     char *ramdisk_fn = 0;
-    void *ramdisk_data = 0;
     char *second_fn = 0;
-    void *second_data = 0;
     char *cmdline = "";
     char *bootimg = 0;
     char *board = "";
     unsigned pagesize = 2048;
     int fd;
+    int seekable = 1;
+    int r;
     SHA_CTX ctx;
-    uint8_t* sha;
     unsigned base           = 0x10000000;
     unsigned kernel_offset  = 0x00008000;
     unsigned ramdisk_offset = 0x01000000;
@@ -198,71 +264,58 @@ int main(int argc, char **argv)
     }
     strcpy((char*)hdr.cmdline, cmdline);
 
-    kernel_data = load_file(kernel_fn, &hdr.kernel_size);
-    if(kernel_data == 0) {
-        fprintf(stderr,"error: could not load kernel '%s'\n", kernel_fn);
+    fd = open(bootimg, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    if(fd < 0) {
+        fprintf(stderr,"error: could not create '%s'\n", bootimg);
         return 1;
     }
 
-    if(!strcmp(ramdisk_fn,"NONE")) {
-        ramdisk_data = 0;
-        hdr.ramdisk_size = 0;
-    } else {
-        ramdisk_data = load_file(ramdisk_fn, &hdr.ramdisk_size);
-        if(ramdisk_data == 0) {
-            fprintf(stderr,"error: could not load ramdisk '%s'\n", ramdisk_fn);
-            return 1;
-        }
-    }
-
-    if(second_fn) {
-        second_data = load_file(second_fn, &hdr.second_size);
-        if(second_data == 0) {
-            fprintf(stderr,"error: could not load secondstage '%s'\n", second_fn);
-            return 1;
-        }
+    /* The header holds the sizes and the hash, which are only known once
+     * everything has been copied, so write it last.  A pipe cannot seek
+     * back to it: read the images once to hash them, write the header,
+     * then copy them. */
+    seekable = lseek(fd, sizeof(hdr), SEEK_SET) == sizeof(hdr);
+    if(!seekable) {
+        if(errno != ESPIPE) goto fail;
+        SHA_init(&ctx);
+        r = copy_images(-1, &hdr, &ctx, kernel_fn, ramdisk_fn, second_fn);
+        if(r) goto fail_quiet;
+        sizes = hdr;
+        if(write_all(fd, &hdr, sizeof(hdr))) goto fail;
     }
+    if(write_padding(fd, pagesize, sizeof(hdr))) goto fail;
 
     /* put a hash of the contents in the header so boot images can be
      * differentiated based on their first 2k.
      */
     SHA_init(&ctx);
-    SHA_update(&ctx, kernel_data, hdr.kernel_size);
-    SHA_update(&ctx, &hdr.kernel_size, sizeof(hdr.kernel_size));
-    SHA_update(&ctx, ramdisk_data, hdr.ramdisk_size);
-    SHA_update(&ctx, &hdr.ramdisk_size, sizeof(hdr.ramdisk_size));
-    SHA_update(&ctx, second_data, hdr.second_size);
-    SHA_update(&ctx, &hdr.second_size, sizeof(hdr.second_size));
-    sha = SHA_final(&ctx);
-    memcpy(hdr.id, sha,
-           SHA_DIGEST_SIZE > sizeof(hdr.id) ? sizeof(hdr.id) : SHA_DIGEST_SIZE);
-
-    fd = open(bootimg, O_CREAT | O_TRUNC | O_WRONLY, 0644);
-    if(fd < 0) {
-        fprintf(stderr,"error: could not create '%s'\n", bootimg);
-        return 1;
-    }
-
-    if(write(fd, &hdr, sizeof(hdr)) != sizeof(hdr)) goto fail;
-    if(write_padding(fd, pagesize, sizeof(hdr))) goto fail;
-
-    if(write(fd, kernel_data, hdr.kernel_size) != hdr.kernel_size) goto fail;
-    if(write_padding(fd, pagesize, hdr.kernel_size)) goto fail;
-
-    if(write(fd, ramdisk_data, hdr.ramdisk_size) != hdr.ramdisk_size) goto fail;
-    if(write_padding(fd, pagesize, hdr.ramdisk_size)) goto fail;
-
-    if(second_data) {
-        if(write(fd, second_data, hdr.second_size) != hdr.second_size) goto fail;
-        if(write_padding(fd, pagesize, hdr.ramdisk_size)) goto fail;
+    r = copy_images(fd, &hdr, seekable ? &ctx : NULL,
+                    kernel_fn, ramdisk_fn, second_fn);
+    if(r < 0) goto fail;
+    if(r) goto fail_quiet;
+
+    if(seekable) {
+        if(lseek(fd, 0, SEEK_SET) != 0) goto fail;
+        if(write_all(fd, &hdr, sizeof(hdr))) goto fail;
+    } else if(hdr.kernel_size != sizes.kernel_size ||
+              hdr.ramdisk_size != sizes.ramdisk_size ||
+              hdr.second_size != sizes.second_size) {
+        fprintf(stderr,"error: images changed while '%s' was written\n", bootimg);
+        goto fail_quiet;
     }
 
+    close(fd);
     return 0;
 
-fail:
-    unlink(bootimg);
+fail_quiet:
+    if(seekable) unlink(bootimg);
     close(fd);
+    return 1;
+
+fail:
     fprintf(stderr,"error: failed writing '%s': %s\n", bootimg,
             strerror(errno));
+    if(seekable) unlink(bootimg);
+    close(fd);
     return 1;
 }
@@ -30,6 +30,46 @@ int read_padding(FILE* f, unsigned itemsize, int pagesize)
     return count;
 }
 
+/* Copies size bytes from f to a new file at path through a fixed buffer,
+ * rather than holding the whole section in memory.
+ * Returns 0, or -1 if the image is short or either file gives an error. */
+int copy_section(FILE* f, const char* path, unsigned size)
+{
+    static byte buf[1024 * 1024];
+    FILE* out = fopen(path, "wb");
+    size_t n;
+    int ret = 0;
+
+    if (out == NULL) {
+        fprintf(stderr, "error: could not create '%s': %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    while (size > 0) {
+        n = size < sizeof(buf) ? size : sizeof(buf);
+        n = fread(buf, 1, n, f);
+        if (n == 0) {
+            if (ferror(f))
+                fprintf(stderr, "error: reading image: %s\n", strerror(errno));
+            else
+                fprintf(stderr, "error: image ends %u bytes short of '%s'\n", size, path);
+            ret = -1;
+            break;
+        }
+        if (fwrite(buf, n, 1, out) != 1) {
+            fprintf(stderr, "error: writing '%s': %s\n", path, strerror(errno));
+            ret = -1;
+            break;
+        }
+        size -= n;
+    }
+    if (fclose(out) != 0 && ret == 0) {
+        fprintf(stderr, "error: writing '%s': %s\n", path, strerror(errno));
+        ret = -1;
+    }
+    return ret;
+}
+
 void write_string_to_file(char* file, char* string)
 {
     FILE* f = fopen(file, "w");
@@ -129,26 +169,20 @@ int main(int argc, char** argv)
 
     sprintf(tmp, "%s/%s", directory, basename(filename));
     strcat(tmp, "-zImage");
-    FILE *k = fopen(tmp, "wb");
-    byte* kernel = (byte*)malloc(header.kernel_size);
     //printf("Reading kernel...\n");
-    fread(kernel, header.kernel_size, 1, f);
+    if (copy_section(f, tmp, header.kernel_size) < 0)
+        return 1;
     total_read += header.kernel_size;
-    fwrite(kernel, header.kernel_size, 1, k);
-    fclose(k);
 
     //printf("total read: %d\n", header.kernel_size);
     total_read += read_padding(f, header.kernel_size, pagesize);
 
     sprintf(tmp, "%s/%s", directory, basename(filename));
     strcat(tmp, "-ramdisk.gz");
-    FILE *r = fopen(tmp, "wb");
-    byte* ramdisk = (byte*)malloc(header.ramdisk_size);
     //printf("Reading ramdisk...\n");
-    fread(ramdisk, header.ramdisk_size, 1, f);
+    if (copy_section(f, tmp, header.ramdisk_size) < 0)
+        return 1;
     total_read += header.ramdisk_size;
-    fwrite(ramdisk, header.ramdisk_size, 1, r);
-    fclose(r);
     
     fclose(f);
     
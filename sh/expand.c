@@ -120,6 +120,7 @@ expandhere(union node *arg, int fd)
 	herefd = fd;
 	expandarg(arg, (struct arglist *)NULL, 0);
 	xwrite(fd, stackblock(), expdest - stackblock());
+	herefd = -1;
 }
 
 
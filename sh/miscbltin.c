@@ -50,10 +50,12 @@ __RCSID("$NetBSD: miscbltin.c,v 1.34.2.1 2005/04/07 11:34:20 tron Exp $");
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/resource.h>
+#include <sys/socket.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <ctype.h>
 #include <errno.h>
+#include <string.h>
 
 #include "shell.h"
 #include "options.h"
@@ -68,11 +70,105 @@ __RCSID("$NetBSD: miscbltin.c,v 1.34.2.1 2005/04/07 11:34:20 tron Exp $");
 
 
 
+/*
+ * Input for the read builtin.  read must not consume anything past the
+ * end of the line, since the rest of stdin belongs to whoever reads it
+ * next.  When stdin is seekable we read ahead in blocks and seek back
+ * over whatever was not used; a socket can be peeked up to the newline;
+ * anything else (pipes, ttys) is read a byte at a time.
+ */
+#define READ_BUFSIZE	1024
+
+#define READ_BYTE	0
+#define READ_SEEK	1
+#define READ_PEEK	2
+
+struct readbuf {
+	int mode;
+	int pos;
+	int len;
+	char buf[READ_BUFSIZE];
+};
+
+/*
+ * Static rather than local to readcmd(), so that its contents are still
+ * valid when readcmd() catches an error with setjmp.
+ */
+static struct readbuf readbuf;
+
+static void
+readbuf_init(struct readbuf *rb)
+{
+	struct stat st;
+
+	rb->pos = rb->len = 0;
+	if (lseek(0, (off_t)0, SEEK_CUR) != (off_t)-1)
+		rb->mode = READ_SEEK;
+	else if (fstat(0, &st) == 0 && S_ISSOCK(st.st_mode))
+		rb->mode = READ_PEEK;
+	else
+		rb->mode = READ_BYTE;
+}
+
+static int
+readbuf_fill(struct readbuf *rb)
+{
+	char *nl;
+	int n;
+
+	switch (rb->mode) {
+	case READ_SEEK:
+		n = read(0, rb->buf, sizeof(rb->buf));
+		break;
+	case READ_PEEK:
+		n = recv(0, rb->buf, sizeof(rb->buf), MSG_PEEK);
+		if (n <= 0)
+			break;
+		/* Only take the peeked bytes up to and including a newline */
+		if ((nl = memchr(rb->buf, '\n', n)) != NULL)
+			n = nl - rb->buf + 1;
+		n = read(0, rb->buf, n);
+		break;
+	default:
+		n = read(0, rb->buf, 1);
+		break;
+	}
+	if (n <= 0)
+		return 0;
+	rb->pos = 0;
+	rb->len = n;
+	return 1;
+}
+
+static inline int
+readbuf_getc(struct readbuf *rb, char *c)
+{
+	if (rb->pos == rb->len && !readbuf_fill(rb))
+		return 0;
+	*c = rb->buf[rb->pos++];
+	return 1;
+}
+
+/*
+ * Give back any read-ahead so the next reader of stdin starts where read
+ * stopped.  Called once the line is done, or when an error or interrupt
+ * unwinds out of readcmd().
+ */
+static void
+readbuf_done(struct readbuf *rb)
+{
+	INTOFF;
+	if (rb->mode == READ_SEEK && rb->pos < rb->len)
+		lseek(0, (off_t)(rb->pos - rb->len), SEEK_CUR);
+	rb->pos = rb->len = 0;
+	INTON;
+}
+
 /*
  * The read builtin.
  * Backslahes escape the next char unless -r is specified.
  *
- * This uses unbuffered input, which may be avoidable in some cases.
+ * Input is buffered as far as stdin allows, see struct readbuf.
  *
  * Note that if IFS=' :' then read x y should work so that:
  * 'a b'	x='a', y='b'
@@ -99,6 +195,9 @@ readcmd(int argc, char **argv)
 	int i;
 	int is_ifs;
 	int saveall = 0;
+	struct readbuf *rb = &readbuf;
+	struct jmploc jmploc;
+	struct jmploc *volatile savehandler;
 
 	rflag = 0;
 	prompt = NULL;
@@ -122,16 +221,25 @@ readcmd(int argc, char **argv)
 
 	status = 0;
 	startword = 2;
+	readbuf_init(rb);
+	savehandler = handler;
+	if (setjmp(jmploc.loc)) {
+		/* setvar() failed (readonly variable) or we were interrupted */
+		handler = savehandler;
+		readbuf_done(rb);
+		longjmp(handler->loc, 1);
+	}
+	handler = &jmploc;
 	STARTSTACKSTR(p);
 	for (;;) {
-		if (read(0, &c, 1) != 1) {
+		if (!readbuf_getc(rb, &c)) {
 			status = 1;
 			break;
 		}
 		if (c == '\0')
 			continue;
 		if (c == '\\' && !rflag) {
-			if (read(0, &c, 1) != 1) {
+			if (!readbuf_getc(rb, &c)) {
 				status = 1;
 				break;
 			}
@@ -187,6 +295,8 @@ readcmd(int argc, char **argv)
 		ap++;
 		STARTSTACKSTR(p);
 	}
+	readbuf_done(rb);
+	handler = savehandler;
 	STACKSTRNUL(p);
 
 	/* Remove trailing IFS chars */
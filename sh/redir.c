@@ -43,6 +43,8 @@ __RCSID("$NetBSD: redir.c,v 1.29 2004/07/08 03:57:33 christos Exp $");
 
 #include <sys/types.h>
 #include <sys/param.h>	/* PIPE_BUF */
+#include <sys/syscall.h>
+#include <paths.h>
 #include <signal.h>
 #include <string.h>
 #include <fcntl.h>
@@ -64,6 +66,7 @@ __RCSID("$NetBSD: redir.c,v 1.29 2004/07/08 03:57:33 christos Exp $");
 #include "output.h"
 #include "memalloc.h"
 #include "error.h"
+#include "var.h"
 
 
 #define EMPTY -2		/* marks an unused slot in redirtab */
@@ -73,6 +76,25 @@ __RCSID("$NetBSD: redir.c,v 1.29 2004/07/08 03:57:33 christos Exp $");
 # define PIPESIZE PIPE_BUF
 #endif
 
+#ifndef _PATH_TMP
+# define _PATH_TMP "/tmp/"
+#endif
+
+/* Older kernel headers lack memfd_create(); the kernel may still have it */
+#ifndef __NR_memfd_create
+# if defined(__arm__)
+#  define __NR_memfd_create 385
+# elif defined(__aarch64__)
+#  define __NR_memfd_create 279
+# elif defined(__i386__)
+#  define __NR_memfd_create 356
+# elif defined(__x86_64__)
+#  define __NR_memfd_create 319
+# elif defined(__mips__) && _MIPS_SIM == _MIPS_SIM_ABI32
+#  define __NR_memfd_create 4354
+# endif
+#endif
+
 #define signal bsd_signal
 
 MKINIT
@@ -92,6 +114,8 @@ MKINIT struct redirtab *redirlist;
 int fd0_redirected = 0;
 
 STATIC void openredirect(union node *, char[10], int);
+STATIC int openheretmpin(const char *);
+STATIC int openheretmp(void);
 STATIC int openhere(union node *);
 
 
@@ -249,9 +273,72 @@ eopen:
 
 
 /*
- * Handle here documents.  Normally we fork off a process to write the
- * data to a pipe.  If the document is short, we can stuff the data in
- * the pipe without forking.
+ * Create an anonymous, seekable file to hold a here document: a memfd
+ * where the kernel has them, else an unlinked file in $TMPDIR or the first
+ * usable directory of heretmpdirs.  Android has no /tmp, and /dev is a
+ * tmpfs only root may write to.  What turns out not to be there at all is
+ * not tried again, so that a shell without any of them goes straight to
+ * the pipe without a failed system call for every here document.
+ * Like the pipe it replaces, the fd is not close-on-exec: it may already
+ * be the descriptor being redirected.  Returns -1 if neither can be had.
+ */
+
+STATIC const char *const heretmpdirs[] = {
+	_PATH_TMP, "/data/local/tmp/", "/dev/",
+};
+STATIC int heretmpdir;		/* first entry of heretmpdirs still worth trying */
+STATIC int nomemfd;		/* memfd_create() is not implemented */
+
+STATIC int
+openheretmpin(const char *dir)
+{
+	char path[MAXPATHLEN];
+	int fd;
+
+	fmtstr(path, sizeof(path), "%s/sh-hereXXXXXX", dir);
+	if ((fd = mkstemp(path)) < 0)
+		return -1;
+	unlink(path);
+	return fd;
+}
+
+STATIC int
+openheretmp(void)
+{
+	const char *tmpdir;
+	int fd;
+
+#ifdef __NR_memfd_create
+	if (!nomemfd) {
+		fd = syscall(__NR_memfd_create, "sh-here", 0);
+		if (fd >= 0)
+			return fd;
+		if (errno == ENOSYS)
+			nomemfd = 1;
+	}
+#endif
+	tmpdir = lookupvar("TMPDIR");
+	if (tmpdir != NULL && *tmpdir != '\0' &&
+	    (fd = openheretmpin(tmpdir)) >= 0)
+		return fd;
+	while (heretmpdir < (int)(sizeof(heretmpdirs) / sizeof(heretmpdirs[0]))) {
+		if ((fd = openheretmpin(heretmpdirs[heretmpdir])) >= 0)
+			return fd;
+		if (errno != ENOENT && errno != ENOTDIR && errno != EACCES &&
+		    errno != EPERM && errno != EROFS)
+			return -1;	/* may work next time */
+		heretmpdir++;
+	}
+	return -1;
+}
+
+
+/*
+ * Handle here documents.  Short literal documents are stuffed straight
+ * into a pipe.  Anything else is written, expanding it if necessary, to
+ * an anonymous file that is rewound and handed to the command, so that no
+ * process has to be forked to feed it.  Only if no such file can be
+ * created do we fork off a process to write the data to a pipe.
  */
 
 STATIC int
@@ -259,16 +346,41 @@ openhere(union node *redir)
 {
 	int pip[2];
 	int len = 0;
+	volatile int fd;
+	struct jmploc jmploc;
+	struct jmploc *volatile savehandler;
 
-	if (pipe(pip) < 0)
-		error("Pipe call failed");
 	if (redir->type == NHERE) {
 		len = strlen(redir->nhere.doc->narg.text);
 		if (len <= PIPESIZE) {
+			if (pipe(pip) < 0)
+				error("Pipe call failed");
 			xwrite(pip[1], redir->nhere.doc->narg.text, len);
 			goto out;
 		}
 	}
+
+	if ((fd = openheretmp()) >= 0) {
+		if (redir->type == NHERE) {
+			xwrite(fd, redir->nhere.doc->narg.text, len);
+		} else {
+			savehandler = handler;
+			if (setjmp(jmploc.loc)) {
+				herefd = -1;
+				close(fd);
+				handler = savehandler;
+				longjmp(handler->loc, 1);
+			}
+			handler = &jmploc;
+			expandhere(redir->nhere.doc, fd);
+			handler = savehandler;
+		}
+		lseek(fd, 0, SEEK_SET);
+		return fd;
+	}
+
+	if (pipe(pip) < 0)
+		error("Pipe call failed");
 	if (forkshell((struct job *)NULL, (union node *)NULL, FORK_NOJOB) == 0) {
 		close(pip[0]);
 		signal(SIGINT, SIG_IGN);
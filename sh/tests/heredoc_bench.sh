@@ -0,0 +1,24 @@
+#!/system/bin/sh
+#
+# Expands a large here document in a loop, to measure the cost of
+# setting up here documents.  Usage: heredoc_bench.sh [iterations [lines]]
+
+iterations=${1:-1000}
+lines=${2:-200}
+
+body=
+i=0
+while [ $i -lt $lines ]; do
+	body="$body line $i of the here document, long enough to fill pipes
+"
+	i=$((i + 1))
+done
+
+i=0
+while [ $i -lt $iterations ]; do
+	read first <<EOF
+$i: $body
+EOF
+	i=$((i + 1))
+done
+echo "$first"
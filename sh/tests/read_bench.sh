@@ -0,0 +1,51 @@
+#!/system/bin/sh
+#
+# Reads a file line by line with the read builtin, to measure the cost of
+# read's input handling.  Usage: read_bench.sh [lines [file|pipe]]
+# (lines is rounded up to a power of two)
+#
+# Redirected from a file, read can fill a buffer and seek back over what
+# it did not use; through a pipe it has to read a byte at a time.  Run it
+# under time for each mode to compare the two.
+
+lines=${1:-20000}
+mode=${2:-file}
+input=${TMPDIR:-/data/local/tmp}/read_bench.$$
+
+# Double the file until it is long enough, rather than loop in the shell
+# with test, which is not a builtin here.
+echo "field1 field2 line of the input, long enough to need a few reads" > $input
+n=1
+while [ $n -lt $lines ]; do
+	cat $input $input > $input.tmp
+	mv $input.tmp $input
+	n=$((n * 2))
+done
+
+n=0
+if [ "$mode" = pipe ]; then
+	cat $input | {
+		while read a b rest; do
+			n=$((n + 1))
+		done
+		echo "$n lines"
+	}
+else
+	while read a b rest; do
+		n=$((n + 1))
+	done < $input
+	echo "$n lines"
+fi
+
+# Whatever read leaves unread must still be there for the next reader,
+# including when it fails part way through a line.
+{
+	read first
+	(readonly a; read a b rest) 2>/dev/null
+	read third
+} < $input
+[ "$first" = "field1 field2 line of the input, long enough to need a few reads" ] &&
+[ "$third" = "field2 line of the input, long enough to need a few reads" ] ||
+	echo "read lost input: '$first' '$third'"
+
+rm -f $input
@@ -85,6 +85,7 @@ ALL_TOOLS += \
 
 LOCAL_SRC_FILES := \
 	dynarray.c \
+	dirwalk.c \
 	toolbox.c \
 	$(patsubst %,%.c,$(TOOLS)) \
 	cp/cp.c cp/utils.c \
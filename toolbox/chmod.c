@@ -2,47 +2,40 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
-#include <dirent.h>
 #include <errno.h>
-#include <sys/limits.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <sys/stat.h>
 
 #include <unistd.h>
 #include <time.h>
 
-void recurse_chmod(char* path, int mode)
-{
-    struct dirent *dp;
-    DIR *dir = opendir(path);
-    if (dir == NULL) {
-        // not a directory, carry on
-        return;
-    }
-    char *subpath = malloc(sizeof(char)*PATH_MAX);
-    int pathlen = strlen(path);
-
-    while ((dp = readdir(dir)) != NULL) {
-        if (strcmp(dp->d_name, ".") == 0 ||
-            strcmp(dp->d_name, "..") == 0) continue;
-
-        if (strlen(dp->d_name) + pathlen + 2/*NUL and slash*/ > PATH_MAX) {
-            fprintf(stderr, "Invalid path specified: too long\n");
-            exit(1);
-        }
+#include "dirwalk.h"
 
-        strcpy(subpath, path);
-        strcat(subpath, "/");
-        strcat(subpath, dp->d_name);
-
-        if (chmod(subpath, mode) < 0) {
-            fprintf(stderr, "Unable to chmod %s: %s\n", subpath, strerror(errno));
-            exit(1);
-        }
+static int chmod_entry(int dirfd, const char *name, int type, void *cookie)
+{
+    /* chmod() would change whatever the link points to */
+    if (type == DT_LNK)
+        return 0;
+    return fchmodat(dirfd, name, *(mode_t *)cookie, 0);
+}
 
-        recurse_chmod(subpath, mode);
+/* changes everything below path, relative to the directory file
+ * descriptors; files and directories that cannot be read are skipped */
+static int recurse_chmod(const char* path, mode_t mode)
+{
+    char errpath[PATH_MAX];
+    dirwalk_t walk;
+
+    walk.pre = chmod_entry;
+    walk.post = NULL;
+    walk.cookie = &mode;
+    walk.flags = DIRWALK_SKIP_UNREADABLE;
+    if (dirwalk(path, &walk, errpath, sizeof(errpath)) < 0) {
+        fprintf(stderr, "Unable to chmod %s: %s\n", errpath, strerror(errno));
+        return -1;
     }
-    free(subpath);
-    closedir(dir);
+    return 0;
 }
 
 static int usage()
@@ -57,23 +50,22 @@ static int usage()
 int chmod_main(int argc, char **argv)
 {
     int i;
+    int recursive = 0;
 
-    if (argc < 3 || strcmp(argv[1], "--help") == 0) {
-        return usage();
+    while (argc > 1 && argv[1][0] == '-') {
+        if (strcmp(argv[1], "-R") == 0 || strcmp(argv[1], "--recursive") == 0) {
+            recursive = 1;
+        } else {
+            return usage();
+        }
+        argc--;
+        argv++;
     }
 
-    int recursive = (strcmp(argv[1], "-R") == 0 ||
-                     strcmp(argv[1], "--recursive") == 0) ? 1 : 0;
-
-    if (recursive && argc < 4) {
+    if (argc < 3) {
         return usage();
     }
 
-    if (recursive) {
-        argc--;
-        argv++;
-    }
-
     int mode = 0;
     const char* s = argv[1];
     while (*s) {
@@ -92,8 +84,8 @@ int chmod_main(int argc, char **argv)
             fprintf(stderr, "Unable to chmod %s: %s\n", argv[i], strerror(errno));
             return 10;
         }
-        if (recursive) {
-            recurse_chmod(argv[i], mode);
+        if (recursive && recurse_chmod(argv[i], mode) < 0) {
+            return 1;
         }
     }
     return 0;
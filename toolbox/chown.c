@@ -2,20 +2,67 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
-#include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <pwd.h>
 #include <grp.h>
 
 #include <unistd.h>
 #include <time.h>
 
+#include "dirwalk.h"
+
+struct owner {
+    uid_t uid;
+    gid_t gid;
+};
+
+static int chown_entry(int dirfd, const char *name, int type, void *cookie)
+{
+    struct owner *owner = cookie;
+
+    return fchownat(dirfd, name, owner->uid, owner->gid, AT_SYMLINK_NOFOLLOW);
+}
+
+/* changes everything below path, relative to the directory file
+ * descriptors; files and directories that cannot be read are skipped */
+static int recurse_chown(const char *path, uid_t uid, gid_t gid)
+{
+    char errpath[PATH_MAX];
+    struct owner owner;
+    dirwalk_t walk;
+
+    owner.uid = uid;
+    owner.gid = gid;
+    walk.pre = chown_entry;
+    walk.post = NULL;
+    walk.cookie = &owner;
+    walk.flags = DIRWALK_SKIP_UNREADABLE;
+    if (dirwalk(path, &walk, errpath, sizeof(errpath)) < 0) {
+        fprintf(stderr, "Unable to chown %s: %s\n", errpath, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
 int chown_main(int argc, char **argv)
 {
     int i;
+    int recursive = 0;
+
+    while (argc > 1 && argv[1][0] == '-') {
+        if (strcmp(argv[1], "-R") == 0) {
+            recursive = 1;
+        } else {
+            break;
+        }
+        argc--;
+        argv++;
+    }
 
     if (argc < 3) {
-        fprintf(stderr, "Usage: chown <USER>[:GROUP] <FILE1> [FILE2] ...\n");
+        fprintf(stderr, "Usage: chown [-R] <USER>[:GROUP] <FILE1> [FILE2] ...\n");
         return 10;
     }
 
@@ -67,6 +114,9 @@ int chown_main(int argc, char **argv)
             fprintf(stderr, "Unable to chown %s: %s\n", argv[i], strerror(errno));
             return 10;
         }
+        if (recursive && recurse_chown(argv[i], uid, gid) < 0) {
+            return 1;
+        }
     }
 
     return 0;
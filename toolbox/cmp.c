@@ -7,11 +7,56 @@
 #include <sys/ioctl.h>
 #include <errno.h>
 
+#define CMP_BUFSIZE (256 * 1024)
+
+/* Fill buf as far as possible so that both streams stay aligned even when
+ * one of them returns short reads. */
+static int read_full(int fd, unsigned char *buf, int len)
+{
+    int total = 0;
+    int res;
+
+    while (total < len) {
+        res = read(fd, buf + total, len - total);
+        if (res < 0) {
+            if (errno == EINTR)
+                continue;
+            return total ? total : -1;
+        }
+        if (res == 0)
+            break;
+        total += res;
+    }
+    return total;
+}
+
+/* Returns the offset of the first differing byte at or after start, or len.
+ * Equal stretches are skipped a machine word at a time. */
+static int find_mismatch(const unsigned char *a, const unsigned char *b,
+                         int start, int len)
+{
+    int i = start;
+
+    while (i < len && ((uintptr_t)(a + i) & (sizeof(unsigned long) - 1))) {
+        if (a[i] != b[i])
+            return i;
+        i++;
+    }
+    if (((uintptr_t)(b + i) & (sizeof(unsigned long) - 1)) == 0) {
+        while (i + (int)sizeof(unsigned long) <= len &&
+               *(const unsigned long *)(a + i) == *(const unsigned long *)(b + i))
+            i += sizeof(unsigned long);
+    }
+    while (i < len && a[i] == b[i])
+        i++;
+    return i;
+}
+
 int cmp_main(int argc, char *argv[])
 {
     int c;
     int fd1, fd2;
-	char buf1[4096], buf2[4096];
+	unsigned char *buf1, *buf2;
     int res, res1, res2;
 	int rv = 0;
 	int i;
@@ -58,16 +103,27 @@ int cmp_main(int argc, char *argv[])
         fprintf(stderr, "could not open %s, %s\n", argv[optind+1], strerror(errno));
         return 1;
     }
-    
+
+    buf1 = malloc(CMP_BUFSIZE);
+    buf2 = malloc(CMP_BUFSIZE);
+    if(buf1 == NULL || buf2 == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
     while(1) {
-        res1 = read(fd1, &buf1, sizeof(buf1));
-        res2 = read(fd2, &buf2, sizeof(buf2));
+        int read_len = CMP_BUFSIZE;
+        if(limit && limit < read_len)
+            read_len = limit;
+        res1 = read_full(fd1, buf1, read_len);
+        res2 = read_full(fd2, buf2, read_len);
 		res = res1 < res2 ? res1 : res2;
 		if(res1 == 0 && res2 == 0) {
 			return rv;
 		}
-		for(i = 0; i < res; i++) {
-			if(buf1[i] != buf2[i]) {
+		if(res > 0 && memcmp(buf1, buf2, res) != 0) {
+			for(i = find_mismatch(buf1, buf2, 0, res); i < res;
+			        i = find_mismatch(buf1, buf2, i + 1, res)) {
 				printf("%s %s differ byte %d", argv[optind], argv[optind+1], filepos + i);
 				if(show_byte)
 					printf(" 0x%02x 0x%02x", buf1[i], buf2[i]);
@@ -76,11 +132,11 @@ int cmp_main(int argc, char *argv[])
 					return 1;
 				rv = 1;
 			}
-			if(limit) {
-				limit--;
-				if(limit == 0)
-					return rv;
-			}
+		}
+		if(limit) {
+			limit -= res > 0 ? res : 0;
+			if(limit == 0)
+				return rv;
 		}
 		if(res1 != res2 || res < 0) {
 			printf("%s on %s\n", res < 0 ? "Read error" : "EOF", res1 < res2 ? argv[optind] : argv[optind+1]);
@@ -0,0 +1,174 @@
+#include "dirwalk.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* A directory that is being walked.  It stays open until everything
+ * below it is done, since its children are removed through it.
+ */
+struct dir_node {
+    struct dir_node *parent;
+    DIR *dir;
+    char name[];
+};
+
+struct walker {
+    const dirwalk_t *walk;
+    int error;              /* first errno, or 0 */
+    char *errpath;
+    size_t errpath_len;
+};
+
+static size_t node_path(const struct dir_node *node, char *buf, size_t len)
+{
+    size_t n = 0;
+
+    if (node->parent) {
+        n = node_path(node->parent, buf, len);
+        if (n + 1 < len)
+            buf[n++] = '/';
+    }
+    n += strlcpy(buf + n, node->name, len - n);
+    return n < len ? n : len - 1;
+}
+
+/* records the first error, which stops the walk */
+static void fail(struct walker *w, const struct dir_node *node, const char *name)
+{
+    size_t n;
+
+    if (w->error)
+        return;
+    w->error = errno;
+    if (w->errpath && w->errpath_len) {
+        n = node_path(node, w->errpath, w->errpath_len);
+        if (name && n + 1 < w->errpath_len) {
+            w->errpath[n++] = '/';
+            strlcpy(w->errpath + n, name, w->errpath_len - n);
+        }
+    }
+}
+
+static struct dir_node *open_node(struct dir_node *parent, const char *name)
+{
+    struct dir_node *node;
+    int fd;
+
+    /* only the top directory may be reached through a symbolic link */
+    fd = openat(parent ? dirfd(parent->dir) : AT_FDCWD, name,
+                O_RDONLY | O_DIRECTORY | (parent ? O_NOFOLLOW : 0));
+    if (fd < 0)
+        return NULL;
+
+    node = malloc(sizeof(*node) + strlen(name) + 1);
+    if (node == NULL) {
+        close(fd);
+        errno = ENOMEM;
+        return NULL;
+    }
+    node->dir = fdopendir(fd);
+    if (node->dir == NULL) {
+        int save = errno;
+        close(fd);
+        free(node);
+        errno = save;
+        return NULL;
+    }
+    node->parent = parent;
+    strcpy(node->name, name);
+    return node;
+}
+
+/* visits everything below node, then closes and frees it */
+static void walk_dir(struct walker *w, struct dir_node *node)
+{
+    const dirwalk_t *walk = w->walk;
+    struct dir_node *parent = node->parent;
+    int fd = dirfd(node->dir);
+    struct dirent *de;
+    struct dir_node *child;
+    struct stat st;
+    int type;
+
+    for (;;) {
+        errno = 0;
+        de = readdir(node->dir);
+        if (de == NULL) {
+            if (errno)
+                fail(w, node, NULL);
+            break;
+        }
+        if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, ".."))
+            continue;
+
+        if (de->d_type != DT_UNKNOWN) {
+            type = de->d_type;
+        } else if (fstatat(fd, de->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0) {
+            type = IFTODT(st.st_mode);
+        } else {
+            fail(w, node, de->d_name);
+            break;
+        }
+
+        if (walk->pre && walk->pre(fd, de->d_name, type, walk->cookie) < 0) {
+            fail(w, node, de->d_name);
+            break;
+        }
+        if (type != DT_DIR)
+            continue;
+
+        child = open_node(node, de->d_name);
+        if (child == NULL) {
+            if (walk->flags & DIRWALK_SKIP_UNREADABLE)
+                continue;
+            fail(w, node, de->d_name);
+            break;
+        }
+        walk_dir(w, child);
+        if (w->error)
+            break;
+    }
+
+    closedir(node->dir);
+    if (walk->post && !w->error &&
+            walk->post(parent ? dirfd(parent->dir) : AT_FDCWD,
+                       node->name, walk->cookie) < 0) {
+        if (parent)
+            fail(w, parent, node->name);
+        else
+            fail(w, node, NULL);
+    }
+    free(node);
+}
+
+int dirwalk(const char *path, const dirwalk_t *walk, char *errpath, size_t errpath_len)
+{
+    struct walker w;
+    struct dir_node *top;
+
+    top = open_node(NULL, path);
+    if (top == NULL) {
+        if (walk->flags & DIRWALK_SKIP_UNREADABLE)
+            return 0;
+        if (errpath && errpath_len)
+            strlcpy(errpath, path, errpath_len);
+        return -1;
+    }
+
+    memset(&w, 0, sizeof(w));
+    w.walk = walk;
+    w.errpath = errpath;
+    w.errpath_len = errpath_len;
+    walk_dir(&w, top);
+
+    if (w.error) {
+        errno = w.error;
+        return -1;
+    }
+    return 0;
+}
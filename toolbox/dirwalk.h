@@ -0,0 +1,41 @@
+#ifndef DIRWALK_H
+#define DIRWALK_H
+
+#include <dirent.h>
+#include <stddef.h>
+
+/* Walks a directory tree with *at() system calls relative to the file
+ * descriptor of each directory, so that the kernel never has to resolve
+ * a full path.
+ */
+
+/* Called for every entry below the top directory as it is found, before
+ * descending into it.  type is one of the DT_* values from <dirent.h>,
+ * and never DT_UNKNOWN.  Returns 0 to carry on, or -1 with errno set.
+ */
+typedef int (*dirwalk_pre_fn)(int dirfd, const char *name, int type, void *cookie);
+
+/* Called for every directory, including the top one, once everything
+ * below it has been visited.  For the top directory, dirfd is AT_FDCWD
+ * and name is the path that was walked.
+ */
+typedef int (*dirwalk_post_fn)(int dirfd, const char *name, void *cookie);
+
+/* skip directories that cannot be opened instead of failing, including
+ * a top one that is not a directory at all */
+#define DIRWALK_SKIP_UNREADABLE  1
+
+typedef struct {
+    dirwalk_pre_fn pre;    /* may be NULL */
+    dirwalk_post_fn post;  /* may be NULL */
+    void *cookie;
+    int flags;
+} dirwalk_t;
+
+/* Returns 0, or -1 with errno set to the first error.  The path of the
+ * entry that failed is then copied into errpath, if it is not NULL.
+ * Symbolic links below the top directory are never followed.
+ */
+int dirwalk(const char *path, const dirwalk_t *walk, char *errpath, size_t errpath_len);
+
+#endif /* DIRWALK_H */
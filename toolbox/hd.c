@@ -7,18 +7,83 @@
 #include <sys/ioctl.h>
 #include <errno.h>
 
+#define HD_BUFSIZE  (64 * 1024)
+#define HD_OUTSIZE  (64 * 1024)
+
+static const char hex_digits[] = "0123456789abcdef";
+
+static char hd_out[HD_OUTSIZE];
+static int hd_out_len;
+
+static void hd_flush(void)
+{
+	fwrite(hd_out, 1, hd_out_len, stdout);
+	hd_out_len = 0;
+}
+
+/* Appends value in hex, padded with zeros to at least width digits */
+static char *put_hex(char *p, unsigned int value, int width)
+{
+	char tmp[8];
+	int n = 0;
+
+	do {
+		tmp[n++] = hex_digits[value & 15];
+		value >>= 4;
+	} while(value);
+	while(n < width)
+		tmp[n++] = '0';
+	while(n > 0)
+		*p++ = tmp[--n];
+	return p;
+}
+
+/* Formats len bytes at filepos as hd lines into the output buffer, ending a
+ * line every 16 bytes and after the last byte. Returns the sum of the bytes. */
+static int hd_format(const unsigned char *buf, int len, int filepos)
+{
+	/* one line is at most 8 + 2 + 16 * 3 + 2 + 8 + 1 bytes */
+	char *p;
+	int sum = 0;
+	int lsum;
+	int i, j, n;
+
+	for(i = 0; i < len; i += 16) {
+		if(hd_out_len > HD_OUTSIZE - 128)
+			hd_flush();
+		p = hd_out + hd_out_len;
+		p = put_hex(p, filepos + i, 8);
+		*p++ = ':';
+		*p++ = ' ';
+		n = len - i < 16 ? len - i : 16;
+		lsum = 0;
+		for(j = 0; j < n; j++) {
+			unsigned char b = buf[i + j];
+			lsum += b;
+			*p++ = hex_digits[b >> 4];
+			*p++ = hex_digits[b & 15];
+			*p++ = ' ';
+		}
+		*p++ = 's';
+		*p++ = ' ';
+		p = put_hex(p, lsum, 1);
+		*p++ = '\n';
+		hd_out_len = p - hd_out;
+		sum += lsum;
+	}
+	return sum;
+}
+
 int hd_main(int argc, char *argv[])
 {
     int c;
     int fd;
-	unsigned char buf[4096];
+	unsigned char *buf;
     int res;
 	int read_len;
 	int rv = 0;
-	int i;
 	int filepos = 0;
 	int sum;
-	int lsum;
 
 	int base = -1;
 	int count = 0;
@@ -56,33 +121,29 @@ int hd_main(int argc, char *argv[])
         return 1;
     }
 
+	buf = malloc(HD_BUFSIZE);
+	if(buf == NULL) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+
 	do {
 		if(base >= 0) {
 			lseek(fd, base, SEEK_SET);
 			filepos = base;
 		}
 		sum = 0;
-		lsum = 0;
 	    while(1) {
-			read_len = sizeof(buf);
+			read_len = HD_BUFSIZE;
 			if(count > 0 && base + count - filepos < read_len)
 				read_len = base + count - filepos;
-	        res = read(fd, &buf, read_len);
+	        res = read(fd, buf, read_len);
 			if(res == 0)
 				break;
-			for(i = 0; i < res; i++) {
-				if((i & 15) == 0) {
-					printf("%08x: ", filepos + i);
-				}
-				lsum += buf[i];
-				sum += buf[i];
-				printf("%02x ", buf[i]);
-				if(((i & 15) == 15) || (i == res - 1)) {
-					printf("s %x\n", lsum);
-					lsum = 0;
-				}
-			}
+			if(res > 0)
+				sum += hd_format(buf, res, filepos);
 			if(res < 0) {
+				hd_flush();
 				printf("Read error on %s, offset %d len %d, %s\n", argv[optind], filepos, read_len, strerror(errno));
 				return 1;
 			}
@@ -90,7 +151,9 @@ int hd_main(int argc, char *argv[])
 			if(filepos == base + count)
 				break;
 	    }
+		hd_flush();
 		printf("sum %x\n", sum);
+		fflush(stdout);
 		if(repeat)
 			sleep(repeat);
 	} while(repeat);
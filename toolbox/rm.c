@@ -1,12 +1,15 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
-#include <dirent.h>
+#include <fcntl.h>
 #include <limits.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#include "dirwalk.h"
+
 #define OPT_RECURSIVE 1
 #define OPT_FORCE     2
 
@@ -16,13 +19,32 @@ static int usage()
     return -1;
 }
 
+static int unlink_entry(int dirfd, const char *name, int type, void *cookie)
+{
+    int flags = *(int *)cookie;
+
+    /* directories are removed once they are empty */
+    if (type == DT_DIR)
+        return 0;
+    if (unlinkat(dirfd, name, 0) < 0)
+        return ((flags & OPT_FORCE) && errno == ENOENT) ? 0 : -1;
+    return 0;
+}
+
+static int remove_dir(int dirfd, const char *name, void *cookie)
+{
+    int flags = *(int *)cookie;
+
+    if (unlinkat(dirfd, name, AT_REMOVEDIR) < 0)
+        return ((flags & OPT_FORCE) && errno == ENOENT) ? 0 : -1;
+    return 0;
+}
+
 /* return -1 on failure, with errno set to the first error */
 static int unlink_recursive(const char* name, int flags)
 {
     struct stat st;
-    DIR *dir;
-    struct dirent *de;
-    int fail = 0;
+    dirwalk_t walk;
 
     /* is it a file or directory? */
     if (lstat(name, &st) < 0)
@@ -32,38 +54,13 @@ static int unlink_recursive(const char* name, int flags)
     if (!S_ISDIR(st.st_mode))
         return unlink(name);
 
-    /* a directory, so open handle */
-    dir = opendir(name);
-    if (dir == NULL)
-        return -1;
-
-    /* recurse over components */
-    errno = 0;
-    while ((de = readdir(dir)) != NULL) {
-        char dn[PATH_MAX];
-        if (!strcmp(de->d_name, "..") || !strcmp(de->d_name, "."))
-            continue;
-        sprintf(dn, "%s/%s", name, de->d_name);
-        if (unlink_recursive(dn, flags) < 0) {
-            fail = 1;
-            break;
-        }
-        errno = 0;
-    }
-    /* in case readdir or unlink_recursive failed */
-    if (fail || errno < 0) {
-        int save = errno;
-        closedir(dir);
-        errno = save;
-        return -1;
-    }
-
-    /* close directory handle */
-    if (closedir(dir) < 0)
-        return -1;
-
-    /* delete target directory */
-    return rmdir(name);
+    /* a directory, so remove everything below it and then itself,
+     * relative to the directory file descriptors */
+    walk.pre = unlink_entry;
+    walk.post = remove_dir;
+    walk.cookie = &flags;
+    walk.flags = 0;
+    return dirwalk(name, &walk, NULL, 0);
 }
 
 int rm_main(int argc, char *argv[])
@@ -3,7 +3,10 @@
 #include <string.h>
 #include <stdint.h>
 #include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
 #include <sys/ioctl.h>
+#include <sys/stat.h>
 //#include <linux/input.h> // this does not compile
 #include <errno.h>
 
@@ -45,32 +48,323 @@ struct input_event {
 
 
 
-int sendevent_main(int argc, char *argv[])
+#define EV_SYN          0x00
+#define SYN_REPORT      0
+
+/* a frame grows as needed; one this long means the recording lost its
+ * SYN_REPORTs, and splitting it would not be a faithful replay */
+#define MIN_FRAME       64
+#define MAX_FRAME       65536
+
+struct replay {
+    FILE *in;
+    int binary;
+    int timed;                  /* the recording has time stamps */
+    int line;
+};
+
+struct pacing {
+    struct timespec start;      /* when the first frame was written */
+    int64_t first_ns;           /* recorded time of the first frame */
+    int frames;
+    int events;
+    int64_t late_ns;            /* sums of how late frames were written */
+    double late_sq;
+    int64_t late_max_ns;
+};
+
+static int64_t timespec_ns(const struct timespec *ts)
+{
+    return ts->tv_sec * 1000000000LL + ts->tv_nsec;
+}
+
+static int64_t event_ns(const struct input_event *event)
 {
+    return event->time.tv_sec * 1000000000LL + event->time.tv_usec * 1000LL;
+}
+
+/* parses a line printed by getevent, with or without -t:
+ *   [   1234.567890] /dev/input/event2: 0003 0035 000001a2
+ * lines that are not events, such as the device list, are skipped */
+static int parse_line(struct replay *r, char *line, struct input_event *event)
+{
+    char *p = line;
+    char *end;
+    unsigned long field[3];
     int i;
+
+    memset(event, 0, sizeof(*event));
+    while (*p == ' ' || *p == '\t')
+        p++;
+    if (*p == '[') {
+        event->time.tv_sec = strtoul(p + 1, &end, 10);
+        if (*end != '.')
+            return 0;
+        event->time.tv_usec = strtoul(end + 1, &end, 10);
+        if (*end != ']')
+            return 0;
+        p = end + 1;
+        r->timed = 1;
+    }
+
+    /* the device name, printed when more than one device was recorded */
+    end = strchr(p, ':');
+    if (end && end[1] == ' ')
+        p = end + 1;
+
+    for (i = 0; i < 3; i++) {
+        field[i] = strtoul(p, &end, 16);
+        if (end == p)
+            return 0;
+        p = end;
+    }
+    while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+        p++;
+    if (*p)
+        return 0;
+
+    event->type = field[0];
+    event->code = field[1];
+    event->value = field[2];
+    return 1;
+}
+
+/* returns 1 with the next event, 0 at the end of the recording, -1 on error */
+static int next_event(struct replay *r, struct input_event *event)
+{
+    char line[256];
+
+    if (r->binary) {
+        if (fread(event, sizeof(*event), 1, r->in) == 1)
+            return 1;
+        return ferror(r->in) ? -1 : 0;
+    }
+
+    while (fgets(line, sizeof(line), r->in)) {
+        r->line++;
+        if (parse_line(r, line, event))
+            return 1;
+    }
+    return ferror(r->in) ? -1 : 0;
+}
+
+/* waits for the time the frame was recorded at, relative to the first
+ * frame; absolute deadlines keep late wakeups from adding up */
+static void pace_frame(struct replay *r, struct pacing *pace,
+                       const struct input_event *first, struct timespec *deadline)
+{
+    int64_t ns;
+
+    if (pace->frames == 0) {
+        clock_gettime(CLOCK_MONOTONIC, &pace->start);
+        pace->first_ns = event_ns(first);
+    }
+    if (!r->timed) {
+        clock_gettime(CLOCK_MONOTONIC, deadline);
+        return;
+    }
+
+    ns = timespec_ns(&pace->start) + event_ns(first) - pace->first_ns;
+    deadline->tv_sec = ns / 1000000000LL;
+    deadline->tv_nsec = ns % 1000000000LL;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, deadline, NULL) == EINTR)
+        ;
+}
+
+/* toolbox is not linked against libm */
+static double root(double x)
+{
+    double r = x;
+
+    if (x <= 0)
+        return 0;
+    while (r * r - x > x / 1e6)
+        r = (r + x / r) / 2;
+    return r;
+}
+
+static int write_frame(int fd, const struct input_event *frame, int count)
+{
+    int size = count * sizeof(*frame);
+    int ret;
+
+    ret = write(fd, frame, size);
+    if (ret < size) {
+        fprintf(stderr, "write event failed, %s\n", ret < 0 ? strerror(errno) : "short write");
+        return -1;
+    }
+    return 0;
+}
+
+static int replay(int fd, struct replay *r, int print_rate)
+{
+    struct input_event *frame, *bigger;
+    struct pacing pace;
+    struct timespec deadline, now;
+    int64_t late, elapsed;
+    int size = MIN_FRAME;
+    int count = 0;
+    int ret;
+
+    frame = malloc(size * sizeof(*frame));
+    if (frame == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    memset(&pace, 0, sizeof(pace));
+    for (;;) {
+        if (count == size) {
+            if (size == MAX_FRAME) {
+                if (r->binary)
+                    fprintf(stderr, "more than %d events without a SYN_REPORT\n",
+                            MAX_FRAME);
+                else
+                    fprintf(stderr, "more than %d events without a SYN_REPORT "
+                            "at line %d\n", MAX_FRAME, r->line);
+                goto fail;
+            }
+            size *= 2;
+            bigger = realloc(frame, size * sizeof(*frame));
+            if (bigger == NULL) {
+                fprintf(stderr, "out of memory\n");
+                goto fail;
+            }
+            frame = bigger;
+        }
+        ret = next_event(r, &frame[count]);
+        if (ret < 0) {
+            fprintf(stderr, "could not read events, %s\n", strerror(errno));
+            goto fail;
+        }
+        if (ret > 0)
+            count++;
+
+        /* a frame ends at SYN_REPORT and is written whole; what is left
+         * at the end of the recording is written as it is */
+        if (count == 0)
+            break;
+        if (ret > 0 &&
+                !(frame[count - 1].type == EV_SYN && frame[count - 1].code == SYN_REPORT))
+            continue;
+
+        pace_frame(r, &pace, &frame[0], &deadline);
+        if (write_frame(fd, frame, count))
+            goto fail;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+
+        late = timespec_ns(&now) - timespec_ns(&deadline);
+        pace.late_ns += late;
+        pace.late_sq += (double)late * late;
+        if (late > pace.late_max_ns)
+            pace.late_max_ns = late;
+        pace.frames++;
+        pace.events += count;
+        count = 0;
+        if (ret == 0)
+            break;
+    }
+    free(frame);
+
+    if (print_rate && pace.frames) {
+        double mean = (double)pace.late_ns / pace.frames;
+        double sq = pace.late_sq / pace.frames - mean * mean;
+        double stddev = root(sq);
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        elapsed = timespec_ns(&now) - timespec_ns(&pace.start);
+        printf("%d frames, %d events in %lld ms: %.1f frames/s, %.1f events/s\n",
+               pace.frames, pace.events, (long long)(elapsed / 1000000),
+               elapsed ? pace.frames * 1e9 / elapsed : 0.0,
+               elapsed ? pace.events * 1e9 / elapsed : 0.0);
+        if (r->timed)
+            printf("lateness: mean %.0f us, stddev %.0f us, max %lld us\n",
+                   mean / 1000, stddev / 1000, (long long)(pace.late_max_ns / 1000));
+    }
+    return 0;
+
+fail:
+    free(frame);
+    return 1;
+}
+
+static int usage(const char *name)
+{
+    fprintf(stderr, "use: %s device type code value\n", name);
+    fprintf(stderr, "     %s [-b] [-r] -f file device\n", name);
+    fprintf(stderr, "    -f: replay events recorded by getevent [-t], or - for stdin\n");
+    fprintf(stderr, "    -b: the recording holds struct input_event records\n");
+    fprintf(stderr, "    -r: print the rate events were written at and how late they were\n");
+    return 1;
+}
+
+int sendevent_main(int argc, char *argv[])
+{
     int fd;
     int ret;
     int version;
+    int c;
+    int print_rate = 0;
+    const char *file = NULL;
     struct input_event event;
+    struct replay r;
+    struct stat st;
 
-    if(argc != 5) {
-        fprintf(stderr, "use: %s device type code value\n", argv[0]);
-        return 1;
+    memset(&r, 0, sizeof(r));
+    /* the value in the single event form may be negative, so only look
+     * for options when the device is not the first argument */
+    opterr = 0;
+    if (argc > 1 && argv[1][0] == '-') {
+        while ((c = getopt(argc, argv, "bf:r")) != EOF) {
+            switch (c) {
+            case 'b':
+                r.binary = 1;
+                r.timed = 1;
+                break;
+            case 'f':
+                file = optarg;
+                break;
+            case 'r':
+                print_rate = 1;
+                break;
+            default:
+                return usage(argv[0]);
+            }
+        }
     }
 
-    fd = open(argv[1], O_RDWR);
+    if (file ? optind + 1 != argc : optind + 4 != argc)
+        return usage(argv[0]);
+
+    fd = open(argv[optind], O_RDWR);
     if(fd < 0) {
         fprintf(stderr, "could not open %s, %s\n", argv[optind], strerror(errno));
         return 1;
     }
-    if (ioctl(fd, EVIOCGVERSION, &version)) {
+    /* a recording may also be replayed into a pipe, or into an existing
+     * file to turn a text recording into a binary one */
+    if ((!file || (fstat(fd, &st) == 0 && S_ISCHR(st.st_mode))) &&
+            ioctl(fd, EVIOCGVERSION, &version)) {
         fprintf(stderr, "could not get driver version for %s, %s\n", argv[optind], strerror(errno));
         return 1;
     }
+
+    if (file) {
+        r.in = strcmp(file, "-") ? fopen(file, "r") : stdin;
+        if (r.in == NULL) {
+            fprintf(stderr, "could not open %s, %s\n", file, strerror(errno));
+            return 1;
+        }
+        ret = replay(fd, &r, print_rate);
+        if (r.in != stdin)
+            fclose(r.in);
+        close(fd);
+        return ret;
+    }
+
     memset(&event, 0, sizeof(event));
-    event.type = atoi(argv[2]);
-    event.code = atoi(argv[3]);
-    event.value = atoi(argv[4]);
+    event.type = atoi(argv[optind + 1]);
+    event.code = atoi(argv[optind + 2]);
+    event.value = atoi(argv[optind + 3]);
     ret = write(fd, &event, sizeof(event));
     if(ret < sizeof(event)) {
         fprintf(stderr, "write event failed, %s\n", strerror(errno));